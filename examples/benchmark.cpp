@@ -0,0 +1,385 @@
+/**
+ * On-device micro-benchmark for HumanESPHTTP (ESP-IDF, no network required)
+ *
+ * Measures query parsing at varying parameter counts and value lengths,
+ * typed conversions (against strtol() & co.), URL decoding, JSON and text response generation,
+ * routing and gzip compression, and prints ns/op plus heap allocations/op for each case.
+ *
+ * Allocation counting requires CONFIG_HEAP_USE_HOOKS=y (ESP-IDF >= 5.1),
+ * otherwise "n/a" is printed instead.
+ * The host build (see host/) runs it as the benchmark target, with allocation counting.
+ *
+ * This example is released under CC0 1.0 Universal
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <sdkconfig.h>
+
+#include <QueryURLParser.hpp>
+#include <URLDecode.hpp>
+#include <JSONWriter.hpp>
+#include <Router.hpp>
+#include <CompressedResponse.hpp>
+#include <ResponseWriter.hpp>
+
+extern "C" {
+    void app_main(void);
+}
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+static volatile uint32_t numAllocations = 0;
+
+// Called by ESP-IDF for every successful heap allocation
+extern "C" void esp_heap_trace_alloc_hook(void* /*ptr*/, size_t /*size*/, uint32_t /*caps*/) {
+    numAllocations++;
+}
+#endif
+
+// Prevents the compiler from optimizing away benchmarked results
+static volatile size_t sink = 0;
+
+/**
+ * Run the given function iterations times and print ns/op and allocations/op
+ */
+template<typename Function>
+static void Benchmark(const char* name, uint32_t iterations, Function&& function) {
+    function(); // Warm up caches
+#ifdef CONFIG_HEAP_USE_HOOKS
+    uint32_t allocationsBefore = numAllocations;
+#endif
+    int64_t start = esp_timer_get_time();
+    for(uint32_t i = 0; i < iterations; i++) {
+        function();
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    double nsPerOp = (double)elapsed * 1000.0 / iterations;
+#ifdef CONFIG_HEAP_USE_HOOKS
+    double allocationsPerOp = (double)(numAllocations - allocationsBefore) / iterations;
+    printf("%-48s %10.0f ns/op %8.2f allocs/op\n", name, nsPerOp, allocationsPerOp);
+#else
+    printf("%-48s %10.0f ns/op      n/a allocs/op\n", name, nsPerOp);
+#endif
+    // Keep the watchdog happy between benchmarks
+    vTaskDelay(1);
+}
+
+/**
+ * Build a query like "param0=value&param1=value&..."
+ */
+static std::string BuildQuery(size_t numParameters, size_t valueLength) {
+    std::string query;
+    for(size_t i = 0; i < numParameters; i++) {
+        if(i != 0) {
+            query += '&';
+        }
+        query += "param" + std::to_string(i) + "=" + std::string(valueLength, 'x');
+    }
+    return query;
+}
+
+static void BenchmarkQueryParsing() {
+    static const size_t parameterCounts[] = {1, 4, 16, 32, 64};
+    char name[64];
+    for(size_t numParameters : parameterCounts) {
+        std::string query = BuildQuery(numParameters, 8);
+        snprintf(name, sizeof(name), "parse %u params (%u bytes)", (unsigned)numParameters, (unsigned)query.size());
+        Benchmark(name, 2000, [&]() {
+            QueryURLParser parser(query.c_str(), query.size());
+            sink += parser.ParameterCount();
+        });
+
+        // Lookup of the last parameter, which used to be the worst case
+        QueryURLParser parser(query.c_str(), query.size());
+        std::string lastKey = "param" + std::to_string(numParameters - 1);
+        snprintf(name, sizeof(name), "HasParameter (last of %u)", (unsigned)numParameters);
+        Benchmark(name, 20000, [&]() {
+            sink += parser.HasParameter(lastKey.c_str());
+        });
+        snprintf(name, sizeof(name), "GetParameter (last of %u)", (unsigned)numParameters);
+        Benchmark(name, 20000, [&]() {
+            sink += parser.GetParameter(lastKey.c_str()).size();
+        });
+#if _CPP17_AVAILABLE
+        snprintf(name, sizeof(name), "GetParameterView (last of %u)", (unsigned)numParameters);
+        Benchmark(name, 20000, [&]() {
+            sink += parser.GetParameterView(lastKey.c_str()).size();
+        });
+#endif
+    }
+
+    static const size_t valueLengths[] = {8, 64, 256};
+    for(size_t valueLength : valueLengths) {
+        std::string query = BuildQuery(4, valueLength);
+        snprintf(name, sizeof(name), "parse 4 params, %u byte values", (unsigned)valueLength);
+        Benchmark(name, 2000, [&]() {
+            QueryURLParser parser(query.c_str(), query.size());
+            sink += parser.ParameterCount();
+        });
+    }
+}
+
+/**
+ * Benchmark a NumberParser kernel against the C library function for the same type
+ */
+template<typename T, typename Reference>
+static void BenchmarkConversion(const char* name, const char* value, Reference&& reference) {
+    char label[64];
+    size_t length = strlen(value);
+    snprintf(label, sizeof(label), "ParseValue<%s>(\"%s\")", name, value);
+    Benchmark(label, 20000, [&]() {
+        T result = 0;
+        ParseValue(value, length, result);
+        sink += (size_t)result;
+    });
+    snprintf(label, sizeof(label), "  reference (\"%s\")", value);
+    Benchmark(label, 20000, [&]() {
+        sink += (size_t)reference(value);
+    });
+}
+
+static void BenchmarkConversions() {
+    BenchmarkConversion<uint8_t>("uint8_t", "200", [](const char* s) { return strtoul(s, nullptr, 10); });
+    BenchmarkConversion<int16_t>("int16_t", "-12345", [](const char* s) { return strtol(s, nullptr, 10); });
+    BenchmarkConversion<int32_t>("int32_t", "-123456", [](const char* s) { return strtol(s, nullptr, 10); });
+    BenchmarkConversion<uint32_t>("uint32_t", "4000000000", [](const char* s) { return strtoul(s, nullptr, 10); });
+    BenchmarkConversion<int64_t>("int64_t", "-1234567890123", [](const char* s) { return strtoll(s, nullptr, 10); });
+    BenchmarkConversion<float>("float", "3.14159", [](const char* s) { return strtof(s, nullptr); });
+    BenchmarkConversion<double>("double", "-0.001", [](const char* s) { return strtod(s, nullptr); });
+    Benchmark("ParseHex<uint32_t>(\"0xdeadbeef\")", 20000, [&]() {
+        uint32_t result = 0;
+        ParseHex("0xdeadbeef", 10, result);
+        sink += result;
+    });
+    Benchmark("ParseBool(\"false\")", 20000, [&]() {
+        bool result = false;
+        ParseBool("false", 5, result);
+        sink += result;
+    });
+
+    QueryURLParser parser("int=-123456&uint=4000000000&float=3.14159&long=1234567890");
+    Benchmark("GetParameterValue<int>", 20000, [&]() {
+        int result = 0;
+        parser.GetParameterValue("int", result);
+        sink += result;
+    });
+    QueryURLParser listParser("ch=0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15&ch=16&ch=17&ch=18&ch=19&ch=20,21,22,23,24,25,26,27,28,29,30,31");
+    Benchmark("GetParameterValues<int32_t> (32 values)", 20000, [&]() {
+        int32_t channels[32];
+        size_t count;
+        listParser.GetParameterValues("ch", channels, count);
+        sink += count;
+    });
+#if _CPP17_AVAILABLE
+    Benchmark("GetParameterIntOptional", 20000, [&]() {
+        sink += parser.GetParameterIntOptional("int").value_or(0);
+    });
+    Benchmark("GetParameterUnsignedLongOptional", 20000, [&]() {
+        sink += parser.GetParameterUnsignedLongOptional("uint").value_or(0);
+    });
+    Benchmark("GetParameterFloatOptional", 20000, [&]() {
+        sink += (size_t)parser.GetParameterFloatOptional("float").value_or(0.0f);
+    });
+#endif
+}
+
+static void BenchmarkDecoding() {
+    static const char encoded[] =
+        "%7B%22name%22%3A%22Hello+World%22%2C%22values%22%3A%5B1%2C2%2C3%5D%7D"
+        "plain-text-without-any-escapes-plain-text-without-any-escapes";
+    char decoded[sizeof(encoded)];
+    Benchmark("URLDecode (mixed, 128 bytes)", 20000, [&]() {
+        sink += URLDecode(encoded, sizeof(encoded) - 1, decoded);
+    });
+    static const char plain[] = "plain-text-without-any-escapes-plain-text-without-any-escapes"
+                                "plain-text-without-any-escapes-plain-text-without-any-escapes";
+    Benchmark("URLNeedsDecoding (plain, 124 bytes)", 20000, [&]() {
+        sink += URLNeedsDecoding(plain, sizeof(plain) - 1);
+    });
+}
+
+static esp_err_t CountBytes(void* context, const char* /*data*/, size_t length) {
+    *(size_t*)context += length;
+    return ESP_OK;
+}
+
+static void BenchmarkJSON() {
+    size_t bytes = 0;
+    Benchmark("JSONWriter status error", 20000, [&]() {
+        JSONWriter json(CountBytes, &bytes);
+        json.BeginObject();
+        json.Key("status").String("error");
+        json.Key("error").String("Parameter \"power\" out of range");
+        json.EndObject();
+        json.Finish();
+    });
+    Benchmark("JSONWriter 100 floats", 2000, [&]() {
+        JSONWriter json(CountBytes, &bytes);
+        json.BeginObject();
+        json.Key("history").BeginArray();
+        for(int i = 0; i < 100; i++) {
+            json.Number(i * 0.25);
+        }
+        json.EndArray();
+        json.EndObject();
+        json.Finish();
+    });
+    Benchmark("JSONWriter 100 ints", 2000, [&]() {
+        JSONWriter json(CountBytes, &bytes);
+        json.BeginArray();
+        for(int i = 0; i < 100; i++) {
+            json.Number(i * 1000);
+        }
+        json.EndArray();
+        json.Finish();
+    });
+    sink += bytes;
+}
+
+static void BenchmarkResponseWriter() {
+    size_t bytes = 0;
+    ResponseWriterStats stats;
+    // Each httpd_resp_send_chunk() call costs at least 3 sends (size line, data, "\r\n")
+    Benchmark("ResponseWriter 20 small writes", 20000, [&]() {
+        ResponseWriter response(CountBytes, &bytes);
+        response.SetType("text/plain");
+        for(int i = 0; i < 10; i++) {
+            response.Write("Channel ");
+            response.WriteNumber(i);
+        }
+        response.Finish();
+        stats = response.GetStats();
+    });
+    printf("%-48s %10u sends for %u writes\n", "", (unsigned)stats.flushes, (unsigned)stats.writes);
+    Benchmark("ResponseWriter 100 floats", 2000, [&]() {
+        ResponseWriter response(CountBytes, &bytes);
+        for(int i = 0; i < 100; i++) {
+            response.WriteNumber(i * 0.25, 2).Write("\n", 1);
+        }
+        response.Finish();
+        stats = response.GetStats();
+    });
+    printf("%-48s %10u sends for %u writes\n", "", (unsigned)stats.flushes, (unsigned)stats.writes);
+    Benchmark("ResponseWriter Printf 4 KB (chunked)", 200, [&]() {
+        ResponseWriter response(CountBytes, &bytes);
+        for(int i = 0; i < 200; i++) {
+            response.Printf("sensor_%03d %8d\n", i, i * 1000);
+        }
+        response.Finish();
+        stats = response.GetStats();
+    });
+    printf("%-48s %10u sends for %u writes\n", "", (unsigned)stats.flushes, (unsigned)stats.writes);
+    sink += bytes;
+}
+
+static esp_err_t AppendString(void* context, const char* data, size_t length) {
+    static_cast<std::string*>(context)->append(data, length);
+    return ESP_OK;
+}
+
+/**
+ * Build a JSON history array like the ones typically served by sensor dashboards
+ */
+static std::string BuildHistory(size_t numEntries) {
+    std::string history;
+    JSONWriter json(AppendString, &history);
+    json.BeginArray();
+    for(size_t i = 0; i < numEntries; i++) {
+        json.BeginObject();
+        json.Key("t").Number((unsigned long)(1700000000 + i * 60));
+        json.Key("temperature").Number(20.0 + (i * 37 % 1000) / 100.0, 2);
+        json.Key("humidity").Number((unsigned long)(40 + i * 7 % 20));
+        json.EndObject();
+    }
+    json.EndArray();
+    json.Finish();
+    return history;
+}
+
+static void BenchmarkCompression() {
+    static const size_t entryCounts[] = {50, 200, 500};
+    char name[64];
+    for(size_t numEntries : entryCounts) {
+        std::string history = BuildHistory(numEntries);
+        size_t compressedSize = 0;
+        snprintf(name, sizeof(name), "gzip JSON history (%u bytes)", (unsigned)history.size());
+        Benchmark(name, 20, [&]() {
+            size_t bytes = 0;
+            GzipEncoder gzip(CountBytes, &bytes);
+            // Written in pieces like a JSONWriter would
+            for(size_t offset = 0; offset < history.size(); offset += HUMANESPHTTP_JSON_BUFFER_SIZE) {
+                size_t length = history.size() - offset;
+                gzip.Write(history.data() + offset, length < HUMANESPHTTP_JSON_BUFFER_SIZE ? length : HUMANESPHTTP_JSON_BUFFER_SIZE);
+            }
+            gzip.Finish();
+            compressedSize = bytes;
+        });
+        printf("%-48s %10u bytes saved (%.1fx)\n", "", (unsigned)(history.size() - compressedSize),
+               (double)history.size() / compressedSize);
+    }
+}
+
+static esp_err_t EmptyRoute(httpd_req_t* /*request*/, const RouteParams& /*params*/) {
+    return ESP_OK;
+}
+
+static void BenchmarkRouting() {
+    static const size_t routeCounts[] = {8, 64, 256};
+    char name[64];
+    for(size_t numRoutes : routeCounts) {
+        // Half static routes, half routes with a {param} capture
+        std::vector<std::string> patterns; // Native templates (with wildcard instead of capture)
+        std::vector<std::string> routePatterns;
+        patterns.reserve(numRoutes);
+        routePatterns.reserve(numRoutes);
+        for(size_t i = 0; i < numRoutes; i++) {
+            if(i % 2 == 0) {
+                routePatterns.push_back("/api/device" + std::to_string(i) + "/status");
+                patterns.push_back(routePatterns.back());
+            } else {
+                routePatterns.push_back("/api/sensor" + std::to_string(i) + "/{id}");
+                patterns.push_back("/api/sensor" + std::to_string(i) + "/*");
+            }
+        }
+        Router router;
+        for(const std::string& pattern : routePatterns) {
+            router.AddRoute(HTTP_GET, pattern.c_str(), EmptyRoute);
+        }
+        // The last registered route is the worst case for the native linear search
+        std::string path = "/api/sensor" + std::to_string(numRoutes - 1) + "/12";
+
+        snprintf(name, sizeof(name), "native wildcard match (%u routes)", (unsigned)numRoutes);
+        Benchmark(name, 2000, [&]() {
+            // Equivalent to the ESP-IDF handler lookup: linear search over all handlers
+            for(size_t i = 0; i < patterns.size(); i++) {
+                if(httpd_uri_match_wildcard(patterns[i].c_str(), path.c_str(), path.size())) {
+                    sink += i;
+                    break;
+                }
+            }
+        });
+        snprintf(name, sizeof(name), "Router match (%u routes)", (unsigned)numRoutes);
+        Benchmark(name, 20000, [&]() {
+            RouteParams params;
+            sink += (size_t)router.Match(HTTP_GET, path.c_str(), path.size(), params);
+        });
+    }
+}
+
+void app_main() {
+    printf("HumanESPHTTP benchmark, free heap: %u bytes\n", (unsigned)heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+    BenchmarkQueryParsing();
+    BenchmarkConversions();
+    BenchmarkDecoding();
+    BenchmarkJSON();
+    BenchmarkResponseWriter();
+    BenchmarkRouting();
+    BenchmarkCompression();
+    printf("Done (%u)\n", (unsigned)sink);
+}
@@ -1,6 +1,7 @@
 #include <Arduino.h>
 #include <HTTPServer.hpp>
 #include <QueryURLParser.hpp>
+#include <ResponseWriter.hpp>
 #include <WiFi.h>
 
 // Declare server globally
@@ -14,11 +15,12 @@ static const httpd_uri_t queryHandler = {
     .handler   = [](httpd_req_t *request) {
         QueryURLParser parser(request);
         if(parser.HasParameter("param")) {
-            httpd_resp_set_type(request, "text/plain");
             std::string param = parser.GetParameter("param");
-            httpd_resp_send_chunk(request, "Param is: ", HTTPD_RESP_USE_STRLEN);
-            httpd_resp_send_chunk(request, param.c_str(), HTTPD_RESP_USE_STRLEN);
-            httpd_resp_send_chunk(request, nullptr, 0); // Finished
+            ResponseWriter response(request);
+            response.SetType("text/plain");
+            response.Write("Param is: ");
+            response.Write(param.data(), param.size());
+            return response.Finish();
         } else {
             httpd_resp_set_type(request, "text/plain");
             httpd_resp_set_status(request, "400 Bad Request");
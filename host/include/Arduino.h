@@ -0,0 +1,34 @@
+#pragma once
+/*
+ * Minimal Arduino API for running the Arduino examples on the host (see "Load testing on the host" in README.md).
+ * setup() and loop() are called by main() in ArduinoMain.cpp.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+void setup();
+void loop();
+
+inline void delay(uint32_t ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+inline unsigned long millis() {
+    return (unsigned long)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/**
+ * Serial port, printing to stdout
+ */
+class HostSerial {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void print(const char* str) { fputs(str, stdout); fflush(stdout); }
+    void println(const char* str = "") { puts(str); }
+    template<typename... Args>
+    void printf(const char* format, Args... args) { ::printf(format, args...); fflush(stdout); }
+};
+
+extern HostSerial Serial;
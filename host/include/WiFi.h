@@ -0,0 +1,23 @@
+#pragma once
+/*
+ * The host is always connected, so WiFi.status() always returns WL_CONNECTED
+ */
+#include <cstdint>
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+class HostWiFi {
+public:
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr) {
+        (void)ssid;
+        (void)passphrase;
+        return WL_CONNECTED;
+    }
+    wl_status_t status() { return WL_CONNECTED; }
+};
+
+extern HostWiFi WiFi;
@@ -0,0 +1,33 @@
+#pragma once
+/*
+ * Host implementation of the esp_heap_caps subset used by the examples.
+ * There is only one heap, so capabilities are ignored.
+ *
+ * Targets linking humanesphttp-heap-hooks get CONFIG_HEAP_USE_HOOKS:
+ * esp_heap_trace_alloc_hook() and esp_heap_trace_free_hook() are then called
+ * for every malloc()/calloc()/realloc()/free() of any thread, like on ESP-IDF.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Free bytes in the malloc arena (mallinfo2().fordblks), which grows on demand
+ */
+size_t heap_caps_get_free_size(uint32_t caps);
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+void esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps);
+void esp_heap_trace_free_hook(void* ptr);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+/*
+ * Host implementation of the ESP-IDF logging macros, printing to stderr.
+ * The level is set using the HUMANESPHTTP_LOG_LEVEL environment variable
+ * (0 = none, 1 = error, 2 = warning (default), 3 = info, 4 = debug, 5 = verbose).
+ */
+#include <stdio.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#define ESP_LOGE(tag, format, ...) esp_log_write(ESP_LOG_ERROR, tag, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) esp_log_write(ESP_LOG_WARN, tag, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) esp_log_write(ESP_LOG_INFO, tag, "I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) esp_log_write(ESP_LOG_DEBUG, tag, "D %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) esp_log_write(ESP_LOG_VERBOSE, tag, "V %s: " format "\n", tag, ##__VA_ARGS__)
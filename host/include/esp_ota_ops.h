@@ -0,0 +1,29 @@
+#pragma once
+/*
+ * There is no flash on the host: all OTA functions fail with ESP_ERR_NOT_SUPPORTED
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef uint32_t esp_ota_handle_t;
+typedef struct esp_partition {
+    const char* label;
+} esp_partition_t;
+
+#define OTA_SIZE_UNKNOWN 0xffffffff
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+/*
+ * Host implementation of the FreeRTOS subset used by HumanESPHTTP:
+ * tasks are threads, queues are mutex-protected ring buffers.
+ * Priorities and core affinity are ignored.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7fffffff
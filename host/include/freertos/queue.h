@@ -0,0 +1,19 @@
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct QueueDefinition* QueueHandle_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize,
+                                   void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackSize,
+                       void* arg, UBaseType_t priority, TaskHandle_t* handle);
+/**
+ * Only deleting the calling task (nullptr) is supported
+ */
+void vTaskDelete(TaskHandle_t task) __attribute__((noreturn));
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+/*
+ * Configuration of the host implementation, matching the ESP-IDF defaults
+ * except for WebSocket support, which is enabled.
+ */
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 512
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_HTTPD_PURGE_BUF 32
+#define CONFIG_LWIP_TCP_MSS 1440
+#define CONFIG_HTTPD_ERR_RESP_NO_DELAY 1
+#define CONFIG_HTTPD_WS_SUPPORT 1
@@ -0,0 +1,542 @@
+#include <JSONWriter.hpp>
+#include <URLDecode.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * HTTP load generator replaying a request trace against a server,
+ * reporting throughput and latency percentiles per route (see "Load testing on the host" in README.md).
+ *
+ * Every connection is served by its own thread sending one request at a time
+ * (no pipelining). The threads take the trace entries in order, so the
+ * request mix matches the trace regardless of the concurrency.
+ */
+
+static const char* Usage =
+    "Usage: humanesphttp-loadgen --trace FILE [options]\n"
+    "  --host HOST         Server host (default 127.0.0.1)\n"
+    "  --port PORT         Server port (default 8080)\n"
+    "  --concurrency N     Concurrent connections (default 4)\n"
+    "  --requests N        Number of requests to send (default 10000)\n"
+    "  --duration SECONDS  Send requests for this long instead of a fixed number\n"
+    "  --keep-alive        Reuse connections (default)\n"
+    "  --no-keep-alive     Open a new connection for every request\n"
+    "  --timeout MS        Connect, send and receive timeout (default 5000)\n"
+    "  --json FILE         Also write the results as JSON ('-' for stdout)\n"
+    "\n"
+    "Trace format, one request per line ('#' starts a comment):\n"
+    "  METHOD URI [route=NAME] [weight=N] [type=CONTENT_TYPE] [body=URL_ENCODED_BODY]\n"
+    "Requests are reported by route, which defaults to the URI path.\n"
+    "weight=N repeats the request N times in the mix.\n";
+
+struct TraceEntry {
+    size_t route;
+    std::string request; // Complete request (without the Connection header) ending with the body
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    std::string trace;
+    size_t concurrency = 4;
+    uint64_t requests = 10000;
+    double duration = 0; // Seconds, 0 = use requests
+    bool keepAlive = true;
+    int timeoutMs = 5000;
+    std::string json;
+};
+
+/**
+ * Results of one route, collected per thread and merged at the end
+ */
+struct RouteStats {
+    std::vector<uint32_t> latencyUs; // Successful requests only
+    uint64_t errors = 0;             // Connection errors, timeouts, malformed responses
+    uint64_t statusClasses[6] = {};  // Index 1-5: 1xx-5xx
+    uint64_t bytes = 0;              // Response bytes including the head
+};
+
+static bool ParseTrace(const Options& options, std::vector<std::string>& routes, std::vector<TraceEntry>& entries) {
+    std::ifstream file(options.trace);
+    if(!file) {
+        fprintf(stderr, "Can't open trace %s\n", options.trace.c_str());
+        return false;
+    }
+    std::map<std::string, size_t> routeIndices;
+    std::string line;
+    size_t lineNumber = 0;
+    while(std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if(comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        std::string method, uri, field;
+        if(!(fields >> method)) {
+            continue; // Empty line
+        }
+        if(!(fields >> uri) || uri[0] != '/') {
+            fprintf(stderr, "%s:%zu: Expected METHOD URI\n", options.trace.c_str(), lineNumber);
+            return false;
+        }
+        std::string route = uri.substr(0, uri.find('?'));
+        std::string type = "application/x-www-form-urlencoded";
+        std::string body;
+        bool hasBody = false;
+        unsigned long weight = 1;
+        while(fields >> field) {
+            size_t equals = field.find('=');
+            std::string key = field.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : field.substr(equals + 1);
+            if(key == "route") {
+                route = value;
+            } else if(key == "weight") {
+                weight = strtoul(value.c_str(), nullptr, 10);
+            } else if(key == "type") {
+                type = value;
+            } else if(key == "body") {
+                body.resize(value.size());
+                body.resize(URLDecode(value.data(), value.size(), &body[0]));
+                hasBody = true;
+            } else {
+                fprintf(stderr, "%s:%zu: Unknown field %s\n", options.trace.c_str(), lineNumber, key.c_str());
+                return false;
+            }
+        }
+        auto inserted = routeIndices.emplace(route, routes.size());
+        if(inserted.second) {
+            routes.push_back(route);
+        }
+        TraceEntry entry;
+        entry.route = inserted.first->second;
+        entry.request = method + " " + uri + " HTTP/1.1\r\nHost: " + options.host + ":" + options.port + "\r\n";
+        if(hasBody || method == "POST" || method == "PUT" || method == "PATCH") {
+            entry.request += "Content-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+        }
+        if(!options.keepAlive) {
+            entry.request += "Connection: close\r\n";
+        }
+        entry.request += "\r\n" + body;
+        for(unsigned long i = 0; i < weight; i++) {
+            entries.push_back(entry);
+        }
+    }
+    if(entries.empty()) {
+        fprintf(stderr, "Trace %s contains no requests\n", options.trace.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * A client connection with a receive buffer
+ */
+class Connection {
+public:
+    Connection(const struct addrinfo* address, int timeoutMs) : address(address), timeoutMs(timeoutMs) {}
+    ~Connection() { Close(); }
+
+    bool IsOpen() const { return fd >= 0; }
+
+    void Close() {
+        if(fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        buffer.clear();
+    }
+
+    bool Open() {
+        Close();
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if(fd < 0) {
+            return false;
+        }
+        struct timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        if(connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool Send(const std::string& data) {
+        size_t sent = 0;
+        while(sent < data.size()) {
+            ssize_t ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if(ret <= 0) {
+                return false;
+            }
+            sent += ret;
+        }
+        return true;
+    }
+
+    /**
+     * Receive one response
+     * @param received Set if any data has been received (to detect closed keep-alive connections)
+     * @param close Set if the server closes the connection after the response
+     * @return The status code, or 0 on errors
+     */
+    int ReceiveResponse(size_t& bytes, bool& received, bool& close) {
+        received = false;
+        close = false;
+        size_t headEnd;
+        while((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if(!Fill()) {
+                return 0;
+            }
+            received = true;
+        }
+        received = true;
+        std::string head = buffer.substr(0, headEnd + 2);
+        buffer.erase(0, headEnd + 4);
+        bytes = headEnd + 4;
+        int status = 0;
+        if(sscanf(head.c_str(), "HTTP/1.%*d %d", &status) != 1) {
+            return 0;
+        }
+        long long contentLength = -1;
+        bool chunked = false;
+        size_t pos = head.find("\r\n") + 2;
+        while(pos < head.size()) {
+            size_t end = head.find("\r\n", pos);
+            std::string line = head.substr(pos, end - pos);
+            pos = end + 2;
+            size_t colon = line.find(':');
+            if(colon == std::string::npos) {
+                continue;
+            }
+            std::string name = line.substr(0, colon);
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            if(strcasecmp(name.c_str(), "Content-Length") == 0) {
+                contentLength = atoll(value.c_str());
+            } else if(strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+                chunked = strcasestr(value.c_str(), "chunked") != nullptr;
+            } else if(strcasecmp(name.c_str(), "Connection") == 0) {
+                close = strcasecmp(value.c_str(), "close") == 0;
+            }
+        }
+        if(chunked) {
+            for(;;) {
+                size_t lineEnd;
+                while((lineEnd = buffer.find("\r\n")) == std::string::npos) {
+                    if(!Fill()) {
+                        return 0;
+                    }
+                }
+                size_t size = strtoul(buffer.c_str(), nullptr, 16);
+                // Chunk data and trailing "\r\n" (after the last chunk: the empty trailer line)
+                size_t total = lineEnd + 2 + size + 2;
+                while(buffer.size() < total) {
+                    if(!Fill()) {
+                        return 0;
+                    }
+                }
+                buffer.erase(0, total);
+                bytes += total;
+                if(size == 0) {
+                    break;
+                }
+            }
+        } else if(contentLength >= 0) {
+            while(buffer.size() < (size_t)contentLength) {
+                if(!Fill()) {
+                    return 0;
+                }
+            }
+            buffer.erase(0, contentLength);
+            bytes += contentLength;
+        } else {
+            // Body until the server closes the connection
+            while(Fill()) {
+            }
+            bytes += buffer.size();
+            buffer.clear();
+            close = true;
+        }
+        return status;
+    }
+
+private:
+    bool Fill() {
+        char data[4096];
+        ssize_t ret = recv(fd, data, sizeof(data), 0);
+        if(ret <= 0) {
+            return false;
+        }
+        buffer.append(data, ret);
+        return true;
+    }
+
+    const struct addrinfo* address;
+    int timeoutMs;
+    int fd = -1;
+    std::string buffer;
+};
+
+struct Shared {
+    const Options* options;
+    const struct addrinfo* address;
+    const std::vector<TraceEntry>* entries;
+    std::atomic<uint64_t> next{0};
+    std::chrono::steady_clock::time_point end;
+};
+
+static void Worker(Shared* shared, std::vector<RouteStats>* stats) {
+    const Options& options = *shared->options;
+    Connection connection(shared->address, options.timeoutMs);
+    for(;;) {
+        uint64_t index = shared->next.fetch_add(1);
+        if(options.duration > 0 ? std::chrono::steady_clock::now() >= shared->end : index >= options.requests) {
+            return;
+        }
+        const TraceEntry& entry = (*shared->entries)[index % shared->entries->size()];
+        RouteStats& route = (*stats)[entry.route];
+        int status = 0;
+        size_t bytes = 0;
+        bool close = false;
+        auto start = std::chrono::steady_clock::now();
+        // A reused connection may have been closed by the server in the meantime, retry once
+        for(int attempt = 0; attempt < 2 && status == 0; attempt++) {
+            bool reused = connection.IsOpen();
+            start = std::chrono::steady_clock::now();
+            if(!reused && !connection.Open()) {
+                break;
+            }
+            bool received = false;
+            if(connection.Send(entry.request)) {
+                status = connection.ReceiveResponse(bytes, received, close);
+            }
+            if(status == 0) {
+                connection.Close();
+                if(!reused || received) {
+                    break;
+                }
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        if(status == 0) {
+            route.errors++;
+            continue;
+        }
+        route.latencyUs.push_back((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        route.statusClasses[std::min(std::max(status / 100, 0), 5)]++;
+        route.bytes += bytes;
+        if(close || !options.keepAlive) {
+            connection.Close();
+        }
+    }
+}
+
+/**
+ * Nearest-rank percentile of sorted latencies in milliseconds
+ */
+static double Percentile(const std::vector<uint32_t>& sorted, double fraction) {
+    if(sorted.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t)std::ceil(fraction * sorted.size());
+    return sorted[std::max(rank, (size_t)1) - 1] / 1000.0;
+}
+
+struct Summary {
+    std::string route;
+    uint64_t count;
+    uint64_t errors;
+    uint64_t non2xx;
+    uint64_t bytes;
+    double mean, p50, p99, p999, max;
+};
+
+static Summary Summarize(const std::string& name, RouteStats& stats) {
+    std::sort(stats.latencyUs.begin(), stats.latencyUs.end());
+    Summary summary;
+    summary.route = name;
+    summary.count = stats.latencyUs.size();
+    summary.errors = stats.errors;
+    summary.non2xx = summary.count - stats.statusClasses[2];
+    summary.bytes = stats.bytes;
+    double total = 0;
+    for(uint32_t latency : stats.latencyUs) {
+        total += latency;
+    }
+    summary.mean = summary.count > 0 ? total / summary.count / 1000.0 : 0;
+    summary.p50 = Percentile(stats.latencyUs, 0.5);
+    summary.p99 = Percentile(stats.latencyUs, 0.99);
+    summary.p999 = Percentile(stats.latencyUs, 0.999);
+    summary.max = stats.latencyUs.empty() ? 0 : stats.latencyUs.back() / 1000.0;
+    return summary;
+}
+
+static esp_err_t WriteFile(void* context, const char* data, size_t length) {
+    return fwrite(data, 1, length, static_cast<FILE*>(context)) == length ? ESP_OK : ESP_FAIL;
+}
+
+static bool WriteJSON(const Options& options, const std::vector<Summary>& summaries, double seconds) {
+    FILE* file = options.json == "-" ? stdout : fopen(options.json.c_str(), "w");
+    if(file == nullptr) {
+        fprintf(stderr, "Can't write %s\n", options.json.c_str());
+        return false;
+    }
+    JSONWriter json(WriteFile, file);
+    json.BeginObject();
+    json.Key("concurrency").Number((unsigned long long)options.concurrency);
+    json.Key("keepAlive").Bool(options.keepAlive);
+    json.Key("seconds").Number(seconds, 3);
+    json.Key("routes").BeginArray();
+    for(const Summary& summary : summaries) {
+        json.BeginObject();
+        json.Key("route").String(summary.route.c_str());
+        json.Key("requests").Number((unsigned long long)summary.count);
+        json.Key("requestsPerSecond").Number(summary.count / seconds, 1);
+        json.Key("errors").Number((unsigned long long)summary.errors);
+        json.Key("non2xx").Number((unsigned long long)summary.non2xx);
+        json.Key("bytes").Number((unsigned long long)summary.bytes);
+        json.Key("meanMs").Number(summary.mean, 3);
+        json.Key("p50Ms").Number(summary.p50, 3);
+        json.Key("p99Ms").Number(summary.p99, 3);
+        json.Key("p999Ms").Number(summary.p999, 3);
+        json.Key("maxMs").Number(summary.max, 3);
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    esp_err_t err = json.Finish();
+    fputc('\n', file);
+    if(file != stdout) {
+        fclose(file);
+    }
+    return err == ESP_OK;
+}
+
+static void PrintSummary(const Summary& summary, double seconds) {
+    printf("%-28s %9llu %10.1f %8.3f %8.3f %8.3f %8.3f %9.3f %7llu %7llu\n", summary.route.c_str(),
+           (unsigned long long)summary.count, summary.count / seconds, summary.mean, summary.p50, summary.p99,
+           summary.p999, summary.max, (unsigned long long)summary.errors, (unsigned long long)summary.non2xx);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        } else if(arg == "--port" && hasValue) {
+            options.port = argv[++i];
+        } else if(arg == "--trace" && hasValue) {
+            options.trace = argv[++i];
+        } else if(arg == "--concurrency" && hasValue) {
+            options.concurrency = std::max(1L, strtol(argv[++i], nullptr, 10));
+        } else if(arg == "--requests" && hasValue) {
+            options.requests = strtoull(argv[++i], nullptr, 10);
+        } else if(arg == "--duration" && hasValue) {
+            options.duration = strtod(argv[++i], nullptr);
+        } else if(arg == "--keep-alive") {
+            options.keepAlive = true;
+        } else if(arg == "--no-keep-alive") {
+            options.keepAlive = false;
+        } else if(arg == "--timeout" && hasValue) {
+            options.timeoutMs = std::max(1, atoi(argv[++i]));
+        } else if(arg == "--json" && hasValue) {
+            options.json = argv[++i];
+        } else {
+            fputs(Usage, stderr);
+            return 1;
+        }
+    }
+    if(options.trace.empty()) {
+        fputs(Usage, stderr);
+        return 1;
+    }
+    std::vector<std::string> routes;
+    std::vector<TraceEntry> entries;
+    if(!ParseTrace(options, routes, entries)) {
+        return 1;
+    }
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* address = nullptr;
+    int err = getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &address);
+    if(err != 0) {
+        fprintf(stderr, "Can't resolve %s: %s\n", options.host.c_str(), gai_strerror(err));
+        return 1;
+    }
+
+    Shared shared;
+    shared.options = &options;
+    shared.address = address;
+    shared.entries = &entries;
+    std::vector<std::vector<RouteStats>> threadStats(options.concurrency, std::vector<RouteStats>(routes.size()));
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    shared.end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.duration));
+    for(size_t i = 0; i < options.concurrency; i++) {
+        threads.emplace_back(Worker, &shared, &threadStats[i]);
+    }
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    freeaddrinfo(address);
+
+    // Merge the per-thread results
+    std::vector<RouteStats> merged(routes.size());
+    RouteStats all;
+    for(const auto& stats : threadStats) {
+        for(size_t route = 0; route < routes.size(); route++) {
+            for(RouteStats* target : {&merged[route], &all}) {
+                target->latencyUs.insert(target->latencyUs.end(), stats[route].latencyUs.begin(), stats[route].latencyUs.end());
+                target->errors += stats[route].errors;
+                target->bytes += stats[route].bytes;
+                for(int i = 0; i < 6; i++) {
+                    target->statusClasses[i] += stats[route].statusClasses[i];
+                }
+            }
+        }
+    }
+    std::vector<Summary> summaries;
+    for(size_t route = 0; route < routes.size(); route++) {
+        summaries.push_back(Summarize(routes[route], merged[route]));
+    }
+    summaries.push_back(Summarize("(all)", all));
+
+    printf("%s:%s, %zu connections, %s, %.2f s\n\n", options.host.c_str(), options.port.c_str(), options.concurrency,
+           options.keepAlive ? "keep-alive" : "no keep-alive", seconds);
+    printf("%-28s %9s %10s %8s %8s %8s %8s %9s %7s %7s\n", "route", "requests", "req/s", "mean ms", "p50 ms",
+           "p99 ms", "p999 ms", "max ms", "errors", "non-2xx");
+    for(const Summary& summary : summaries) {
+        PrintSummary(summary, seconds);
+    }
+    if(!options.json.empty() && !WriteJSON(options, summaries, seconds)) {
+        return 1;
+    }
+    return all.errors > 0 ? 2 : 0;
+}
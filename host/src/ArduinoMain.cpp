@@ -0,0 +1,32 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Entry point for the Arduino examples on the host.
+ * Usage: <example> [--port N] (default 8080, or the HUMANESPHTTP_PORT environment variable)
+ */
+
+HostSerial Serial;
+HostWiFi WiFi;
+
+int main(int argc, char** argv) {
+    // httpd_start() listens on HUMANESPHTTP_PORT instead of the configured port (80)
+    setenv("HUMANESPHTTP_PORT", "8080", 0);
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            setenv("HUMANESPHTTP_PORT", argv[++i], 1);
+        } else {
+            fprintf(stderr, "Usage: %s [--port N]\n", argv[0]);
+            return 1;
+        }
+    }
+    setup();
+    printf("Listening on port %s\n", getenv("HUMANESPHTTP_PORT"));
+    fflush(stdout);
+    for(;;) {
+        loop();
+    }
+}
@@ -0,0 +1,1631 @@
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Host implementation of esp_http_server.
+ *
+ * Mirrors the behaviour of the ESP-IDF server which handlers can observe:
+ * - One server thread runs select(), accepts connections, parses requests and
+ *   runs handlers and queued work, so a slow handler blocks all other clients.
+ * - Connections are only accepted while fewer than max_open_sockets are open
+ *   (or the least recently used one is closed if lru_purge_enable is set).
+ * - The request line and headers must fit into HTTPD_MAX_REQ_HDR_LEN bytes (414/431 otherwise),
+ *   and are no longer available once the response has been started.
+ * - Unmatched requests get a 404 (405 if only the method differs) and the connection is closed,
+ *   as it is if a handler returns an error.
+ * - Responses are sent in the same pieces as by ESP-IDF (status line and content type,
+ *   every header in four sends, chunk size line, data and trailer separately),
+ *   through the session's send override.
+ * - Unread request bodies are discarded after the handler returns.
+ * - Async request copies (httpd_req_async_handler_begin()) keep the socket out of
+ *   select() until completed.
+ * - WebSocket endpoints: the handshake is answered before the handler is called (with HTTP_GET),
+ *   then the handler is called for every frame (with method 0) after its first byte has been read.
+ *   Pings and close frames are answered unless the handler asked for control frames.
+ */
+
+static const char* TAG = "httpd";
+
+struct HostSession {
+    int fd = -1;
+    void* ctx = nullptr;
+    httpd_free_ctx_fn_t freeCtx = nullptr;
+    void* transportCtx = nullptr; // Set by esp_https_server for the TLS connection
+    httpd_free_ctx_fn_t freeTransportCtx = nullptr;
+    httpd_send_func_t send = nullptr;
+    httpd_recv_func_t recv = nullptr;
+    httpd_pending_func_t pending = nullptr;
+    std::string unread; // Received, but not consumed yet (e.g. the start of the body)
+    uint64_t lastUsed = 0;
+    // Changed by other threads while the server thread polls
+    std::atomic<int> asyncRequests{0}; // Unfinished copies from httpd_req_async_handler_begin()
+    std::atomic<bool> closeRequested{false};
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    // WebSocket endpoint, after the handshake
+    esp_err_t (*wsHandler)(httpd_req_t* r) = nullptr;
+    void* wsUserCtx = nullptr;
+    bool wsControlFrames = false;
+#endif
+};
+
+struct HostRequestAux {
+    HostSession* session = nullptr;
+    std::vector<std::pair<std::string, std::string>> headers;
+    size_t remaining = 0; // Unread body bytes
+    const char* status = HTTPD_200;
+    const char* type = HTTPD_TYPE_TEXT;
+    std::vector<std::pair<const char*, const char*>> responseHeaders;
+    bool firstChunkSent = false;
+    bool keepAlive = true;
+    bool handedOff = false; // An async copy has taken over the request
+    // Query location in the URI as received, like ESP-IDF's url_parse_res.
+    // Copied by httpd_req_async_handler_begin(), even if the copy's URI is changed.
+    bool hasQuery = false;
+    size_t queryOffset = 0;
+    size_t queryLength = 0;
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    // Current frame, see ReceiveFrameType()
+    uint8_t wsType = 0;
+    bool wsFinal = false;
+    uint8_t wsMask[4] = {};
+#endif
+};
+
+struct HostHandler {
+    std::string uri;
+    httpd_uri_t handler;
+};
+
+struct HostServer {
+    httpd_config_t config;
+    int listenFd = -1;
+    int wakeFds[2] = {-1, -1};
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::mutex mutex; // Guards sessions (for other threads), handlers, work and closeRequests
+    std::vector<std::unique_ptr<HostHandler>> handlers; // Slots, nullptr if free
+    std::vector<std::unique_ptr<HostSession>> sessions;
+    std::vector<std::pair<httpd_work_fn_t, void*>> work;
+    std::vector<int> closeRequests;
+    uint64_t lruCounter = 0;
+    httpd_req_t* current = nullptr; // Request whose handler is running on the server thread
+};
+
+static HostServer* ToServer(httpd_handle_t handle) {
+    return static_cast<HostServer*>(handle);
+}
+
+static HostRequestAux* ToAux(httpd_req_t* r) {
+    return static_cast<HostRequestAux*>(r->aux);
+}
+
+static HostSession* FindSession(HostServer* server, int sockfd) {
+    for(const auto& session : server->sessions) {
+        if(session->fd == sockfd) {
+            return session.get();
+        }
+    }
+    return nullptr;
+}
+
+static void Wake(HostServer* server) {
+    char byte = 0;
+    if(write(server->wakeFds[1], &byte, 1) < 0 && errno != EAGAIN) {
+        ESP_LOGW(TAG, "Failed to wake the server thread: %s", strerror(errno));
+    }
+}
+
+static int DefaultSend(httpd_handle_t hd, int sockfd, const char* buf, size_t buf_len, int flags) {
+    (void)hd;
+    if(buf == nullptr) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    ssize_t ret = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    if(ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)ret;
+}
+
+static int DefaultRecv(httpd_handle_t hd, int sockfd, char* buf, size_t buf_len, int flags) {
+    (void)hd;
+    if(buf == nullptr) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    ssize_t ret = recv(sockfd, buf, buf_len, flags);
+    if(ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    return (int)ret;
+}
+
+static void FreeContext(void* ctx, httpd_free_ctx_fn_t freeCtx) {
+    if(ctx == nullptr) {
+        return;
+    }
+    if(freeCtx != nullptr) {
+        freeCtx(ctx);
+    } else {
+        free(ctx);
+    }
+}
+
+/**
+ * Close the session and free its context (server thread only)
+ */
+static void CloseSession(HostServer* server, HostSession* session) {
+    std::unique_ptr<HostSession> closed;
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        auto it = std::find_if(server->sessions.begin(), server->sessions.end(),
+                               [session](const std::unique_ptr<HostSession>& s) { return s.get() == session; });
+        if(it == server->sessions.end()) {
+            return;
+        }
+        closed = std::move(*it);
+        server->sessions.erase(it);
+    }
+    ESP_LOGD(TAG, "Closing socket %d", closed->fd);
+    // Like ESP-IDF, a close function has to close the socket itself
+    if(server->config.close_fn != nullptr) {
+        server->config.close_fn(server, closed->fd);
+    } else {
+        close(closed->fd);
+    }
+    FreeContext(closed->ctx, closed->freeCtx);
+    FreeContext(closed->transportCtx, closed->freeTransportCtx);
+}
+
+static int Receive(HostServer* server, HostSession* session, char* buf, size_t length) {
+    httpd_recv_func_t recvFunction;
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        recvFunction = session->recv;
+    }
+    return recvFunction(server, session->fd, buf, length, 0);
+}
+
+/**
+ * Send all data, retrying on timeouts like httpd_send_all() of ESP-IDF
+ */
+static esp_err_t SendAll(httpd_req_t* r, const char* buf, size_t length) {
+    while(length > 0) {
+        int ret = httpd_send(r, buf, length);
+        if(ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if(ret <= 0) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        buf += ret;
+        length -= ret;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t SendString(httpd_req_t* r, const char* str) {
+    return SendAll(r, str, strlen(str));
+}
+
+/**
+ * Send the headers set with httpd_resp_set_hdr() and the empty line ending the head
+ */
+static esp_err_t SendHeaders(httpd_req_t* r) {
+    for(const auto& header : ToAux(r)->responseHeaders) {
+        if(SendString(r, header.first) != ESP_OK || SendString(r, ": ") != ESP_OK
+           || SendString(r, header.second) != ESP_OK || SendString(r, "\r\n") != ESP_OK) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+    }
+    return SendString(r, "\r\n");
+}
+
+/**
+ * Discard the unread part of the body
+ * @return false if the connection broke
+ */
+static bool DiscardBody(httpd_req_t* r) {
+    char buffer[CONFIG_HTTPD_PURGE_BUF];
+    while(ToAux(r)->remaining > 0) {
+        int ret = httpd_req_recv(r, buffer, std::min(sizeof(buffer), ToAux(r)->remaining));
+        if(ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if(ret <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void FreeRequest(httpd_req_t* r) {
+    delete ToAux(r);
+    free(r);
+}
+
+static const char* HeaderValue(const HostRequestAux* aux, const char* field) {
+    for(const auto& header : aux->headers) {
+        if(strcasecmp(header.first.c_str(), field) == 0) {
+            return header.second.c_str();
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Take over the session context set by the handler
+ */
+static void TakeSessionContext(HostSession* session, httpd_req_t* r) {
+    if(r->ignore_sess_ctx_changes) {
+        return;
+    }
+    if(session->ctx != r->sess_ctx) {
+        FreeContext(session->ctx, session->freeCtx);
+        session->ctx = r->sess_ctx;
+    }
+    session->freeCtx = r->free_ctx;
+}
+
+/**
+ * Answer a request which could not be parsed and close the connection
+ */
+static void RejectRequest(HostServer* server, HostSession* session, httpd_err_code_t error) {
+    httpd_req_t* r = static_cast<httpd_req_t*>(calloc(1, sizeof(httpd_req_t)));
+    HostRequestAux* aux = new HostRequestAux();
+    aux->session = session;
+    r->handle = server;
+    r->aux = aux;
+    httpd_resp_send_err(r, error, nullptr);
+    FreeRequest(r);
+    CloseSession(server, session);
+}
+
+static void TrimSpaces(std::string& str) {
+    size_t start = str.find_first_not_of(" \t");
+    size_t end = str.find_last_not_of(" \t");
+    str = start == std::string::npos ? std::string() : str.substr(start, end - start + 1);
+}
+
+/**
+ * Parse the request line and headers
+ * @return HTTPD_ERR_CODE_MAX on success, otherwise the error to respond with
+ */
+static httpd_err_code_t ParseHead(const std::string& head, int& method, std::string& uri, HostRequestAux* aux,
+                                  size_t& contentLength) {
+    size_t lineEnd = head.find("\r\n");
+    std::string requestLine = head.substr(0, lineEnd);
+    size_t methodEnd = requestLine.find(' ');
+    size_t uriEnd = requestLine.rfind(' ');
+    if(methodEnd == std::string::npos || uriEnd == methodEnd) {
+        return HTTPD_400_BAD_REQUEST;
+    }
+    std::string methodName = requestLine.substr(0, methodEnd);
+    method = -1;
+    for(int i = 0; i <= HTTP_UNLINK; i++) {
+        if(methodName == http_method_str((enum http_method)i)) {
+            method = i;
+            break;
+        }
+    }
+    if(method < 0) {
+        return HTTPD_501_METHOD_NOT_IMPLEMENTED;
+    }
+    uri = requestLine.substr(methodEnd + 1, uriEnd - methodEnd - 1);
+    if(uri.empty() || uri.find(' ') != std::string::npos) {
+        return HTTPD_400_BAD_REQUEST;
+    }
+    if(uri.size() > HTTPD_MAX_URI_LEN) {
+        return HTTPD_414_URI_TOO_LONG;
+    }
+    std::string version = requestLine.substr(uriEnd + 1);
+    if(version == "HTTP/1.0") {
+        aux->keepAlive = false; // Unless the client asks for it
+    } else if(version != "HTTP/1.1") {
+        return HTTPD_505_VERSION_NOT_SUPPORTED;
+    }
+    contentLength = 0;
+    size_t pos = lineEnd == std::string::npos ? head.size() : lineEnd + 2; // Requests without headers
+    while(pos < head.size()) {
+        size_t end = head.find("\r\n", pos);
+        if(end == std::string::npos) {
+            end = head.size();
+        }
+        size_t colon = head.find(':', pos);
+        if(colon == std::string::npos || colon >= end || colon == pos) {
+            return HTTPD_400_BAD_REQUEST;
+        }
+        std::string name = head.substr(pos, colon - pos);
+        std::string value = head.substr(colon + 1, end - colon - 1);
+        TrimSpaces(value);
+        if(strcasecmp(name.c_str(), "Content-Length") == 0) {
+            char* valueEnd = nullptr;
+            errno = 0;
+            unsigned long long length = strtoull(value.c_str(), &valueEnd, 10);
+            if(value.empty() || *valueEnd != '\0' || errno != 0 || value[0] == '-') {
+                return HTTPD_400_BAD_REQUEST;
+            }
+            contentLength = (size_t)length;
+        } else if(strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+            return HTTPD_411_LENGTH_REQUIRED; // Chunked requests are not supported by ESP-IDF either
+        } else if(strcasecmp(name.c_str(), "Connection") == 0) {
+            if(strcasecmp(value.c_str(), "close") == 0) {
+                aux->keepAlive = false;
+            } else if(strcasecmp(value.c_str(), "keep-alive") == 0) {
+                aux->keepAlive = true;
+            }
+        }
+        aux->headers.emplace_back(std::move(name), std::move(value));
+        pos = end + 2;
+    }
+    return HTTPD_ERR_CODE_MAX;
+}
+
+/**
+ * Find the handler like ESP-IDF: the first registered one matching URI and method
+ * @param uriMatched Set if a handler matched the URI, but not the method
+ */
+static bool FindHandler(HostServer* server, const char* uri, int method, httpd_uri_t& found, bool& uriMatched) {
+    size_t pathLength = strcspn(uri, "?");
+    uriMatched = false;
+    std::lock_guard<std::mutex> lock(server->mutex);
+    for(const auto& slot : server->handlers) {
+        if(slot == nullptr) {
+            continue;
+        }
+        const char* handlerURI = slot->uri.c_str();
+        bool match = server->config.uri_match_fn != nullptr
+            ? server->config.uri_match_fn(handlerURI, uri, pathLength)
+            : slot->uri.size() == pathLength && strncmp(handlerURI, uri, pathLength) == 0;
+        if(!match) {
+            continue;
+        }
+        if((int)slot->handler.method == method) {
+            found = slot->handler;
+            found.uri = handlerURI;
+            return true;
+        }
+        uriMatched = true;
+    }
+    return false;
+}
+
+/**
+ * @return The error for a request whose head does not fit into HTTPD_MAX_REQ_HDR_LEN:
+ * 414 if it is the request line already, 431 otherwise
+ */
+static httpd_err_code_t HeadTooLongError(const std::string& head) {
+    size_t lineEnd = head.find("\r\n");
+    return lineEnd == std::string::npos || lineEnd > HTTPD_MAX_REQ_HDR_LEN
+        ? HTTPD_414_URI_TOO_LONG : HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE;
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+/**
+ * Receive exactly length bytes (data received with the head first)
+ * @return false if the connection broke or timed out
+ */
+static bool ReceiveAll(HostServer* server, HostSession* session, void* buf, size_t length) {
+    char* out = static_cast<char*>(buf);
+    size_t received = std::min(length, session->unread.size());
+    memcpy(out, session->unread.data(), received);
+    session->unread.erase(0, received);
+    while(received < length) {
+        int ret = Receive(server, session, out + received, length - received);
+        if(ret <= 0) {
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+static uint32_t RotateLeft(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ * SHA-1 (only for the Sec-WebSocket-Accept header)
+ */
+static void SHA1(const std::string& data, uint8_t digest[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    std::string message = data;
+    message += '\x80';
+    while(message.size() % 64 != 56) {
+        message += '\0';
+    }
+    uint64_t bits = (uint64_t)data.size() * 8;
+    for(int shift = 56; shift >= 0; shift -= 8) {
+        message += (char)(bits >> shift);
+    }
+    for(size_t block = 0; block < message.size(); block += 64) {
+        uint32_t w[80];
+        for(int i = 0; i < 16; i++) {
+            const uint8_t* word = (const uint8_t*)message.data() + block + i * 4;
+            w[i] = (uint32_t)word[0] << 24 | (uint32_t)word[1] << 16 | (uint32_t)word[2] << 8 | word[3];
+        }
+        for(int i = 16; i < 80; i++) {
+            w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for(int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if(i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if(i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if(i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = RotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for(int i = 0; i < 20; i++) {
+        digest[i] = (uint8_t)(h[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+static std::string Base64(const uint8_t* data, size_t length) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string encoded;
+    for(size_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)data[i] << 16;
+        if(i + 1 < length) {
+            group |= (uint32_t)data[i + 1] << 8;
+        }
+        if(i + 2 < length) {
+            group |= data[i + 2];
+        }
+        encoded += alphabet[(group >> 18) & 0x3F];
+        encoded += alphabet[(group >> 12) & 0x3F];
+        encoded += i + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=';
+        encoded += i + 2 < length ? alphabet[group & 0x3F] : '=';
+    }
+    return encoded;
+}
+
+/**
+ * @return true if the request asks for a WebSocket upgrade
+ */
+static bool IsWebSocketUpgrade(const HostRequestAux* aux) {
+    const char* upgrade = HeaderValue(aux, "Upgrade");
+    return upgrade != nullptr && strcasestr(upgrade, "websocket") != nullptr;
+}
+
+/**
+ * Answer the WebSocket handshake with 101 Switching Protocols, like ESP-IDF
+ */
+static esp_err_t RespondHandshake(httpd_req_t* r, const char* subprotocol) {
+    HostRequestAux* aux = ToAux(r);
+    const char* key = HeaderValue(aux, "Sec-WebSocket-Key");
+    const char* version = HeaderValue(aux, "Sec-WebSocket-Version");
+    if(key == nullptr || version == nullptr || strcmp(version, "13") != 0) {
+        ESP_LOGW(TAG, "Invalid WebSocket handshake");
+        httpd_resp_send_err(r, HTTPD_400_BAD_REQUEST, nullptr);
+        return ESP_FAIL;
+    }
+    uint8_t digest[20];
+    SHA1(std::string(key) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " + Base64(digest, sizeof(digest)) + "\r\n";
+    const char* protocols = HeaderValue(aux, "Sec-WebSocket-Protocol");
+    if(subprotocol != nullptr && protocols != nullptr && strstr(protocols, subprotocol) != nullptr) {
+        response += "Sec-WebSocket-Protocol: " + std::string(subprotocol) + "\r\n";
+    }
+    response += "\r\n";
+    return SendAll(r, response.data(), response.size());
+}
+
+/**
+ * Read the first byte of a frame and answer pings and close frames
+ * (unless the handler gets control frames), like httpd_ws_get_frame_type()
+ */
+static esp_err_t ReceiveFrameType(httpd_req_t* r, bool controlFrames) {
+    HostRequestAux* aux = ToAux(r);
+    uint8_t first;
+    if(!ReceiveAll(ToServer(r->handle), aux->session, &first, 1)) {
+        return ESP_FAIL;
+    }
+    aux->wsFinal = (first & 0x80) != 0;
+    aux->wsType = first & 0x0F;
+    if(controlFrames || (aux->wsType != HTTPD_WS_TYPE_PING && aux->wsType != HTTPD_WS_TYPE_CLOSE)) {
+        return ESP_OK;
+    }
+    uint8_t payload[128];
+    httpd_ws_frame_t frame = {};
+    frame.payload = payload;
+    if(httpd_ws_recv_frame(r, &frame, 125) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(aux->wsType == HTTPD_WS_TYPE_PING) {
+        frame.type = HTTPD_WS_TYPE_PONG;
+    } else {
+        frame.type = HTTPD_WS_TYPE_CLOSE;
+        frame.len = 0;
+        frame.payload = nullptr;
+    }
+    return httpd_ws_send_frame(r, &frame);
+}
+
+/**
+ * Read and dispatch one frame of a WebSocket session (server thread only)
+ */
+static void ProcessFrame(HostServer* server, HostSession* session) {
+    session->lastUsed = ++server->lruCounter;
+    HostRequestAux* aux = new HostRequestAux();
+    aux->session = session;
+    httpd_req_t* r = static_cast<httpd_req_t*>(calloc(1, sizeof(httpd_req_t)));
+    r->handle = server;
+    r->aux = aux;
+    r->user_ctx = session->wsUserCtx;
+    r->sess_ctx = session->ctx;
+    r->free_ctx = session->freeCtx;
+    esp_err_t ret = ReceiveFrameType(r, session->wsControlFrames);
+    bool closing = aux->wsType == HTTPD_WS_TYPE_CLOSE && !session->wsControlFrames;
+    if(ret == ESP_OK && (aux->wsType < HTTPD_WS_TYPE_CLOSE || session->wsControlFrames)) {
+        server->current = r;
+        ret = session->wsHandler(r);
+        server->current = nullptr;
+    }
+    TakeSessionContext(session, r);
+    FreeRequest(r);
+    if(ret != ESP_OK || closing) {
+        CloseSession(server, session);
+    }
+}
+#endif
+
+/**
+ * Read, dispatch and answer one request of the session (server thread only)
+ */
+static void ProcessRequest(HostServer* server, HostSession* session) {
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    if(session->wsHandler != nullptr) {
+        ProcessFrame(server, session);
+        return;
+    }
+#endif
+    session->lastUsed = ++server->lruCounter;
+    // The head is received in blocks, anything after it stays in session->unread for the body
+    size_t headEnd;
+    for(;;) {
+        // Tolerate empty lines between requests
+        size_t start = session->unread.find_first_not_of("\r\n");
+        session->unread.erase(0, start == std::string::npos ? session->unread.size() : start);
+        headEnd = session->unread.find("\r\n\r\n");
+        if(headEnd != std::string::npos) {
+            break;
+        }
+        if(session->unread.size() > HTTPD_MAX_REQ_HDR_LEN) {
+            RejectRequest(server, session, HeadTooLongError(session->unread));
+            return;
+        }
+        char buffer[HTTPD_MAX_REQ_HDR_LEN];
+        int ret = Receive(server, session, buffer, sizeof(buffer));
+        if(ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            if(session->unread.empty()) {
+                return; // Nothing there after all
+            }
+            RejectRequest(server, session, HTTPD_408_REQ_TIMEOUT);
+            return;
+        }
+        if(ret <= 0) {
+            CloseSession(server, session); // Closed by the client
+            return;
+        }
+        session->unread.append(buffer, ret);
+    }
+    if(headEnd + 4 > HTTPD_MAX_REQ_HDR_LEN) {
+        RejectRequest(server, session, HeadTooLongError(session->unread));
+        return;
+    }
+    std::string head = session->unread.substr(0, headEnd);
+    session->unread.erase(0, headEnd + 4);
+
+    HostRequestAux* aux = new HostRequestAux();
+    aux->session = session;
+    int method = -1;
+    std::string uri;
+    size_t contentLength = 0;
+    httpd_err_code_t error = ParseHead(head, method, uri, aux, contentLength);
+    if(error != HTTPD_ERR_CODE_MAX) {
+        delete aux;
+        RejectRequest(server, session, error);
+        return;
+    }
+    aux->remaining = contentLength;
+    size_t question = uri.find('?');
+    if(question != std::string::npos) {
+        aux->hasQuery = true;
+        aux->queryOffset = question + 1;
+        aux->queryLength = strcspn(uri.c_str() + aux->queryOffset, "#");
+    }
+    httpd_req_t* r = static_cast<httpd_req_t*>(calloc(1, sizeof(httpd_req_t)));
+    r->handle = server;
+    r->method = method;
+    memcpy((char*)r->uri, uri.c_str(), uri.size() + 1);
+    r->content_len = contentLength;
+    r->aux = aux;
+    r->sess_ctx = session->ctx;
+    r->free_ctx = session->freeCtx;
+
+    httpd_uri_t handler;
+    bool uriMatched = false;
+    esp_err_t ret;
+    if(FindHandler(server, r->uri, method, handler, uriMatched)) {
+        r->user_ctx = handler.user_ctx;
+        server->current = r;
+        ret = ESP_OK;
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        // Without an upgrade, the handler is called like any other
+        if(handler.is_websocket && method == HTTP_GET && IsWebSocketUpgrade(aux)) {
+            ret = RespondHandshake(r, handler.supported_subprotocol);
+            if(ret == ESP_OK) {
+                session->wsHandler = handler.handler;
+                session->wsUserCtx = handler.user_ctx;
+                session->wsControlFrames = handler.handle_ws_control_frames;
+            }
+        }
+#endif
+        if(ret == ESP_OK) {
+            ret = handler.handler(r);
+        }
+        server->current = nullptr;
+    } else {
+        ESP_LOGW(TAG, "No handler for %s %s", http_method_str((enum http_method)method), r->uri);
+        httpd_resp_send_err(r, uriMatched ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, nullptr);
+        ret = ESP_FAIL; // ESP-IDF closes the connection unless an error handler says otherwise
+    }
+    TakeSessionContext(session, r);
+    bool keepOpen = ret == ESP_OK;
+    if(!aux->handedOff) {
+        keepOpen = keepOpen && aux->keepAlive && DiscardBody(r);
+    }
+    FreeRequest(r);
+    if(!keepOpen) {
+        if(session->asyncRequests > 0) {
+            session->closeRequested = true; // Closed when the async request completes
+        } else {
+            CloseSession(server, session);
+        }
+    }
+}
+
+static void Accept(HostServer* server) {
+    int fd = accept(server->listenFd, nullptr, nullptr);
+    if(fd < 0) {
+        ESP_LOGW(TAG, "accept() failed: %s", strerror(errno));
+        return;
+    }
+    if(server->sessions.size() >= server->config.max_open_sockets) {
+        // Only possible with lru_purge_enable, otherwise the listening socket is not polled
+        HostSession* lru = nullptr;
+        for(const auto& session : server->sessions) {
+            if(session->asyncRequests == 0 && (lru == nullptr || session->lastUsed < lru->lastUsed)) {
+                lru = session.get();
+            }
+        }
+        if(lru == nullptr) {
+            close(fd);
+            return;
+        }
+        ESP_LOGD(TAG, "Closing least recently used socket %d", lru->fd);
+        CloseSession(server, lru);
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    struct timeval timeout = {server->config.recv_wait_timeout, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    timeout = {server->config.send_wait_timeout, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if(server->config.enable_so_linger) {
+        struct linger linger = {1, server->config.linger_timeout};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    }
+    if(server->config.keep_alive_enable) {
+        int enable = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+    }
+    const char* noDelay = getenv("HUMANESPHTTP_TCP_NODELAY");
+    if(noDelay != nullptr && strcmp(noDelay, "1") == 0) {
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+    std::unique_ptr<HostSession> session(new HostSession());
+    session->fd = fd;
+    session->send = DefaultSend;
+    session->recv = DefaultRecv;
+    session->lastUsed = ++server->lruCounter;
+    HostSession* added = session.get();
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        server->sessions.push_back(std::move(session));
+    }
+    if(server->config.open_fn != nullptr && server->config.open_fn(server, fd) != ESP_OK) {
+        CloseSession(server, added);
+    }
+}
+
+/**
+ * Run queued work and close requested sessions (server thread only)
+ */
+static void ProcessControl(HostServer* server) {
+    char buffer[64];
+    while(read(server->wakeFds[0], buffer, sizeof(buffer)) > 0) {
+    }
+    std::vector<std::pair<httpd_work_fn_t, void*>> work;
+    std::vector<int> closeRequests;
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        work.swap(server->work);
+        closeRequests.swap(server->closeRequests);
+    }
+    for(const auto& item : work) {
+        item.first(item.second);
+    }
+    for(int fd : closeRequests) {
+        HostSession* session = FindSession(server, fd);
+        if(session == nullptr) {
+            continue;
+        }
+        if(session->asyncRequests > 0) {
+            session->closeRequested = true;
+        } else {
+            CloseSession(server, session);
+        }
+    }
+    // Sessions whose async request completed
+    std::vector<HostSession*> finished;
+    for(const auto& session : server->sessions) {
+        if(session->closeRequested && session->asyncRequests == 0) {
+            finished.push_back(session.get());
+        }
+    }
+    for(HostSession* session : finished) {
+        CloseSession(server, session);
+    }
+}
+
+static void ServerThread(HostServer* server) {
+    while(server->running) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(server->wakeFds[0], &readSet);
+        int maxFd = server->wakeFds[0];
+        bool dataPending = false;
+        bool canAccept = server->sessions.size() < server->config.max_open_sockets;
+        for(const auto& session : server->sessions) {
+            if(session->asyncRequests > 0) {
+                continue;
+            }
+            canAccept = canAccept || server->config.lru_purge_enable;
+            FD_SET(session->fd, &readSet);
+            maxFd = std::max(maxFd, session->fd);
+            dataPending = dataPending || !session->unread.empty()
+                || (session->pending != nullptr && session->pending(server, session->fd) > 0);
+        }
+        if(canAccept) {
+            FD_SET(server->listenFd, &readSet);
+            maxFd = std::max(maxFd, server->listenFd);
+        }
+        struct timeval noWait = {0, 0};
+        int ready = select(maxFd + 1, &readSet, nullptr, nullptr, dataPending ? &noWait : nullptr);
+        if(ready < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "select() failed: %s", strerror(errno));
+            break;
+        }
+        if(FD_ISSET(server->wakeFds[0], &readSet)) {
+            ProcessControl(server);
+        }
+        // Handlers may open and close sessions, so process a snapshot
+        std::vector<int> readable;
+        for(const auto& session : server->sessions) {
+            if(session->asyncRequests > 0) {
+                continue;
+            }
+            bool pending = !session->unread.empty()
+                || (session->pending != nullptr && session->pending(server, session->fd) > 0);
+            if(pending || FD_ISSET(session->fd, &readSet)) {
+                readable.push_back(session->fd);
+            }
+        }
+        for(int fd : readable) {
+            HostSession* session = FindSession(server, fd);
+            if(session != nullptr && session->asyncRequests == 0) {
+                ProcessRequest(server, session);
+            }
+        }
+        if(canAccept && FD_ISSET(server->listenFd, &readSet)) {
+            Accept(server);
+        }
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config) {
+    if(handle == nullptr || config == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostServer* server = new HostServer();
+    server->config = *config;
+    // Ports below 1024 usually need root on the host
+    const char* port = getenv("HUMANESPHTTP_PORT");
+    if(port != nullptr) {
+        server->config.server_port = (uint16_t)atoi(port);
+    }
+    server->handlers.resize(server->config.max_uri_handlers);
+    signal(SIGPIPE, SIG_IGN);
+
+    server->listenFd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int family = AF_INET6;
+    if(server->listenFd < 0) {
+        family = AF_INET;
+        server->listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+    if(server->listenFd < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: %s", strerror(errno));
+        delete server;
+        return ESP_FAIL;
+    }
+    int enable = 1;
+    setsockopt(server->listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    int bound;
+    if(family == AF_INET6) {
+        int v6Only = 0;
+        setsockopt(server->listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &v6Only, sizeof(v6Only));
+        struct sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(server->config.server_port);
+        bound = bind(server->listenFd, (struct sockaddr*)&address, sizeof(address));
+    } else {
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(server->config.server_port);
+        bound = bind(server->listenFd, (struct sockaddr*)&address, sizeof(address));
+    }
+    if(bound != 0 || listen(server->listenFd, server->config.backlog_conn) != 0 || pipe(server->wakeFds) != 0) {
+        ESP_LOGE(TAG, "Failed to listen on port %u: %s", (unsigned)server->config.server_port, strerror(errno));
+        close(server->listenFd);
+        delete server;
+        return ESP_FAIL;
+    }
+    fcntl(server->wakeFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(server->wakeFds[1], F_SETFL, O_NONBLOCK);
+    ESP_LOGI(TAG, "Started server on port %u", (unsigned)server->config.server_port);
+    server->running = true;
+    server->thread = std::thread(ServerThread, server);
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    HostServer* server = ToServer(handle);
+    if(server == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    server->running = false;
+    Wake(server);
+    server->thread.join();
+    while(!server->sessions.empty()) {
+        CloseSession(server, server->sessions.back().get());
+    }
+    close(server->listenFd);
+    close(server->wakeFds[0]);
+    close(server->wakeFds[1]);
+    FreeContext(server->config.global_user_ctx, server->config.global_user_ctx_free_fn);
+    FreeContext(server->config.global_transport_ctx, server->config.global_transport_ctx_free_fn);
+    delete server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    HostServer* server = ToServer(handle);
+    if(server == nullptr || uri_handler == nullptr || uri_handler->uri == nullptr || uri_handler->handler == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(server->mutex);
+    for(const auto& slot : server->handlers) {
+        if(slot != nullptr && slot->uri == uri_handler->uri && slot->handler.method == uri_handler->method) {
+            ESP_LOGW(TAG, "Handler %s already registered", uri_handler->uri);
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    for(auto& slot : server->handlers) {
+        if(slot == nullptr) {
+            // Like ESP-IDF, the URI is copied
+            slot.reset(new HostHandler{uri_handler->uri, *uri_handler});
+            return ESP_OK;
+        }
+    }
+    ESP_LOGW(TAG, "No slot left for handler %s (max_uri_handlers = %u)", uri_handler->uri,
+             (unsigned)server->config.max_uri_handlers);
+    return ESP_ERR_HTTPD_HANDLERS_FULL;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle, const char* uri, httpd_method_t method) {
+    HostServer* server = ToServer(handle);
+    if(server == nullptr || uri == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(server->mutex);
+    for(auto& slot : server->handlers) {
+        if(slot != nullptr && slot->uri == uri && slot->handler.method == method) {
+            slot.reset();
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_unregister_uri(httpd_handle_t handle, const char* uri) {
+    HostServer* server = ToServer(handle);
+    if(server == nullptr || uri == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool found = false;
+    std::lock_guard<std::mutex> lock(server->mutex);
+    for(auto& slot : server->handlers) {
+        if(slot != nullptr && slot->uri == uri) {
+            slot.reset();
+            found = true;
+        }
+    }
+    return found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+bool httpd_uri_match_wildcard(const char* uri_template, const char* uri_to_match, size_t match_upto) {
+    const size_t templateLength = strlen(uri_template);
+    const char last = templateLength > 0 ? uri_template[templateLength - 1] : 0;
+    const char prevLast = templateLength > 1 ? uri_template[templateLength - 2] : 0;
+    const bool asterisk = last == '*' || (prevLast == '*' && last == '?');
+    const bool quest = last == '?' || (prevLast == '?' && last == '*');
+    size_t exactChars = templateLength;
+    if(exactChars < (size_t)(asterisk + quest * 2)) {
+        return false;
+    }
+    exactChars -= asterisk + quest * 2;
+    if(match_upto < exactChars) {
+        return false;
+    }
+    if(!quest) {
+        if(!asterisk && match_upto != exactChars) {
+            return false;
+        }
+        return strncmp(uri_template, uri_to_match, exactChars) == 0;
+    }
+    if(match_upto > exactChars && uri_template[exactChars] != uri_to_match[exactChars]) {
+        return false; // The optional character differs
+    }
+    if(strncmp(uri_template, uri_to_match, exactChars) != 0) {
+        return false;
+    }
+    return asterisk || match_upto <= exactChars + 1;
+}
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    if(r == nullptr || buf == nullptr) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    HostRequestAux* aux = ToAux(r);
+    buf_len = std::min(buf_len, aux->remaining);
+    if(buf_len == 0) {
+        return 0;
+    }
+    // Data received together with the head first, then one receive for the rest (like ESP-IDF)
+    std::string& unread = aux->session->unread;
+    size_t pendingLength = std::min(buf_len, unread.size());
+    memcpy(buf, unread.data(), pendingLength);
+    unread.erase(0, pendingLength);
+    int ret = (int)pendingLength;
+    if(pendingLength < buf_len) {
+        int received = Receive(ToServer(r->handle), aux->session, buf + pendingLength, buf_len - pendingLength);
+        if(received < 0) {
+            if(pendingLength == 0) {
+                return received;
+            }
+        } else {
+            ret += received;
+            if(received == 0 && pendingLength == 0) {
+                return HTTPD_SOCK_ERR_FAIL; // Connection closed before the end of the body
+            }
+        }
+    }
+    aux->remaining -= ret;
+    return ret;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t* r, const char* field) {
+    if(r == nullptr || field == nullptr) {
+        return 0;
+    }
+    const char* value = HeaderValue(ToAux(r), field);
+    return value == nullptr ? 0 : strlen(value);
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r, const char* field, char* val, size_t val_size) {
+    if(r == nullptr || field == nullptr || val == nullptr || val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char* value = HeaderValue(ToAux(r), field);
+    if(value == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t length = strlen(value);
+    size_t copied = std::min(length, val_size - 1);
+    memcpy(val, value, copied);
+    val[copied] = '\0';
+    return copied < length ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+// Like ESP-IDF, the query is located using the offsets parsed from the URI as received,
+// not by searching r->uri (which may have been changed, e.g. for batch sub-requests)
+size_t httpd_req_get_url_query_len(httpd_req_t* r) {
+    if(r == nullptr || r->aux == nullptr) {
+        return 0;
+    }
+    return ToAux(r)->hasQuery ? ToAux(r)->queryLength : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len) {
+    if(r == nullptr || r->aux == nullptr || buf == nullptr || buf_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostRequestAux* aux = ToAux(r);
+    if(!aux->hasQuery) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // strlcpy() from r->uri + offset, as in ESP-IDF
+    const char* query = r->uri + aux->queryOffset;
+    size_t minLength = aux->queryLength + 1;
+    size_t limit = std::min(buf_len, minLength) - 1;
+    size_t copied = strnlen(query, limit);
+    memcpy(buf, query, copied);
+    buf[copied] = '\0';
+    return buf_len < minLength ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val, size_t val_size) {
+    if(qry == nullptr || key == nullptr || val == nullptr || val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t keyLength = strlen(key);
+    const char* pair = qry;
+    while(*pair != '\0') {
+        size_t pairLength = strcspn(pair, "&");
+        if(pairLength > keyLength && strncmp(pair, key, keyLength) == 0 && pair[keyLength] == '=') {
+            size_t length = pairLength - keyLength - 1;
+            size_t copied = std::min(length, val_size - 1);
+            memcpy(val, pair + keyLength + 1, copied);
+            val[copied] = '\0';
+            return copied < length ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        pair += pairLength;
+        if(*pair == '&') {
+            pair++;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r) {
+    if(r == nullptr || r->aux == nullptr) {
+        return -1;
+    }
+    return ToAux(r)->session->fd;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t* r, httpd_req_t** out) {
+    if(r == nullptr || out == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    httpd_req_t* copy = static_cast<httpd_req_t*>(malloc(sizeof(httpd_req_t)));
+    if(copy == nullptr) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(static_cast<void*>(copy), r, sizeof(httpd_req_t));
+    HostRequestAux* aux = ToAux(r);
+    copy->aux = new HostRequestAux(*aux);
+    aux->handedOff = true;
+    aux->remaining = 0;
+    HostServer* server = ToServer(r->handle);
+    std::lock_guard<std::mutex> lock(server->mutex);
+    aux->session->asyncRequests++;
+    *out = copy;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t* r) {
+    if(r == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostServer* server = ToServer(r->handle);
+    HostRequestAux* aux = ToAux(r);
+    bool keepOpen = aux->keepAlive && DiscardBody(r);
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        aux->session->asyncRequests--;
+        if(!keepOpen) {
+            aux->session->closeRequested = true;
+        }
+    }
+    FreeRequest(r);
+    Wake(server); // Poll the socket again
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    if(r == nullptr || status == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ToAux(r)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    if(r == nullptr || type == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ToAux(r)->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value) {
+    if(r == nullptr || field == nullptr || value == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostRequestAux* aux = ToAux(r);
+    if(aux->responseHeaders.size() >= ToServer(r->handle)->config.max_resp_headers) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    aux->responseHeaders.emplace_back(field, value);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    if(r == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf == nullptr ? 0 : strlen(buf);
+    }
+    HostRequestAux* aux = ToAux(r);
+    // ESP-IDF formats the status line into the buffer holding the request headers
+    aux->headers.clear();
+    char head[HTTPD_MAX_REQ_HDR_LEN + 1];
+    int headLength = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n",
+                              aux->status, aux->type, (int)buf_len);
+    if(headLength < 0 || (size_t)headLength >= sizeof(head)) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    if(SendAll(r, head, headLength) != ESP_OK || SendHeaders(r) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if(buf != nullptr && buf_len > 0 && SendAll(r, buf, buf_len) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    if(r == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf == nullptr ? 0 : strlen(buf);
+    }
+    HostRequestAux* aux = ToAux(r);
+    if(!aux->firstChunkSent) {
+        aux->headers.clear();
+        char head[HTTPD_MAX_REQ_HDR_LEN + 1];
+        int headLength = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n",
+                                  aux->status, aux->type);
+        if(headLength < 0 || (size_t)headLength >= sizeof(head)) {
+            return ESP_ERR_HTTPD_RESP_HDR;
+        }
+        if(SendAll(r, head, headLength) != ESP_OK || SendHeaders(r) != ESP_OK) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        aux->firstChunkSent = true;
+    }
+    char sizeLine[16];
+    snprintf(sizeLine, sizeof(sizeLine), "%x\r\n", (unsigned)buf_len);
+    if(SendString(r, sizeLine) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    if(buf != nullptr && buf_len > 0 && SendAll(r, buf, buf_len) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return SendString(r, "\r\n");
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg) {
+    const char* status;
+    const char* defaultMessage;
+    switch(error) {
+        case HTTPD_501_METHOD_NOT_IMPLEMENTED:
+            status = "501 Method Not Implemented";
+            defaultMessage = "Server does not support this method";
+            break;
+        case HTTPD_505_VERSION_NOT_SUPPORTED:
+            status = "505 Version Not Supported";
+            defaultMessage = "HTTP version not supported by server";
+            break;
+        case HTTPD_400_BAD_REQUEST:
+            status = "400 Bad Request";
+            defaultMessage = "Bad request syntax";
+            break;
+        case HTTPD_401_UNAUTHORIZED:
+            status = "401 Unauthorized";
+            defaultMessage = "No permission -- see authorization schemes";
+            break;
+        case HTTPD_403_FORBIDDEN:
+            status = "403 Forbidden";
+            defaultMessage = "Request forbidden -- authorization will not help";
+            break;
+        case HTTPD_404_NOT_FOUND:
+            status = "404 Not Found";
+            defaultMessage = "Nothing matches the given URI";
+            break;
+        case HTTPD_405_METHOD_NOT_ALLOWED:
+            status = "405 Method Not Allowed";
+            defaultMessage = "Specified method is invalid for this resource";
+            break;
+        case HTTPD_408_REQ_TIMEOUT:
+            status = "408 Request Timeout";
+            defaultMessage = "Server closed this connection";
+            break;
+        case HTTPD_411_LENGTH_REQUIRED:
+            status = "411 Length Required";
+            defaultMessage = "Chunked encoding not supported";
+            break;
+        case HTTPD_414_URI_TOO_LONG:
+            status = "414 URI Too Long";
+            defaultMessage = "URI is too long";
+            break;
+        case HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE:
+            status = "431 Request Header Fields Too Large";
+            defaultMessage = "Header fields are too long";
+            break;
+        default:
+            status = "500 Internal Server Error";
+            defaultMessage = "Server has encountered an unexpected error";
+            break;
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+#ifdef CONFIG_HTTPD_ERR_RESP_NO_DELAY
+    // Like ESP-IDF, disable Nagle's algorithm so the error goes out before the socket is closed
+    int fd = httpd_req_to_sockfd(req);
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+#endif
+    esp_err_t ret = httpd_resp_send(req, msg != nullptr ? msg : defaultMessage, HTTPD_RESP_USE_STRLEN);
+#ifdef CONFIG_HTTPD_ERR_RESP_NO_DELAY
+    noDelay = 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+#endif
+    return ret;
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+esp_err_t httpd_ws_recv_frame(httpd_req_t* req, httpd_ws_frame_t* pkt, size_t max_len) {
+    if(req == nullptr || req->aux == nullptr || pkt == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostServer* server = ToServer(req->handle);
+    HostRequestAux* aux = ToAux(req);
+    // Like ESP-IDF, the header is read by the first call (with len 0), the payload by the next
+    if(pkt->len == 0) {
+        pkt->type = (httpd_ws_type_t)aux->wsType;
+        pkt->final = aux->wsFinal;
+        uint8_t second;
+        if(!ReceiveAll(server, aux->session, &second, 1)) {
+            return ESP_FAIL;
+        }
+        uint64_t length = second & 0x7F;
+        if(length >= 126) {
+            uint8_t bytes[8];
+            size_t count = length == 126 ? 2 : 8;
+            if(!ReceiveAll(server, aux->session, bytes, count)) {
+                return ESP_FAIL;
+            }
+            length = 0;
+            for(size_t i = 0; i < count; i++) {
+                length = (length << 8) | bytes[i];
+            }
+        }
+        pkt->len = (size_t)length;
+        // Client frames must be masked (RFC 6455 section 5.2)
+        if(!(second & 0x80)) {
+            ESP_LOGW(TAG, "WebSocket frame is not masked");
+            return ESP_ERR_INVALID_STATE;
+        }
+        if(!ReceiveAll(server, aux->session, aux->wsMask, sizeof(aux->wsMask))) {
+            return ESP_FAIL;
+        }
+    }
+    if(pkt->len > max_len) {
+        if(max_len == 0) {
+            return ESP_OK; // Only the length was asked for
+        }
+        ESP_LOGW(TAG, "WebSocket message too long");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if(pkt->len == 0) {
+        return ESP_OK;
+    }
+    if(pkt->payload == nullptr) {
+        return ESP_FAIL;
+    }
+    if(!ReceiveAll(server, aux->session, pkt->payload, pkt->len)) {
+        return ESP_FAIL;
+    }
+    for(size_t i = 0; i < pkt->len; i++) {
+        pkt->payload[i] ^= aux->wsMask[i % 4];
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t* req, httpd_ws_frame_t* pkt) {
+    if(req == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return httpd_ws_send_frame_async(req->handle, httpd_req_to_sockfd(req), pkt);
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t* frame) {
+    if(frame == nullptr || (frame->len > 0 && frame->payload == nullptr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Server frames are not masked
+    char header[10];
+    size_t headerLength = 2;
+    header[0] = (char)((frame->fragmented ? 0 : 0x80) | frame->type);
+    if(frame->len < 126) {
+        header[1] = (char)frame->len;
+    } else if(frame->len <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = (char)(frame->len >> 8);
+        header[3] = (char)frame->len;
+        headerLength = 4;
+    } else {
+        header[1] = 127;
+        for(int i = 0; i < 8; i++) {
+            header[2 + i] = (char)((uint64_t)frame->len >> (56 - i * 8));
+        }
+        headerLength = 10;
+    }
+    // Like ESP-IDF: the header in one send, the payload until it has been sent
+    if(httpd_socket_send(hd, fd, header, headerLength, 0) < 0) {
+        return ESP_FAIL;
+    }
+    size_t sent = 0;
+    while(sent < frame->len) {
+        int ret = httpd_socket_send(hd, fd, (const char*)frame->payload + sent, frame->len - sent, 0);
+        if(ret < 0) {
+            return ESP_FAIL;
+        }
+        sent += ret;
+    }
+    return ESP_OK;
+}
+#endif
+
+int httpd_send(httpd_req_t* r, const char* buf, size_t buf_len) {
+    if(r == nullptr || r->aux == nullptr || buf == nullptr) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    HostServer* server = ToServer(r->handle);
+    HostSession* session = ToAux(r)->session;
+    httpd_send_func_t sendFunction;
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        sendFunction = session->send;
+    }
+    return sendFunction(server, session->fd, buf, buf_len, 0);
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char* buf, size_t buf_len, int flags) {
+    HostServer* server = ToServer(hd);
+    httpd_send_func_t sendFunction = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        HostSession* session = FindSession(server, sockfd);
+        if(session != nullptr) {
+            sendFunction = session->send;
+        }
+    }
+    if(sendFunction == nullptr) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    return sendFunction(hd, sockfd, buf, buf_len, flags);
+}
+
+int httpd_socket_recv(httpd_handle_t hd, int sockfd, char* buf, size_t buf_len, int flags) {
+    HostServer* server = ToServer(hd);
+    httpd_recv_func_t recvFunction = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        HostSession* session = FindSession(server, sockfd);
+        if(session != nullptr) {
+            recvFunction = session->recv;
+        }
+    }
+    if(recvFunction == nullptr) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    return recvFunction(hd, sockfd, buf, buf_len, flags);
+}
+
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func) {
+    HostServer* server = ToServer(hd);
+    std::lock_guard<std::mutex> lock(server->mutex);
+    HostSession* session = FindSession(server, sockfd);
+    if(session == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    session->send = send_func != nullptr ? send_func : DefaultSend;
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_recv_override(httpd_handle_t hd, int sockfd, httpd_recv_func_t recv_func) {
+    HostServer* server = ToServer(hd);
+    std::lock_guard<std::mutex> lock(server->mutex);
+    HostSession* session = FindSession(server, sockfd);
+    if(session == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    session->recv = recv_func != nullptr ? recv_func : DefaultRecv;
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_pending_override(httpd_handle_t hd, int sockfd, httpd_pending_func_t pending_func) {
+    HostServer* server = ToServer(hd);
+    std::lock_guard<std::mutex> lock(server->mutex);
+    HostSession* session = FindSession(server, sockfd);
+    if(session == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    session->pending = pending_func;
+    return ESP_OK;
+}
+
+void* httpd_sess_get_ctx(httpd_handle_t handle, int sockfd) {
+    HostServer* server = ToServer(handle);
+    std::lock_guard<std::mutex> lock(server->mutex);
+    HostSession* session = FindSession(server, sockfd);
+    if(session == nullptr) {
+        return nullptr;
+    }
+    // Like ESP-IDF, the context of the request being handled takes precedence
+    httpd_req_t* current = server->current;
+    if(current != nullptr && ToAux(current)->session == session) {
+        return current->sess_ctx;
+    }
+    return session->ctx;
+}
+
+void httpd_sess_set_ctx(httpd_handle_t handle, int sockfd, void* ctx, httpd_free_ctx_fn_t free_fn) {
+    HostServer* server = ToServer(handle);
+    void* previous = nullptr;
+    httpd_free_ctx_fn_t previousFree = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        HostSession* session = FindSession(server, sockfd);
+        if(session == nullptr) {
+            return;
+        }
+        httpd_req_t* current = server->current;
+        void** target = &session->ctx;
+        httpd_free_ctx_fn_t* targetFree = &session->freeCtx;
+        if(current != nullptr && ToAux(current)->session == session) {
+            target = &current->sess_ctx;
+            targetFree = &current->free_ctx;
+        }
+        if(*target != ctx) {
+            previous = *target;
+            previousFree = *targetFree;
+        }
+        *target = ctx;
+        *targetFree = free_fn;
+    }
+    FreeContext(previous, previousFree);
+}
+
+void* httpd_sess_get_transport_ctx(httpd_handle_t handle, int sockfd) {
+    HostServer* server = ToServer(handle);
+    std::lock_guard<std::mutex> lock(server->mutex);
+    HostSession* session = FindSession(server, sockfd);
+    return session != nullptr ? session->transportCtx : nullptr;
+}
+
+void httpd_sess_set_transport_ctx(httpd_handle_t handle, int sockfd, void* ctx, httpd_free_ctx_fn_t free_fn) {
+    HostServer* server = ToServer(handle);
+    void* previous = nullptr;
+    httpd_free_ctx_fn_t previousFree = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        HostSession* session = FindSession(server, sockfd);
+        if(session == nullptr) {
+            return;
+        }
+        if(session->transportCtx != ctx) {
+            previous = session->transportCtx;
+            previousFree = session->freeTransportCtx;
+        }
+        session->transportCtx = ctx;
+        session->freeTransportCtx = free_fn;
+    }
+    FreeContext(previous, previousFree);
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    HostServer* server = ToServer(handle);
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        if(FindSession(server, sockfd) == nullptr) {
+            return ESP_ERR_NOT_FOUND;
+        }
+        server->closeRequests.push_back(sockfd);
+    }
+    Wake(server);
+    return ESP_OK;
+}
+
+void* httpd_get_global_user_ctx(httpd_handle_t handle) {
+    return ToServer(handle)->config.global_user_ctx;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void* arg) {
+    HostServer* server = ToServer(handle);
+    if(server == nullptr || work == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!server->running) {
+        return ESP_FAIL;
+    }
+    {
+        std::lock_guard<std::mutex> lock(server->mutex);
+        server->work.emplace_back(work, arg);
+    }
+    Wake(server);
+    return ESP_OK;
+}
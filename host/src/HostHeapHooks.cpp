@@ -0,0 +1,68 @@
+#include <esp_heap_caps.h>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Heap allocation hooks (CONFIG_HEAP_USE_HOOKS) on the host:
+ * replaces malloc() & co. of the C library, calling the weak hook functions
+ * the program may define, like the ESP-IDF heap does.
+ *
+ * Only linked into targets using humanesphttp-heap-hooks (not into the library),
+ * as it doesn't combine with sanitizers or other malloc replacements.
+ */
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+__attribute__((weak)) void esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps) {
+    (void)ptr;
+    (void)size;
+    (void)caps;
+}
+
+__attribute__((weak)) void esp_heap_trace_free_hook(void* ptr) {
+    (void)ptr;
+}
+
+void* malloc(size_t size) {
+    void* ptr = __libc_malloc(size);
+    if(ptr != nullptr) {
+        esp_heap_trace_alloc_hook(ptr, size, MALLOC_CAP_DEFAULT);
+    }
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size) {
+    void* ptr = __libc_calloc(count, size);
+    if(ptr != nullptr) {
+        esp_heap_trace_alloc_hook(ptr, count * size, MALLOC_CAP_DEFAULT);
+    }
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    // Like heap_caps_realloc(): the old block is freed, a new one allocated
+    void* result = __libc_realloc(ptr, size);
+    if(result != nullptr || size == 0) {
+        if(ptr != nullptr) {
+            esp_heap_trace_free_hook(ptr);
+        }
+        if(result != nullptr) {
+            esp_heap_trace_alloc_hook(result, size, MALLOC_CAP_DEFAULT);
+        }
+    }
+    return result;
+}
+
+void free(void* ptr) {
+    if(ptr != nullptr) {
+        esp_heap_trace_free_hook(ptr);
+    }
+    __libc_free(ptr);
+}
+
+}
@@ -0,0 +1,360 @@
+#include <esp_err.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <http_parser.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <pthread.h>
+
+/*
+ * Host implementations of the ESP-IDF and FreeRTOS functions used by HumanESPHTTP
+ * besides esp_http_server (see HostHTTPD.cpp)
+ */
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+/* Logging */
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    (void)tag;
+    static const int maxLevel = []() {
+        const char* value = getenv("HUMANESPHTTP_LOG_LEVEL");
+        return value != nullptr ? atoi(value) : (int)ESP_LOG_WARN;
+    }();
+    if((int)level > maxLevel) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch(code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_HTTPD_HANDLERS_FULL: return "ESP_ERR_HTTPD_HANDLERS_FULL";
+        case ESP_ERR_HTTPD_HANDLER_EXISTS: return "ESP_ERR_HTTPD_HANDLER_EXISTS";
+        case ESP_ERR_HTTPD_INVALID_REQ: return "ESP_ERR_HTTPD_INVALID_REQ";
+        case ESP_ERR_HTTPD_RESULT_TRUNC: return "ESP_ERR_HTTPD_RESULT_TRUNC";
+        case ESP_ERR_HTTPD_RESP_HDR: return "ESP_ERR_HTTPD_RESP_HDR";
+        case ESP_ERR_HTTPD_RESP_SEND: return "ESP_ERR_HTTPD_RESP_SEND";
+        case ESP_ERR_HTTPD_ALLOC_MEM: return "ESP_ERR_HTTPD_ALLOC_MEM";
+        case ESP_ERR_HTTPD_TASK: return "ESP_ERR_HTTPD_TASK";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+void esp_error_check_failed(esp_err_t rc, const char* file, int line, const char* expression) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nexpression: %s\n",
+            rc, esp_err_to_name(rc), file, line, expression);
+    abort();
+}
+
+const char* http_method_str(enum http_method m) {
+    static const char* names[] = {
+#define XX(num, name, string) #string,
+        HTTP_METHOD_MAP(XX)
+#undef XX
+    };
+    if((unsigned)m >= sizeof(names) / sizeof(names[0])) {
+        return "<unknown>";
+    }
+    return names[m];
+}
+
+/* esp_timer: all callbacks run on one timer thread, like the ESP_TIMER_TASK dispatch */
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    int64_t dueUs = 0;
+    uint64_t periodUs = 0;
+    bool active = false;
+    bool deleted = false;
+};
+
+// Never destroyed: the detached timer thread still waits on them during static destruction
+static std::mutex& timerMutex = *new std::mutex();
+static std::condition_variable& timerCondition = *new std::condition_variable();
+static std::vector<esp_timer*>& timers = *new std::vector<esp_timer*>();
+static esp_timer* dispatchedTimer = nullptr; // Callback running right now
+
+int64_t esp_timer_get_time(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+static void TimerThread() {
+    std::unique_lock<std::mutex> lock(timerMutex);
+    for(;;) {
+        esp_timer* next = nullptr;
+        for(esp_timer* timer : timers) {
+            if(timer->active && (next == nullptr || timer->dueUs < next->dueUs)) {
+                next = timer;
+            }
+        }
+        if(next == nullptr) {
+            timerCondition.wait(lock);
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        if(next->dueUs > now) {
+            timerCondition.wait_for(lock, std::chrono::microseconds(next->dueUs - now));
+            continue;
+        }
+        if(next->periodUs > 0) {
+            next->dueUs += next->periodUs;
+        } else {
+            next->active = false;
+        }
+        dispatchedTimer = next;
+        lock.unlock();
+        next->callback(next->arg);
+        lock.lock();
+        dispatchedTimer = nullptr;
+        if(next->deleted) {
+            delete next;
+        }
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle) {
+    if(args == nullptr || args->callback == nullptr || out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    static std::once_flag started;
+    std::call_once(started, []() {
+        std::thread(TimerThread).detach();
+    });
+    esp_timer* timer = new esp_timer{args->callback, args->arg};
+    std::lock_guard<std::mutex> lock(timerMutex);
+    timers.push_back(timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t StartTimer(esp_timer_handle_t timer, uint64_t timeoutUs, bool periodic) {
+    if(timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if(timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->dueUs = esp_timer_get_time() + (int64_t)timeoutUs;
+    timer->periodUs = periodic ? timeoutUs : 0;
+    timerCondition.notify_one();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return StartTimer(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return StartTimer(timer, period, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if(timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if(!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if(timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if(timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timers.erase(std::remove(timers.begin(), timers.end(), timer), timers.end());
+    if(timer == dispatchedTimer) {
+        timer->deleted = true; // Deleted from its own callback, free it afterwards
+    } else {
+        delete timer;
+    }
+    return ESP_OK;
+}
+
+/* FreeRTOS tasks and queues */
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize,
+                                   void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    (void)name;
+    (void)stackSize;
+    (void)priority;
+    (void)core;
+    std::thread(function, arg).detach();
+    if(handle != nullptr) {
+        *handle = nullptr;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackSize,
+                       void* arg, UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stackSize, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if(task != nullptr) {
+        fprintf(stderr, "vTaskDelete() only supports deleting the calling task\n");
+        abort();
+    }
+    pthread_exit(nullptr);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+struct QueueDefinition {
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::vector<char> items;
+    UBaseType_t itemSize;
+    UBaseType_t length;
+    UBaseType_t head = 0;
+    UBaseType_t count = 0;
+};
+
+/**
+ * Wait until the predicate is true or the ticks have passed
+ */
+template<typename Predicate>
+static bool WaitFor(std::condition_variable& condition, std::unique_lock<std::mutex>& lock,
+                    TickType_t ticksToWait, Predicate predicate) {
+    if(ticksToWait == portMAX_DELAY) {
+        condition.wait(lock, predicate);
+        return true;
+    }
+    return condition.wait_for(lock, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS), predicate);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    if(length == 0) {
+        return nullptr;
+    }
+    QueueHandle_t queue = new QueueDefinition();
+    queue->items.resize((size_t)length * itemSize);
+    queue->itemSize = itemSize;
+    queue->length = length;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if(!WaitFor(queue->notFull, lock, ticksToWait, [queue]() { return queue->count < queue->length; })) {
+        return pdFALSE;
+    }
+    UBaseType_t index = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items.data() + (size_t)index * queue->itemSize, item, queue->itemSize);
+    queue->count++;
+    queue->notEmpty.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if(!WaitFor(queue->notEmpty, lock, ticksToWait, [queue]() { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.data() + (size_t)queue->head * queue->itemSize, queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->notFull.notify_one();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->count;
+}
+
+/* Heap */
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    (void)caps;
+    return mallinfo2().fordblks;
+}
+
+/* OTA: there is no flash to update */
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    (void)start_from;
+    return nullptr;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle) {
+    (void)partition;
+    (void)image_size;
+    (void)out_handle;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size) {
+    (void)handle;
+    (void)data;
+    (void)size;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    (void)handle;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    (void)handle;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    (void)partition;
+    return ESP_ERR_NOT_SUPPORTED;
+}
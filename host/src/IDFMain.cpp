@@ -0,0 +1,14 @@
+#include <cstdio>
+
+/*
+ * Entry point for ESP-IDF applications (app_main()) on the host.
+ * Unlike on the device, the program exits when app_main() returns.
+ */
+
+extern "C" void app_main(void);
+
+int main() {
+    app_main();
+    fflush(stdout);
+    return 0;
+}
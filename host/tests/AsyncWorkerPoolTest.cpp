@@ -0,0 +1,115 @@
+#include "TestSupport.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+/*
+ * AsyncWorkerPool through HTTPServer: while slow handlers keep the workers busy,
+ * the p99 latency of a fast endpoint stays flat. The same slow handler on the
+ * httpd task is measured as control, to show that the test would notice.
+ */
+
+static const int SlowMs = 100;
+
+static esp_err_t Fast(httpd_req_t *request, const RouteParams&) {
+    return httpd_resp_send(request, "fast", 4);
+}
+
+static esp_err_t Slow(httpd_req_t *request, const RouteParams&) {
+    vTaskDelay(pdMS_TO_TICKS(SlowMs));
+    return httpd_resp_send(request, "slow", 4);
+}
+
+/**
+ * Send at least the given number of sequential requests, for at least minMs milliseconds
+ * @return The p99 latency in microseconds
+ */
+static int64_t MeasureP99(uint16_t port, const char* uri, int requests, int minMs = 0) {
+    TestClient client(port);
+    std::vector<int64_t> latencies;
+    int64_t end = NowUs() + minMs * 1000;
+    for(int i = 0; i < requests || NowUs() < end; i++) {
+        int64_t start = NowUs();
+        HTTPResponse response = client.Get(uri);
+        latencies.push_back(NowUs() - start);
+        if(!CHECK_EQUAL(response.status, 200)) {
+            break;
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return latencies[(latencies.size() * 99 + 99) / 100 - 1];
+}
+
+/**
+ * Keeps requesting the given URI on several connections until stopped
+ */
+class BackgroundLoad {
+public:
+    BackgroundLoad(uint16_t port, const char* uri, int connections) {
+        for(int i = 0; i < connections; i++) {
+            threads.emplace_back([this, port, uri]() {
+                TestClient client(port, 10000);
+                while(!stop) {
+                    if(client.Get(uri).status == 200) {
+                        completed++;
+                    }
+                }
+            });
+        }
+        // Until every connection has a request in progress
+        vTaskDelay(pdMS_TO_TICKS(SlowMs / 2));
+    }
+
+    ~BackgroundLoad() {
+        stop = true;
+        for(std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::atomic<int> completed{0};
+
+private:
+    std::vector<std::thread> threads;
+    std::atomic<bool> stop{false};
+};
+
+int main() {
+    static AsyncWorkerPool workers(2, 8);
+    workers.Start();
+    HTTPServer http;
+    http.RegisterRoute(HTTP_GET, "/fast", Fast);
+    HandlerOptions options;
+    options.workers = &workers;
+    http.RegisterRoute(HTTP_GET, "/slow", Slow, nullptr, options);
+    http.RegisterRoute(HTTP_GET, "/slow-inline", Slow);
+    uint16_t port = StartTestServer(http);
+    if(port == 0) {
+        return 1;
+    }
+
+    int64_t idle = MeasureP99(port, "/fast", 500);
+    int64_t busy;
+    int slowCompleted;
+    {
+        BackgroundLoad load(port, "/slow", 4);
+        busy = MeasureP99(port, "/fast", 500, SlowMs * 5);
+        slowCompleted = load.completed;
+    }
+    int64_t blocked;
+    {
+        BackgroundLoad load(port, "/slow-inline", 2);
+        blocked = MeasureP99(port, "/fast", 10);
+    }
+    printf("fast p99: idle %.3f ms, slow handlers on workers %.3f ms (%d completed), on the httpd task %.3f ms\n",
+           idle / 1000.0, busy / 1000.0, slowCompleted, blocked / 1000.0);
+    // Flat: far below the duration of a slow handler
+    CHECK(busy < SlowMs * 1000 / 4);
+    CHECK(slowCompleted > 0);
+    // Control: a slow handler on the httpd task delays the fast endpoint
+    CHECK(blocked > SlowMs * 1000 / 2);
+
+    httpd_stop(http.server);
+    return TestResult();
+}
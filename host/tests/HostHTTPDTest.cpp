@@ -0,0 +1,121 @@
+#include "TestSupport.hpp"
+#include <cstring>
+
+/*
+ * Behaviour of the host esp_http_server which handlers rely on:
+ * query location, errors, keep-alive, request bodies and chunked responses.
+ */
+
+static esp_err_t Query(httpd_req_t *request) {
+    char query[64];
+    size_t length = httpd_req_get_url_query_len(request);
+    esp_err_t err = httpd_req_get_url_query_str(request, query, sizeof(query));
+    std::string response = std::to_string(length) + " " + (err == ESP_OK ? query : esp_err_to_name(err));
+    return httpd_resp_send(request, response.c_str(), response.size());
+}
+
+static esp_err_t TruncatedQuery(httpd_req_t *request) {
+    char query[4];
+    esp_err_t err = httpd_req_get_url_query_str(request, query, sizeof(query));
+    std::string response = std::string(query) + " " + esp_err_to_name(err);
+    return httpd_resp_send(request, response.c_str(), response.size());
+}
+
+static esp_err_t RewrittenQuery(httpd_req_t *request) {
+    // Like ESP-IDF, the query is found at the offset parsed from the URI as received
+    strcpy((char*)request->uri, "/REWRITE?b=2");
+    return Query(request);
+}
+
+static esp_err_t Echo(httpd_req_t *request) {
+    std::string body(request->content_len, '\0');
+    size_t received = 0;
+    while(received < body.size()) {
+        int ret = httpd_req_recv(request, &body[received], body.size() - received);
+        if(ret <= 0) {
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    return httpd_resp_send(request, body.data(), body.size());
+}
+
+static esp_err_t Chunked(httpd_req_t *request) {
+    httpd_resp_set_hdr(request, "X-Test", "chunked");
+    httpd_resp_send_chunk(request, "Hello ", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(request, "World", HTTPD_RESP_USE_STRLEN);
+    return httpd_resp_send_chunk(request, nullptr, 0);
+}
+
+/**
+ * Register a handler (ESP-IDF copies the handler struct)
+ */
+static void RegisterHandler(HTTPServer& http, const char* uri, httpd_method_t method,
+                            esp_err_t (*handler)(httpd_req_t *request)) {
+    httpd_uri_t handlerInfo = {};
+    handlerInfo.uri = uri;
+    handlerInfo.method = method;
+    handlerInfo.handler = handler;
+    http.RegisterHandler(&handlerInfo);
+}
+
+int main() {
+    HTTPServer http;
+    uint16_t port = StartTestServer(http);
+    if(port == 0) {
+        return 1;
+    }
+    RegisterHandler(http, "/query", HTTP_GET, Query);
+    RegisterHandler(http, "/truncated", HTTP_GET, TruncatedQuery);
+    RegisterHandler(http, "/rewrite", HTTP_GET, RewrittenQuery);
+    RegisterHandler(http, "/echo", HTTP_POST, Echo);
+    RegisterHandler(http, "/chunked", HTTP_GET, Chunked);
+
+    TestClient client(port);
+    CHECK(client.IsConnected());
+    // Query up to the fragment, keep-alive
+    HTTPResponse response = client.Get("/query?a=1&b=two#fragment");
+    CHECK_EQUAL(response.status, 200);
+    CHECK_EQUAL(response.body, "9 a=1&b=two");
+    response = client.Get("/query");
+    CHECK_EQUAL(response.body, "0 ESP_ERR_NOT_FOUND");
+    response = client.Get("/query?");
+    CHECK_EQUAL(response.body, "0 ");
+    response = client.Get("/truncated?abcdef");
+    CHECK_EQUAL(response.body, "abc ESP_ERR_HTTPD_RESULT_TRUNC");
+    response = client.Get("/rewrite?a=1");
+    CHECK_EQUAL(response.body, "3 b=2");
+
+    // Body and chunked response on the same connection
+    response = client.Request("POST", "/echo", "Hello body");
+    CHECK_EQUAL(response.status, 200);
+    CHECK_EQUAL(response.body, "Hello body");
+    response = client.Get("/chunked");
+    CHECK(response.chunked);
+    CHECK_EQUAL(response.body, "Hello World");
+    CHECK(response.Header("X-Test") != nullptr && strcmp(response.Header("X-Test"), "chunked") == 0);
+
+    // Unmatched requests are answered and the connection is closed
+    response = client.Get("/missing");
+    CHECK_EQUAL(response.status, 404);
+    CHECK(client.WaitForClose());
+    TestClient methodClient(port);
+    response = methodClient.Request("POST", "/query", "x");
+    CHECK_EQUAL(response.status, 405);
+    CHECK(methodClient.WaitForClose());
+
+    // Heads over HTTPD_MAX_REQ_HDR_LEN
+    TestClient longClient(port);
+    response = longClient.Get("/query", "X-Long: " + std::string(HTTPD_MAX_REQ_HDR_LEN, 'x') + "\r\n");
+    CHECK_EQUAL(response.status, 431);
+
+    // HTTP/1.0 closes the connection after the response
+    TestClient oldClient(port);
+    CHECK(oldClient.Send("GET /query?x=1 HTTP/1.0\r\n\r\n"));
+    response = oldClient.ReceiveResponse();
+    CHECK_EQUAL(response.body, "3 x=1");
+    CHECK(oldClient.WaitForClose());
+
+    httpd_stop(http.server);
+    return TestResult();
+}
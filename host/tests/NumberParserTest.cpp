@@ -0,0 +1,424 @@
+#include "TestSupport.hpp"
+#include <NumberParser.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Number parsing kernel: differential fuzzing against the C library's strto*()
+ * (correctly rounded in glibc) for every integer type, hex, float and double,
+ * bool and enums against their tables, and the time per value for each type.
+ */
+
+static const int Iterations = 100000;
+
+template<typename T>
+static std::string ToString(T value) {
+    if(std::is_floating_point<T>::value) {
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%.17g", (double)value);
+        return buf;
+    }
+    return std::to_string(+value);
+}
+
+/**
+ * Compare the result (error and bit pattern of the value) with the reference, print the input if different
+ */
+template<typename T>
+static bool SameResult(const std::string& input, ValueParseError error, T value,
+                       ValueParseError expectedError, T expected) {
+    bool same = error == expectedError
+        && (error != ValueParseError::None || memcmp(&value, &expected, sizeof(T)) == 0);
+    if(same) {
+        return true;
+    }
+    std::string message = "\"" + input + "\": " + ValueParseErrorToString(error) + " " + ToString(value)
+        + ", expected " + ValueParseErrorToString(expectedError) + " " + ToString(expected);
+    return CheckResult(false, message.c_str(), __FILE__, __LINE__);
+}
+
+/**
+ * The documented ParseInteger() behaviour in terms of strtoll()/strtoull()
+ */
+template<typename T>
+static ValueParseError ReferenceInteger(const std::string& input, unsigned base, T& out) {
+    if(input.empty()) {
+        return ValueParseError::Empty;
+    }
+    // strto*() skip whitespace and negate unsigned values instead of rejecting them
+    if(isspace((unsigned char)input[0]) || (!std::is_signed<T>::value && input[0] == '-')) {
+        return ValueParseError::Invalid;
+    }
+    char* end;
+    errno = 0;
+    bool inRange;
+    if(std::is_signed<T>::value) {
+        long long value = strtoll(input.c_str(), &end, base);
+        inRange = errno != ERANGE && value >= (long long)std::numeric_limits<T>::min()
+            && value <= (long long)std::numeric_limits<T>::max();
+        out = (T)value;
+    } else {
+        unsigned long long value = strtoull(input.c_str(), &end, base);
+        inRange = errno != ERANGE && value <= (unsigned long long)std::numeric_limits<T>::max();
+        out = (T)value;
+    }
+    if(end != input.c_str() + input.size()) {
+        return ValueParseError::Invalid;
+    }
+    return inRange ? ValueParseError::None : ValueParseError::OutOfRange;
+}
+
+static std::string RandomString(std::mt19937_64& random, const char* alphabet, size_t maxLength) {
+    size_t alphabetLength = strlen(alphabet);
+    std::string str(random() % (maxLength + 1), ' ');
+    for(char& c : str) {
+        c = alphabet[random() % alphabetLength];
+    }
+    return str;
+}
+
+/**
+ * @return Mostly well-formed integers of all magnitudes (around the limits of every type),
+ *         with signs, prefixes, leading zeros, extra digits and corrupted characters
+ */
+static std::string RandomInteger(std::mt19937_64& random, unsigned base) {
+    if(random() % 4 == 0) {
+        return RandomString(random, "0123456789abcdefABCDEFxX+- .", 24);
+    }
+    unsigned long long value = random() >> (random() % 64);
+    if(random() % 4 == 0) {
+        // Exactly at or next to a limit
+        static const unsigned long long limits[] = {0x7F, 0x80, 0xFF, 0x7FFF, 0x8000, 0xFFFF, 0x7FFFFFFF,
+                                                    0x80000000, 0xFFFFFFFF, 0x7FFFFFFFFFFFFFFF,
+                                                    0x8000000000000000, 0xFFFFFFFFFFFFFFFF};
+        value = limits[random() % 12] + (random() % 3) - 1;
+    }
+    char digits[32];
+    snprintf(digits, sizeof(digits), base == 16 ? (random() % 2 ? "%llx" : "%llX") : "%llu", value);
+    std::string str = digits;
+    if(random() % 8 == 0) {
+        str = std::string(random() % 4, '0') + str;
+    }
+    if(random() % 8 == 0) {
+        str += digits[0];
+    }
+    if(base == 16 && random() % 2) {
+        str = (random() % 2 ? "0x" : "0X") + str;
+    }
+    switch(random() % 4) {
+        case 0: str = "-" + str; break;
+        case 1: str = "+" + str; break;
+    }
+    if(random() % 16 == 0) {
+        str[random() % str.size()] = "+-x. g"[random() % 6];
+    }
+    return str;
+}
+
+template<typename T>
+static void FuzzInteger(const char* name, std::mt19937_64& random) {
+    for(unsigned base : {10u, 16u}) {
+        for(int i = 0; i < Iterations; i++) {
+            std::string input = RandomInteger(random, base);
+            T expected = 42;
+            ValueParseError expectedError = ReferenceInteger(input, base, expected);
+            // The output is only written on success
+            T value = 42;
+            ValueParseError error = base == 16 ? ParseHex(input.data(), input.size(), value)
+                                               : ParseValue(input.data(), input.size(), value);
+            if(expectedError != ValueParseError::None) {
+                expected = 42;
+            }
+            if(!SameResult(input, error, value, expectedError, expected)) {
+                fprintf(stderr, "%s, base %u\n", name, base);
+                return;
+            }
+        }
+    }
+}
+
+template<typename T> T ReferenceConvert(const char* str, char** end);
+template<> float ReferenceConvert<float>(const char* str, char** end) { return strtof(str, end); }
+template<> double ReferenceConvert<double>(const char* str, char** end) { return strtod(str, end); }
+
+/**
+ * The documented ParseFloat()/ParseDouble() behaviour in terms of strtof()/strtod(),
+ * for inputs made of digits, '.', 'e', 'E', '+' and '-' (where both accept the same syntax)
+ */
+template<typename T>
+static ValueParseError ReferenceFloat(const std::string& input, T& out) {
+    if(input.empty()) {
+        return ValueParseError::Empty;
+    }
+    char* end;
+    T value = ReferenceConvert<T>(input.c_str(), &end);
+    if(end != input.c_str() + input.size()) {
+        return ValueParseError::Invalid;
+    }
+    // Infinite, or rounded to zero although the mantissa isn't
+    size_t mantissaEnd = std::min(input.find_first_of("eE"), input.size());
+    bool nonZero = input.find_first_of("123456789") < mantissaEnd;
+    if(std::isinf(value) || (value == 0 && nonZero)) {
+        return ValueParseError::OutOfRange;
+    }
+    out = value;
+    return ValueParseError::None;
+}
+
+/**
+ * @return Decimal numbers of all shapes and magnitudes: round-trip representations,
+ *         halfway cases, long mantissas, subnormals, overflows and random syntax
+ */
+template<typename T>
+static std::string RandomFloat(std::mt19937_64& random) {
+    char buf[128];
+    switch(random() % 6) {
+        case 0:
+            return RandomString(random, "0123456789.eE+-", 16);
+        case 1: {
+            // Random bit patterns, shortest round trip or rounded to fewer digits
+            T value;
+            uint64_t bits = random();
+            memcpy(&value, &bits, sizeof(T));
+            if(!std::isfinite(value)) {
+                value = 1;
+            }
+            int digits = random() % 2 ? std::numeric_limits<T>::max_digits10 : (int)(random() % 20);
+            snprintf(buf, sizeof(buf), "%.*e", digits, (double)value);
+            return buf;
+        }
+        case 2: {
+            // Halfway between two neighbours (with an exact or slightly shortened decimal expansion)
+            T value = (T)std::ldexp((double)(random() % 100000 + 1) / 7, (int)(random() % 80) - 40);
+            long double halfway = ((long double)value + (long double)std::nextafter(value, (T)INFINITY)) / 2;
+            snprintf(buf, sizeof(buf), "%.*Le", (int)(random() % 2 ? 60 : random() % 30), halfway);
+            return buf;
+        }
+        default: {
+            // Query-like values, mostly within the exact fast path
+            std::string str = random() % 4 == 0 ? "-" : "";
+            str += std::to_string(random() >> (random() % 64 + (random() % 2 ? 0 : 40)));
+            if(random() % 2) {
+                size_t point = random() % (str.size() + 1);
+                if(point > 0 && str[point - 1] == '-') {
+                    point = str.size();
+                }
+                str.insert(point, ".");
+            }
+            if(random() % 3 == 0) {
+                str += (random() % 2 ? "e" : "E") + std::to_string((int)(random() % 700) - 350);
+            }
+            return str;
+        }
+    }
+}
+
+template<typename T>
+static void FuzzFloat(const char* name, std::mt19937_64& random) {
+    for(int i = 0; i < Iterations * 2; i++) {
+        std::string input = RandomFloat<T>(random);
+        T expected = 42;
+        ValueParseError expectedError = ReferenceFloat(input, expected);
+        T value = 42;
+        ValueParseError error = ParseValue(input.data(), input.size(), value);
+        if(!SameResult(input, error, value, expectedError, expected)) {
+            fprintf(stderr, "%s\n", name);
+            return;
+        }
+    }
+}
+
+static void FuzzBool(std::mt19937_64& random) {
+    static const char* const trueWords[] = {"true", "1", "on", "yes"};
+    static const char* const falseWords[] = {"false", "0", "off", "no"};
+    for(int i = 0; i < Iterations; i++) {
+        std::string input = RandomString(random, "truefalsonys01T", 5);
+        ValueParseError expectedError = input.empty() ? ValueParseError::Empty : ValueParseError::Invalid;
+        bool expected = false;
+        for(int word = 0; word < 4; word++) {
+            if(input == trueWords[word] || input == falseWords[word]) {
+                expectedError = ValueParseError::None;
+                expected = input == trueWords[word];
+            }
+        }
+        bool value = false;
+        ValueParseError error = ParseValue(input.data(), input.size(), value);
+        if(!SameResult(input, error, value, expectedError, expected)) {
+            return;
+        }
+    }
+}
+
+enum class Mode { Off, Auto, On, Manual };
+static constexpr EnumName<Mode> ModeNames[] = {{"off", Mode::Off}, {"auto", Mode::Auto},
+                                               {"on", Mode::On}, {"manual", Mode::Manual}};
+
+static void FuzzEnum(std::mt19937_64& random) {
+    for(int i = 0; i < Iterations; i++) {
+        std::string input = RandomString(random, "offautonmanl", 6);
+        ValueParseError expectedError = input.empty() ? ValueParseError::Empty : ValueParseError::UnknownName;
+        int expected = -1;
+        for(const EnumName<Mode>& entry : ModeNames) {
+            if(input == entry.name) {
+                expectedError = ValueParseError::None;
+                expected = (int)entry.value;
+            }
+        }
+        Mode mode = (Mode)-1;
+        ValueParseError error = ParseEnum(input.data(), input.size(), ModeNames, mode);
+        if(!SameResult(input, error, (int)mode, expectedError, expected)) {
+            return;
+        }
+    }
+}
+
+static volatile double sink = 0;
+
+/**
+ * @return The best time per value of a few runs in nanoseconds
+ */
+template<typename Function>
+static double NanosecondsPerValue(const std::vector<std::string>& inputs, Function&& function) {
+    double best = 1e9;
+    for(int run = 0; run < 5; run++) {
+        int64_t start = NowUs();
+        for(int repeat = 0; repeat < 20; repeat++) {
+            for(const std::string& input : inputs) {
+                function(input);
+            }
+        }
+        best = std::min(best, (NowUs() - start) * 1000.0 / (20 * inputs.size()));
+    }
+    return best;
+}
+
+/**
+ * Print the time per value of the kernel and of the strto*() function (if any) for typical values
+ * @return The speedup over strto*()
+ */
+template<typename T, typename Reference>
+static double Benchmark(const char* name, const std::vector<std::string>& inputs, const char* referenceName,
+                        Reference&& reference) {
+    double kernel = NanosecondsPerValue(inputs, [](const std::string& input) {
+        T value{};
+        ParseValue(input.data(), input.size(), value);
+        sink = sink + value;
+    });
+    double strto = NanosecondsPerValue(inputs, [&reference](const std::string& input) {
+        sink = sink + reference(input.c_str());
+    });
+    printf("%-20s %8.1f ns %8.1f ns  %-8s %5.1fx\n", name, kernel, strto, referenceName, strto / kernel);
+    return strto / kernel;
+}
+
+template<typename T>
+static std::vector<std::string> TypicalIntegers(std::mt19937_64& random) {
+    std::vector<std::string> inputs;
+    for(int i = 0; i < 1000; i++) {
+        // Mostly small values, like IDs, counts and settings
+        T value = (T)(random() >> (random() % 64));
+        inputs.push_back(std::to_string(+value));
+    }
+    return inputs;
+}
+
+static std::vector<std::string> TypicalDecimals(std::mt19937_64& random) {
+    std::vector<std::string> inputs;
+    char buf[32];
+    for(int i = 0; i < 1000; i++) {
+        // Sensor values and setpoints
+        double value = std::ldexp((double)(random() % 1000000), (int)(random() % 20) - 12) - 50;
+        snprintf(buf, sizeof(buf), "%.*f", (int)(random() % 5), value);
+        inputs.push_back(buf);
+    }
+    return inputs;
+}
+
+static void RunBenchmarks(std::mt19937_64& random) {
+    auto strtoll10 = [](const char* str) { return (double)strtoll(str, nullptr, 10); };
+    auto strtoull10 = [](const char* str) { return (double)strtoull(str, nullptr, 10); };
+    printf("%-20s %11s %11s\n", "type (typical values)", "ParseValue", "strto*()");
+    Benchmark<int8_t>("int8_t", TypicalIntegers<int8_t>(random), "strtol", strtoll10);
+    Benchmark<uint8_t>("uint8_t", TypicalIntegers<uint8_t>(random), "strtoul", strtoull10);
+    Benchmark<int16_t>("int16_t", TypicalIntegers<int16_t>(random), "strtol", strtoll10);
+    Benchmark<uint16_t>("uint16_t", TypicalIntegers<uint16_t>(random), "strtoul", strtoull10);
+    double intSpeedup = Benchmark<int32_t>("int32_t", TypicalIntegers<int32_t>(random), "strtol", strtoll10);
+    Benchmark<uint32_t>("uint32_t", TypicalIntegers<uint32_t>(random), "strtoul", strtoull10);
+    Benchmark<int64_t>("int64_t", TypicalIntegers<int64_t>(random), "strtoll", strtoll10);
+    Benchmark<uint64_t>("uint64_t", TypicalIntegers<uint64_t>(random), "strtoull", strtoull10);
+
+    std::vector<std::string> hex;
+    char buf[32];
+    for(int i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "%x", (unsigned)(random() >> (random() % 64)));
+        hex.push_back(buf);
+    }
+    double hexKernel = NanosecondsPerValue(hex, [](const std::string& input) {
+        uint32_t value = 0;
+        ParseHex(input.data(), input.size(), value);
+        sink = sink + value;
+    });
+    double hexReference = NanosecondsPerValue(hex, [](const std::string& input) {
+        sink = sink + strtoul(input.c_str(), nullptr, 16);
+    });
+    printf("%-20s %8.1f ns %8.1f ns  %-8s %5.1fx\n", "uint32_t (hex)", hexKernel, hexReference, "strtoul",
+           hexReference / hexKernel);
+
+    std::vector<std::string> decimals = TypicalDecimals(random);
+    Benchmark<float>("float", decimals, "strtof", [](const char* str) { return (double)strtof(str, nullptr); });
+    double doubleSpeedup = Benchmark<double>("double", decimals, "strtod", [](const char* str) {
+        return strtod(str, nullptr);
+    });
+
+    std::vector<std::string> words;
+    std::vector<std::string> names;
+    static const char* const wordList[] = {"true", "false", "1", "0", "on", "off", "yes", "no"};
+    static const char* const nameList[] = {"off", "auto", "on", "manual"};
+    for(int i = 0; i < 1000; i++) {
+        words.push_back(wordList[random() % 8]);
+        names.push_back(nameList[random() % 4]);
+    }
+    double boolKernel = NanosecondsPerValue(words, [](const std::string& input) {
+        bool value = false;
+        ParseValue(input.data(), input.size(), value);
+        sink = sink + value;
+    });
+    double enumKernel = NanosecondsPerValue(names, [](const std::string& input) {
+        Mode mode = Mode::Off;
+        ParseEnum(input.data(), input.size(), ModeNames, mode);
+        sink = sink + (int)mode;
+    });
+    printf("%-20s %8.1f ns\n%-20s %8.1f ns\n", "bool", boolKernel, "enum (4 names)", enumKernel);
+    // No locale, no whitespace skipping, and 32 bit arithmetic or a single multiplication
+    CHECK(intSpeedup > 1);
+    CHECK(doubleSpeedup > 1);
+}
+
+int main() {
+    std::mt19937_64 random(12345);
+    FuzzInteger<signed char>("signed char", random);
+    FuzzInteger<unsigned char>("unsigned char", random);
+    FuzzInteger<short>("short", random);
+    FuzzInteger<unsigned short>("unsigned short", random);
+    FuzzInteger<int>("int", random);
+    FuzzInteger<unsigned int>("unsigned int", random);
+    FuzzInteger<long>("long", random);
+    FuzzInteger<unsigned long>("unsigned long", random);
+    FuzzInteger<long long>("long long", random);
+    FuzzInteger<unsigned long long>("unsigned long long", random);
+    FuzzFloat<float>("float", random);
+    FuzzFloat<double>("double", random);
+    FuzzBool(random);
+    FuzzEnum(random);
+    RunBenchmarks(random);
+    return TestResult();
+}
@@ -0,0 +1,153 @@
+#include "TestSupport.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+ * Admission control under a flood: one client (127.0.0.1) hammers the server on
+ * several connections and gets 429 with Retry-After, while another client (127.0.0.2)
+ * within its limit keeps getting answers with bounded latency. Rate limited WebSocket
+ * handshakes are disconnected, and per-route limits answer 503.
+ */
+
+static const int FloodMs = 1000;
+static const float Rate = 20;
+static const uint32_t Burst = 10;
+
+static esp_err_t Status(httpd_req_t *request, const RouteParams&) {
+    return httpd_resp_send(request, "{\"ok\":true}", HTTPD_RESP_USE_STRLEN);
+}
+
+struct FloodResult {
+    std::atomic<int> admitted{0};
+    std::atomic<int> rejected{0};
+    std::atomic<int> withoutRetryAfter{0};
+    std::atomic<int> other{0};
+};
+
+/**
+ * Send requests as fast as possible until the time is over, reconnecting if closed
+ */
+static void Flood(uint16_t port, int64_t endUs, FloodResult& result) {
+    std::unique_ptr<TestClient> client;
+    while(NowUs() < endUs) {
+        if(client == nullptr || !client->IsConnected()) {
+            client.reset(new TestClient(port));
+        }
+        HTTPResponse response = client->Get("/api/status");
+        if(response.status == 200) {
+            result.admitted++;
+        } else if(response.status == 429) {
+            result.rejected++;
+            if(response.Header("Retry-After") == nullptr) {
+                result.withoutRetryAfter++;
+            }
+        } else {
+            result.other++;
+            client->Close();
+        }
+    }
+}
+
+static bool WebSocketHandshake(TestClient& client) {
+    HTTPResponse response = client.Get("/ws", "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                                              "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                              "Sec-WebSocket-Version: 13\r\n");
+    return response.status == 101;
+}
+
+int main() {
+    static RateLimiter limiter(Rate, Burst);
+    static TokenBucket routeLimit(5, 2);
+    static WebSocketHub hub;
+    HTTPServer http;
+    // Routes are registered after starting (for the WebSocket endpoint)
+    http.conf.uri_match_fn = httpd_uri_match_wildcard;
+    uint16_t port = StartTestServer(http);
+    if(port == 0) {
+        return 1;
+    }
+    http.EnableRateLimit(&limiter);
+    http.RegisterRoute(HTTP_GET, "/api/status", Status);
+    http.RegisterWebSocket("/ws", &hub);
+
+    // Flood from 127.0.0.1, a well-behaved client on 127.0.0.2 at half its limit
+    FloodResult flood;
+    int64_t start = NowUs();
+    int64_t end = start + FloodMs * 1000;
+    std::vector<std::thread> flooders;
+    for(int i = 0; i < 3; i++) {
+        flooders.emplace_back([port, end, &flood]() {
+            Flood(port, end, flood);
+        });
+    }
+    TestClient client(port, 5000, "127.0.0.2");
+    std::vector<int64_t> latencies;
+    while(NowUs() < end) {
+        int64_t requestStart = NowUs();
+        HTTPResponse response = client.Get("/api/status");
+        latencies.push_back(NowUs() - requestStart);
+        if(!CHECK_EQUAL(response.status, 200)) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS((int)(2000 / Rate)));
+    }
+    for(std::thread& thread : flooders) {
+        thread.join();
+    }
+    double seconds = (NowUs() - start) / 1e6;
+    std::sort(latencies.begin(), latencies.end());
+    int64_t maxLatency = latencies.empty() ? 0 : latencies.back();
+    printf("flood: %d admitted, %d rejected (%.0f requests/s); other client: %d requests, max latency %.3f ms\n",
+           flood.admitted.load(), flood.rejected.load(), (flood.admitted + flood.rejected) / seconds,
+           (int)latencies.size(), maxLatency / 1000.0);
+    // The flooder gets its burst and rate, everything else is shed
+    CHECK(flood.admitted <= (int)(Burst + Rate * seconds) + 1);
+    CHECK(flood.rejected > flood.admitted * 10);
+    CHECK_EQUAL(flood.withoutRetryAfter.load(), 0);
+    CHECK_EQUAL(flood.other.load(), 0);
+    CHECK_EQUAL(limiter.GetRejectedCount(), (uint32_t)flood.rejected);
+    CHECK_EQUAL(limiter.GetRetryAfter(), 1u);
+    // The other client is not affected
+    CHECK((int)latencies.size() >= (int)(Rate / 2 * FloodMs / 1000) / 2);
+    CHECK(maxLatency < 50000);
+
+    // Over the limit, a WebSocket handshake (already answered like by ESP-IDF) is disconnected
+    TestClient limitedSocket(port);
+    int drained = 0;
+    while(drained < 100 && limitedSocket.Get("/api/status").status == 200) {
+        drained++;
+    }
+    CHECK(WebSocketHandshake(limitedSocket));
+    CHECK(limitedSocket.WaitForClose());
+    CHECK_EQUAL(limiter.GetRejectedCount(), (uint32_t)flood.rejected + 2);
+    TestClient socket(port, 5000, "127.0.0.2");
+    CHECK(WebSocketHandshake(socket));
+    for(int i = 0; i < 100 && hub.GetClientCount() == 0; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    CHECK_EQUAL(hub.GetClientCount(), 1u);
+
+    // A per-route limit applies to all clients together
+    HandlerOptions options;
+    options.rateLimit = &routeLimit;
+    http.EnableRateLimit(nullptr);
+    http.RegisterRoute(HTTP_GET, "/api/expensive", Status, nullptr, options);
+    TestClient routeClient(port, 5000, "127.0.0.3");
+    int unavailable = 0;
+    for(int i = 0; i < 5; i++) {
+        HTTPResponse response = routeClient.Get("/api/expensive");
+        if(response.status == 503 && response.Header("Retry-After") != nullptr) {
+            unavailable++;
+        }
+    }
+    CHECK_EQUAL(unavailable, 3);
+    CHECK_EQUAL(routeLimit.GetRejectedCount(), 3u);
+
+    httpd_stop(http.server);
+    return TestResult();
+}
@@ -0,0 +1,135 @@
+#include "TestSupport.hpp"
+#include <JSONWriter.hpp>
+#include <QueryURLParser.hpp>
+#include <ResponseWriter.hpp>
+#include <URLDecode.hpp>
+#include <esp_heap_caps.h>
+#include <atomic>
+#include <cstdio>
+
+/*
+ * Request arena: once warmed up, a request parsing its query, decoding values and
+ * building a JSON or text response makes no malloc()/free() calls at all.
+ * Counted with the heap hooks around the router (everything HTTPServer does per request),
+ * the same JSON route without an arena is the control.
+ */
+
+static thread_local bool measuring = false;
+static std::atomic<uint32_t> allocations{0};
+static std::atomic<uint32_t> frees{0};
+
+extern "C" void esp_heap_trace_alloc_hook(void*, size_t, uint32_t) {
+    if(measuring) {
+        allocations++;
+    }
+}
+
+extern "C" void esp_heap_trace_free_hook(void*) {
+    if(measuring) {
+        frees++;
+    }
+}
+
+/**
+ * The router's catch-all handler, measured
+ */
+static esp_err_t MeasuredDispatch(httpd_req_t *request) {
+    measuring = true;
+    esp_err_t err = Router::Dispatch(request);
+    measuring = false;
+    return err;
+}
+
+static esp_err_t Sensor(httpd_req_t *request, const RouteParams& params) {
+    QueryURLParser query(request);
+    int count = 0;
+    query.GetParameterValue("count", count);
+    std::string_view name = query.GetParameterDecodedView("name");
+    // A decoded copy, like for handing to another API
+    size_t unitLength = 0;
+    std::string_view rawUnit = query.GetParameterView("unit");
+    char* unit = URLDecodeAllocate(rawUnit.data(), rawUnit.size(), &unitLength);
+    JSONWriter json(request);
+    json.BeginObject();
+    json.Key("id").String(params.GetParamView("id").data(), params.GetParamView("id").size());
+    json.Key("name").String(name.data(), name.size());
+    json.Key("unit").String(unit, unitLength);
+    json.Key("values").BeginArray();
+    for(int i = 0; i < count; i++) {
+        json.Number(i * 0.5);
+    }
+    json.EndArray();
+    json.EndObject();
+    RequestFree(unit);
+    return json.Finish();
+}
+
+static esp_err_t Text(httpd_req_t *request, const RouteParams&) {
+    QueryURLParser query(request);
+    std::string_view name = query.GetParameterDecodedView("name");
+    ResponseWriter writer(request);
+    writer.SetType("text/plain");
+    writer.Printf("Hello %.*s, ", (int)name.size(), name.data());
+    writer.WriteNumber(21.5, 1).Write("\n");
+    return writer.Finish();
+}
+
+/**
+ * @return The number of malloc() and free() calls per request, after warming up
+ */
+static double HeapCallsPerRequest(TestClient& client, const std::string& uri, int requests) {
+    for(int i = 0; i < 10; i++) {
+        client.Get(uri);
+    }
+    allocations = 0;
+    frees = 0;
+    for(int i = 0; i < requests; i++) {
+        if(!CHECK_EQUAL(client.Get(uri).status, 200)) {
+            break;
+        }
+    }
+    return (double)(allocations + frees) / requests;
+}
+
+int main() {
+    HTTPServer http;
+    // Control: the same route using the heap
+    http.RegisterRoute(HTTP_GET, "/heap/sensor/{id}", Sensor);
+    http.EnableRequestArena(2048);
+    http.RegisterRoute(HTTP_GET, "/arena/sensor/{id}", Sensor);
+    http.RegisterRoute(HTTP_GET, "/arena/text", Text);
+    uint16_t port = StartTestServer(http);
+    if(port == 0) {
+        return 1;
+    }
+    // Replace the catch-all handler by the measured one
+    httpd_unregister_uri_handler(http.server, "/*", HTTP_GET);
+    httpd_uri_t measured = {};
+    measured.uri = "/*";
+    measured.method = HTTP_GET;
+    measured.handler = MeasuredDispatch;
+    measured.user_ctx = &http.router;
+    httpd_register_uri_handler(http.server, &measured);
+
+    TestClient client(port);
+    const char* query = "?count=20&name=living%20room%20%28north%29&unit=%C2%B0C&other=1";
+    HTTPResponse response = client.Get(std::string("/arena/sensor/t1") + query);
+    CHECK_EQUAL(response.status, 200);
+    std::string expected = "{\"id\":\"t1\",\"name\":\"living room (north)\",\"unit\":\"\xC2\xB0" "C\",\"values\":[0,0.5,";
+    CHECK_EQUAL(response.body.substr(0, expected.size()), expected);
+    CHECK_EQUAL(client.Get("/arena/text?name=a%2Bb").body, "Hello a+b, 21.5\n");
+
+    const int requests = 200;
+    double heapSensor = HeapCallsPerRequest(client, std::string("/heap/sensor/t1") + query, requests);
+    double arenaSensor = HeapCallsPerRequest(client, std::string("/arena/sensor/t1") + query, requests);
+    double arenaText = HeapCallsPerRequest(client, "/arena/text?name=a%2Bb", requests);
+    printf("malloc()/free() calls per request: JSON %.1f without arena, %.1f with arena; text %.1f with arena\n",
+           heapSensor, arenaSensor, arenaText);
+    // The control shows that the hooks see the handler's allocations
+    CHECK(heapSensor > 0);
+    CHECK_EQUAL(arenaSensor, 0.0);
+    CHECK_EQUAL(arenaText, 0.0);
+
+    httpd_stop(http.server);
+    return TestResult();
+}
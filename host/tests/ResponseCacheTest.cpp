@@ -0,0 +1,141 @@
+#include "TestSupport.hpp"
+#include <CompressedResponse.hpp>
+#include <JSONResponse.hpp>
+#include <QueryURLParser.hpp>
+#include <atomic>
+#include <thread>
+
+/*
+ * ResponseCache through HTTPServer: hits are served without calling the handler,
+ * keys ignore the parameter order, only 200 OK is cached, compressed responses are not
+ * served to clients without gzip, TTL and invalidation,
+ * and concurrent misses (on worker tasks) generate the response once.
+ */
+
+static std::atomic<int> calls{0};
+static std::atomic<int> slowCalls{0};
+static std::atomic<int> reportCalls{0};
+static std::string report;
+
+static esp_err_t Counter(httpd_req_t *request, const RouteParams&) {
+    int call = ++calls;
+    QueryURLParser query(request);
+    if(query.HasParameter("missing")) {
+        httpd_resp_set_status(request, HTTPD_404);
+        return SendStatusError(request, "missing");
+    }
+    std::string body = "{\"call\":" + std::to_string(call) + "}";
+    httpd_resp_set_type(request, HTTPD_TYPE_JSON);
+    httpd_resp_set_hdr(request, "X-Generated", "yes");
+    return httpd_resp_send(request, body.data(), body.size());
+}
+
+static esp_err_t Slow(httpd_req_t *request, const RouteParams&) {
+    int call = ++slowCalls;
+    vTaskDelay(pdMS_TO_TICKS(200));
+    std::string body = std::to_string(call);
+    return httpd_resp_send(request, body.data(), body.size());
+}
+
+static esp_err_t Report(httpd_req_t *request, const RouteParams&) {
+    reportCalls++;
+    httpd_resp_set_type(request, "text/plain");
+    return SendCompressed(request, report.data(), report.size());
+}
+
+int main() {
+    static ResponseCache cache;
+    static AsyncWorkerPool workers(2, 8);
+    workers.Start();
+    HTTPServer http;
+    HandlerOptions options;
+    options.cache = &cache;
+    options.cacheTTL = 300;
+    http.RegisterRoute(HTTP_GET, "/api/counter", Counter, nullptr, options);
+    http.RegisterRoute(HTTP_GET, "/api/report", Report, nullptr, options);
+    options.workers = &workers;
+    options.cacheTTL = 5000;
+    http.RegisterRoute(HTTP_GET, "/api/slow", Slow, nullptr, options);
+    uint16_t port = StartTestServer(http);
+    if(port == 0) {
+        return 1;
+    }
+
+    TestClient client(port);
+    HTTPResponse first = client.Get("/api/counter?a=1&b=2");
+    CHECK_EQUAL(first.status, 200);
+    CHECK_EQUAL(first.body, "{\"call\":1}");
+    // A hit is the same response, and the handler is not called
+    HTTPResponse hit = client.Get("/api/counter?a=1&b=2");
+    CHECK_EQUAL(calls.load(), 1);
+    CHECK_EQUAL(hit.status, 200);
+    CHECK_EQUAL(hit.body, first.body);
+    CHECK(hit.Header("X-Generated") != nullptr);
+    CHECK(hit.Header("Content-Type") != nullptr && std::string(hit.Header("Content-Type")) == HTTPD_TYPE_JSON);
+    // The parameter order does not matter
+    hit = client.Get("/api/counter?b=2&a=1");
+    CHECK_EQUAL(hit.body, first.body);
+    CHECK_EQUAL(calls.load(), 1);
+    // Other queries are other entries
+    CHECK_EQUAL(client.Get("/api/counter?a=2").body, "{\"call\":2}");
+    CHECK_EQUAL(calls.load(), 2);
+    ResponseCacheStats stats = cache.GetStats();
+    CHECK_EQUAL(stats.hits, 2u);
+    CHECK_EQUAL(stats.misses, 2u);
+
+    // Errors are not cached
+    CHECK_EQUAL(client.Get("/api/counter?missing").status, 404);
+    CHECK_EQUAL(client.Get("/api/counter?missing").status, 404);
+    CHECK_EQUAL(calls.load(), 4);
+    CHECK_EQUAL(cache.GetStats().uncacheable, 2u);
+
+    // Expired and invalidated entries are generated again
+    vTaskDelay(pdMS_TO_TICKS(400));
+    CHECK_EQUAL(client.Get("/api/counter?a=1&b=2").body, "{\"call\":5}");
+    CHECK_EQUAL(client.Get("/api/counter?a=1&b=2").body, "{\"call\":5}");
+    cache.Invalidate("/api/counter");
+    CHECK_EQUAL(client.Get("/api/counter?a=1&b=2").body, "{\"call\":6}");
+    CHECK_EQUAL(calls.load(), 6);
+
+    // Compressed responses are not stored, so clients without gzip never get them
+    while(report.size() < 4096) {
+        report += "sensor reading 21.5 degC, ";
+    }
+    uint32_t uncacheable = cache.GetStats().uncacheable;
+    HTTPResponse gzip = client.Get("/api/report", "Accept-Encoding: gzip\r\n");
+    CHECK_EQUAL(gzip.status, 200);
+    CHECK(gzip.Header("Content-Encoding") != nullptr);
+    CHECK_EQUAL(cache.GetStats().uncacheable, uncacheable + 1);
+    HTTPResponse plain = client.Get("/api/report");
+    CHECK_EQUAL(plain.status, 200);
+    CHECK(plain.Header("Content-Encoding") == nullptr);
+    CHECK_EQUAL(plain.body, report);
+    CHECK_EQUAL(reportCalls.load(), 2);
+    // The identity response is cached and fine for every client
+    plain = client.Get("/api/report", "Accept-Encoding: gzip\r\n");
+    CHECK(plain.Header("Content-Encoding") == nullptr);
+    CHECK_EQUAL(plain.body, report);
+    CHECK_EQUAL(reportCalls.load(), 2);
+
+    // Concurrent misses call the handler once
+    std::vector<std::thread> threads;
+    std::atomic<int> ok{0};
+    for(int i = 0; i < 4; i++) {
+        threads.emplace_back([port, &ok]() {
+            TestClient slowClient(port);
+            HTTPResponse response = slowClient.Get("/api/slow");
+            if(response.status == 200 && response.body == "1") {
+                ok++;
+            }
+        });
+    }
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK_EQUAL(ok.load(), 4);
+    CHECK_EQUAL(slowCalls.load(), 1);
+    CHECK(cache.GetStats().coalesced >= 1);
+
+    httpd_stop(http.server);
+    return TestResult();
+}
@@ -0,0 +1,264 @@
+#include "TestSupport.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+bool CheckResult(bool ok, const char* expression, const char* file, int line) {
+    if(!ok) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        failures++;
+    }
+    return ok;
+}
+
+int TestResult() {
+    if(failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
+
+int64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @return A port which is free right now, or 0
+ */
+static uint16_t FindFreePort() {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        return 0;
+    }
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    uint16_t port = 0;
+    if(bind(fd, (struct sockaddr*)&address, sizeof(address)) == 0
+       && getsockname(fd, (struct sockaddr*)&address, &length) == 0) {
+        port = ntohs(address.sin_port);
+    }
+    close(fd);
+    return port;
+}
+
+uint16_t StartTestServer(HTTPServer& http) {
+    setenv("HUMANESPHTTP_TCP_NODELAY", "1", 1);
+    // Another process may take the port in the meantime
+    for(int attempt = 0; attempt < 10 && http.server == nullptr; attempt++) {
+        uint16_t port = FindFreePort();
+        if(port == 0) {
+            continue;
+        }
+        setenv("HUMANESPHTTP_PORT", std::to_string(port).c_str(), 1);
+        http.StartServer();
+        if(http.server != nullptr) {
+            return port;
+        }
+    }
+    fprintf(stderr, "Failed to start the test server\n");
+    return 0;
+}
+
+const char* HTTPResponse::Header(const char* name) const {
+    for(const auto& header : headers) {
+        if(strcasecmp(header.first.c_str(), name) == 0) {
+            return header.second.c_str();
+        }
+    }
+    return nullptr;
+}
+
+TestClient::TestClient(uint16_t port, int timeoutMs, const char* sourceAddress) {
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        return;
+    }
+    struct timeval timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    if(sourceAddress != nullptr) {
+        inet_pton(AF_INET, sourceAddress, &address.sin_addr);
+        if(bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+            Close();
+            return;
+        }
+    }
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if(connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        Close();
+    }
+}
+
+TestClient::~TestClient() {
+    Close();
+}
+
+void TestClient::Close() {
+    if(fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    buffer.clear();
+}
+
+bool TestClient::Send(const std::string& data) {
+    size_t sent = 0;
+    while(fd >= 0 && sent < data.size()) {
+        ssize_t ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(ret <= 0) {
+            return false;
+        }
+        sent += ret;
+    }
+    return fd >= 0;
+}
+
+bool TestClient::Fill() {
+    if(fd < 0) {
+        return false;
+    }
+    char data[4096];
+    ssize_t ret = recv(fd, data, sizeof(data), 0);
+    if(ret <= 0) {
+        return false;
+    }
+    buffer.append(data, ret);
+    return true;
+}
+
+HTTPResponse TestClient::Request(const char* method, const std::string& uri, const std::string& body,
+                                 const std::string& headers) {
+    std::string request = std::string(method) + " " + uri + " HTTP/1.1\r\nHost: 127.0.0.1\r\n" + headers;
+    if(!body.empty()) {
+        request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    request += "\r\n" + body;
+    if(!Send(request)) {
+        return HTTPResponse();
+    }
+    return ReceiveResponse(strcmp(method, "HEAD") == 0);
+}
+
+HTTPResponse TestClient::ReceiveResponse(bool head) {
+    HTTPResponse response;
+    size_t headEnd;
+    while((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if(!Fill()) {
+            return HTTPResponse();
+        }
+    }
+    std::string headLines = buffer.substr(0, headEnd + 2);
+    buffer.erase(0, headEnd + 4);
+    int status = 0;
+    if(sscanf(headLines.c_str(), "HTTP/1.%*d %d", &status) != 1) {
+        return HTTPResponse();
+    }
+    long long contentLength = -1;
+    size_t pos = headLines.find("\r\n") + 2;
+    while(pos < headLines.size()) {
+        size_t end = headLines.find("\r\n", pos);
+        std::string line = headLines.substr(pos, end - pos);
+        pos = end + 2;
+        size_t colon = line.find(':');
+        if(colon == std::string::npos) {
+            continue;
+        }
+        std::string name = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        if(strcasecmp(name.c_str(), "Content-Length") == 0) {
+            contentLength = atoll(value.c_str());
+        } else if(strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+            response.chunked = strcasestr(value.c_str(), "chunked") != nullptr;
+        }
+        response.headers.emplace_back(std::move(name), std::move(value));
+    }
+    if(head || status / 100 == 1 || status == 304 || status == 204) {
+        // No body
+    } else if(response.chunked) {
+        for(;;) {
+            size_t lineEnd;
+            while((lineEnd = buffer.find("\r\n")) == std::string::npos) {
+                if(!Fill()) {
+                    return HTTPResponse();
+                }
+            }
+            size_t size = strtoul(buffer.c_str(), nullptr, 16);
+            size_t total = lineEnd + 2 + size + 2;
+            while(buffer.size() < total) {
+                if(!Fill()) {
+                    return HTTPResponse();
+                }
+            }
+            response.body.append(buffer, lineEnd + 2, size);
+            buffer.erase(0, total);
+            if(size == 0) {
+                break;
+            }
+        }
+    } else if(contentLength >= 0) {
+        while(buffer.size() < (size_t)contentLength) {
+            if(!Fill()) {
+                return HTTPResponse();
+            }
+        }
+        response.body = buffer.substr(0, contentLength);
+        buffer.erase(0, contentLength);
+    } else {
+        // Body until the server closes the connection
+        while(Fill()) {
+        }
+        response.body.swap(buffer);
+        Close();
+    }
+    response.status = status;
+    return response;
+}
+
+bool TestClient::Receive(std::string& data, size_t length) {
+    while(buffer.size() < length) {
+        if(!Fill()) {
+            return false;
+        }
+    }
+    data = buffer.substr(0, length);
+    buffer.erase(0, length);
+    return true;
+}
+
+bool TestClient::WaitForClose() {
+    if(fd < 0) {
+        return true;
+    }
+    char data[4096];
+    for(;;) {
+        ssize_t ret = recv(fd, data, sizeof(data), 0);
+        if(ret == 0) {
+            return true;
+        }
+        if(ret < 0) {
+            // Timeout, or reset by the server
+            return errno == ECONNRESET;
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+/*
+ * Support for the host tests (see "Tests" in README.md): checks, a server on a free
+ * loopback port and a blocking HTTP/1.1 client.
+ *
+ * Every test is a program returning TestResult() from main(), run by ctest.
+ */
+#include <HTTPServer.hpp>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Record a failed check (with the expression and location) and continue
+ */
+#define CHECK(condition) CheckResult((condition), #condition, __FILE__, __LINE__)
+/**
+ * Like CHECK(), but also prints both values on failure
+ */
+#define CHECK_EQUAL(actual, expected) CheckEqual((actual), (expected), #actual, __FILE__, __LINE__)
+
+bool CheckResult(bool ok, const char* expression, const char* file, int line);
+
+template<typename Actual, typename Expected>
+bool CheckEqual(const Actual& actual, const Expected& expected, const char* expression, const char* file, int line) {
+    if(actual == expected) {
+        return CheckResult(true, expression, file, line);
+    }
+    std::ostringstream message;
+    message << expression << " == " << actual << ", expected " << expected;
+    return CheckResult(false, message.str().c_str(), file, line);
+}
+
+/**
+ * @brief Print the number of failed checks
+ * @return The exit code of the test: 0 if all checks passed
+ */
+int TestResult();
+
+/**
+ * @return Microseconds of a monotonic clock
+ */
+int64_t NowUs();
+
+/**
+ * @brief Start the server on a free port (instead of conf.server_port)
+ * Nagle's algorithm is disabled, so latencies don't depend on delayed ACKs.
+ * @return The port, or 0 if the server could not be started
+ */
+uint16_t StartTestServer(HTTPServer& http);
+
+struct HTTPResponse {
+    int status = 0; // 0 if no (complete) response has been received
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    bool chunked = false;
+
+    /**
+     * @return The value of the given header, or nullptr if it is missing
+     */
+    const char* Header(const char* name) const;
+};
+
+/**
+ * Connection to a test server, sending one request at a time (with keep-alive)
+ */
+class TestClient {
+public:
+    /**
+     * Connect to the given port on 127.0.0.1 (receive timeout in milliseconds),
+     * optionally from another loopback address (e.g. "127.0.0.2", to appear as another client)
+     */
+    explicit TestClient(uint16_t port, int timeoutMs = 5000, const char* sourceAddress = nullptr);
+    ~TestClient();
+
+    TestClient(const TestClient&) = delete;
+    TestClient& operator=(const TestClient&) = delete;
+
+    bool IsConnected() const { return fd >= 0; }
+    int GetSocket() const { return fd; }
+
+    /**
+     * @brief Send a request and receive its response
+     * @param headers Additional header lines, each ending with "\r\n"
+     */
+    HTTPResponse Request(const char* method, const std::string& uri, const std::string& body = "",
+                         const std::string& headers = "");
+    HTTPResponse Get(const std::string& uri, const std::string& headers = "") {
+        return Request("GET", uri, "", headers);
+    }
+
+    bool Send(const std::string& data);
+    /**
+     * @brief Receive one response (without body for HEAD requests)
+     */
+    HTTPResponse ReceiveResponse(bool head = false);
+    /**
+     * @brief Receive exactly the given number of bytes (e.g. a WebSocket frame)
+     * @return false on errors or if the connection has been closed
+     */
+    bool Receive(std::string& data, size_t length);
+    /**
+     * @return true if the server closes the connection within the receive timeout
+     * (received data is discarded)
+     */
+    bool WaitForClose();
+    void Close();
+
+private:
+    bool Fill();
+
+    int fd = -1;
+    std::string buffer;
+};
@@ -0,0 +1,203 @@
+#include "TestSupport.hpp"
+#include <QueryURLParser.hpp>
+#include <URLDecode.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * URL decoding: the word-at-a-time kernel against a byte-at-a-time reference
+ * (random inputs at every alignment), QueryURLParser's lazy decoding, and throughput.
+ */
+
+static int HexValue(char c) {
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * The obvious byte-at-a-time implementation of the documented URLDecode() behaviour
+ */
+static size_t ReferenceDecode(const char* src, size_t length, char* dst) {
+    size_t decoded = 0;
+    for(size_t i = 0; i < length; i++) {
+        if(src[i] == '+') {
+            dst[decoded++] = ' ';
+        } else if(src[i] == '%' && i + 2 < length && HexValue(src[i + 1]) >= 0 && HexValue(src[i + 2]) >= 0) {
+            dst[decoded++] = (char)(HexValue(src[i + 1]) * 16 + HexValue(src[i + 2]));
+            i += 2;
+        } else {
+            dst[decoded++] = src[i];
+        }
+    }
+    return decoded;
+}
+
+static std::string ReferenceDecode(const std::string& src) {
+    std::string decoded(src.size(), '\0');
+    decoded.resize(ReferenceDecode(src.data(), src.size(), &decoded[0]));
+    return decoded;
+}
+
+static std::string Decode(const std::string& src) {
+    std::string decoded(src.size(), '\0');
+    decoded.resize(URLDecode(src.data(), src.size(), &decoded[0]));
+    return decoded;
+}
+
+static void TestEdgeCases() {
+    CHECK_EQUAL(Decode(""), "");
+    CHECK_EQUAL(Decode("plain"), "plain");
+    CHECK_EQUAL(Decode("a+b"), "a b");
+    CHECK_EQUAL(Decode("%41%62%2b%2B"), "Ab++");
+    CHECK_EQUAL(Decode("%7B%22a%22%3A1%7D"), "{\"a\":1}");
+    CHECK_EQUAL(Decode("100%"), "100%");
+    CHECK_EQUAL(Decode("%4"), "%4");
+    CHECK_EQUAL(Decode("%zz%4g"), "%zz%4g");
+    CHECK_EQUAL(Decode("%%41"), "%A");
+    CHECK_EQUAL(Decode("%00"), std::string(1, '\0'));
+    CHECK_EQUAL(Decode("%FF"), std::string(1, '\xff'));
+    CHECK(!URLNeedsDecoding("plain-text-value", 16));
+    CHECK(URLNeedsDecoding("plain-text-value+", 17));
+    CHECK(URLNeedsDecoding("%", 1));
+}
+
+static void TestRandom() {
+    static const char alphabet[] = "%%++0123456789abcdefABCDEFxyz-_.~&=\x80\xff";
+    std::mt19937 generator(12345);
+    char buffer[256 + 8];
+    for(int iteration = 0; iteration < 100000; iteration++) {
+        size_t length = generator() % 200;
+        // Mostly clean runs with a few escapes, like real query strings
+        bool sparse = generator() % 2 == 0;
+        std::string src;
+        for(size_t i = 0; i < length; i++) {
+            src += sparse && generator() % 16 != 0 ? 'a' + generator() % 26 : alphabet[generator() % (sizeof(alphabet) - 1)];
+        }
+        std::string expected = ReferenceDecode(src);
+        // Every alignment of source and destination
+        size_t offset = iteration % 8;
+        memcpy(buffer + offset, src.data(), src.size());
+        const char* found = URLFindEncoded(buffer + offset, buffer + offset + src.size());
+        size_t expectedPosition = std::min(src.find_first_of("%+"), src.size());
+        if(!CHECK_EQUAL((size_t)(found - buffer - offset), expectedPosition)) {
+            break;
+        }
+        char decoded[256];
+        size_t decodedLength = URLDecode(buffer + offset, src.size(), decoded);
+        if(!CHECK_EQUAL(std::string(decoded, decodedLength), expected)) {
+            break;
+        }
+        // In place
+        decodedLength = URLDecode(buffer + offset, src.size(), buffer + offset);
+        if(!CHECK_EQUAL(std::string(buffer + offset, decodedLength), expected)) {
+            break;
+        }
+    }
+}
+
+static void TestQueryParser() {
+    QueryURLParser parser("json=%7B%22a%22%3A1%7D&plain=value&space=a+b&broken=%zz");
+    const char* rawPlain = parser.GetParameterView("plain").data();
+    // Values without escapes are views of the parser's buffer
+    std::string_view plain = parser.GetParameterDecodedView("plain");
+    CHECK_EQUAL(plain, "value");
+    CHECK(plain.data() == rawPlain);
+    CHECK_EQUAL(parser.GetParameterDecodedView("json"), "{\"a\":1}");
+    // Decoded in place, once
+    CHECK_EQUAL(parser.GetParameter("json"), "{\"a\":1}");
+    CHECK_EQUAL(parser.GetParameterDecodedView("json"), "{\"a\":1}");
+    CHECK_EQUAL(parser.GetParameterDecoded("space"), "a b");
+    CHECK_EQUAL(parser.GetParameterDecoded("broken"), "%zz");
+    CHECK(!parser.GetParameterDecodedViewOptional("missing").has_value());
+
+    QueryURLParser bufferParser("v=%41%42%43%44");
+    char buf[8];
+    CHECK_EQUAL(bufferParser.GetParameterDecoded("v", buf, sizeof(buf)), ESP_OK);
+    CHECK_EQUAL(std::string(buf), "ABCD");
+    char small[3];
+    CHECK_EQUAL(bufferParser.GetParameterDecoded("v", small, sizeof(small)), ESP_ERR_HTTPD_RESULT_TRUNC);
+    CHECK_EQUAL(std::string(small), "AB");
+    CHECK_EQUAL(bufferParser.GetParameterDecoded("x", buf, sizeof(buf)), ESP_ERR_NOT_FOUND);
+    // The buffer variant does not modify the parser
+    CHECK_EQUAL(bufferParser.GetParameter("v"), "%41%42%43%44");
+}
+
+/**
+ * @return The best throughput of a few runs in MB/s
+ */
+template<typename Function>
+static double Throughput(size_t bytes, Function&& function) {
+    double best = 0;
+    for(int run = 0; run < 5; run++) {
+        int64_t start = NowUs();
+        for(int i = 0; i < 200; i++) {
+            function();
+        }
+        int64_t elapsed = std::max<int64_t>(NowUs() - start, 1);
+        best = std::max(best, 200.0 * bytes / elapsed);
+    }
+    return best;
+}
+
+static volatile size_t sink = 0;
+
+static void TestThroughput() {
+    // A long JSON value with few escapes (the common case for JSON blobs in a query)
+    std::string clean;
+    while(clean.size() < 16384) {
+        clean += "temperature-sensor-reading-value-";
+    }
+    std::string sparse = clean;
+    for(size_t i = 0; i < sparse.size(); i += 512) {
+        sparse.replace(i, 3, "%2C");
+    }
+    std::string dense;
+    while(dense.size() < 16384) {
+        dense += "%7B%22a%22%3A1%7D";
+    }
+    std::vector<char> out(std::max(clean.size(), dense.size()));
+    printf("%-24s %10s %10s %10s\n", "input (16 KB)", "URLDecode", "reference", "memcpy");
+    double memcpyRate = Throughput(clean.size(), [&]() {
+        memcpy(out.data(), clean.data(), clean.size());
+        sink += out[0];
+    });
+    double cleanRate = 0;
+    double cleanReference = 0;
+    const std::pair<const char*, const std::string*> inputs[] = {{"clean", &clean}, {"sparse escapes", &sparse}, {"dense escapes", &dense}};
+    for(const auto& input : inputs) {
+        const std::string& src = *input.second;
+        double rate = Throughput(src.size(), [&]() {
+            sink += URLDecode(src.data(), src.size(), out.data());
+        });
+        double reference = Throughput(src.size(), [&]() {
+            sink += ReferenceDecode(src.data(), src.size(), out.data());
+        });
+        printf("%-24s %7.0f MB/s %7.0f MB/s %7.0f MB/s\n", input.first, rate, reference, memcpyRate);
+        if(input.second == &clean) {
+            cleanRate = rate;
+            cleanReference = reference;
+        }
+    }
+    // Clean runs are skipped a word at a time, which a byte loop can't match
+    CHECK(cleanRate > cleanReference);
+}
+
+int main() {
+    TestEdgeCases();
+    TestRandom();
+    TestQueryParser();
+    TestThroughput();
+    return TestResult();
+}
@@ -0,0 +1,201 @@
+#include "TestSupport.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * WebSocketHub through the host WebSocket emulation: the handshake, masked client
+ * frames, published messages per second and their latency (coalesced into fewer
+ * sends), echo round trips, pings and closing.
+ */
+
+static const int PublishCount = 5000;
+
+static esp_err_t OnMessage(WebSocketHub& hub, int client, httpd_ws_type_t type,
+                           const char* data, size_t length, void*) {
+    if(length == 9 && memcmp(data, "subscribe", 9) == 0) {
+        return hub.Subscribe(client, "time");
+    }
+    return hub.Send(client, data, length, type);
+}
+
+/**
+ * Upgrade the connection with the sample key from RFC 6455
+ * @return false if the connection was not upgraded
+ */
+static bool Handshake(TestClient& client) {
+    HTTPResponse response = client.Get("/ws", "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                                              "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                              "Sec-WebSocket-Version: 13\r\n");
+    const char* accept = response.Header("Sec-WebSocket-Accept");
+    return CHECK_EQUAL(response.status, 101)
+        && CHECK(accept != nullptr && strcmp(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == 0);
+}
+
+/**
+ * @return A client frame (masked, like browsers send them)
+ */
+static std::string ClientFrame(httpd_ws_type_t type, const std::string& payload, bool masked = true) {
+    static const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+    std::string frame(1, (char)(0x80 | type));
+    uint8_t maskBit = masked ? 0x80 : 0;
+    if(payload.size() < 126) {
+        frame += (char)(maskBit | payload.size());
+    } else {
+        frame += (char)(maskBit | 126);
+        frame += (char)(payload.size() >> 8);
+        frame += (char)payload.size();
+    }
+    if(!masked) {
+        return frame + payload;
+    }
+    frame.append((const char*)mask, sizeof(mask));
+    for(size_t i = 0; i < payload.size(); i++) {
+        frame += (char)(payload[i] ^ mask[i % 4]);
+    }
+    return frame;
+}
+
+/**
+ * Receive a server frame (unmasked)
+ * @return false if the connection broke
+ */
+static bool ReceiveFrame(TestClient& client, int& opcode, std::string& payload) {
+    std::string header;
+    if(!client.Receive(header, 2)) {
+        return false;
+    }
+    opcode = header[0] & 0x0F;
+    size_t length = header[1] & 0x7F;
+    if(length >= 126) {
+        std::string extended;
+        size_t count = length == 126 ? 2 : 8;
+        if(!client.Receive(extended, count)) {
+            return false;
+        }
+        length = 0;
+        for(char byte : extended) {
+            length = (length << 8) | (uint8_t)byte;
+        }
+    }
+    return client.Receive(payload, length);
+}
+
+static int64_t Percentile99(std::vector<int64_t>& values) {
+    std::sort(values.begin(), values.end());
+    return values[(values.size() * 99 + 99) / 100 - 1];
+}
+
+/**
+ * Publish timestamps while the client receives them
+ */
+static void TestPublish(WebSocketHub& hub, TestClient& client) {
+    std::thread publisher([&hub]() {
+        for(int i = 0; i < PublishCount; i++) {
+            std::string timestamp = std::to_string(NowUs());
+            hub.Publish("time", timestamp.data(), timestamp.size());
+            if(i % 100 == 99) {
+                vTaskDelay(pdMS_TO_TICKS(1));
+            }
+        }
+    });
+    std::vector<int64_t> latencies;
+    int64_t start = NowUs();
+    int opcode;
+    std::string payload;
+    while((int)latencies.size() < PublishCount && ReceiveFrame(client, opcode, payload)) {
+        if(!CHECK_EQUAL(opcode, (int)HTTPD_WS_TYPE_TEXT)) {
+            break;
+        }
+        latencies.push_back(NowUs() - atoll(payload.c_str()));
+    }
+    int64_t elapsed = std::max<int64_t>(NowUs() - start, 1);
+    publisher.join();
+    if(!CHECK_EQUAL((int)latencies.size(), PublishCount)) {
+        return;
+    }
+    WebSocketStats stats = hub.GetStats();
+    int64_t p99 = Percentile99(latencies);
+    printf("publish: %.0f messages/s, latency p99 %.3f ms, %u messages in %u sends\n",
+           PublishCount * 1e6 / elapsed, p99 / 1000.0, (unsigned)stats.queued, (unsigned)stats.sends);
+    CHECK_EQUAL(stats.dropped, 0u);
+    // Coalesced: several messages per send, within the latency budget (plus scheduling)
+    CHECK(stats.sends < stats.queued);
+    CHECK(p99 < 50000);
+}
+
+static void TestEcho(TestClient& client) {
+    std::vector<int64_t> latencies;
+    int opcode;
+    std::string payload;
+    int64_t start = NowUs();
+    for(int i = 0; i < 1000; i++) {
+        std::string message = "echo " + std::to_string(i) + std::string(i % 300, 'x');
+        int64_t sent = NowUs();
+        if(!CHECK(client.Send(ClientFrame(HTTPD_WS_TYPE_TEXT, message)))
+           || !CHECK(ReceiveFrame(client, opcode, payload)) || !CHECK_EQUAL(payload, message)) {
+            return;
+        }
+        latencies.push_back(NowUs() - sent);
+    }
+    int64_t elapsed = std::max<int64_t>(NowUs() - start, 1);
+    int64_t p99 = Percentile99(latencies);
+    printf("echo: %.0f round trips/s, p99 %.3f ms\n", latencies.size() * 1e6 / elapsed, p99 / 1000.0);
+    CHECK(p99 < 50000);
+}
+
+int main() {
+    static WebSocketHub hub(4, 65536, 2000);
+    hub.SetMessageHandler(OnMessage);
+    HTTPServer http;
+    uint16_t port = StartTestServer(http);
+    if(port == 0) {
+        return 1;
+    }
+    http.RegisterWebSocket("/ws", &hub);
+
+    TestClient client(port);
+    if(!Handshake(client)) {
+        return TestResult();
+    }
+    CHECK_EQUAL(hub.GetClientCount(), 1u);
+    // Subscribed once the following echo arrives (messages are handled in order)
+    CHECK(client.Send(ClientFrame(HTTPD_WS_TYPE_TEXT, "subscribe")));
+    CHECK(client.Send(ClientFrame(HTTPD_WS_TYPE_TEXT, "ready")));
+    int opcode;
+    std::string payload;
+    CHECK(ReceiveFrame(client, opcode, payload));
+    CHECK_EQUAL(payload, "ready");
+
+    TestPublish(hub, client);
+    TestEcho(client);
+
+    // Pings are answered by the server with the same payload
+    CHECK(client.Send(ClientFrame(HTTPD_WS_TYPE_PING, "ping")));
+    CHECK(ReceiveFrame(client, opcode, payload));
+    CHECK_EQUAL(opcode, (int)HTTPD_WS_TYPE_PONG);
+    CHECK_EQUAL(payload, "ping");
+
+    // Closing is answered and removes the client
+    CHECK(client.Send(ClientFrame(HTTPD_WS_TYPE_CLOSE, "")));
+    CHECK(ReceiveFrame(client, opcode, payload));
+    CHECK_EQUAL(opcode, (int)HTTPD_WS_TYPE_CLOSE);
+    CHECK(client.WaitForClose());
+    for(int i = 0; i < 100 && hub.GetClientCount() > 0; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    CHECK_EQUAL(hub.GetClientCount(), 0u);
+
+    // Unmasked client frames close the connection
+    TestClient unmasked(port);
+    if(Handshake(unmasked)) {
+        CHECK(unmasked.Send(ClientFrame(HTTPD_WS_TYPE_TEXT, "hello", false)));
+        CHECK(unmasked.WaitForClose());
+    }
+
+    httpd_stop(http.server);
+    return TestResult();
+}
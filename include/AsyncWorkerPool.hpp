@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <esp_http_server.h>
+#include <esp_idf_version.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "Router.hpp"
+
+// httpd_req_async_handler_begin() is available since ESP-IDF 5.1
+#ifndef HUMANESPHTTP_ASYNC_HANDLERS
+#define HUMANESPHTTP_ASYNC_HANDLERS (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0))
+#endif
+
+// Default number of worker tasks of an AsyncWorkerPool
+#ifndef HUMANESPHTTP_ASYNC_WORKERS
+#define HUMANESPHTTP_ASYNC_WORKERS 2
+#endif
+
+// Default number of requests waiting for a worker before requests are rejected with 503
+#ifndef HUMANESPHTTP_ASYNC_QUEUE_LENGTH
+#define HUMANESPHTTP_ASYNC_QUEUE_LENGTH 8
+#endif
+
+// Default stack size of the worker tasks in bytes
+#ifndef HUMANESPHTTP_ASYNC_STACK_SIZE
+#define HUMANESPHTTP_ASYNC_STACK_SIZE 4096
+#endif
+
+// Default priority of the worker tasks (same as the httpd task by default)
+#ifndef HUMANESPHTTP_ASYNC_PRIORITY
+#define HUMANESPHTTP_ASYNC_PRIORITY 5
+#endif
+
+/**
+ * Pool of worker tasks running slow handlers outside of the httpd task,
+ * so they don't block other clients (e.g. health checks) while they run.
+ *
+ * A request submitted to the pool is detached from the httpd task using
+ * httpd_req_async_handler_begin() and queued. A worker task then runs
+ * the handler and completes the request. If the queue is full, the client
+ * immediately gets a 503 Service Unavailable response instead.
+ *
+ * Usually used through HTTPServer::RegisterHandler() / RegisterRoute() with HandlerOptions:
+ *
+ *  static AsyncWorkerPool workers(2, 8); // 2 tasks, up to 8 queued requests
+ *  workers.Start();
+ *  HandlerOptions options;
+ *  options.workers = &workers;
+ *  http.RegisterRoute(HTTP_POST, "/api/calibrate", CalibrateHandler, nullptr, options);
+ *
+ * NOTE: Every queued or running request keeps its socket open, so
+ * conf.max_open_sockets should be larger than workers + queue length.
+ * Requires ESP-IDF 5.1 or later, with older versions handlers run on the httpd task.
+ */
+class AsyncWorkerPool {
+public:
+    /**
+     * Function run on a worker task.
+     * params is nullptr for native (non-router) handlers.
+     */
+    typedef esp_err_t (*Function)(httpd_req_t *request, void* context, const RouteParams* params);
+
+    /**
+     * @param core The core to pin the worker tasks to, or tskNO_AFFINITY
+     */
+    AsyncWorkerPool(size_t numWorkers = HUMANESPHTTP_ASYNC_WORKERS,
+                    size_t queueLength = HUMANESPHTTP_ASYNC_QUEUE_LENGTH,
+                    BaseType_t core = tskNO_AFFINITY,
+                    UBaseType_t priority = HUMANESPHTTP_ASYNC_PRIORITY,
+                    uint32_t stackSize = HUMANESPHTTP_ASYNC_STACK_SIZE);
+
+    AsyncWorkerPool(const AsyncWorkerPool&) = delete;
+    AsyncWorkerPool& operator=(const AsyncWorkerPool&) = delete;
+
+    /**
+     * @brief Create the queue and the worker tasks.
+     * The pool must be kept in scope while the server is running (typically a global).
+     */
+    esp_err_t Start();
+
+    /**
+     * @brief Run function(request, context, params) on a worker task,
+     * or send a 503 response if the queue is full.
+     *
+     * The request is handled in both cases, so the return value can be returned
+     * from the httpd handler directly. The params are copied.
+     * If the pool has not been started, the function is called directly.
+     */
+    esp_err_t Submit(httpd_req_t *request, Function function, void* context, const RouteParams* params = nullptr);
+
+    /**
+     * @return The number of requests waiting for a worker
+     */
+    size_t GetQueueDepth() const;
+
+    /**
+     * @return The number of requests rejected with 503 since starting
+     */
+    uint32_t GetRejectedCount() const { return rejected.load(); }
+
+    /**
+     * @return The number of requests completed by the workers since starting
+     */
+    uint32_t GetCompletedCount() const { return completed.load(); }
+
+private:
+    struct Job {
+        httpd_req_t *request; // The detached copy
+        Function function;
+        void* context;
+        bool hasParams;
+        RouteParams params;
+    };
+
+    static void WorkerTask(void* arg);
+
+    size_t numWorkers;
+    size_t queueLength;
+    BaseType_t core;
+    UBaseType_t priority;
+    uint32_t stackSize;
+    QueueHandle_t queue = nullptr;
+    std::atomic<uint32_t> rejected{0};
+    std::atomic<uint32_t> completed{0};
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <esp_http_server.h>
+
+// Maximum number of sub-requests in a batch
+#ifndef HUMANESPHTTP_BATCH_MAX_REQUESTS
+#define HUMANESPHTTP_BATCH_MAX_REQUESTS 32
+#endif
+
+// Maximum size of a batch request body in bytes
+#ifndef HUMANESPHTTP_BATCH_MAX_BODY
+#define HUMANESPHTTP_BATCH_MAX_BODY 2048
+#endif
+
+// Maximum total size of the sub-response bodies in bytes.
+// Bodies beyond this limit are truncated, remaining sub-requests are not run.
+#ifndef HUMANESPHTTP_BATCH_MAX_OUTPUT
+#define HUMANESPHTTP_BATCH_MAX_OUTPUT 32768
+#endif
+
+// Maximum size of the status line and headers of a single sub-response
+#ifndef HUMANESPHTTP_BATCH_MAX_HEAD
+#define HUMANESPHTTP_BATCH_MAX_HEAD 512
+#endif
+
+/**
+ * Runs a sub-request, e.g. by dispatching it to the matching handler (see HTTPServer::ServeBatch())
+ */
+typedef esp_err_t (*BatchDispatcher)(httpd_req_t *subRequest, void* context);
+
+/**
+ * @brief Execute the sub-requests listed in the body of the given request
+ * and send all their responses as a single JSON response
+ *
+ * The body lists one sub-request per line, as "<METHOD> <URI>" or just "<URI>" for GET:
+ *
+ *  GET /api/status
+ *  /api/sensor/3/history?count=10
+ *
+ * Every sub-request is a copy of the batch request (with the same headers) with the
+ * method and URI replaced and an empty body. It is passed to dispatch(subRequest, context)
+ * on the current task. Everything the handler sends is captured (see SendSink) and
+ * streamed into the combined response as soon as it arrives:
+ *
+ *  [{"method":"GET","uri":"/api/status","status":200,
+ *    "headers":{"Content-Type":"application/json"},"body":"{\"status\":\"ok\"}"}, ...]
+ *
+ * Bodies are JSON strings, so they should be text. Sub-requests which fail without
+ * sending a response have an "error" instead of headers and body, bodies exceeding
+ * HUMANESPHTTP_BATCH_MAX_OUTPUT are cut off and marked with "truncated":true.
+ * The combined response is gzip compressed if the client accepts it (see CompressedResponse).
+ *
+ * Requires ESP-IDF 5.1 or later (sub-requests are created with httpd_req_async_handler_begin()).
+ *
+ * IMPORTANT: Sub-requests are copies of the batch request, so ESP-IDF still sees the batch
+ * request's headers and parse state:
+ * - httpd_req_get_url_query_len() and httpd_req_get_url_query_str() locate the query using
+ *   offsets parsed from the batch request's URI, so they return garbage or nothing for the
+ *   sub-request's URI. Handlers which may be batched must read the query from request->uri,
+ *   e.g. using QueryURLParser.
+ * - Responses are captured on the current task: handlers which take over the connection
+ *   (e.g. SSEHub::Handle()) or respond from another task must not be dispatched
+ *   (see IsBatchSubRequest()). Sub-responses are never gzip compressed (see ScopedIdentityEncoding),
+ *   so precompressed static assets get 406 Not Acceptable.
+ * - Capturing replaces the session's send function (see ScopedSendSink), so do not use
+ *   with esp_https_server. Sessions with a transport context (TLS) get 500 Internal Server Error.
+ */
+esp_err_t HandleBatchRequest(httpd_req_t *request, BatchDispatcher dispatch, void* context);
+
+/**
+ * @return true if the given request is a sub-request of a batch running on the current task.
+ * Handlers which take over the connection (e.g. event streams) must refuse these.
+ */
+bool IsBatchSubRequest(httpd_req_t *request);
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <esp_http_server.h>
+
+// LZ77 window of the gzip encoder in bytes (power of two, 512 to 16384).
+// The encoder uses about 4 * window + 2 * 2^HASH_BITS + OUTPUT_SIZE bytes of heap.
+#ifndef HUMANESPHTTP_GZIP_WINDOW
+#define HUMANESPHTTP_GZIP_WINDOW 2048
+#endif
+
+#ifndef HUMANESPHTTP_GZIP_HASH_BITS
+#define HUMANESPHTTP_GZIP_HASH_BITS 10
+#endif
+
+// Maximum number of earlier occurrences compared for each match (speed vs. ratio)
+#ifndef HUMANESPHTTP_GZIP_MAX_CHAIN
+#define HUMANESPHTTP_GZIP_MAX_CHAIN 8
+#endif
+
+// Compressed data is sent in chunks of this size
+#ifndef HUMANESPHTTP_GZIP_OUTPUT_SIZE
+#define HUMANESPHTTP_GZIP_OUTPUT_SIZE 1024
+#endif
+
+// Responses smaller than this are sent uncompressed (with a Content-Length header)
+#ifndef HUMANESPHTTP_GZIP_MIN_SIZE
+#define HUMANESPHTTP_GZIP_MIN_SIZE 512
+#endif
+
+/**
+ * Incremental gzip encoder with bounded memory.
+ *
+ * Uses greedy LZ77 matching over a small sliding window and the fixed
+ * deflate Huffman codes, so there are no frequency tables to build and no
+ * need to buffer a whole block. This compresses repetitive text such as JSON
+ * well (typically 4-8x) with a few KB of RAM, unlike zlib/miniz compressors
+ * which need a 32 KB window plus over 100 KB of tables.
+ *
+ * Usage:
+ *
+ *  GzipEncoder gzip(output, context);
+ *  gzip.Write(data, length); // Any number of times
+ *  gzip.Finish();
+ */
+class GzipEncoder {
+public:
+    /**
+     * Called with compressed data whenever the output buffer is full,
+     * and with the remaining data in Finish().
+     * Return anything but ESP_OK to abort compression.
+     */
+    typedef esp_err_t (*OutputFunction)(void* context, const char* data, size_t length);
+
+    GzipEncoder(OutputFunction output, void* context, size_t window = HUMANESPHTTP_GZIP_WINDOW);
+    ~GzipEncoder();
+
+    GzipEncoder(const GzipEncoder&) = delete;
+    GzipEncoder& operator=(const GzipEncoder&) = delete;
+
+    /**
+     * @return false if the encoder memory could not be allocated
+     */
+    bool IsValid() const { return memory != nullptr; }
+
+    esp_err_t Write(const char* data, size_t length);
+
+    /**
+     * @brief Compress the remaining data and write the gzip trailer
+     */
+    esp_err_t Finish();
+
+    size_t GetInputSize() const { return inputSize; }
+    size_t GetOutputSize() const { return outputSize; }
+
+private:
+    void Process(bool finish);
+    void Slide();
+    void Insert(size_t position);
+    void PutBits(uint32_t value, unsigned count);
+    void PutByte(uint8_t value);
+    void PutSymbol(unsigned symbol);
+    void PutMatch(size_t length, size_t distance);
+    void FlushOutput();
+
+    OutputFunction output;
+    void* context;
+    size_t window;
+    uint8_t* memory = nullptr;
+    uint16_t* head = nullptr; // Last position + 1 of each hash, 0 if none
+    uint16_t* prev = nullptr; // Previous position + 1 with the same hash, by position % window
+    uint8_t* buffer = nullptr; // 2 * window bytes: window history and lookahead
+    uint8_t* out = nullptr;
+    size_t position = 0; // Next byte to encode
+    size_t end = 0;      // End of the data in buffer
+    size_t outLength = 0;
+    uint32_t bits = 0;
+    unsigned bitCount = 0;
+    uint32_t crc = 0;
+    size_t inputSize = 0;
+    size_t outputSize = 0;
+    esp_err_t error = ESP_OK;
+};
+
+/**
+ * @return true if the request's Accept-Encoding header allows gzip
+ * (always false within a ScopedIdentityEncoding)
+ */
+bool AcceptsGzip(httpd_req_t *request);
+
+/**
+ * Disables gzip (see AcceptsGzip()) for responses sent on the current task while in scope,
+ * e.g. while responses are captured into another response which is compressed as a whole
+ * (see HandleBatchRequest()). Scopes may be nested.
+ */
+class ScopedIdentityEncoding {
+public:
+    ScopedIdentityEncoding();
+    ~ScopedIdentityEncoding();
+
+    ScopedIdentityEncoding(const ScopedIdentityEncoding&) = delete;
+    ScopedIdentityEncoding& operator=(const ScopedIdentityEncoding&) = delete;
+
+private:
+    bool previous;
+};
+
+/**
+ * Response stream which is gzip compressed if the client accepts it
+ * and the response is large enough (HUMANESPHTTP_GZIP_MIN_SIZE).
+ *
+ * Data is compressed incrementally and sent as chunks whenever the compressed
+ * output buffer is full. Small responses and clients without gzip support get
+ * the identity encoding. Set the content type and other headers before writing.
+ *
+ * Usage:
+ *
+ *  httpd_resp_set_type(request, "application/json");
+ *  CompressedResponse response(request);
+ *  response.Write(data, length); // Any number of times
+ *  return response.Finish();
+ *
+ * or with a JSONWriter:
+ *
+ *  CompressedResponse response(request);
+ *  JSONWriter json(CompressedResponse::Output, &response);
+ *  // ...
+ *  json.Finish();
+ *  return response.Finish();
+ */
+class CompressedResponse {
+public:
+    CompressedResponse(httpd_req_t *request);
+
+    CompressedResponse(const CompressedResponse&) = delete;
+    CompressedResponse& operator=(const CompressedResponse&) = delete;
+
+    esp_err_t Write(const char* data, size_t length);
+
+    /**
+     * @brief Send the remaining data and finish the response
+     */
+    esp_err_t Finish();
+
+    /**
+     * JSONWriter::OutputFunction writing to the CompressedResponse given as context
+     */
+    static esp_err_t Output(void* context, const char* data, size_t length);
+
+    /**
+     * @return true if the response is being sent gzip compressed
+     */
+    bool IsCompressed() const { return encoder != nullptr; }
+
+private:
+    enum class State { Buffering, Compressing, Identity, Finished };
+
+    /**
+     * Choose the encoding once the response is too large to be sent in one piece
+     */
+    void Start();
+    static esp_err_t SendChunk(void* context, const char* data, size_t length);
+
+    httpd_req_t *request;
+    State state = State::Buffering;
+    bool acceptsGzip;
+    std::unique_ptr<GzipEncoder> encoder;
+    esp_err_t error = ESP_OK;
+    char pending[HUMANESPHTTP_GZIP_MIN_SIZE];
+    size_t pendingLength = 0;
+};
+
+/**
+ * @brief Send the given body, gzip compressed if the client accepts it
+ * and it's at least HUMANESPHTTP_GZIP_MIN_SIZE bytes long (see CompressedResponse)
+ */
+esp_err_t SendCompressed(httpd_req_t *request, const char* data, size_t length);
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <esp_http_server.h>
+#include <esp_timer.h>
+
+// Close connections without activity for this long (0 disables idle reaping)
+#ifndef HUMANESPHTTP_CONN_IDLE_TIMEOUT_MS
+#define HUMANESPHTTP_CONN_IDLE_TIMEOUT_MS 30000
+#endif
+
+// Number of socket slots kept free for new clients by closing idle connections
+#ifndef HUMANESPHTTP_CONN_RESERVED_SLOTS
+#define HUMANESPHTTP_CONN_RESERVED_SLOTS 1
+#endif
+
+// Connections with activity within this time are never closed to free a slot
+#ifndef HUMANESPHTTP_CONN_PURGE_MIN_IDLE_MS
+#define HUMANESPHTTP_CONN_PURGE_MIN_IDLE_MS 1000
+#endif
+
+/**
+ * State of an open connection, see ConnectionManager::GetConnections()
+ */
+struct ConnectionInfo {
+    int sockfd = -1;
+    int64_t openedUs = 0;       // esp_timer_get_time() when accepted
+    int64_t lastActivityUs = 0; // Last data received or sent
+    uint32_t requests = 0;      // Requests (or WebSocket frames) received, pipelined requests count once
+    uint32_t bytesReceived = 0;
+    uint32_t bytesSent = 0;
+    uint16_t activeRequests = 0; // Handlers running on worker tasks
+    bool receiving = false;     // Last activity was receiving
+    bool streaming = false;     // Event stream or WebSocket (the session has a context)
+    bool closing = false;       // Close has been triggered
+};
+
+/**
+ * Totals since the server has been started, see ConnectionManager::GetStats()
+ */
+struct ConnectionStats {
+    uint32_t open = 0;
+    uint32_t accepted = 0;
+    uint32_t closed = 0;     // Including the ones below
+    uint32_t idleClosed = 0; // Closed after the idle timeout
+    uint32_t purged = 0;     // Closed to keep a slot free for new clients
+};
+
+/**
+ * Connection lifecycle manager, to keep socket slots (conf.max_open_sockets)
+ * available for productive traffic. By default, a few browser tabs holding
+ * idle keep-alive connections can lock out other clients such as a monitoring scraper.
+ *
+ * The manager tracks every connection (open time, last activity, requests, bytes) and
+ *  - closes connections without activity for longer than the idle timeout
+ *  - closes an idle connection whenever a new connection takes the last free slots,
+ *    so that the next client can connect. Connections with recent activity, handlers
+ *    still running on worker tasks and event stream / WebSocket subscribers
+ *    are never closed this way, idle plain HTTP connections are closed first
+ *    (longest idle first).
+ * This replaces ESP-IDF's LRU purge (conf.lru_purge_enable), which may close any connection.
+ *
+ * Usage:
+ *
+ *  static ConnectionManager connections;
+ *  http.EnableConnectionManager(&connections); // Before StartServer()
+ *
+ * The manager uses conf.open_fn, conf.close_fn (previously set functions are still called)
+ * and conf.global_user_ctx, and installs session send/recv overrides
+ * (so do not use with esp_https_server). Subscribers are detected by their session context,
+ * so they should be sent data (e.g. SSEHub::Ping()) to detect dead clients.
+ */
+class ConnectionManager {
+public:
+    ConnectionManager(uint32_t idleTimeoutMs = HUMANESPHTTP_CONN_IDLE_TIMEOUT_MS,
+                      size_t reservedSlots = HUMANESPHTTP_CONN_RESERVED_SLOTS,
+                      uint32_t purgeMinIdleMs = HUMANESPHTTP_CONN_PURGE_MIN_IDLE_MS);
+    ~ConnectionManager();
+
+    ConnectionManager(const ConnectionManager&) = delete;
+    ConnectionManager& operator=(const ConnectionManager&) = delete;
+
+    /**
+     * @brief Install the manager's hooks in the given config, before httpd_start()
+     * @return ESP_ERR_INVALID_STATE if conf.global_user_ctx is already in use
+     */
+    esp_err_t Attach(httpd_config_t& conf);
+
+    /**
+     * @brief Start idle reaping, after httpd_start()
+     */
+    esp_err_t Start(httpd_handle_t server);
+
+    ConnectionStats GetStats();
+
+    /**
+     * @brief Copy the state of up to maxCount open connections into connections
+     * @return The number of connections copied
+     */
+    size_t GetConnections(ConnectionInfo* connections, size_t maxCount);
+
+    /**
+     * @brief Send the stats and all open connections as JSON
+     */
+    esp_err_t SendJSON(httpd_req_t *request);
+
+    /**
+     * Marks the request's connection as busy while in scope,
+     * so it is not closed while a handler is running on a worker task.
+     * Does nothing if manager is nullptr.
+     */
+    class RequestScope {
+    public:
+        RequestScope(ConnectionManager* manager, httpd_req_t *request);
+        ~RequestScope();
+
+        RequestScope(const RequestScope&) = delete;
+        RequestScope& operator=(const RequestScope&) = delete;
+
+    private:
+        ConnectionManager* manager;
+        int sockfd;
+    };
+
+private:
+    static esp_err_t OnOpen(httpd_handle_t hd, int sockfd);
+    static void OnClose(httpd_handle_t hd, int sockfd);
+    static int Receive(httpd_handle_t hd, int sockfd, char *buf, size_t length, int flags);
+    static void OnSend(httpd_handle_t hd, int sockfd, size_t length);
+    static void ReapTimer(void* arg);
+    static void ReapWork(void* arg);
+    static void FreeContext(void*) {} // The manager is not owned by ESP-IDF
+
+    ConnectionInfo* Find(int sockfd);
+    /**
+     * Close connections idle for longer than the timeout (httpd task only)
+     */
+    void Reap();
+    /**
+     * Close the best connection to free a slot for new clients (httpd task only)
+     */
+    void Purge(int newSockfd);
+    void UpdateStreaming(ConnectionInfo& connection);
+    void Close(int sockfd);
+
+    uint32_t idleTimeoutMs;
+    size_t reservedSlots;
+    uint32_t purgeMinIdleMs;
+    size_t maxConnections = 0;
+    httpd_open_func_t userOpen = nullptr;
+    httpd_close_func_t userClose = nullptr;
+    httpd_handle_t server = nullptr;
+    esp_timer_handle_t timer = nullptr;
+
+    std::mutex mutex;
+    std::vector<ConnectionInfo> connections; // Slot per socket, sockfd -1 if unused
+    ConnectionStats stats;
+};
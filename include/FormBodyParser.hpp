@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <esp_http_server.h>
+
+// Size of the FormBodyParser receive buffer.
+// This limits the length of a single key + value pair (after decoding),
+// but not the size of the body.
+#ifndef HUMANESPHTTP_FORM_BUFFER_SIZE
+#define HUMANESPHTTP_FORM_BUFFER_SIZE 512
+#endif
+
+/**
+ * A form field to be extracted by FormBodyParser::Parse(FormBodyField*, size_t).
+ * The decoded value is copied into the given buffer and NUL-terminated.
+ */
+struct FormBodyField {
+    const char* key;
+    char* buffer;
+    size_t bufferSize;
+    size_t length = 0; // Length of the value in buffer
+    bool found = false;
+    bool truncated = false; // The value did not fit into the buffer
+
+    FormBodyField(const char* key, char* buffer, size_t bufferSize)
+        : key(key), buffer(buffer), bufferSize(bufferSize) {}
+};
+
+/**
+ * Streaming parser for application/x-www-form-urlencoded POST bodies.
+ *
+ * The body is pulled with httpd_req_recv() into a fixed-size buffer and
+ * parsed incrementally, so RAM usage is constant regardless of the body size.
+ * Keys and values are URL-decoded while parsing (also if an escape
+ * sequence is split between two receive calls) and each complete pair
+ * is delivered to a callback.
+ *
+ * Uses the same tokenizer and decoder as QueryURLParser.
+ *
+ * Usage:
+ *
+ *  FormBodyParser form(request);
+ *  esp_err_t err = form.ForEachPair([](const char* key, size_t keyLength,
+ *                                      const char* value, size_t valueLength) {
+ *      // key and value are decoded and NUL-terminated,
+ *      // but only valid during the callback
+ *      return ESP_OK; // Anything else aborts parsing
+ *  });
+ *
+ * or, to extract a fixed set of fields:
+ *
+ *  char ssid[33], password[65];
+ *  FormBodyField fields[] = {{"ssid", ssid, sizeof(ssid)}, {"password", password, sizeof(password)}};
+ *  esp_err_t err = form.Parse(fields, 2);
+ */
+class FormBodyParser {
+public:
+    /**
+     * Called for every key/value pair. Return anything but ESP_OK to abort parsing.
+     */
+    typedef esp_err_t (*PairCallback)(void* context, const char* key, size_t keyLength,
+                                      const char* value, size_t valueLength);
+
+    FormBodyParser(httpd_req_t *request);
+
+    FormBodyParser(const FormBodyParser&) = delete;
+    FormBodyParser& operator=(const FormBodyParser&) = delete;
+
+    /**
+     * @brief Receive and parse the whole body
+     * Must only be called once per request.
+     *
+     * @return ESP_OK,
+     *         ESP_ERR_INVALID_SIZE if a single pair does not fit into the buffer,
+     *         ESP_FAIL if receiving the body failed,
+     *         or the first error returned by the callback
+     */
+    esp_err_t Parse(PairCallback callback, void* context);
+
+    /**
+     * @brief Receive and parse the whole body, copying the values of the given fields
+     * Unknown keys are ignored. If a key occurs multiple times, the first value is used.
+     *
+     * @return See Parse(PairCallback, void*)
+     */
+    esp_err_t Parse(FormBodyField* fields, size_t numFields);
+
+    /**
+     * @brief Receive and parse the whole body, calling
+     * callback(key, keyLength, value, valueLength) for every pair.
+     * The callback must return an esp_err_t.
+     */
+    template<typename Callback>
+    esp_err_t ForEachPair(Callback&& callback) {
+        typedef typename std::remove_reference<Callback>::type CallbackType;
+        return Parse([](void* context, const char* key, size_t keyLength,
+                        const char* value, size_t valueLength) -> esp_err_t {
+            return (*static_cast<CallbackType*>(context))(key, keyLength, value, valueLength);
+        }, const_cast<void*>(static_cast<const void*>(&callback)));
+    }
+
+private:
+    /**
+     * Tokenize and decode the received data in the buffer,
+     * delivering complete pairs.
+     * @param final true if the end of the body has been received
+     */
+    esp_err_t Process(bool final, PairCallback callback, void* context);
+    /**
+     * Move the current (incomplete) pair to the start of the buffer
+     */
+    void Compact();
+
+    httpd_req_t *request;
+    // Buffer layout: [completed pairs][current pair, decoded][raw data not yet processed]
+    size_t pairStart = 0;   // Start of the current pair
+    size_t valueStart = 0;  // Start of the current value (if inValue)
+    size_t decodedEnd = 0;  // End of the decoded part of the current pair
+    size_t rawStart = 0;    // Start of the raw data
+    size_t filled = 0;      // End of the raw data
+    bool inValue = false;   // The '=' of the current pair has been seen
+    char buffer[HUMANESPHTTP_FORM_BUFFER_SIZE + 1]; // +1 for the NUL terminator of the last value
+};
@@ -1,7 +1,45 @@
 #pragma once
 
 #include "HTTPServer.hpp"
+#include "Router.hpp"
+#include "StaticAssets.hpp"
+#include "ResponseCache.hpp"
+#include "AsyncWorkerPool.hpp"
+#include "SSEHub.hpp"
+#include "WebSocketHub.hpp"
+#include "Metrics.hpp"
+#include "RequestArena.hpp"
+#include "ConnectionManager.hpp"
+#include "RateLimiter.hpp"
+#include "BatchRequest.hpp"
 #include <esp_http_server.h>
+#include <memory>
+#include <vector>
+
+/**
+ * Optional behaviour of a handler or route,
+ * see HTTPServer::RegisterHandler() and HTTPServer::RegisterRoute()
+ */
+struct HandlerOptions {
+    /**
+     * Cache responses in this cache (only GET/HEAD, see ResponseCache)
+     */
+    ResponseCache* cache = nullptr;
+    /**
+     * How long cached responses are served, in milliseconds
+     */
+    uint32_t cacheTTL = 1000;
+    /**
+     * Run the handler on a worker task of this pool instead of the httpd task
+     * (for slow handlers, see AsyncWorkerPool)
+     */
+    AsyncWorkerPool* workers = nullptr;
+    /**
+     * Global limit for this handler (may be shared by several handlers).
+     * Requests over the limit get a 503 response with Retry-After (see TokenBucket)
+     */
+    TokenBucket* rateLimit = nullptr;
+};
 
 /**
  * HTTP server.
@@ -10,6 +48,12 @@
  * Usage:
  * First call http.StartServer()
  * Then call http.RegisterHandler(...) for all handlers
+ * and/or http.RegisterRoute(...) for all routes
+ *
+ * NOTE: Registering the first route (or static assets) before StartServer() sets
+ * conf.uri_match_fn to httpd_uri_match_wildcard (required for the router's
+ * catch-all handlers), so native handler URIs ending with '*' or '?' are then
+ * matched as wildcards. Otherwise, conf is left unchanged.
  */
 class HTTPServer {
 public:
@@ -27,9 +71,180 @@ public:
      * This is typically called multiple times.
      * Note that the handler is not copied, so it must be kept in scope.
      * Typically, declare const handler objects globally.
+     *
+     * Native handlers take precedence over routes registered with RegisterRoute().
      */
     void RegisterHandler(const httpd_uri_t *uri_handler);
 
+    /**
+     * @brief Registers a handler with the given options (e.g. response caching, async execution)
+     * The handler is wrapped, the wrapper is stored in the HTTPServer.
+     */
+    void RegisterHandler(const httpd_uri_t *uri_handler, const HandlerOptions& options);
+
+    /**
+     * @brief Registers a route which is dispatched by the built-in router
+     *
+     * The pattern may contain {name} captures spanning a whole path segment,
+     * e.g. "/api/sensor/{id}/history". The handler reads them from its
+     * RouteParams argument. The pattern is not copied, so it must be kept in scope
+     * (typically a string literal).
+     *
+     * All routes of the same method share a single ESP-IDF handler slot
+     * (see conf.max_uri_handlers), and dispatch cost does not depend on
+     * the number of routes. Unmatched requests get a 404 JSON response.
+     *
+     * May be called before or after StartServer(), but not concurrently with requests.
+     * If no route is registered before StartServer(), set
+     * conf.uri_match_fn = httpd_uri_match_wildcard before starting the server.
+     */
+    void RegisterRoute(httpd_method_t method, const char* pattern, RouteHandler handler, void* user_ctx = nullptr);
+
+    /**
+     * @brief Registers a route with the given options (e.g. response caching, async execution)
+     */
+    void RegisterRoute(httpd_method_t method, const char* pattern, RouteHandler handler,
+                       void* user_ctx, const HandlerOptions& options);
+
+    /**
+     * @brief Serve the given static assets for all GET requests not matching
+     * a native handler or a route (see StaticAssetServer)
+     * Uses the router's catch-all handler, so no additional handler slot is needed.
+     * The asset server is not copied, so it must be kept in scope.
+     */
+    void ServeStaticAssets(const StaticAssetServer* assets);
+
+    /**
+     * @brief Registers a GET route accepting Server-Sent Events clients for the given hub
+     * (see SSEHub). The pattern and the hub are not copied, so they must be kept in scope.
+     */
+    void RegisterEventStream(const char* pattern, SSEHub* hub);
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    /**
+     * @brief Registers a WebSocket endpoint for the given hub (see WebSocketHub)
+     * Uses a native handler slot. The URI and the hub are not copied, so they must be kept in scope.
+     *
+     * ESP-IDF calls the handler for every frame, so WebSocket endpoints are neither measured
+     * nor given a request arena. With EnableRateLimit(), only the handshake is limited:
+     * since ESP-IDF has already answered it, clients over the limit are disconnected.
+     */
+    void RegisterWebSocket(const char* uri, WebSocketHub* hub);
+#endif
+
+    /**
+     * @brief Measure all handlers and routes registered after this call (see Metrics)
+     * The metrics object is not copied, so it must be kept in scope.
+     */
+    void EnableMetrics(Metrics* metrics);
+
+    /**
+     * @brief Registers routes serving the metrics enabled by EnableMetrics()
+     * in the Prometheus text format and (optionally) as JSON
+     */
+    void ServeMetrics(const char* prometheusPath = "/metrics", const char* jsonPath = nullptr);
+
+    /**
+     * @brief Give all handlers and routes registered after this call a request arena
+     * of the given size (see RequestArena), which is reset when the handler returns.
+     * Peak arena use is recorded per route if metrics are enabled.
+     */
+    void EnableRequestArena(size_t size = HUMANESPHTTP_REQUEST_ARENA_SIZE);
+
+    /**
+     * @brief Track connections, close idle ones and keep socket slots free for new clients
+     * (see ConnectionManager). Must be called before StartServer() and before
+     * registering handlers with worker pools. The manager is not copied, so it must be kept in scope.
+     */
+    void EnableConnectionManager(ConnectionManager* manager);
+
+    /**
+     * @brief Limit the request rate per client for all handlers and routes registered after this call
+     * (see RateLimiter). Requests over the limit are answered with 429 before the handler runs.
+     * The limiter is not copied, so it must be kept in scope.
+     */
+    void EnableRateLimit(RateLimiter* limiter);
+
+    /**
+     * @brief Registers a POST route executing batches of requests to the other handlers and routes
+     * in a single HTTP request (see HandleBatchRequest())
+     * WebSocket endpoints and event streams can't be part of a batch.
+     * Handlers with HandlerOptions::workers run on the httpd task when called from a batch.
+     * Do not use with esp_https_server (responses are captured by replacing the send function).
+     */
+    void ServeBatch(const char* path = "/batch");
+
     httpd_handle_t server = nullptr;
     httpd_config_t conf;
-};
\ No newline at end of file
+    Router router;
+
+private:
+    /**
+     * A handler or route registered with HandlerOptions
+     */
+    struct HandlerRecord {
+        esp_err_t (*handler)(httpd_req_t *request) = nullptr;
+        RouteHandler routeHandler = nullptr;
+        void* userCtx = nullptr;
+        HandlerOptions options;
+        RouteMetrics* metrics = nullptr;
+        size_t arenaSize = 0;
+        ConnectionManager* connections = nullptr; // Only for handlers running on worker tasks
+        RateLimiter* rateLimiter = nullptr;
+    };
+
+    struct HandlerCall {
+        HandlerRecord* record;
+        const RouteParams* params; // nullptr for native handlers
+    };
+
+    /**
+     * Install the catch-all handler dispatching to the router for the given method
+     */
+    void RegisterRouterHandler(httpd_method_t method);
+    /**
+     * Dispatch requests of the given method to the router (and enable wildcard matching)
+     */
+    void EnableRouter(httpd_method_t method);
+    void RegisterNativeHandler(const httpd_uri_t *uri_handler);
+    /**
+     * @return true if handlers have to be wrapped even without options
+     */
+    bool WrapAllHandlers() const { return metrics != nullptr || arenaSize > 0 || rateLimiter != nullptr; }
+    void AddRouterRoute(httpd_method_t method, const char* pattern, RouteHandler handler, void* user_ctx);
+    HandlerRecord* AddHandlerRecord(httpd_method_t method, const char* route, void* userCtx, const HandlerOptions& options);
+
+    /**
+     * Run the handler of the given record (context), applying its options.
+     * Called on the httpd task or on a worker task.
+     */
+    static esp_err_t InvokeHandler(httpd_req_t *request, void* context, const RouteParams* params);
+    /**
+     * Run the handler of the given record now or submit it to the record's worker pool
+     */
+    static esp_err_t ScheduleHandler(HandlerRecord* record, httpd_req_t *request, const RouteParams* params);
+    static esp_err_t CallHandler(httpd_req_t *request, void* context);
+    static esp_err_t CallCachedHandler(httpd_req_t *request, void* context);
+    // ESP-IDF and router handler functions for handlers with options (user_ctx is the record)
+    static esp_err_t WrappedHandler(httpd_req_t *request);
+    static esp_err_t WrappedRoute(httpd_req_t *request, const RouteParams& params);
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    /**
+     * ESP-IDF handler function for rate limited WebSocket endpoints (user_ctx is the record)
+     */
+    static esp_err_t LimitedWebSocket(httpd_req_t *request);
+#endif
+    /**
+     * Run a batch sub-request (context) like the ESP-IDF server would:
+     * the first matching native handler, otherwise the router
+     */
+    static esp_err_t DispatchSubRequest(httpd_req_t *request, void* context);
+
+    uint64_t routerMethods = 0; // Bit i: routes for method i exist
+    Metrics* metrics = nullptr;
+    size_t arenaSize = 0;
+    ConnectionManager* connections = nullptr;
+    RateLimiter* rateLimiter = nullptr;
+    std::vector<std::unique_ptr<HandlerRecord>> handlerRecords;
+    std::vector<httpd_uri_t> nativeHandlers; // In registration order, for batches
+};
@@ -1,14 +1,56 @@
 #pragma once
 #include <esp_http_server.h>
 
+// Define HUMANESPHTTP_STATIC_RESPONSES to true to send the constant responses
+// below with a single precomputed raw send (requires C++17) instead of httpd_resp_send().
+// The raw send ignores the status and the headers set using httpd_resp_set_status()
+// and httpd_resp_set_hdr(), so only enable it if no handler relies on them.
+#ifndef HUMANESPHTTP_STATIC_RESPONSES
+#define HUMANESPHTTP_STATIC_RESPONSES false
+#endif
+
+// Extra header lines (each terminated by "\r\n") which are included in the
+// precomputed constant responses, e.g. "Access-Control-Allow-Origin: *\r\n"
+#ifndef HUMANESPHTTP_STATIC_RESPONSE_HEADERS
+#define HUMANESPHTTP_STATIC_RESPONSE_HEADERS ""
+#endif
+
 /**
  * Send {"status":"ok"} as JSON response
+ *
+ * With HUMANESPHTTP_STATIC_RESPONSES, the response is precomputed at compile time
+ * and sent with a single write.
  */
 esp_err_t SendStatusOK(httpd_req_t *request);
 
 /**
- * Send {"status":"error", "error": "<description>"} as JSON response
+ * Send {"status":"error","error":"<description>"} as JSON response
  * 
- * NOTE: Currently, <description> is not escaped, so it must not contain any JSON special characters.
+ * <description> is escaped, so it may contain any characters.
+ * The response is sent in a single write with a Content-Length header.
+ */
+esp_err_t SendStatusError(httpd_req_t *request, const char* description);
+
+/**
+ * Send a constant 400 Bad Request response with the JSON body
+ * {"status":"error","error":"Bad request"}
+ */
+esp_err_t SendStatusBadRequest(httpd_req_t *request);
+
+/**
+ * Send a constant 404 Not Found response with the JSON body
+ * {"status":"error","error":"Not found"}
+ */
+esp_err_t SendStatusNotFound(httpd_req_t *request);
+
+/**
+ * Send a constant 500 Internal Server Error response with the JSON body
+ * {"status":"error","error":"Internal server error"}
+ */
+esp_err_t SendStatusInternalServerError(httpd_req_t *request);
+
+/**
+ * Send a constant 503 Service Unavailable response with the JSON body
+ * {"status":"error","error":"Service unavailable"}
  */
-esp_err_t SendStatusError(httpd_req_t *request, const char* description);
\ No newline at end of file
+esp_err_t SendStatusServiceUnavailable(httpd_req_t *request);
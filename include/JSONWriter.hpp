@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_http_server.h>
+
+// Size of the JSONWriter output buffer.
+// Responses up to this size are sent in a single write with a Content-Length header,
+// larger responses are sent as chunked encoding, one full buffer per chunk.
+#ifndef HUMANESPHTTP_JSON_BUFFER_SIZE
+#define HUMANESPHTTP_JSON_BUFFER_SIZE 512
+#endif
+
+// Maximum nesting depth of objects/arrays
+#define HUMANESPHTTP_JSON_MAX_DEPTH 32
+
+/**
+ * Streaming JSON writer.
+ *
+ * Serializes JSON directly into a fixed-size buffer and only sends data
+ * to the client when the buffer is full, so it uses constant RAM for
+ * arbitrarily large responses and does not allocate.
+ * Commas and colons are inserted automatically and strings are escaped.
+ *
+ * Usage:
+ *
+ *  JSONWriter json(request);
+ *  json.BeginObject();
+ *  json.Key("value").Number(1.5);
+ *  json.Key("name").String("Hello \"world\"");
+ *  json.Key("list").BeginArray().Number(1).Number(2).EndArray();
+ *  json.EndObject();
+ *  return json.Finish();
+ *
+ * The content type is set to application/json on construction.
+ * Set the status (httpd_resp_set_status) before the first flush,
+ * i.e. typically before writing anything.
+ */
+class JSONWriter {
+public:
+    /**
+     * Output function for writing JSON somewhere other than a HTTP response.
+     * Called with a full buffer whenever it fills up, and once more
+     * for the remaining data in Finish().
+     * Return anything but ESP_OK to abort serialization.
+     */
+    typedef esp_err_t (*OutputFunction)(void* context, const char* data, size_t length);
+
+    JSONWriter(httpd_req_t *request);
+
+    /**
+     * Serialize to the given output function instead of a HTTP response
+     * (e.g. to a file, a socket or a buffer for benchmarking).
+     */
+    JSONWriter(OutputFunction output, void* context);
+
+    JSONWriter(const JSONWriter&) = delete;
+    JSONWriter& operator=(const JSONWriter&) = delete;
+
+    JSONWriter& BeginObject();
+    JSONWriter& EndObject();
+    JSONWriter& BeginArray();
+    JSONWriter& EndArray();
+
+    /**
+     * Write an object key. Must be followed by exactly one value.
+     */
+    JSONWriter& Key(const char* key);
+    JSONWriter& Key(const char* key, size_t length);
+
+    /**
+     * Write an escaped string value. nullptr is written as null.
+     */
+    JSONWriter& String(const char* value);
+    JSONWriter& String(const char* value, size_t length);
+
+    /**
+     * Write an escaped string value in pieces, e.g. while it is being received:
+     * BeginString(), then any number of StringPart(), then EndString()
+     */
+    JSONWriter& BeginString();
+    JSONWriter& StringPart(const char* value, size_t length);
+    JSONWriter& EndString();
+
+    JSONWriter& Number(int value) { return Number((long long)value); }
+    JSONWriter& Number(unsigned int value) { return Number((unsigned long long)value); }
+    JSONWriter& Number(long value) { return Number((long long)value); }
+    JSONWriter& Number(unsigned long value) { return Number((unsigned long long)value); }
+    JSONWriter& Number(long long value);
+    JSONWriter& Number(unsigned long long value);
+
+    /**
+     * Write a floating point value with (at most) the given number of decimals.
+     * Trailing zeros are removed. NaN and infinity are written as null
+     * since JSON can't represent them.
+     */
+    JSONWriter& Number(double value, uint8_t decimals = 6);
+    JSONWriter& Number(float value, uint8_t decimals = 6) { return Number((double)value, decimals); }
+
+    JSONWriter& Bool(bool value);
+    JSONWriter& Null();
+
+    /**
+     * Write an already serialized JSON value verbatim
+     */
+    JSONWriter& Raw(const char* json, size_t length);
+
+    /**
+     * Send the remaining data and finish the response.
+     * If nothing has been flushed yet, the whole response is sent
+     * in a single write including a Content-Length header.
+     * Must be called exactly once.
+     *
+     * @return ESP_OK or the first error which occurred while sending
+     */
+    esp_err_t Finish();
+
+    /**
+     * @return The first error which occurred while sending, or ESP_OK
+     */
+    esp_err_t GetError() const { return error; }
+
+private:
+    /**
+     * Insert a comma if required, to be called before any value or key
+     */
+    void BeginValue();
+    /**
+     * Mark the current container as non-empty
+     */
+    void EndValue();
+    void Open(char bracket);
+    void Close(char bracket);
+
+    void Write(const char* data, size_t length);
+    void Put(char c);
+    void WriteEscaped(const char* str, size_t length);
+    /**
+     * Send the buffer contents as a chunk
+     */
+    void Flush();
+    /**
+     * Send the given data as a chunk (or to the output function)
+     */
+    void SendChunk(const char* data, size_t length);
+
+    httpd_req_t *request = nullptr;
+    OutputFunction output = nullptr;
+    void* outputContext = nullptr;
+    esp_err_t error = ESP_OK;
+    size_t length = 0;
+    bool chunked = false; // At least one chunk has been sent
+    bool afterKey = false;
+    uint8_t depth = 0;
+    uint32_t nonEmpty = 0; // Bit i: container at depth i already contains a value
+    char buffer[HUMANESPHTTP_JSON_BUFFER_SIZE];
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <esp_http_server.h>
+
+// Maximum number of instrumented handlers and routes
+#ifndef HUMANESPHTTP_METRICS_MAX_ROUTES
+#define HUMANESPHTTP_METRICS_MAX_ROUTES 32
+#endif
+
+/**
+ * Request metrics of a single handler or route.
+ *
+ * All counters are 32-bit atomics which are updated without locks
+ * (64-bit atomics are not lock-free on ESP32). They wrap around,
+ * which Prometheus treats like a counter reset.
+ */
+struct RouteMetrics {
+    /**
+     * Number of latency histogram buckets. Bucket i counts requests taking
+     * up to 64 µs * 2^i, the last bucket counts all slower requests.
+     */
+    static constexpr size_t NumBuckets = 16;
+    static constexpr uint32_t FirstBucketUs = 64;
+
+    httpd_method_t method;
+    const char* route; // Handler URI or route pattern
+
+    std::atomic<uint32_t> requests{0};
+    std::atomic<uint32_t> statusClasses[5]; // 1xx to 5xx
+    std::atomic<uint32_t> errors{0};        // Handler returned an error (connection is closed)
+    std::atomic<uint32_t> bytesSent{0};     // Including status line and headers
+    std::atomic<uint32_t> latencySumUs{0};
+    std::atomic<uint32_t> arenaPeak{0};     // Largest request arena use of a single request in bytes
+    std::atomic<uint32_t> buckets[NumBuckets];
+
+    RouteMetrics();
+
+    /**
+     * @brief Record a request
+     * @param status The response status code, or 0 if nothing has been sent
+     */
+    void Record(uint32_t latencyUs, int status, uint32_t bytes, bool error);
+
+    /**
+     * @brief Record the request arena use of a request (see RequestArena)
+     */
+    void RecordArenaUse(uint32_t bytes);
+
+    /**
+     * @return The index of the histogram bucket for the given latency
+     */
+    static size_t BucketIndex(uint32_t latencyUs);
+
+    /**
+     * @return The upper bound of the given histogram bucket in µs
+     */
+    static uint32_t BucketUpperBoundUs(size_t index) { return FirstBucketUs << index; }
+};
+
+/**
+ * Per-route request metrics: request count, status class counts,
+ * bytes sent and a log-scale latency histogram for every instrumented
+ * handler and route.
+ *
+ * Usage (see HTTPServer::EnableMetrics()):
+ *
+ *  static Metrics metrics;
+ *  http.EnableMetrics(&metrics); // Before registering handlers
+ *  http.RegisterHandler(...);
+ *  http.ServeMetrics("/metrics", "/metrics.json");
+ *
+ * Responses are measured using a SendObserver (session send override),
+ * so do not use with esp_https_server.
+ */
+class Metrics {
+public:
+    Metrics() = default;
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    /**
+     * @brief Add a handler or route to be measured
+     * The route string is not copied, so it must be kept in scope.
+     * @return The metrics of the route, or nullptr if HUMANESPHTTP_METRICS_MAX_ROUTES has been exceeded
+     */
+    RouteMetrics* AddRoute(httpd_method_t method, const char* route);
+
+    typedef esp_err_t (*Handler)(httpd_req_t *request, void* context);
+
+    /**
+     * @brief Call handler(request, context) and record it in the given route metrics
+     */
+    static esp_err_t Measure(httpd_req_t *request, RouteMetrics* route, Handler handler, void* context);
+
+    size_t GetRouteCount() const { return count.load(std::memory_order_acquire); }
+    const RouteMetrics& GetRoute(size_t index) const { return routes[index]; }
+
+    /**
+     * @brief Send all metrics in the Prometheus text exposition format
+     */
+    esp_err_t SendPrometheus(httpd_req_t *request) const;
+
+    /**
+     * @brief Send all metrics as JSON
+     * (one object per route, with non-cumulative histogram bucket counts)
+     */
+    esp_err_t SendJSON(httpd_req_t *request) const;
+
+private:
+    RouteMetrics routes[HUMANESPHTTP_METRICS_MAX_ROUTES];
+    std::atomic<size_t> count{0};
+};
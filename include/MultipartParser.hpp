@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_http_server.h>
+
+// Size of the receive buffer, which is allocated once per upload.
+// Larger buffers mean fewer httpd_req_recv() calls and larger sink writes,
+// use MultipartStats to tune it. The headers of a single part must fit into it.
+#ifndef HUMANESPHTTP_MULTIPART_BUFFER_SIZE
+#define HUMANESPHTTP_MULTIPART_BUFFER_SIZE 4096
+#endif
+
+// Maximum number of sinks which can be added to a MultipartParser
+#ifndef HUMANESPHTTP_MULTIPART_MAX_SINKS
+#define HUMANESPHTTP_MULTIPART_MAX_SINKS 4
+#endif
+
+/**
+ * Information about a part of a multipart/form-data body
+ * (from its Content-Disposition and Content-Type headers).
+ * Values which are too long are truncated.
+ */
+struct MultipartPart {
+    char name[64];          // Form field name
+    char filename[128];     // Empty if the part is not a file
+    char contentType[64];   // Empty if not given
+};
+
+/**
+ * Destination for the contents of an uploaded part.
+ * For every part routed to the sink, Begin() is called first,
+ * then Write() for every piece of data, then End().
+ * If the upload fails after Begin(), Abort() is called instead of End().
+ */
+class UploadSink {
+public:
+    virtual ~UploadSink() {}
+
+    virtual esp_err_t Begin(const MultipartPart& /*part*/) { return ESP_OK; }
+    /**
+     * Write the next piece of data. Return anything but ESP_OK to abort the upload.
+     */
+    virtual esp_err_t Write(const char* data, size_t length) = 0;
+    virtual esp_err_t End() { return ESP_OK; }
+    virtual void Abort() {}
+};
+
+/**
+ * Timing statistics of an upload, e.g. for tuning HUMANESPHTTP_MULTIPART_BUFFER_SIZE.
+ * All times are in microseconds.
+ */
+struct MultipartStats {
+    size_t bytesReceived = 0;
+    uint32_t receiveCalls = 0;
+    uint32_t numParts = 0;
+    int64_t receiveTime = 0; // Time spent in httpd_req_recv()
+    int64_t sinkTime = 0;    // Time spent in sinks
+    int64_t totalTime = 0;   // Including parsing
+
+    /**
+     * @return The overall throughput in kB/s
+     */
+    uint32_t ThroughputKBps() const {
+        return totalTime > 0 ? (uint32_t)((uint64_t)bytesReceived * 1000000 / 1024 / (uint64_t)totalTime) : 0;
+    }
+};
+
+/**
+ * Streaming multipart/form-data parser for uploads.
+ *
+ * The body is received into a single fixed-size buffer and the contents
+ * of each part are passed to an UploadSink directly from that buffer,
+ * so RAM usage does not depend on the upload size.
+ * Part boundaries are found using a Boyer-Moore-Horspool search,
+ * which skips most of the data without comparing every byte.
+ *
+ * Usage:
+ *
+ *  OTAUploadSink ota;
+ *  MultipartParser multipart(request);
+ *  multipart.AddSink("firmware", &ota);
+ *  if(multipart.Parse() != ESP_OK) {
+ *      return SendStatusBadRequest(request);
+ *  }
+ *  return SendStatusOK(request);
+ *
+ * Parts without a matching sink are skipped.
+ */
+class MultipartParser {
+public:
+    MultipartParser(httpd_req_t *request);
+
+    MultipartParser(const MultipartParser&) = delete;
+    MultipartParser& operator=(const MultipartParser&) = delete;
+
+    /**
+     * @brief Route parts with the given form field name to the given sink
+     * The name is not copied, so it must be kept in scope.
+     * @param name The form field name, or nullptr for all parts without another matching sink
+     */
+    esp_err_t AddSink(const char* name, UploadSink* sink);
+
+    /**
+     * @brief Receive and parse the whole body
+     * @return ESP_OK,
+     *         ESP_ERR_INVALID_ARG if the request is not multipart/form-data,
+     *         ESP_ERR_NO_MEM if the receive buffer can't be allocated,
+     *         ESP_ERR_INVALID_SIZE if the headers of a part don't fit into the buffer,
+     *         ESP_FAIL if receiving failed or the body is malformed,
+     *         or the first error returned by a sink
+     */
+    esp_err_t Parse();
+
+    const MultipartStats& GetStats() const { return stats; }
+
+private:
+    enum class State : uint8_t {
+        Preamble,       // Before the first boundary
+        AfterBoundary,  // Expecting "\r\n" (next part) or "--" (end)
+        Headers,
+        Body,
+        Done
+    };
+
+    /**
+     * Extract the boundary from the Content-Type header
+     * and build the Horspool skip table
+     */
+    esp_err_t ParseBoundary();
+    /**
+     * Process the buffered data as far as possible
+     * @param needMoreData Set to true if more data has to be received to continue
+     */
+    esp_err_t Process(bool& needMoreData);
+    esp_err_t ParseHeaders(const char* headers, const char* end);
+    esp_err_t Emit(const char* data, size_t length);
+    UploadSink* FindSink(const char* name) const;
+    /**
+     * Find the delimiter ("\r\n--" + boundary) in the given range
+     * @return Pointer to the delimiter or nullptr
+     */
+    const char* FindDelimiter(const char* begin, const char* end) const;
+
+    httpd_req_t *request;
+    struct SinkEntry {
+        const char* name;
+        UploadSink* sink;
+    };
+    SinkEntry sinks[HUMANESPHTTP_MULTIPART_MAX_SINKS];
+    size_t numSinks = 0;
+    UploadSink* currentSink = nullptr;
+    MultipartPart part;
+    MultipartStats stats;
+    State state = State::Preamble;
+
+    char* buffer = nullptr;
+    size_t pos = 0;
+    size_t filled = 0;
+
+    char delimiter[4 + 70 + 1]; // "\r\n--" + boundary (at most 70 characters)
+    size_t delimiterLength = 0;
+    uint8_t skip[256]; // Horspool bad character shift table
+};
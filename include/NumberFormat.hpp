@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Locale-independent number formatting without printf(),
+ * shared by JSONWriter and ResponseWriter.
+ *
+ * All functions write to out (which must have room for at least
+ * NumberFormatMaxLength characters), do not NUL-terminate and
+ * return the number of characters written.
+ */
+
+static constexpr size_t NumberFormatMaxLength = 40;
+
+size_t FormatUnsigned(char* out, unsigned long long value);
+size_t FormatInteger(char* out, long long value);
+
+/**
+ * @brief Format a finite value with (at most) the given number of decimals (up to 15)
+ * Trailing zeros are removed, "-0" is written as "0".
+ * Values of 1e15 and above are written in scientific notation, like "1.5e20".
+ */
+size_t FormatDouble(char* out, double value, uint8_t decimals);
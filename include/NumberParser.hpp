@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Result of parsing a value with the functions below
+ */
+enum class ValueParseError : uint8_t {
+    None = 0,
+    NotFound,    // The parameter does not exist (see QueryURLParser::GetParameterValue())
+    Empty,       // The value is empty
+    Invalid,     // The value is not a valid number, bool or name
+    OutOfRange,  // The value is valid, but too large (or too small) for the type
+    UnknownName, // The value is not in the name table (see ParseEnum())
+    TooMany      // More values than fit into the output array (see QueryURLParser::GetParameterValues())
+};
+
+/**
+ * @return A short description of the given error, like "out of range"
+ */
+const char* ValueParseErrorToString(ValueParseError error);
+
+/*
+ * Locale-independent, allocation-free parsing of query and path values.
+ *
+ * All functions parse exactly length characters (no NUL terminator required)
+ * and fail with a precise error instead of stopping at the first invalid
+ * character like strtol() & co. Whitespace is not skipped.
+ * The output is only written on success.
+ */
+
+/**
+ * @brief Parse a signed or unsigned 8 to 64 bit integer with exact overflow detection
+ * A leading '+' is accepted, '-' only for signed types.
+ * @param base 10, 16 (optional "0x" prefix) or 0 (hex with "0x" prefix, decimal otherwise)
+ */
+template<typename T>
+ValueParseError ParseInteger(const char* str, size_t length, T& out, unsigned base = 10);
+
+/**
+ * @brief Parse a hexadecimal integer, with or without "0x" prefix
+ */
+template<typename T>
+inline ValueParseError ParseHex(const char* str, size_t length, T& out) {
+    return ParseInteger(str, length, out, 16);
+}
+
+/**
+ * @brief Parse a decimal floating point number like "-12.5" or "1e-3", correctly rounded
+ * Values too large for the type (or non-zero values too small to be represented)
+ * are OutOfRange. "inf", "nan" and hexadecimal floats are not accepted.
+ */
+ValueParseError ParseFloat(const char* str, size_t length, float& out);
+ValueParseError ParseDouble(const char* str, size_t length, double& out);
+
+/**
+ * @brief Parse true/false, 1/0, on/off or yes/no
+ */
+ValueParseError ParseBool(const char* str, size_t length, bool& out);
+
+/**
+ * Entry of a name table for ParseEnum()
+ */
+template<typename E>
+struct EnumName {
+    const char* name;
+    E value;
+};
+
+/**
+ * @brief Parse a value using a name table, e.g.
+ *
+ *  static constexpr EnumName<Mode> ModeNames[] = {{"off", Mode::Off}, {"auto", Mode::Auto}};
+ *  Mode mode;
+ *  ValueParseError error = ParseEnum(str, length, ModeNames, mode);
+ */
+template<typename E, size_t N>
+ValueParseError ParseEnum(const char* str, size_t length, const EnumName<E> (&names)[N], E& out) {
+    if(length == 0) {
+        return ValueParseError::Empty;
+    }
+    for(const EnumName<E>& entry : names) {
+        if(strncmp(entry.name, str, length) == 0 && entry.name[length] == '\0') {
+            out = entry.value;
+            return ValueParseError::None;
+        }
+    }
+    return ValueParseError::UnknownName;
+}
+
+/**
+ * @brief Parse any integer type, float, double or bool
+ */
+template<typename T>
+inline ValueParseError ParseValue(const char* str, size_t length, T& out) {
+    return ParseInteger(str, length, out);
+}
+
+template<>
+inline ValueParseError ParseValue<bool>(const char* str, size_t length, bool& out) {
+    return ParseBool(str, length, out);
+}
+
+template<>
+inline ValueParseError ParseValue<float>(const char* str, size_t length, float& out) {
+    return ParseFloat(str, length, out);
+}
+
+template<>
+inline ValueParseError ParseValue<double>(const char* str, size_t length, double& out) {
+    return ParseDouble(str, length, out);
+}
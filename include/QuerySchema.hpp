@@ -0,0 +1,289 @@
+#pragma once
+
+#include "QueryURLParser.hpp"
+
+#if _CPP17_AVAILABLE
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <string_view>
+
+/**
+ * Declarative query parameter binding.
+ *
+ * A schema maps query parameters to members of a plain struct,
+ * including required/optional flags, default values and range checks.
+ * Binding walks the parsed query exactly once and does not allocate.
+ *
+ * Usage:
+ *
+ *  struct PowerConfig {
+ *      float power;
+ *      int channel;
+ *      bool enabled;
+ *  };
+ *
+ *  static constexpr auto PowerConfigSchema = MakeQuerySchema(
+ *      QueryParam("power", &PowerConfig::power).Required().Range(0.0f, 100.0f),
+ *      QueryParam("channel", &PowerConfig::channel).Default(1).Range(1, 13),
+ *      QueryParam("enabled", &PowerConfig::enabled).Default(true)
+ *  );
+ *
+ *  // In the handler
+ *  PowerConfig config;
+ *  auto result = PowerConfigSchema.Bind(request, config);
+ *  if(!result) {
+ *      return result.Respond(request); // 400 listing every bad parameter
+ *  }
+ *
+ * Supported member types: bool, all integer types, float, double and
+ * std::string_view (URL-decoded, pointing into the parser's buffer, so
+ * use Bind(QueryURLParser&, ...) and keep the parser alive in that case).
+ */
+
+enum class QueryFieldError : uint8_t {
+    None = 0,
+    Missing,    // Required parameter not present
+    Invalid,    // Value can't be converted to the member type
+    OutOfRange  // Value is outside of Range() or not representable as the member type
+};
+
+inline const char* QueryFieldErrorToString(QueryFieldError error) {
+    switch(error) {
+        case QueryFieldError::None: return "ok";
+        case QueryFieldError::Missing: return "missing";
+        case QueryFieldError::Invalid: return "invalid";
+        case QueryFieldError::OutOfRange: return "out of range";
+    }
+    return "unknown";
+}
+
+struct QueryFieldErrorEntry {
+    const char* name;
+    QueryFieldError error;
+};
+
+/**
+ * Send a 400 Bad Request JSON response listing all the given errors, like
+ * {"status":"error","error":"Invalid query parameters","parameters":{"power":"missing"}}
+ */
+esp_err_t SendQueryFieldErrors(httpd_req_t *request, const QueryFieldErrorEntry* errors, size_t numErrors);
+
+/**
+ * Parse a query value as bool.
+ * Accepts 1/0, true/false, on/off and yes/no.
+ */
+bool ParseQueryBool(std::string_view value, bool& out);
+
+/**
+ * A single field of a QuerySchema.
+ * Create using QueryParam() and refine using the builder functions.
+ */
+template<typename Struct, typename T>
+struct QueryField {
+    using StructType = Struct;
+    using ValueType = T;
+
+    const char* name;
+    size_t nameLength;
+    T Struct::* member;
+    bool required = false;
+    bool hasDefault = false;
+    bool hasRange = false;
+    T defaultValue{};
+    T minimum{};
+    T maximum{};
+
+    /**
+     * Binding fails with QueryFieldError::Missing if the parameter is not present
+     */
+    constexpr QueryField Required() const {
+        QueryField field = *this;
+        field.required = true;
+        return field;
+    }
+
+    /**
+     * Assign the given value if the parameter is not present.
+     * Without a default, the member is left untouched if the parameter is missing.
+     */
+    constexpr QueryField Default(T value) const {
+        QueryField field = *this;
+        field.hasDefault = true;
+        field.defaultValue = value;
+        return field;
+    }
+
+    /**
+     * Binding fails with QueryFieldError::OutOfRange if the value is outside [min, max]
+     */
+    constexpr QueryField Range(T min, T max) const {
+        static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>,
+            "Range() is only supported for numeric fields");
+        QueryField field = *this;
+        field.hasRange = true;
+        field.minimum = min;
+        field.maximum = max;
+        return field;
+    }
+};
+
+/**
+ * Declare a query parameter which is bound to the given struct member
+ */
+template<typename Struct, typename T, size_t N>
+constexpr QueryField<Struct, T> QueryParam(const char (&name)[N], T Struct::* member) {
+    static_assert(N > 1, "Query parameter name must not be empty");
+    return QueryField<Struct, T>{name, N - 1, member};
+}
+
+/**
+ * Result of QuerySchema::Bind(), holding one entry per failed field
+ */
+template<size_t N>
+struct QueryBindResult {
+    QueryFieldErrorEntry errors[N > 0 ? N : 1];
+    size_t numErrors = 0;
+
+    bool Ok() const { return numErrors == 0; }
+    explicit operator bool() const { return numErrors == 0; }
+
+    /**
+     * Respond with a single 400 Bad Request listing every bad parameter
+     */
+    esp_err_t Respond(httpd_req_t *request) const {
+        return SendQueryFieldErrors(request, errors, numErrors);
+    }
+
+    void AddError(const char* name, QueryFieldError error) {
+        errors[numErrors++] = QueryFieldErrorEntry{name, error};
+    }
+};
+
+template<typename Struct, typename... Fields>
+class QuerySchema {
+public:
+    static constexpr size_t NumFields = sizeof...(Fields);
+    static_assert(NumFields <= 64, "QuerySchema supports at most 64 fields");
+
+    constexpr QuerySchema(Fields... fields) : fields(fields...) {}
+
+    /**
+     * Bind the parameters of an already parsed query to the given struct.
+     * Every parameter in the query is visited exactly once.
+     * Unknown parameters are ignored. For repeated keys, the first occurrence wins.
+     */
+    QueryBindResult<NumFields> Bind(QueryURLParser& parser, Struct& out) const {
+        QueryBindResult<NumFields> result;
+        uint64_t seen = 0;
+        parser.ForEachParameter([&](const char* key, size_t keyLength, const char* value, size_t valueLength) {
+            MatchKey(std::index_sequence_for<Fields...>{}, parser,
+                std::string_view(key, keyLength), std::string_view(value, valueLength),
+                out, result, seen);
+        });
+        ApplyMissing(std::index_sequence_for<Fields...>{}, out, result, seen);
+        return result;
+    }
+
+    /**
+     * Parse the query of the given request and bind it to the given struct.
+     * NOTE: std::string_view members would dangle after this returns,
+     * use Bind(QueryURLParser&, ...) for those.
+     */
+    QueryBindResult<NumFields> Bind(httpd_req_t *request, Struct& out) const {
+        QueryURLParser parser(request);
+        return Bind(parser, out);
+    }
+
+private:
+    template<size_t... I>
+    void MatchKey(std::index_sequence<I...>, QueryURLParser& parser, std::string_view key, std::string_view value,
+                  Struct& out, QueryBindResult<NumFields>& result, uint64_t& seen) const {
+        // Expands to a chain of length + first character comparisons against
+        // the (constexpr) field names, stopping at the first match
+        (void)(MatchField<I>(parser, key, value, out, result, seen) || ...);
+    }
+
+    template<size_t I>
+    bool MatchField(QueryURLParser& parser, std::string_view key, std::string_view value,
+                    Struct& out, QueryBindResult<NumFields>& result, uint64_t& seen) const {
+        const auto& field = std::get<I>(fields);
+        if(key.size() != field.nameLength || key[0] != field.name[0]
+            || memcmp(key.data(), field.name, field.nameLength) != 0) {
+            return false;
+        }
+        constexpr uint64_t bit = (uint64_t)1 << I;
+        if(seen & bit) {
+            return true; // Repeated key, the first occurrence wins
+        }
+        seen |= bit;
+        QueryFieldError error = Assign(field, parser, value, out);
+        if(error != QueryFieldError::None) {
+            result.AddError(field.name, error);
+        }
+        return true;
+    }
+
+    template<typename T>
+    static QueryFieldError Assign(const QueryField<Struct, T>& field, QueryURLParser& parser,
+                                  std::string_view value, Struct& out) {
+        if constexpr (std::is_same_v<T, bool>) {
+            if(!ParseQueryBool(value, out.*field.member)) {
+                return QueryFieldError::Invalid;
+            }
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            T number;
+            ValueParseError error = ParseValue(value.data(), value.size(), number);
+            if(error == ValueParseError::OutOfRange) {
+                return QueryFieldError::OutOfRange; // Not representable as T
+            }
+            if(error != ValueParseError::None) {
+                return QueryFieldError::Invalid;
+            }
+            if(field.hasRange && (number < field.minimum || number > field.maximum)) {
+                return QueryFieldError::OutOfRange;
+            }
+            out.*field.member = number;
+        } else if constexpr (std::is_same_v<T, std::string_view>) {
+            // Lookup is a hash table probe, not a rescan of the query
+            out.*field.member = parser.GetParameterDecodedView(field.name);
+        } else {
+            static_assert(std::is_arithmetic_v<T>, "Unsupported QueryField member type");
+        }
+        return QueryFieldError::None;
+    }
+
+    template<size_t... I>
+    void ApplyMissing(std::index_sequence<I...>, Struct& out, QueryBindResult<NumFields>& result, uint64_t seen) const {
+        (ApplyMissingField<I>(out, result, seen), ...);
+    }
+
+    template<size_t I>
+    void ApplyMissingField(Struct& out, QueryBindResult<NumFields>& result, uint64_t seen) const {
+        const auto& field = std::get<I>(fields);
+        if(seen & ((uint64_t)1 << I)) {
+            return;
+        }
+        if(field.required) {
+            result.AddError(field.name, QueryFieldError::Missing);
+        } else if(field.hasDefault) {
+            out.*field.member = field.defaultValue;
+        }
+    }
+
+    std::tuple<Fields...> fields;
+};
+
+/**
+ * Create a QuerySchema from the given fields (see QueryParam()).
+ * All fields must refer to members of the same struct.
+ */
+template<typename First, typename... Rest>
+constexpr QuerySchema<typename First::StructType, First, Rest...> MakeQuerySchema(First first, Rest... rest) {
+    static_assert((std::is_same_v<typename First::StructType, typename Rest::StructType> && ...),
+        "All fields of a QuerySchema must refer to the same struct");
+    return QuerySchema<typename First::StructType, First, Rest...>(first, rest...);
+}
+
+#endif // _CPP17_AVAILABLE
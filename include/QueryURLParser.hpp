@@ -1,7 +1,10 @@
 #pragma once
 
 #include <string>
+#include <cstddef>
+#include <cstdint>
 #include <esp_http_server.h>
+#include "NumberParser.hpp"
 
 #ifndef _CPP17_AVAILABLE
 #define _CPP17_AVAILABLE (__cplusplus >= 201703L)
@@ -16,6 +19,20 @@
 #define HUMANESPHTTP_EXCEPTIONS false
 #endif
 
+// Query strings up to this size (including the NUL terminator) are stored
+// inside the parser object itself. Longer query strings are stored in the
+// request arena (see RequestArena) or on the heap.
+#ifndef HUMANESPHTTP_QUERY_INLINE_SIZE
+#define HUMANESPHTTP_QUERY_INLINE_SIZE 128
+#endif
+
+// Number of parameters which can be indexed without a heap allocation.
+// Queries with more parameters allocate a single index block
+// from the request arena or the heap.
+#ifndef HUMANESPHTTP_QUERY_INLINE_PARAMETERS
+#define HUMANESPHTTP_QUERY_INLINE_PARAMETERS 32
+#endif
+
 // Define a custom exception QueryURLParserException
 #if HUMANESPHTTP_EXCEPTIONS
 #include <exception>
@@ -62,12 +79,43 @@ public:
 
 #if _CPP17_AVAILABLE
 #include <optional>
+#include <string_view>
 #endif
 
+/**
+ * Smallest power of two >= n (used to size the parameter hash table)
+ */
+constexpr size_t QueryURLParserNextPowerOfTwo(size_t n, size_t p = 1) {
+    return p >= n ? p : QueryURLParserNextPowerOfTwo(n, p * 2);
+}
+
+/**
+ * Parses the query part of a request URL.
+ *
+ * The query string is copied once (into an inline buffer for short queries)
+ * and tokenized into an index of key/value offsets in the constructor.
+ * All accessors then resolve from that index, so looking up a parameter
+ * does not rescan the query string, no matter how many parameters it has.
+ *
+ * The parser is not copyable since it owns its (possibly inline) buffers.
+ */
 class QueryURLParser {
 public:
     QueryURLParser(httpd_req_t *req);
 
+    /**
+     * @brief Parse the given query string (without the leading '?')
+     * This is mostly useful for parsing strings which do not originate
+     * directly from a request URL.
+     */
+    QueryURLParser(const char* query);
+    QueryURLParser(const char* query, size_t length);
+
+    ~QueryURLParser();
+
+    QueryURLParser(const QueryURLParser&) = delete;
+    QueryURLParser& operator=(const QueryURLParser&) = delete;
+
     /**
      * @brief Get the value of the parameter with the given key
      * Returns an empty string if the parameter does not exist
@@ -75,7 +123,7 @@ public:
      * @param key The key to look for
      * @return std::string The parameter value if it exists, otherwise an empty string
      */
-    std::string GetParameter(const char* key);
+    std::string GetParameter(const char* key) const;
 
     /**
      * @brief Check if the query URL contains a parameter with the given key
@@ -83,58 +131,326 @@ public:
      * @param key The key to check for
      * @return true If the query URL contains a parameter with the given key
      * @return false If the query URL does not contain a parameter with the given key
+     *
+     * NOTE: A key without a value (e.g. "?flag") is considered present with an empty value.
+     */
+    bool HasParameter(const char* key) const;
+
+    /**
+     * @brief Get the URL-decoded value of the parameter with the given key
+     * Returns an empty string if the parameter does not exist.
+     *
+     * '+' is decoded to a space and "%XX" escapes are decoded to the corresponding byte.
+     * Decoding happens lazily and in place inside the parser's buffer, and only
+     * for values which actually contain an escape. After a value has been decoded,
+     * the raw accessors (e.g. GetParameter()) return the decoded value as well.
+     *
+     * NOTE: Keys are always matched as-is, without decoding.
      */
-    bool HasParameter(const char* key);
+    std::string GetParameterDecoded(const char* key);
+
+    /**
+     * @brief Decode the value of the parameter with the given key into the given buffer
+     * The result is always NUL-terminated. The parser itself is not modified.
+     *
+     * @return ESP_OK on success,
+     *         ESP_ERR_NOT_FOUND if the parameter does not exist,
+     *         ESP_ERR_HTTPD_RESULT_TRUNC if the decoded value did not fit into the buffer
+     *         (the buffer contains the truncated value in that case)
+     */
+    esp_err_t GetParameterDecoded(const char* key, char* buf, size_t bufSize) const;
+
+    /**
+     * @brief Get the number of parameters in the query string
+     * Repeated keys are counted once per occurrence.
+     */
+    size_t ParameterCount() const { return numParameters; }
+
+    /**
+     * @brief Call callback(key, keyLength, value, valueLength) for every parameter
+     * Parameters are visited in the order they appear in the query string,
+     * including repeated keys. Keys and values are raw (not URL-decoded)
+     * and NUL-terminated.
+     */
+    template<typename Callback>
+    void ForEachParameter(Callback&& callback) const {
+        for(size_t i = 0; i < numParameters; i++) {
+            const Parameter& param = parameters[i];
+            callback(query + param.keyOffset, (size_t)param.keyLength,
+                     query + param.valueOffset, (size_t)param.valueLength);
+        }
+    }
+
+    /**
+     * @brief Parse the value of the parameter with the given key (see ParseValue())
+     * T can be any integer type, float, double or bool. The value is parsed
+     * as-is (not URL-decoded) and out is only written on success.
+     *
+     * @return ValueParseError::NotFound if the parameter does not exist,
+     *         otherwise the result of the conversion
+     */
+    template<typename T>
+    ValueParseError GetParameterValue(const char* key, T& out) const {
+        const Parameter* param = FindParameter(key);
+        if(param == nullptr) {
+            return ValueParseError::NotFound;
+        }
+        return ParseValue(query + param->valueOffset, param->valueLength, out);
+    }
+
+    /**
+     * @brief Parse the value of the parameter with the given key using a name table (see ParseEnum())
+     *
+     * @return ValueParseError::NotFound if the parameter does not exist,
+     *         ValueParseError::UnknownName if the value is not in the table
+     */
+    template<typename E, size_t N>
+    ValueParseError GetParameterEnum(const char* key, const EnumName<E> (&names)[N], E& out) const {
+        const Parameter* param = FindParameter(key);
+        if(param == nullptr) {
+            return ValueParseError::NotFound;
+        }
+        return ParseEnum(query + param->valueOffset, param->valueLength, names, out);
+    }
+
+    /**
+     * @brief Call callback(value, valueLength) for every occurrence of the given key
+     * (e.g. "1", "2" for "?id=1&id=2"), in the order they appear in the query string.
+     * Values are raw (not URL-decoded) and NUL-terminated.
+     * @return The number of occurrences
+     */
+    template<typename Callback>
+    size_t ForEachValue(const char* key, Callback&& callback) const {
+        size_t count = 0;
+        for(const Parameter* param = FindParameter(key); param != nullptr; param = FindNextParameter(param)) {
+            callback(query + param->valueOffset, (size_t)param->valueLength);
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Get the number of occurrences of the given key
+     */
+    size_t CountValues(const char* key) const;
+
+    /**
+     * @brief Call callback(element, elementLength) for every comma-separated element
+     * of every occurrence of the given key, e.g. "1", "2", "3" for "?id=1,2&id=3"
+     * Both ',' and an encoded "%2C" separate elements. Elements are raw and not NUL-terminated.
+     * A parameter with an empty value (e.g. "?id=") is an empty list.
+     * @return The number of elements
+     */
+    template<typename Callback>
+    size_t ForEachListElement(const char* key, Callback&& callback) const {
+        size_t count = 0;
+        for(const Parameter* param = FindParameter(key); param != nullptr; param = FindNextParameter(param)) {
+            if(param->valueLength == 0) {
+                continue;
+            }
+            const char* element = query + param->valueOffset;
+            const char* end = element + param->valueLength;
+            while(true) {
+                size_t separatorLength;
+                const char* elementEnd = FindListSeparator(element, end, separatorLength);
+                callback(element, (size_t)(elementEnd - element));
+                count++;
+                if(separatorLength == 0) {
+                    break;
+                }
+                element = elementEnd + separatorLength;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * @brief Parse all values of the given key into the given array (see ParseValue())
+     * Repeated keys and comma-separated lists are both accepted and can be mixed,
+     * so "?ch=1&ch=2,3" yields {1, 2, 3}. Nothing is allocated.
+     * T can be any integer type, float, double or bool.
+     *
+     * @param count Set to the number of values stored in out. On error, this is
+     *              the index of the offending element.
+     * @return ValueParseError::NotFound if the parameter does not exist,
+     *         ValueParseError::TooMany if there are more than maxCount elements,
+     *         otherwise the first conversion error (e.g. ValueParseError::Empty for "1,,2")
+     */
+    template<typename T>
+    ValueParseError GetParameterValues(const char* key, T* out, size_t maxCount, size_t& count) const {
+        count = 0;
+        const Parameter* param = FindParameter(key);
+        if(param == nullptr) {
+            return ValueParseError::NotFound;
+        }
+        for(; param != nullptr; param = FindNextParameter(param)) {
+            if(param->valueLength == 0) {
+                continue;
+            }
+            const char* element = query + param->valueOffset;
+            const char* end = element + param->valueLength;
+            while(true) {
+                size_t separatorLength;
+                const char* elementEnd = FindListSeparator(element, end, separatorLength);
+                if(count == maxCount) {
+                    return ValueParseError::TooMany;
+                }
+                ValueParseError error = ParseValue(element, (size_t)(elementEnd - element), out[count]);
+                if(error != ValueParseError::None) {
+                    return error;
+                }
+                count++;
+                if(separatorLength == 0) {
+                    break;
+                }
+                element = elementEnd + separatorLength;
+            }
+        }
+        return ValueParseError::None;
+    }
+
+    template<typename T, size_t N>
+    ValueParseError GetParameterValues(const char* key, T (&out)[N], size_t& count) const {
+        return GetParameterValues(key, out, N, count);
+    }
 
     #if HUMANESPHTTP_EXCEPTIONS
     /**
      * Get a given parameter, or throw a
      * QueryURLParameterNotFoundException if it does not exist
     */
-    std::string GetParameterException(const char* key);
+    std::string GetParameterException(const char* key) const;
 
     /**
      * Get a given parameter, or throw a
      * - QueryURLParameterNotFoundException if it does not exist
      * - QueryURLParameterConversionException if it can't be converted to an int
     */
-    int GetParameterIntException(const char* key);
+    int GetParameterIntException(const char* key) const;
 
     /**
      * Get a given parameter, or throw a
      * - QueryURLParameterNotFoundException if it does not exist
      * - QueryURLParameterConversionException if it can't be converted to an unsigned int
     */
-    unsigned int GetParameterUnsignedIntException(const char* key);
+    unsigned int GetParameterUnsignedIntException(const char* key) const;
 
     /**
      * Get a given parameter, or throw a
      * - QueryURLParameterNotFoundException if it does not exist
      * - QueryURLParameterConversionException if it can't be converted to a long
     */
-    long GetParameterLongException(const char* key);
+    long GetParameterLongException(const char* key) const;
 
     /**
      * Get a given parameter, or throw a
      * - QueryURLParameterNotFoundException if it does not exist
      * - QueryURLParameterConversionException if it can't be converted to an unsigned long
     */
-    unsigned long GetParameterUnsignedLongException(const char* key);
+    unsigned long GetParameterUnsignedLongException(const char* key) const;
 
     /**
      * Get a given parameter, or throw a
      * - QueryURLParameterNotFoundException if it does not exist
-     * - QueryURLParameterConversionException if it can't be converted to a short
+     * - QueryURLParameterConversionException if it can't be converted to a float
+    */
+    float GetParameterFloatException(const char* key) const;
+
+    /**
+     * Get a given parameter as T (any integer type, float, double or bool), or throw a
+     * - QueryURLParameterNotFoundException if it does not exist
+     * - QueryURLParameterConversionException if it is empty, invalid or out of range for T
+    */
+    template<typename T>
+    T GetParameterValueException(const char* key) const {
+        T result;
+        ThrowOnError(key, GetParameterValue(key, result));
+        return result;
+    }
+
+    /**
+     * Get a given parameter using a name table (see ParseEnum()), or throw a
+     * - QueryURLParameterNotFoundException if it does not exist
+     * - QueryURLParameterConversionException if it is not in the table
     */
-    float GetParameterFloatException(const char* key);
+    template<typename E, size_t N>
+    E GetParameterEnumException(const char* key, const EnumName<E> (&names)[N]) const {
+        E result;
+        ThrowOnError(key, GetParameterEnum(key, names, result));
+        return result;
+    }
     #endif
 
     #if _CPP17_AVAILABLE
+    /**
+     * @brief Get a view of the value of the parameter with the given key
+     * Returns an empty view if the parameter does not exist.
+     *
+     * The view points into the parser's own buffer, so it is only valid
+     * as long as the parser exists. The viewed value is always NUL-terminated.
+     */
+    std::string_view GetParameterView(const char* key) const;
+
+    /**
+     * @brief Get a view of the value of the parameter with the given key, if it exists
+     * Otherwise, return an empty optional.
+     *
+     * The view points into the parser's own buffer, so it is only valid
+     * as long as the parser exists. The viewed value is always NUL-terminated.
+     */
+    std::optional<std::string_view> GetParameterViewOptional(const char* key) const;
+
+    /**
+     * @brief Get a view of the URL-decoded value of the parameter with the given key
+     * Returns an empty view if the parameter does not exist.
+     *
+     * Values without escapes are returned as zero-copy views, values containing
+     * escapes are decoded in place on first access (see GetParameterDecoded()).
+     */
+    std::string_view GetParameterDecodedView(const char* key);
+
+    /**
+     * @brief Get a view of the URL-decoded value of the parameter with the given key, if it exists
+     * Otherwise, return an empty optional.
+     *
+     * Values without escapes are returned as zero-copy views, values containing
+     * escapes are decoded in place on first access (see GetParameterDecoded()).
+     */
+    std::optional<std::string_view> GetParameterDecodedViewOptional(const char* key);
+
+    /**
+     * @brief Parse the value of the parameter with the given key as a number, if it exists
+     * T can be any integer type, float or double.
+     *
+     * If the parameter does not exist, return an empty optional
+     * If the value can't be parsed or is out of range for T, return an empty optional
+     */
+    template<typename T>
+    std::optional<T> GetParameterNumberOptional(const char* key) const {
+        std::optional<std::string_view> value = GetParameterViewOptional(key);
+        if(!value.has_value()) {
+            return std::nullopt;
+        }
+        return ParseNumber<T>(*value);
+    }
+
+    /**
+     * @brief Parse the given string as a number of type T
+     * T can be any integer type, float or double.
+     * Integers are parsed in base 10. A single leading '+' is accepted.
+     *
+     * The entire string must be consumed, otherwise an empty optional is returned.
+     * The conversion is locale-independent and does not allocate any memory
+     * for values shorter than 64 characters (see ParseValue() for the precise error).
+     */
+    template<typename T>
+    static std::optional<T> ParseNumber(std::string_view value);
+
     /**
      * @brief Get the value of the parameter with the given key, if it exists
      * Otherwise, return an empty optional
     */
-    std::optional<std::string> GetParameterOptional(const char* key);
+    std::optional<std::string> GetParameterOptional(const char* key) const;
 
     /**
      * @brief Get the integer value of the parameter with the given key, if it exists
@@ -142,7 +458,7 @@ public:
      * If the parameter does not exist, return an empty optional
      * If the int can't be parsed, return an empty optional
      */
-    std::optional<int> GetParameterIntOptional(const char* key);
+    std::optional<int> GetParameterIntOptional(const char* key) const;
 
     /**
      * @brief Get the unsigned integer value of the parameter with the given key, if it exists
@@ -150,7 +466,7 @@ public:
      * If the parameter does not exist, return an empty optional
      * If the int can't be parsed, return an empty optional
      */
-    std::optional<unsigned int> GetParameterUnsignedIntOptional(const char* key);
+    std::optional<unsigned int> GetParameterUnsignedIntOptional(const char* key) const;
 
     /**
      * @brief Get the integer value of the parameter with the given key, if it exists
@@ -158,7 +474,7 @@ public:
      * If the parameter does not exist, return an empty optional
      * If the long can't be parsed, return an empty optional
      */
-    std::optional<long> GetParameterLongOptional(const char* key);
+    std::optional<long> GetParameterLongOptional(const char* key) const;
 
     /**
      * @brief Get the integer value of the parameter with the given key, if it exists
@@ -166,7 +482,7 @@ public:
      * If the parameter does not exist, return an empty optional
      * If the long can't be parsed, return an empty optional
      */
-    std::optional<unsigned long> GetParameterUnsignedLongOptional(const char* key);
+    std::optional<unsigned long> GetParameterUnsignedLongOptional(const char* key) const;
 
     /**
      * @brief Get the integer value of the parameter with the given key, if it exists
@@ -174,9 +490,108 @@ public:
      * If the parameter does not exist, return an empty optional
      * If the int can't be parsed, return an empty optional
      */
-    std::optional<float> GetParameterFloatOptional(const char* key);
+    std::optional<float> GetParameterFloatOptional(const char* key) const;
+
+    /**
+     * @brief Get the double value of the parameter with the given key, if it exists
+     * 
+     * If the parameter does not exist, return an empty optional
+     * If the double can't be parsed, return an empty optional
+     */
+    std::optional<double> GetParameterDoubleOptional(const char* key) const;
     #endif
 
 private:
-    std::string queryURLString;
+    /**
+     * Index entry for a single key=value pair.
+     * Offsets are relative to the start of the query buffer.
+     */
+    struct Parameter {
+        uint16_t keyOffset;
+        uint16_t keyLength;
+        uint16_t valueOffset;
+        uint16_t valueLength;
+        uint8_t hash; // Low bits of the key hash, used to reject mismatches quickly
+        uint8_t flags;
+    };
+
+    // Parameter::flags: the value has already been URL-decoded in place
+    static constexpr uint8_t ParameterDecoded = 0x01;
+
+    static constexpr size_t InlineSlots = QueryURLParserNextPowerOfTwo(2 * HUMANESPHTTP_QUERY_INLINE_PARAMETERS);
+
+    /**
+     * Copy the given query string into the internal buffer
+     * and build the parameter index.
+     */
+    void Parse(const char* str, size_t length);
+    /**
+     * Allocate the query buffer for a query of the given length
+     * (excluding the NUL terminator). Returns nullptr on failure.
+     */
+    char* AllocateQuery(size_t length);
+    /**
+     * Tokenize the query buffer in place and build the parameter index.
+     */
+    void BuildIndex();
+
+    /**
+     * Find the first occurrence of the given key.
+     * @return The index entry or nullptr if the key does not exist
+     */
+    const Parameter* FindParameter(const char* key) const;
+
+    /**
+     * Find the first occurrence of the given key and URL-decode its value in place
+     * (unless it has already been decoded).
+     * @return The index entry or nullptr if the key does not exist
+     */
+    const Parameter* FindDecodedParameter(const char* key);
+
+    /**
+     * Find the next occurrence of the key of the given parameter.
+     * @return The index entry or nullptr if there are no more occurrences
+     */
+    const Parameter* FindNextParameter(const Parameter* param) const;
+
+    /**
+     * Find the next ',' or "%2C" in [element, end)
+     * @param separatorLength Set to the length of the separator, 0 if there is none
+     * @return The separator or end
+     */
+    static const char* FindListSeparator(const char* element, const char* end, size_t& separatorLength) {
+        for(const char* p = element; p < end; p++) {
+            if(*p == ',') {
+                separatorLength = 1;
+                return p;
+            }
+            if(*p == '%' && end - p >= 3 && p[1] == '2' && (p[2] | 0x20) == 'c') {
+                separatorLength = 3;
+                return p;
+            }
+        }
+        separatorLength = 0;
+        return end;
+    }
+
+    static uint32_t HashKey(const char* key, size_t length);
+
+    #if HUMANESPHTTP_EXCEPTIONS
+    /**
+     * Throw the exception matching the given error, if any
+     */
+    void ThrowOnError(const char* key, ValueParseError error) const;
+    #endif
+
+    char* query = inlineQuery;
+    size_t queryLength = 0;
+    Parameter* parameters = inlineParameters;
+    size_t numParameters = 0;
+    // Open-addressed hash table, each slot holds (parameter index + 1) or 0 if empty
+    uint16_t* slots = inlineSlots;
+    size_t slotMask = 0;
+
+    char inlineQuery[HUMANESPHTTP_QUERY_INLINE_SIZE];
+    Parameter inlineParameters[HUMANESPHTTP_QUERY_INLINE_PARAMETERS];
+    uint16_t inlineSlots[InlineSlots];
 };
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <esp_http_server.h>
+
+// Default number of clients tracked by a RateLimiter (rounded up to a power of two)
+#ifndef HUMANESPHTTP_RATE_LIMIT_CLIENTS
+#define HUMANESPHTTP_RATE_LIMIT_CLIENTS 16
+#endif
+
+/**
+ * Token bucket in its GCRA form: instead of a token count, the bucket stores
+ * the time at which it would be full again, so taking a token is a comparison
+ * and an addition without any refill computation.
+ *
+ * A request is admitted if at most burst requests have been admitted
+ * during the last burst / ratePerSecond seconds.
+ */
+class TokenBucket {
+public:
+    TokenBucket(float ratePerSecond, uint32_t burst);
+
+    /**
+     * @brief Take a token from the given bucket state (see below)
+     * @param full The time at which the bucket is full, updated if a token is taken
+     * @return true if a token has been taken
+     */
+    bool Take(int64_t& full, int64_t nowUs) const {
+        int64_t start = full > nowUs ? full : nowUs;
+        if(start - nowUs > toleranceUs) {
+            return false;
+        }
+        full = start + intervalUs;
+        return true;
+    }
+
+    /**
+     * @brief Take a token from this bucket
+     */
+    bool Take(int64_t nowUs) { return Take(full, nowUs); }
+
+    /**
+     * @brief Admit the request if a token is available,
+     * otherwise send a precomputed 503 response with Retry-After
+     * (see SendResponse())
+     * Not thread safe, call from the httpd task only (see HandlerOptions::rateLimit).
+     * @return true if the request has been admitted, false if it has been answered
+     */
+    bool Admit(httpd_req_t *request);
+
+    uint32_t GetRejectedCount() const { return rejected; }
+
+    /**
+     * @return The Retry-After value in seconds for rejected requests
+     */
+    uint32_t GetRetryAfter() const;
+
+protected:
+    int64_t intervalUs;  // Time to earn one token
+    int64_t toleranceUs; // (burst - 1) * intervalUs
+    int64_t full = 0;
+    uint32_t rejected = 0;
+    std::unique_ptr<char[]> response;
+    size_t responseLength = 0;
+
+    void SetResponse(const char* status, const char* error);
+    /**
+     * Send the precomputed response with a single non-blocking send.
+     * If the client does not read its socket, the connection is closed
+     * instead of blocking the httpd task.
+     */
+    esp_err_t SendResponse(httpd_req_t *request) const;
+};
+
+/**
+ * Per-client rate limiting (admission control), to keep the server responsive
+ * when a misbehaving client hammers it.
+ *
+ * Every client IP address has a token bucket in a small fixed-size open-addressed table.
+ * Requests over the limit are answered with a precomputed 429 response (with Retry-After)
+ * before any handler, parser or worker pool is involved. Clients whose bucket is full
+ * are forgotten, and when the table is full, the least limited client is replaced.
+ *
+ * Usage (see HTTPServer::EnableRateLimit()):
+ *
+ *  static RateLimiter limiter(10, 20); // 10 requests/s per client, bursts of 20
+ *  http.EnableRateLimit(&limiter);     // Before registering handlers
+ *
+ * Not thread safe: requests are admitted on the httpd task.
+ */
+class RateLimiter : private TokenBucket {
+public:
+    RateLimiter(float ratePerSecond, uint32_t burst, size_t maxClients = HUMANESPHTTP_RATE_LIMIT_CLIENTS);
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    /**
+     * IPv6 or IPv4-mapped IPv6 client address
+     */
+    typedef uint8_t Address[16];
+
+    /**
+     * @brief Admit the request if the client's bucket has a token,
+     * otherwise send a precomputed 429 response with Retry-After
+     * @return true if the request has been admitted, false if it has been answered
+     */
+    bool Admit(httpd_req_t *request);
+
+    /**
+     * @brief Take a token from the request's client's bucket without responding,
+     * e.g. for a WebSocket handshake (which ESP-IDF has already answered)
+     * Rejections are counted.
+     * @return true if the client is within its limit
+     */
+    bool AdmitConnection(httpd_req_t *request);
+
+    /**
+     * @brief Take a token from the given client's bucket
+     * @return true if the client is within its limit
+     */
+    bool AdmitClient(const Address address, int64_t nowUs);
+
+    /**
+     * @brief Get the address of the request's client
+     * @return false if the address could not be determined
+     */
+    static bool GetClientAddress(httpd_req_t *request, Address address);
+
+    using TokenBucket::GetRejectedCount;
+    using TokenBucket::GetRetryAfter;
+    size_t GetTableSize() const { return tableSize; }
+
+private:
+    struct Client {
+        Address address;
+        int64_t full; // See TokenBucket::Take(), 0 if unused
+    };
+
+    // Slots looked at for each client (bounded cost per request)
+    static constexpr size_t MaxProbes = 8;
+
+    std::unique_ptr<Client[]> clients;
+    size_t tableSize;
+};
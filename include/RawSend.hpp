@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <esp_http_server.h>
+
+// How often a raw send which timed out (after send_wait_timeout seconds) is retried
+// before giving up. The default behaves like the ESP-IDF response functions,
+// which give up on the first error.
+#ifndef HUMANESPHTTP_SEND_RETRIES
+#define HUMANESPHTTP_SEND_RETRIES 0
+#endif
+
+/**
+ * Send the whole buffer on the request's socket, bypassing the ESP-IDF
+ * response functions (the buffer must contain the complete HTTP response,
+ * or the next part of it).
+ *
+ * A send which times out is retried at most HUMANESPHTTP_SEND_RETRIES times,
+ * so a client which stops reading can't block the httpd task indefinitely.
+ *
+ * @param flags Flags passed to the session send function. With MSG_DONTWAIT,
+ *        the send fails instead of waiting if the socket buffer is full
+ *        and is never retried.
+ * @return ESP_OK or ESP_ERR_HTTPD_RESP_SEND
+ */
+esp_err_t SendRaw(httpd_req_t *request, const char* data, size_t length, int flags = 0);
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Default request arena size per task in bytes (0 = no arena), see HTTPServer::EnableRequestArena()
+#ifndef HUMANESPHTTP_REQUEST_ARENA_SIZE
+#define HUMANESPHTTP_REQUEST_ARENA_SIZE 2048
+#endif
+
+/**
+ * Bump allocator for short-lived per-request memory
+ * (parser buffers, decoded strings, response scratch space).
+ *
+ * Allocating is a pointer increment, freeing individual allocations is a no-op
+ * and all memory is released at once when the request is finished.
+ * This keeps short-lived allocations out of the heap shared with lwIP and Wi-Fi,
+ * so they can't fragment it.
+ *
+ * Every task handling requests (the httpd task and async worker tasks)
+ * has its own arena, which is allocated once on first use.
+ * Usually used through HTTPServer::EnableRequestArena() and RequestAllocate().
+ */
+class RequestArena {
+public:
+    explicit RequestArena(size_t capacity);
+    ~RequestArena();
+
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    /**
+     * @brief Allocate memory from the arena
+     * @return The memory, or nullptr if the arena is exhausted
+     */
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * @brief Check if the given pointer has been allocated from this arena
+     */
+    bool Contains(const void* pointer) const {
+        return (const uint8_t*)pointer >= buffer && (const uint8_t*)pointer < buffer + capacity;
+    }
+
+    /**
+     * @brief Release all allocations
+     */
+    void Reset();
+
+    size_t GetCapacity() const { return capacity; }
+    size_t GetUsed() const { return used; }
+    /**
+     * @return The largest number of bytes used by a single request
+     */
+    size_t GetPeak() const { return used > peak ? used : peak; }
+    /**
+     * @return The number of allocations which did not fit and used the heap instead
+     */
+    uint32_t GetOverflowCount() const { return overflows; }
+
+    /**
+     * @return The arena of the request running on the current task, or nullptr
+     */
+    static RequestArena* Current();
+
+    /**
+     * @return The arena of the current task (which might not be in use), or nullptr
+     */
+    static RequestArena* ForCurrentTask();
+
+private:
+    friend void* RequestAllocate(size_t size);
+
+    uint8_t* buffer;
+    size_t capacity;
+    size_t used = 0;
+    size_t peak = 0;
+    uint32_t overflows = 0;
+};
+
+/**
+ * Makes the current task's arena (created with the given capacity on first use)
+ * the arena of the request while in scope, and resets it afterwards.
+ * Nested scopes share the outermost scope's arena.
+ * A capacity of 0 disables the arena.
+ */
+class RequestArenaScope {
+public:
+    explicit RequestArenaScope(size_t capacity);
+    ~RequestArenaScope();
+
+    RequestArenaScope(const RequestArenaScope&) = delete;
+    RequestArenaScope& operator=(const RequestArenaScope&) = delete;
+
+    /**
+     * @return The number of bytes allocated from the arena in this scope
+     */
+    size_t GetUsed() const;
+
+private:
+    RequestArena* arena = nullptr; // nullptr if not the outermost scope or disabled
+};
+
+/**
+ * @brief Allocate memory for the current request
+ * Uses the request arena if there is one and it has enough space left,
+ * otherwise the heap. Release with RequestFree().
+ * Memory from the arena must not be used after the handler has returned.
+ */
+void* RequestAllocate(size_t size);
+
+/**
+ * @brief Release memory allocated with RequestAllocate() (a no-op for arena memory)
+ */
+void RequestFree(void* pointer);
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <esp_http_server.h>
+
+// Default memory budget of a ResponseCache in bytes (responses + keys)
+#ifndef HUMANESPHTTP_CACHE_BUDGET
+#define HUMANESPHTTP_CACHE_BUDGET 16384
+#endif
+
+// Maximum number of responses in a ResponseCache
+#ifndef HUMANESPHTTP_CACHE_MAX_ENTRIES
+#define HUMANESPHTTP_CACHE_MAX_ENTRIES 16
+#endif
+
+// How long a request waits for a concurrent request
+// generating the same response before generating it itself
+#ifndef HUMANESPHTTP_CACHE_WAIT_MS
+#define HUMANESPHTTP_CACHE_WAIT_MS 2000
+#endif
+
+/**
+ * Hit/miss counters of a ResponseCache
+ */
+struct ResponseCacheStats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t coalesced = 0;  // Requests which waited for a concurrent miss
+    uint32_t evictions = 0;
+    uint32_t uncacheable = 0; // Responses not stored (not 200 OK, encoded, too large or handler error)
+};
+
+/**
+ * Server-side cache for complete responses (status line, headers and body)
+ * of expensive GET handlers.
+ *
+ * Responses are keyed by method, path and query (with sorted parameters,
+ * so "?a=1&b=2" and "?b=2&a=1" share an entry) and kept for a per-handler TTL.
+ * On a hit, the stored response is sent with a raw send and the handler
+ * is not called at all. All entries share a fixed memory budget,
+ * the least recently used entries are evicted first.
+ * Concurrent misses on the same key are coalesced: only the first request
+ * calls the handler, the others wait and are served from the cache.
+ *
+ * Only 200 OK responses to GET and HEAD requests are cached. Responses with a
+ * Content-Encoding (e.g. gzip from CompressedResponse) are not cached, since the key
+ * doesn't include the client's Accept-Encoding.
+ *
+ * Usually used through HTTPServer::RegisterHandler() / RegisterRoute() with HandlerOptions:
+ *
+ *  static ResponseCache cache;
+ *  HandlerOptions options;
+ *  options.cache = &cache;
+ *  options.cacheTTL = 1000; // ms
+ *  http.RegisterHandler(&historyHandler, options);
+ *
+ *  // After the underlying data changed
+ *  cache.Invalidate("/api/history");
+ *
+ * NOTE: Responses are captured using a SendObserver (session send override).
+ * Do not use with esp_https_server.
+ */
+class ResponseCache {
+public:
+    typedef esp_err_t (*Generator)(httpd_req_t *request, void* context);
+
+    ResponseCache(size_t budget = HUMANESPHTTP_CACHE_BUDGET);
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    /**
+     * @brief Serve the request from the cache, or call generator(request, context)
+     * and cache the response for ttlMs milliseconds
+     */
+    esp_err_t Handle(httpd_req_t *request, uint32_t ttlMs, Generator generator, void* context);
+
+    /**
+     * @brief Remove all cached responses for the given path (with any query)
+     */
+    void Invalidate(const char* path);
+
+    /**
+     * @brief Remove all cached responses
+     */
+    void Clear();
+
+    ResponseCacheStats GetStats();
+
+    /**
+     * @return The number of bytes currently used by cached responses
+     */
+    size_t GetUsedBytes();
+
+private:
+    enum class EntryState : uint8_t {
+        Pending, // Being generated by a request
+        Ready
+    };
+
+    struct Entry {
+        uint32_t hash;
+        std::string key;
+        size_t pathLength; // Length of the "<method> <path>" part of the key
+        std::shared_ptr<const std::string> response;
+        int64_t expires = 0;
+        uint32_t lastUsed = 0;
+        uint32_t generation = 0; // Identifies the request generating a pending entry
+        EntryState state = EntryState::Pending;
+    };
+
+    /**
+     * Build the cache key "<method> <path>?<sorted query>"
+     * @return false if the request can't be cached
+     */
+    static bool BuildKey(httpd_req_t *request, std::string& key, size_t& pathLength);
+    Entry* Find(uint32_t hash, const std::string& key);
+    void Remove(Entry* entry);
+    /**
+     * Evict least recently used entries until the given number of bytes fits
+     * @return false if it can't fit
+     */
+    bool MakeRoom(size_t bytes);
+    static size_t EntrySize(const Entry& entry);
+
+    size_t budget;
+    size_t used = 0;
+    uint32_t clock = 0;
+    uint32_t nextGeneration = 0;
+    std::vector<Entry> entries;
+    ResponseCacheStats stats;
+    std::mutex mutex;
+    std::condition_variable generated;
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_http_server.h>
+
+// Size of the ResponseWriter buffer for the status line, headers and body.
+// Defaults to the TCP MSS, so a response fitting into the buffer is a single segment.
+#ifndef HUMANESPHTTP_RESPONSE_BUFFER_SIZE
+#ifdef CONFIG_LWIP_TCP_MSS
+#define HUMANESPHTTP_RESPONSE_BUFFER_SIZE CONFIG_LWIP_TCP_MSS
+#else
+#define HUMANESPHTTP_RESPONSE_BUFFER_SIZE 1440
+#endif
+#endif
+
+// Part of the ResponseWriter buffer reserved for the status line and headers.
+// Longer heads are sent separately.
+#ifndef HUMANESPHTTP_RESPONSE_HEAD_SIZE
+#define HUMANESPHTTP_RESPONSE_HEAD_SIZE 160
+#endif
+
+// Maximum number of headers set using ResponseWriter::SetHeader()
+#ifndef HUMANESPHTTP_RESPONSE_MAX_HEADERS
+#define HUMANESPHTTP_RESPONSE_MAX_HEADERS 4
+#endif
+
+/**
+ * Statistics of a single ResponseWriter response
+ */
+struct ResponseWriterStats {
+    uint32_t writes = 0;  // Calls of Write(), Printf() and WriteNumber()
+    uint32_t flushes = 0; // Sends to the socket (or calls of the output function)
+    size_t bytes = 0;     // Body bytes
+    bool chunked = false; // The body did not fit into the buffer
+};
+
+/**
+ * Buffered text response for handlers which build their response from many small pieces.
+ *
+ * Status line, headers and body are assembled in a single TCP MSS sized buffer
+ * instead of being sent piece by piece like with httpd_resp_send_chunk(),
+ * which costs a chunk header and often a separate TCP segment (waiting for a delayed ACK)
+ * for every call. If the whole body fits into the buffer, Finish() sends the response
+ * with a Content-Length header in a single send. Otherwise it switches to chunked
+ * encoding, sending one full buffer per chunk.
+ *
+ * Usage:
+ *
+ *  ResponseWriter response(request);
+ *  response.SetType("text/plain");
+ *  response.Write("Power is: ");
+ *  response.WriteNumber(power, 2);
+ *  response.Printf(" (%d%%)", percent);
+ *  return response.Finish();
+ *
+ * NOTE: Like StaticResponse, ResponseWriter sends the raw response and bypasses the
+ * ESP-IDF response functions, so the status, content type and headers set using
+ * httpd_resp_set_status(), httpd_resp_set_type() and httpd_resp_set_hdr() are NOT sent.
+ * Use SetStatus(), SetType() and SetHeader() instead. HUMANESPHTTP_STATIC_RESPONSE_HEADERS
+ * are included.
+ *
+ * The buffer is part of the object, so keep the stack size of the tasks
+ * using it (httpd_config_t::stack_size) in mind.
+ */
+class ResponseWriter {
+public:
+    /**
+     * Output function receiving the raw response (status line, headers
+     * and framed body) instead of the request's socket, e.g. for benchmarking.
+     * Return anything but ESP_OK to abort the response.
+     */
+    typedef esp_err_t (*OutputFunction)(void* context, const char* data, size_t length);
+
+    ResponseWriter(httpd_req_t *request);
+    ResponseWriter(OutputFunction output, void* context);
+
+    ResponseWriter(const ResponseWriter&) = delete;
+    ResponseWriter& operator=(const ResponseWriter&) = delete;
+
+    /**
+     * Set the status, e.g. "404 Not Found" (default: "200 OK").
+     * Like the header functions below, this must be called before the first flush,
+     * i.e. typically before writing anything. The string must stay valid until then.
+     */
+    ResponseWriter& SetStatus(const char* status);
+    /**
+     * Set the content type (default: "text/html", like ESP-IDF)
+     */
+    ResponseWriter& SetType(const char* type);
+    /**
+     * Add a header. Fails with ESP_ERR_HTTPD_RESP_HDR after HUMANESPHTTP_RESPONSE_MAX_HEADERS headers.
+     */
+    esp_err_t SetHeader(const char* name, const char* value);
+
+    ResponseWriter& Write(const char* data, size_t length);
+    ResponseWriter& Write(const char* str);
+
+    /**
+     * Append printf() formatted text. Text longer than the buffer
+     * is formatted into a temporary buffer (see RequestAllocate()).
+     */
+    ResponseWriter& Printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    ResponseWriter& WriteNumber(int value) { return WriteNumber((long long)value); }
+    ResponseWriter& WriteNumber(unsigned int value) { return WriteNumber((unsigned long long)value); }
+    ResponseWriter& WriteNumber(long value) { return WriteNumber((long long)value); }
+    ResponseWriter& WriteNumber(unsigned long value) { return WriteNumber((unsigned long long)value); }
+    ResponseWriter& WriteNumber(long long value);
+    ResponseWriter& WriteNumber(unsigned long long value);
+
+    /**
+     * Write a floating point value with (at most) the given number of decimals.
+     * Trailing zeros are removed, NaN and infinity are written as "nan", "inf" and "-inf".
+     * Does not depend on printf() float support.
+     */
+    ResponseWriter& WriteNumber(double value, uint8_t decimals = 6);
+    ResponseWriter& WriteNumber(float value, uint8_t decimals = 6) { return WriteNumber((double)value, decimals); }
+
+    /**
+     * Send the remaining data and finish the response.
+     * If nothing has been flushed yet, the whole response is sent
+     * in a single send including a Content-Length header.
+     * Must be called exactly once.
+     *
+     * @return ESP_OK or the first error which occurred while sending
+     */
+    esp_err_t Finish();
+
+    /**
+     * @return The first error which occurred while sending, or ESP_OK
+     */
+    esp_err_t GetError() const { return error; }
+
+    const ResponseWriterStats& GetStats() const { return stats; }
+
+private:
+    /**
+     * Append to the buffer without counting a write
+     */
+    void Append(const char* data, size_t length);
+    /**
+     * Send the buffer contents as a chunk, preceded by the head if it has not been sent yet
+     * @param last Append the terminating zero-length chunk
+     */
+    void Flush(bool last);
+    /**
+     * Write the status line and headers ending right before end if there is room,
+     * otherwise send them on their own
+     * @return The start of the head in the buffer, end if it has been sent separately
+     */
+    char* PrependHead(char* end, bool chunked, size_t contentLength);
+    /**
+     * @param out nullptr to only compute the length
+     */
+    size_t FormatHead(char* out, bool chunked, size_t contentLength) const;
+    void Send(const char* data, size_t length);
+
+    static constexpr size_t ChunkTrailerSize = 7; // "\r\n" after the data and "0\r\n\r\n"
+    static constexpr size_t Capacity = HUMANESPHTTP_RESPONSE_BUFFER_SIZE - HUMANESPHTTP_RESPONSE_HEAD_SIZE - ChunkTrailerSize;
+    static_assert(HUMANESPHTTP_RESPONSE_HEAD_SIZE >= 16, "HUMANESPHTTP_RESPONSE_HEAD_SIZE too small");
+    static_assert(HUMANESPHTTP_RESPONSE_BUFFER_SIZE >= HUMANESPHTTP_RESPONSE_HEAD_SIZE + ChunkTrailerSize + 64,
+        "HUMANESPHTTP_RESPONSE_BUFFER_SIZE too small");
+
+    httpd_req_t *request = nullptr;
+    OutputFunction output = nullptr;
+    void* outputContext = nullptr;
+    const char* status = "200 OK";
+    const char* type = HTTPD_TYPE_TEXT;
+    const char* headers[HUMANESPHTTP_RESPONSE_MAX_HEADERS][2];
+    uint8_t numHeaders = 0;
+    bool headSent = false;
+    esp_err_t error = ESP_OK;
+    ResponseWriterStats stats;
+    size_t length = 0; // Body bytes in the buffer
+    char buffer[HUMANESPHTTP_RESPONSE_BUFFER_SIZE];
+};
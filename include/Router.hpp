@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <esp_http_server.h>
+
+#ifndef _CPP17_AVAILABLE
+#define _CPP17_AVAILABLE (__cplusplus >= 201703L)
+#endif
+
+#if _CPP17_AVAILABLE
+#include <string_view>
+#endif
+
+// Maximum number of {param} captures in a single route
+#ifndef HUMANESPHTTP_ROUTER_MAX_PARAMS
+#define HUMANESPHTTP_ROUTER_MAX_PARAMS 4
+#endif
+
+/**
+ * Path parameters captured while routing a request,
+ * e.g. {"id": "12"} for the route /api/sensor/{id}/history
+ * and the path /api/sensor/12/history.
+ *
+ * Values point directly into the request URI (they are not copied
+ * and not URL-decoded), so they are only valid during the request.
+ */
+class RouteParams {
+public:
+    size_t Count() const { return count; }
+
+    /**
+     * @brief Check if a parameter with the given name has been captured
+     */
+    bool HasParam(const char* name) const;
+
+    /**
+     * @brief Get the value of the given parameter as a (copied) string
+     * Returns an empty string if there is no such parameter.
+     */
+    std::string GetParam(const char* name) const;
+
+    /**
+     * @brief Get a pointer to the value of the given parameter (not NUL-terminated)
+     * @return false if there is no such parameter
+     */
+    bool GetParam(const char* name, const char*& value, size_t& length) const;
+
+#if _CPP17_AVAILABLE
+    /**
+     * @brief Get a view of the value of the given parameter
+     * Returns an empty view if there is no such parameter.
+     */
+    std::string_view GetParamView(const char* name) const;
+#endif
+
+    /**
+     * @brief Make the values point into a copy of the request URI
+     * (e.g. the one made by httpd_req_async_handler_begin())
+     */
+    void Rebase(const char* oldURI, const char* newURI);
+
+private:
+    friend class Router;
+
+    struct Capture {
+        const char* name; // Not NUL-terminated (points into the route pattern)
+        size_t nameLength;
+        const char* value;
+        size_t length;
+    };
+
+    const Capture* Find(const char* name) const;
+
+    Capture captures[HUMANESPHTTP_ROUTER_MAX_PARAMS];
+    size_t count = 0;
+};
+
+/**
+ * Handler for a route registered with the Router.
+ * Like with native handlers, request->user_ctx is set to the user_ctx
+ * given when registering the route.
+ */
+typedef esp_err_t (*RouteHandler)(httpd_req_t *request, const RouteParams& params);
+
+/**
+ * Radix-trie based request router.
+ *
+ * Routes are static paths like "/api/status" or patterns with
+ * {param} captures like "/api/sensor/{id}/history".
+ * A capture matches one non-empty path segment (up to the next '/').
+ * Static segments take precedence over captures.
+ *
+ * Matching walks the trie once along the path, so the cost depends
+ * on the path length, not on the number of registered routes.
+ *
+ * Typically used through HTTPServer::RegisterRoute(), which installs
+ * one catch-all ESP-IDF handler per HTTP method dispatching to the router.
+ *
+ * NOTE: Register all routes during startup. Adding routes is not
+ * synchronized with requests being dispatched concurrently.
+ */
+class Router {
+public:
+    struct Route {
+        httpd_method_t method;
+        RouteHandler handler;
+        void* userCtx;
+        const char* pattern;
+    };
+
+    Router();
+
+    /**
+     * @brief Add a route
+     * The pattern string is not copied, so it must be kept in scope
+     * (typically a string literal).
+     *
+     * @return ESP_OK on success,
+     *         ESP_ERR_INVALID_ARG if the pattern is malformed,
+     *         ESP_ERR_INVALID_STATE if the same method + pattern is already registered
+     *         or conflicts with a capture of a different name at the same position
+     */
+    esp_err_t AddRoute(httpd_method_t method, const char* pattern, RouteHandler handler, void* userCtx = nullptr);
+
+    /**
+     * @brief Find the route matching the given method and path (without query string)
+     * @param methodMismatch Set to true if the path matched, but not for this method
+     * @return The route or nullptr if no route matches
+     */
+    const Route* Match(httpd_method_t method, const char* path, size_t pathLength,
+                       RouteParams& params, bool* methodMismatch = nullptr) const;
+
+    /**
+     * @brief Set a handler for requests whose path matches no route
+     * (e.g. to serve static files). request->user_ctx is set to userCtx.
+     * If not set, a 404 Not Found response is sent instead.
+     */
+    void SetNotFoundHandler(esp_err_t (*handler)(httpd_req_t *request), void* userCtx = nullptr);
+
+    /**
+     * @brief Route and handle the given request
+     * Responds with 404 Not Found (or 405 Method Not Allowed) if no route matches
+     * and no not found handler is set.
+     */
+    esp_err_t Handle(httpd_req_t *request) const;
+
+    /**
+     * ESP-IDF handler function dispatching to the Router in request->user_ctx
+     */
+    static esp_err_t Dispatch(httpd_req_t *request);
+
+    size_t RouteCount() const { return routes.size(); }
+
+private:
+    struct Node {
+        std::string prefix;                 // Static characters on the edge into this node
+        std::vector<uint16_t> children;     // Static children, distinct first characters
+        int16_t paramChild = -1;            // Child matching a {param} segment
+        const char* paramName = nullptr;    // Set for {param} nodes
+        size_t paramNameLength = 0;
+        std::vector<uint16_t> routes;       // Routes ending at this node (one per method)
+    };
+
+    /**
+     * Insert static characters below the given node, splitting edges as required
+     * @return The node at which the inserted characters end
+     */
+    uint16_t InsertStatic(uint16_t node, const char* str, size_t length);
+    /**
+     * Get or create the {param} child of the given node
+     * @return The child or -1 on conflicting parameter names
+     */
+    int InsertParam(uint16_t node, const char* name, size_t nameLength);
+    uint16_t NewNode();
+
+    bool MatchNode(uint16_t node, const char* path, const char* end, httpd_method_t method,
+                   RouteParams& params, const Route*& result, bool& methodMismatch) const;
+
+    std::vector<Node> nodes;
+    std::vector<Route> routes;
+    esp_err_t (*notFoundHandler)(httpd_req_t *request) = nullptr;
+    void* notFoundUserCtx = nullptr;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <esp_http_server.h>
+#include <esp_timer.h>
+
+// Default maximum number of concurrent event stream clients of an SSEHub
+#ifndef HUMANESPHTTP_SSE_MAX_CLIENTS
+#define HUMANESPHTTP_SSE_MAX_CLIENTS 8
+#endif
+
+// Default number of events which may be waiting for a slow client
+// before it is disconnected
+#ifndef HUMANESPHTTP_SSE_MAX_BACKLOG
+#define HUMANESPHTTP_SSE_MAX_BACKLOG 4
+#endif
+
+// Delay (in milliseconds) before retrying to send the backlog
+// of clients whose socket buffer was full
+#ifndef HUMANESPHTTP_SSE_RETRY_MS
+#define HUMANESPHTTP_SSE_RETRY_MS 20
+#endif
+
+/**
+ * Server-Sent Events (text/event-stream) broadcast hub,
+ * e.g. for pushing live telemetry to several browser tabs:
+ *
+ *  const source = new EventSource("/api/events");
+ *  source.addEventListener("telemetry", (e) => update(JSON.parse(e.data)));
+ *
+ * Clients connecting to the hub's route keep their connection open and are
+ * tracked as subscribers. Publish() serializes an event once into a shared,
+ * reference-counted buffer and hands it to the httpd task, which sends it
+ * to every subscriber without blocking (so the cost per update is one
+ * serialization plus one send per client, instead of one request per client).
+ *
+ * Each client has a bounded backlog of events which could not be sent yet,
+ * which is retried after HUMANESPHTTP_SSE_RETRY_MS until it has been sent.
+ * Clients which don't keep up are disconnected (EventSource reconnects automatically),
+ * closed connections are removed from the hub when ESP-IDF closes their session.
+ *
+ * Usage:
+ *
+ *  static SSEHub events;
+ *  http.RegisterEventStream("/api/events", &events);
+ *  // From any task
+ *  events.Publish("telemetry", "{\"temperature\":21.5}");
+ *
+ * The hub must be kept in scope while the server is running (typically a global).
+ * It uses the session context of its clients' sockets.
+ */
+class SSEHub {
+public:
+    SSEHub(size_t maxClients = HUMANESPHTTP_SSE_MAX_CLIENTS,
+           size_t maxBacklog = HUMANESPHTTP_SSE_MAX_BACKLOG);
+    ~SSEHub();
+
+    SSEHub(const SSEHub&) = delete;
+    SSEHub& operator=(const SSEHub&) = delete;
+
+    /**
+     * @brief Accept the request as event stream subscriber
+     * Sends the response headers and keeps the connection open.
+     * Responds with 503 if the maximum number of clients has been reached.
+     */
+    esp_err_t Handle(httpd_req_t *request);
+
+    /**
+     * @brief Send an event to all subscribers
+     * May be called from any task. Returns immediately, the event is sent by the httpd task.
+     * @param event The event type, or nullptr for the default "message" event
+     * @param data The event data (e.g. JSON). Line breaks are allowed.
+     */
+    esp_err_t Publish(const char* event, const char* data, size_t length);
+    esp_err_t Publish(const char* event, const char* data);
+
+    /**
+     * @brief Send a comment to all subscribers
+     * Call this periodically when there are no events, to keep proxies
+     * from closing the connections and to detect dead clients.
+     */
+    esp_err_t Ping();
+
+    /**
+     * @return The number of currently connected clients
+     */
+    size_t GetClientCount();
+
+    /**
+     * @return The number of clients which have been disconnected because they were too slow
+     */
+    uint32_t GetDroppedCount();
+
+private:
+    /**
+     * Session context of a subscriber's socket,
+     * freed by ESP-IDF when the session is closed
+     */
+    struct Subscription {
+        SSEHub* hub;
+        int sockfd;
+    };
+
+    struct Client {
+        Subscription* subscription;
+        int sockfd;
+        // Events waiting to be sent, the first one partially sent (offset bytes)
+        std::vector<std::shared_ptr<const std::string>> backlog;
+        size_t offset = 0;
+    };
+
+    struct Delivery {
+        SSEHub* hub;
+        std::shared_ptr<const std::string> message;
+    };
+
+    /**
+     * Queue the message for sending on the httpd task
+     */
+    esp_err_t Broadcast(std::shared_ptr<const std::string> message);
+    /**
+     * Append the message to every client's backlog and send as much as possible.
+     * Runs on the httpd task.
+     */
+    void Deliver(const std::shared_ptr<const std::string>& message);
+    /**
+     * @return false if the client has to be disconnected
+     */
+    bool Flush(Client& client);
+    /**
+     * Retry sending every client's backlog. Runs on the httpd task.
+     */
+    void FlushAll();
+    /**
+     * Schedule FlushAll() if any backlog is waiting, unless already scheduled
+     */
+    void ScheduleRetry();
+    void Disconnect(size_t index);
+
+    static void DeliverWork(void* arg);
+    static void RetryTimer(void* arg);
+    static void RetryWork(void* arg);
+    static void SessionClosed(void* context);
+
+    size_t maxClients;
+    size_t maxBacklog;
+    httpd_handle_t server = nullptr;
+    esp_timer_handle_t timer = nullptr;
+    bool retryScheduled = false;
+    std::vector<Client> clients;
+    uint32_t dropped = 0;
+    std::mutex mutex;
+};
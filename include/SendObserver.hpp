@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <esp_http_server.h>
+
+class SendObserver;
+class SendSink;
+
+/**
+ * Plain socket send, equivalent to the ESP-IDF default send function,
+ * which also notifies the observers attached to the socket and the send hook.
+ * If a SendSink is attached to the socket, the data goes to the sink instead.
+ * Installed as session send override by ScopedSendObserver, ScopedSendSink and ConnectionManager.
+ */
+int ObservedSend(httpd_handle_t hd, int sockfd, const char *buf, size_t length, int flags);
+
+/**
+ * Called for every successful ObservedSend() on any socket and task
+ */
+typedef void (*SendHook)(httpd_handle_t hd, int sockfd, size_t length);
+
+/**
+ * @brief Set the function called for every successful ObservedSend() (nullptr to disable)
+ * Used by ConnectionManager.
+ */
+void SetSendHook(SendHook hook);
+
+/**
+ * Receives the raw bytes (status line, headers and body) sent in response
+ * to a request, e.g. to cache or measure the response, without changing what is sent.
+ * Used by ResponseCache and Metrics.
+ *
+ * Attach an observer for the duration of a handler call using ScopedSendObserver.
+ */
+class SendObserver {
+public:
+    /**
+     * Called after data has been sent on the request's socket
+     */
+    virtual void OnSend(const char* data, size_t length) = 0;
+
+protected:
+    ~SendObserver() = default;
+
+private:
+    friend class ScopedSendObserver;
+    friend int ObservedSend(httpd_handle_t hd, int sockfd, const char *buf, size_t length, int flags);
+
+    SendObserver* next = nullptr;
+    int sockfd = -1;
+};
+
+/**
+ * Receives the raw bytes sent in response to a request instead of the socket,
+ * e.g. to run a handler without sending its response. Used by HandleBatchRequest().
+ *
+ * Attach a sink for the duration of a handler call using ScopedSendSink.
+ */
+class SendSink {
+public:
+    /**
+     * Called instead of sending data on the request's socket.
+     * Anything sent from within this function goes to the socket.
+     * @return ESP_OK, anything else makes the send fail
+     */
+    virtual esp_err_t OnSend(const char* data, size_t length) = 0;
+
+protected:
+    ~SendSink() = default;
+
+private:
+    friend class ScopedSendSink;
+    friend int ObservedSend(httpd_handle_t hd, int sockfd, const char *buf, size_t length, int flags);
+
+    SendSink* previous = nullptr;
+    SendObserver* outerObservers = nullptr; // Observers attached before the sink don't see its data
+    int sockfd = -1;
+};
+
+/**
+ * Attaches a SendObserver to the request on the current task while in scope.
+ * Observers may be nested (they are detached in reverse order).
+ *
+ * NOTE: This installs a session send override, which is a plain socket send
+ * otherwise. Do not use with esp_https_server.
+ */
+class ScopedSendObserver {
+public:
+    ScopedSendObserver(httpd_req_t *request, SendObserver* observer);
+    ~ScopedSendObserver();
+
+    ScopedSendObserver(const ScopedSendObserver&) = delete;
+    ScopedSendObserver& operator=(const ScopedSendObserver&) = delete;
+
+private:
+    SendObserver* observer;
+};
+
+/**
+ * Attaches a SendSink to the request on the current task while in scope.
+ * Observers attached while the sink is active see the data, the send hook does not.
+ *
+ * NOTE: This installs a session send override, which is a plain socket send
+ * otherwise. Do not use with esp_https_server.
+ */
+class ScopedSendSink {
+public:
+    ScopedSendSink(httpd_req_t *request, SendSink* sink);
+    ~ScopedSendSink();
+
+    ScopedSendSink(const ScopedSendSink&) = delete;
+    ScopedSendSink& operator=(const ScopedSendSink&) = delete;
+
+private:
+    SendSink* sink;
+};
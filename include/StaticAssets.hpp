@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_http_server.h>
+
+/**
+ * A file embedded into the firmware by tools/embed_assets.py
+ */
+struct StaticAsset {
+    const char* path;           // URL path, e.g. "/index.html"
+    const char* contentType;    // e.g. "text/html"
+    const uint8_t* data;
+    size_t length;
+    const char* etag;           // Quoted strong ETag derived from the hash of data (as sent)
+    bool gzip;                  // data is gzip-compressed
+};
+
+/**
+ * Serves a table of embedded static assets (e.g. a single-page web UI)
+ * as generated by tools/embed_assets.py.
+ *
+ * - Assets are looked up using binary search in the (sorted) table
+ * - Bodies are sent directly from flash/rodata in a single send, without copying
+ * - Precompressed assets are sent with Content-Encoding: gzip and Vary: Accept-Encoding.
+ *   Clients whose Accept-Encoding doesn't allow gzip get 406 Not Acceptable
+ *   (all browsers accept gzip, for curl use --compressed).
+ * - Every response includes the ETag and Cache-Control headers,
+ *   and requests with a matching If-None-Match header get
+ *   a 304 Not Modified response without body
+ *
+ * Paths ending with '/' are mapped to index.html in that directory.
+ *
+ * Usage (see HTTPServer::ServeStaticAssets()):
+ *
+ *  #include "WebUIAssets.hpp" // Generated
+ *  static const StaticAssetServer webUI(WebUIAssets, WebUIAssetsCount);
+ *  http.ServeStaticAssets(&webUI);
+ */
+class StaticAssetServer {
+public:
+    /**
+     * @param assets The asset table, sorted by path
+     * @param cacheControl The Cache-Control header value. The default makes browsers
+     *        revalidate on every load, which is cheap thanks to 304 responses.
+     * @param fallbackPath If not nullptr, this asset is served for unknown paths
+     *        (e.g. "/index.html" for single-page apps with client-side routing).
+     */
+    StaticAssetServer(const StaticAsset* assets, size_t numAssets,
+                      const char* cacheControl = "no-cache",
+                      const char* fallbackPath = nullptr);
+
+    /**
+     * @brief Find the asset with the given path
+     * @return The asset or nullptr
+     */
+    const StaticAsset* Find(const char* path, size_t length) const;
+
+    /**
+     * @brief Serve the asset for the given request (or a 404 response)
+     */
+    esp_err_t Handle(httpd_req_t *request) const;
+
+    /**
+     * ESP-IDF handler function serving the StaticAssetServer in request->user_ctx
+     */
+    static esp_err_t Dispatch(httpd_req_t *request);
+
+private:
+    /**
+     * @return true if the request's If-None-Match header matches the given ETag
+     */
+    static bool IsNotModified(httpd_req_t *request, const char* etag);
+
+    const StaticAsset* assets;
+    size_t numAssets;
+    const char* cacheControl;
+    const char* fallbackPath;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <esp_http_server.h>
+#include "RawSend.hpp"
+
+#ifndef _CPP17_AVAILABLE
+#define _CPP17_AVAILABLE (__cplusplus >= 201703L)
+#endif
+
+#if _CPP17_AVAILABLE
+
+/**
+ * A complete HTTP response (status line, headers and body)
+ * which is assembled at compile time.
+ *
+ * Send() writes the precomputed bytes to the socket with a single send,
+ * including a Content-Length header so clients can keep the connection alive.
+ * Nothing is formatted, measured or copied at runtime.
+ *
+ * Usage:
+ *
+ *  static constexpr auto NotFoundResponse = MakeStaticResponse(
+ *      "404 Not Found", "application/json", "{\"status\":\"error\",\"error\":\"Not found\"}");
+ *
+ *  // In the handler
+ *  return NotFoundResponse.Send(request);
+ *
+ * NOTE: Since Send() bypasses the ESP-IDF response functions, headers set using
+ * httpd_resp_set_hdr() are NOT sent. Pass them as extra headers
+ * (see MakeStaticResponse()) or use SendWithHeaders().
+ */
+template<size_t N>
+class StaticResponse {
+public:
+    /**
+     * Send the precomputed response with a single raw send.
+     */
+    esp_err_t Send(httpd_req_t *request) const {
+        return SendRaw(request, data, size);
+    }
+
+    /**
+     * Send the response through the regular ESP-IDF response functions,
+     * so headers set using httpd_resp_set_hdr() are included.
+     * Extra headers passed to MakeStaticResponse() are NOT sent in this case.
+     */
+    esp_err_t SendWithHeaders(httpd_req_t *request) const {
+        httpd_resp_set_status(request, status);
+        httpd_resp_set_type(request, contentType);
+        return httpd_resp_send(request, data + bodyOffset, size - bodyOffset);
+    }
+
+    /**
+     * The raw HTTP response
+     */
+    constexpr const char* Data() const { return data; }
+    constexpr size_t Size() const { return size; }
+
+    constexpr const char* Body() const { return data + bodyOffset; }
+    constexpr size_t BodyLength() const { return size - bodyOffset; }
+
+    char data[N] = {};
+    size_t size = 0;
+    size_t bodyOffset = 0;
+    const char* status = nullptr;
+    const char* contentType = nullptr;
+
+    constexpr void Append(const char* str, size_t length) {
+        for(size_t i = 0; i < length; i++) {
+            data[size++] = str[i];
+        }
+    }
+};
+
+constexpr size_t StaticResponseDecimalDigits(size_t n) {
+    return n < 10 ? 1 : 1 + StaticResponseDecimalDigits(n / 10);
+}
+
+/**
+ * Size of the buffer for a static response with the given
+ * string literal sizes (including their NUL terminators)
+ */
+constexpr size_t StaticResponseSize(size_t statusSize, size_t typeSize, size_t headersSize, size_t bodySize) {
+    return (sizeof("HTTP/1.1 \r\nContent-Type: \r\nContent-Length: \r\n\r\n") - 1)
+        + (statusSize - 1) + (typeSize - 1) + (headersSize - 1)
+        + StaticResponseDecimalDigits(bodySize - 1) + (bodySize - 1);
+}
+
+/**
+ * Build a static response.
+ * @param status The status, e.g. "200 OK"
+ * @param contentType The content type, e.g. "application/json"
+ * @param headers Extra header lines, each terminated by "\r\n",
+ *        e.g. "Cache-Control: no-store\r\n"
+ * @param body The body
+ */
+template<size_t S, size_t T, size_t H, size_t B>
+constexpr StaticResponse<StaticResponseSize(S, T, H, B)> MakeStaticResponse(
+        const char (&status)[S], const char (&contentType)[T],
+        const char (&headers)[H], const char (&body)[B]) {
+    StaticResponse<StaticResponseSize(S, T, H, B)> response;
+    response.status = status;
+    response.contentType = contentType;
+    response.Append("HTTP/1.1 ", 9);
+    response.Append(status, S - 1);
+    response.Append("\r\nContent-Type: ", 16);
+    response.Append(contentType, T - 1);
+    response.Append("\r\nContent-Length: ", 18);
+    char digits[StaticResponseDecimalDigits(B - 1)] = {};
+    size_t bodyLength = B - 1;
+    for(size_t i = sizeof(digits); i > 0; i--) {
+        digits[i - 1] = (char)('0' + bodyLength % 10);
+        bodyLength /= 10;
+    }
+    response.Append(digits, sizeof(digits));
+    response.Append("\r\n", 2);
+    response.Append(headers, H - 1);
+    response.Append("\r\n", 2);
+    response.bodyOffset = response.size;
+    response.Append(body, B - 1);
+    return response;
+}
+
+/**
+ * Build a static response without extra headers
+ */
+template<size_t S, size_t T, size_t B>
+constexpr StaticResponse<StaticResponseSize(S, T, 1, B)> MakeStaticResponse(
+        const char (&status)[S], const char (&contentType)[T], const char (&body)[B]) {
+    return MakeStaticResponse(status, contentType, "", body);
+}
+
+#endif // _CPP17_AVAILABLE
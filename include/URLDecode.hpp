@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Find the first character which needs URL decoding ('%' or '+')
+ * in the given range.
+ * The range is scanned one machine word at a time, so clean runs
+ * are skipped at close to memchr() speed.
+ *
+ * @return Pointer to the first '%' or '+', or end if there is none
+ */
+const char* URLFindEncoded(const char* begin, const char* end);
+
+/**
+ * Find the end of the key or value starting at begin in a
+ * "key1=value1&key2=value2" string: the next '&' or,
+ * if inKey is true, the next '&' or '=', whichever comes first.
+ * Shared by the query URL and form body parsers.
+ *
+ * @return Pointer to the delimiter, or end if there is none
+ */
+const char* URLFindDelimiter(const char* begin, const char* end, bool inKey);
+
+/**
+ * @brief Check if the given string contains any character which needs URL decoding
+ */
+inline bool URLNeedsDecoding(const char* str, size_t length) {
+    return URLFindEncoded(str, str + length) != str + length;
+}
+
+/**
+ * Decode a percent-encoded (application/x-www-form-urlencoded) string.
+ * '+' is decoded to a space, "%XX" is decoded to the byte with the hex value XX.
+ * Invalid or truncated escape sequences (e.g. "%zz" or a trailing "%4")
+ * are copied verbatim.
+ *
+ * The decoded string is never longer than the input, so dst needs
+ * room for length bytes. dst may be equal to src to decode in place,
+ * or lie before src in the same buffer (decoding moves data towards the front),
+ * but the ranges must not overlap otherwise.
+ * The output is NOT NUL-terminated.
+ *
+ * @return The length of the decoded string
+ */
+size_t URLDecode(const char* src, size_t length, char* dst);
+
+/**
+ * @brief URL-decode the given string into newly allocated memory
+ * The memory comes from the request arena if there is one (see RequestAllocate()),
+ * so decoding a value in a handler usually doesn't touch the heap.
+ * Release it with RequestFree().
+ *
+ * @param decodedLength If not nullptr, set to the length of the decoded string
+ * @return The NUL-terminated decoded string, or nullptr if out of memory
+ */
+char* URLDecodeAllocate(const char* src, size_t length, size_t* decodedLength = nullptr);
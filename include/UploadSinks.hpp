@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdio>
+#include "MultipartParser.hpp"
+#include <esp_ota_ops.h>
+
+/**
+ * Writes an uploaded firmware image to the next OTA partition.
+ *
+ * The partition is erased sequentially while writing, so the upload
+ * does not stall for a full-partition erase at the beginning.
+ * The image is validated in End(). If setBootPartition is true,
+ * the new image is also selected as boot partition (restart to boot it).
+ */
+class OTAUploadSink : public UploadSink {
+public:
+    OTAUploadSink(bool setBootPartition = true);
+
+    esp_err_t Begin(const MultipartPart& part) override;
+    esp_err_t Write(const char* data, size_t length) override;
+    esp_err_t End() override;
+    void Abort() override;
+
+    /**
+     * @return The partition the image has been written to, or nullptr
+     */
+    const esp_partition_t* GetPartition() const { return partition; }
+
+private:
+    bool setBootPartition;
+    const esp_partition_t* partition = nullptr;
+    esp_ota_handle_t handle = 0;
+};
+
+/**
+ * Writes an uploaded file to the filesystem (SPIFFS, FAT, LittleFS, ...).
+ * The path is not copied, so it must be kept in scope.
+ * Incomplete files are deleted if the upload fails.
+ */
+class FileUploadSink : public UploadSink {
+public:
+    FileUploadSink(const char* path);
+    ~FileUploadSink();
+
+    esp_err_t Begin(const MultipartPart& part) override;
+    esp_err_t Write(const char* data, size_t length) override;
+    esp_err_t End() override;
+    void Abort() override;
+
+private:
+    const char* path;
+    FILE* file = nullptr;
+};
+
+/**
+ * Stores an uploaded part in a fixed caller-provided buffer,
+ * e.g. for small configuration files or for testing.
+ * Fails with ESP_ERR_INVALID_SIZE if the part doesn't fit.
+ */
+class MemoryUploadSink : public UploadSink {
+public:
+    MemoryUploadSink(char* buffer, size_t size) : buffer(buffer), size(size) {}
+
+    esp_err_t Begin(const MultipartPart& /*part*/) override {
+        length = 0;
+        return ESP_OK;
+    }
+
+    esp_err_t Write(const char* data, size_t dataLength) override;
+
+    const char* Data() const { return buffer; }
+    size_t Length() const { return length; }
+
+private:
+    char* buffer;
+    size_t size;
+    size_t length = 0;
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <esp_http_server.h>
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <esp_timer.h>
+
+// Default maximum number of concurrent WebSocket clients of a WebSocketHub
+#ifndef HUMANESPHTTP_WS_MAX_CLIENTS
+#define HUMANESPHTTP_WS_MAX_CLIENTS 4
+#endif
+
+// Maximum size of a received message (larger messages close the connection)
+#ifndef HUMANESPHTTP_WS_MAX_MESSAGE
+#define HUMANESPHTTP_WS_MAX_MESSAGE 1024
+#endif
+
+// Default maximum number of bytes waiting to be sent to a single client.
+// Messages which don't fit are dropped for that client.
+#ifndef HUMANESPHTTP_WS_MAX_QUEUE
+#define HUMANESPHTTP_WS_MAX_QUEUE 4096
+#endif
+
+// Default latency budget in microseconds: messages queued within this time
+// are sent together (0 = send as soon as possible)
+#ifndef HUMANESPHTTP_WS_COALESCE_US
+#define HUMANESPHTTP_WS_COALESCE_US 2000
+#endif
+
+/**
+ * Counters of a WebSocketHub
+ */
+struct WebSocketStats {
+    uint32_t published = 0; // Publish() and Send() calls
+    uint32_t queued = 0;    // Messages queued for a client
+    uint32_t dropped = 0;   // Messages dropped because a client's queue was full
+    uint32_t sends = 0;     // Socket sends (each containing one or more frames)
+    uint32_t received = 0;  // Messages received from clients
+};
+
+class WebSocketHub;
+
+/**
+ * Called on the httpd task for every message received from a client.
+ * data points into the hub's receive buffer and is only valid during the call.
+ * Returning an error closes the connection.
+ */
+typedef esp_err_t (*WebSocketMessageHandler)(WebSocketHub& hub, int client, httpd_ws_type_t type,
+                                             const char* data, size_t length, void* context);
+
+/**
+ * WebSocket publish/subscribe hub: tracks clients, their topic subscriptions
+ * and an outbound queue per client.
+ *
+ * Outgoing messages are framed once and appended to the queue of every subscribed client.
+ * Queues are flushed by the httpd task after the latency budget (coalesceUs),
+ * so all messages queued within that time are sent in a single socket send
+ * (one TCP segment instead of one per message). Sends never block the httpd task.
+ *
+ * Received messages are read into a single buffer owned by the hub
+ * (no allocation per message) and passed to the message handler.
+ *
+ * Usage:
+ *
+ *  static WebSocketHub ws;
+ *
+ *  static esp_err_t OnMessage(WebSocketHub& hub, int client, httpd_ws_type_t type,
+ *                             const char* data, size_t length, void* context) {
+ *      if(length == 9 && memcmp(data, "subscribe", 9) == 0) {
+ *          return hub.Subscribe(client, "state");
+ *      }
+ *      ApplyJoystickInput(data, length);
+ *      return ESP_OK;
+ *  }
+ *
+ *  ws.SetMessageHandler(OnMessage);
+ *  http.RegisterWebSocket("/ws", &ws);
+ *  // From any task
+ *  ws.Publish("state", json, length);
+ *
+ * Clients are identified by their socket descriptor.
+ * The hub must be kept in scope while the server is running (typically a global).
+ * It uses the session context of its clients' sockets.
+ */
+class WebSocketHub {
+public:
+    /**
+     * Maximum number of distinct topics
+     */
+    static constexpr size_t MaxTopics = 32;
+
+    WebSocketHub(size_t maxClients = HUMANESPHTTP_WS_MAX_CLIENTS,
+                 size_t maxQueue = HUMANESPHTTP_WS_MAX_QUEUE,
+                 uint32_t coalesceUs = HUMANESPHTTP_WS_COALESCE_US);
+    ~WebSocketHub();
+
+    WebSocketHub(const WebSocketHub&) = delete;
+    WebSocketHub& operator=(const WebSocketHub&) = delete;
+
+    /**
+     * @brief Set the function called for every received message
+     */
+    void SetMessageHandler(WebSocketMessageHandler handler, void* context = nullptr);
+
+    /**
+     * @brief Subscribe the client to the given topic
+     * @return ESP_ERR_NOT_FOUND if there is no such client,
+     *         ESP_ERR_NO_MEM if there are too many topics
+     */
+    esp_err_t Subscribe(int client, const char* topic);
+
+    /**
+     * @brief Unsubscribe the client from the given topic
+     */
+    esp_err_t Unsubscribe(int client, const char* topic);
+
+    /**
+     * @brief Queue a message for all clients subscribed to the topic
+     * May be called from any task.
+     */
+    esp_err_t Publish(const char* topic, const char* data, size_t length,
+                      httpd_ws_type_t type = HTTPD_WS_TYPE_TEXT);
+
+    /**
+     * @brief Queue a message for a single client
+     * May be called from any task.
+     */
+    esp_err_t Send(int client, const char* data, size_t length,
+                   httpd_ws_type_t type = HTTPD_WS_TYPE_TEXT);
+
+    /**
+     * @return The number of currently connected clients
+     */
+    size_t GetClientCount();
+
+    WebSocketStats GetStats();
+
+    /**
+     * @brief WebSocket handler: accepts clients and receives their messages
+     */
+    esp_err_t Handle(httpd_req_t *request);
+
+    /**
+     * ESP-IDF handler function for the WebSocketHub in request->user_ctx
+     */
+    static esp_err_t Dispatch(httpd_req_t *request);
+
+private:
+    /**
+     * Session context of a client's socket,
+     * freed by ESP-IDF when the session is closed
+     */
+    struct Session {
+        WebSocketHub* hub;
+        int sockfd;
+    };
+
+    struct Client {
+        Session* session;
+        int sockfd;
+        uint32_t topics = 0; // Bit i: subscribed to topics[i]
+        std::string outbound; // Complete frames waiting to be sent
+    };
+
+    Client* FindClient(int sockfd);
+    int FindTopic(const char* topic);
+    /**
+     * Append the (already framed) message to the client's queue
+     */
+    void Enqueue(Client& client, const std::string& frame);
+    /**
+     * Schedule a flush on the httpd task after the given delay, unless already scheduled
+     */
+    void ScheduleFlush(uint64_t delayUs);
+    void Flush();
+
+    static void BuildFrame(std::string& frame, httpd_ws_type_t type, const char* data, size_t length);
+    static void FlushTimer(void* arg);
+    static void FlushWork(void* arg);
+    static void SessionClosed(void* context);
+
+    size_t maxClients;
+    size_t maxQueue;
+    uint32_t coalesceUs;
+    WebSocketMessageHandler messageHandler = nullptr;
+    void* messageContext = nullptr;
+    httpd_handle_t server = nullptr;
+    esp_timer_handle_t timer = nullptr;
+    bool flushScheduled = false;
+    std::vector<Client> clients;
+    std::vector<std::string> topics;
+    WebSocketStats stats;
+    std::mutex mutex;
+    uint8_t receiveBuffer[HUMANESPHTTP_WS_MAX_MESSAGE];
+};
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
@@ -0,0 +1,91 @@
+#include "AsyncWorkerPool.hpp"
+#include "JSONResponse.hpp"
+#include <esp_log.h>
+
+static const char* TAG = "Async workers";
+
+AsyncWorkerPool::AsyncWorkerPool(size_t numWorkers, size_t queueLength, BaseType_t core,
+                                 UBaseType_t priority, uint32_t stackSize)
+    : numWorkers(numWorkers), queueLength(queueLength), core(core), priority(priority), stackSize(stackSize) {
+}
+
+esp_err_t AsyncWorkerPool::Start() {
+#if HUMANESPHTTP_ASYNC_HANDLERS
+    if(queue != nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(numWorkers == 0 || queueLength == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    queue = xQueueCreate(queueLength, sizeof(Job));
+    if(queue == nullptr) {
+        ESP_LOGE(TAG, "Failed to create queue");
+        return ESP_ERR_NO_MEM;
+    }
+    for(size_t i = 0; i < numWorkers; i++) {
+        if(xTaskCreatePinnedToCore(WorkerTask, "httpd_worker", stackSize, this, priority, nullptr, core) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create worker task %u", (unsigned)i);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "Async handlers require ESP-IDF 5.1 or later");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t AsyncWorkerPool::Submit(httpd_req_t *request, Function function, void* context, const RouteParams* params) {
+#if HUMANESPHTTP_ASYNC_HANDLERS
+    if(queue == nullptr) {
+        return function(request, context, params);
+    }
+    Job job;
+    job.function = function;
+    job.context = context;
+    job.hasParams = params != nullptr;
+    // Reject early so the request doesn't have to be copied
+    if(uxQueueSpacesAvailable(queue) == 0
+        || httpd_req_async_handler_begin(request, &job.request) != ESP_OK) {
+        rejected++;
+        return SendStatusServiceUnavailable(request);
+    }
+    if(params != nullptr) {
+        // Captures point into the URI, which has been copied
+        job.params = *params;
+        job.params.Rebase(request->uri, job.request->uri);
+    }
+    if(xQueueSend(queue, &job, 0) != pdTRUE) {
+        // Another task filled the queue in the meantime
+        rejected++;
+        esp_err_t err = SendStatusServiceUnavailable(job.request);
+        httpd_req_async_handler_complete(job.request);
+        return err;
+    }
+    return ESP_OK;
+#else
+    return function(request, context, params);
+#endif
+}
+
+size_t AsyncWorkerPool::GetQueueDepth() const {
+    return queue == nullptr ? 0 : uxQueueMessagesWaiting(queue);
+}
+
+void AsyncWorkerPool::WorkerTask(void* arg) {
+#if HUMANESPHTTP_ASYNC_HANDLERS
+    AsyncWorkerPool* pool = static_cast<AsyncWorkerPool*>(arg);
+    Job job;
+    while(true) {
+        if(xQueueReceive(pool->queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        esp_err_t err = job.function(job.request, job.context, job.hasParams ? &job.params : nullptr);
+        if(err != ESP_OK) {
+            ESP_LOGW(TAG, "Handler for %s failed: %s", job.request->uri, esp_err_to_name(err));
+        }
+        httpd_req_async_handler_complete(job.request);
+        pool->completed++;
+    }
+#endif
+}
@@ -0,0 +1,412 @@
+#include "BatchRequest.hpp"
+#include "AsyncWorkerPool.hpp"
+#include "CompressedResponse.hpp"
+#include "JSONResponse.hpp"
+#include "JSONWriter.hpp"
+#include "NumberParser.hpp"
+#include "RequestArena.hpp"
+#include "SendObserver.hpp"
+#include <esp_log.h>
+#include <cstring>
+#include <memory>
+#include <strings.h>
+
+static const char* TAG = "Batch";
+
+// Sub-request running on the current task
+static thread_local httpd_req_t* currentSubRequest = nullptr;
+
+bool IsBatchSubRequest(httpd_req_t *request) {
+    return request != nullptr && request == currentSubRequest;
+}
+
+static const EnumName<httpd_method_t> MethodNames[] = {
+    {"GET", HTTP_GET}, {"HEAD", HTTP_HEAD}, {"POST", HTTP_POST}, {"PUT", HTTP_PUT},
+    {"DELETE", HTTP_DELETE}, {"PATCH", HTTP_PATCH}, {"OPTIONS", HTTP_OPTIONS}
+};
+
+/**
+ * A line of the batch body
+ */
+struct SubRequestLine {
+    const char* methodName;
+    size_t methodNameLength;
+    httpd_method_t method;
+    const char* uri;
+    size_t uriLength;
+};
+
+enum class LineResult { End, Ok, Invalid };
+
+/**
+ * Parse the next non-empty line ("<METHOD> <URI>" or "<URI>") of the batch body
+ */
+static LineResult NextLine(const char*& p, const char* end, SubRequestLine& line) {
+    while(p < end) {
+        const char* newline = (const char*)memchr(p, '\n', end - p);
+        const char* lineEnd = newline != nullptr ? newline : end;
+        const char* start = p;
+        p = newline != nullptr ? newline + 1 : end;
+        while(lineEnd > start && (lineEnd[-1] == '\r' || lineEnd[-1] == ' ')) {
+            lineEnd--;
+        }
+        if(lineEnd == start) {
+            continue; // Empty line
+        }
+        if(*start == '/') {
+            line.methodName = "GET";
+            line.methodNameLength = 3;
+            line.method = HTTP_GET;
+            line.uri = start;
+        } else {
+            const char* space = (const char*)memchr(start, ' ', lineEnd - start);
+            if(space == nullptr
+                || ParseEnum(start, space - start, MethodNames, line.method) != ValueParseError::None) {
+                return LineResult::Invalid;
+            }
+            line.methodName = start;
+            line.methodNameLength = space - start;
+            line.uri = space + 1;
+            while(line.uri < lineEnd && *line.uri == ' ') {
+                line.uri++;
+            }
+        }
+        line.uriLength = lineEnd - line.uri;
+        if(line.uriLength == 0 || *line.uri != '/' || line.uriLength > HTTPD_MAX_URI_LEN
+            || memchr(line.uri, ' ', line.uriLength) != nullptr) {
+            return LineResult::Invalid;
+        }
+        return LineResult::Ok;
+    }
+    return LineResult::End;
+}
+
+/**
+ * Parses the raw response of a sub-request (status line, headers and a
+ * Content-Length or chunked body) while it is being sent, and writes it
+ * to the combined JSON response as one object.
+ */
+class SubResponse : public SendSink {
+public:
+    SubResponse(JSONWriter& json) : json(json) {}
+
+    /**
+     * Start capturing the response to the given sub-request
+     */
+    void Begin(const SubRequestLine& line) {
+        this->line = line;
+        state = State::Head;
+        headLength = 0;
+        remaining = 0;
+        truncated = false;
+        started = false;
+    }
+
+    esp_err_t OnSend(const char* data, size_t length) override {
+        if(state == State::Head) {
+            size_t consumed = ReceiveHead(data, length);
+            data += consumed;
+            length -= consumed;
+        }
+        ReceiveBody(data, length);
+        return json.GetError();
+    }
+
+    /**
+     * Finish the JSON object of the sub-response
+     * @param err The result of the handler
+     */
+    void Finish(esp_err_t err) {
+        if(!started) {
+            const char* error = state == State::Invalid ? "Invalid response"
+                : err != ESP_OK ? esp_err_to_name(err) : "No response";
+            WriteError(error);
+            return;
+        }
+        json.EndString();
+        if(truncated) {
+            json.Key("truncated").Bool(true);
+        }
+        json.EndObject();
+    }
+
+    /**
+     * Write an object for a sub-request without response
+     */
+    void WriteError(const char* error) {
+        json.BeginObject();
+        WriteRequest();
+        json.Key("error").String(error);
+        json.EndObject();
+    }
+
+    /**
+     * @return The number of body bytes which may still be written
+     */
+    size_t GetBudget() const { return budget; }
+
+private:
+    enum class State : uint8_t { Head, ChunkSize, ChunkExtension, ChunkData, ChunkDataEnd, Identity, Done, Invalid };
+
+    void WriteRequest() {
+        json.Key("method").String(line.methodName, line.methodNameLength);
+        json.Key("uri").String(line.uri, line.uriLength);
+    }
+
+    /**
+     * Collect the status line and headers
+     * @return The number of bytes consumed
+     */
+    size_t ReceiveHead(const char* data, size_t length) {
+        for(size_t i = 0; i < length; i++) {
+            if(headLength == sizeof(head)) {
+                ESP_LOGW(TAG, "Response headers of %.*s too large", (int)line.uriLength, line.uri);
+                state = State::Invalid;
+                return length;
+            }
+            head[headLength++] = data[i];
+            if(headLength >= 4 && memcmp(head + headLength - 4, "\r\n\r\n", 4) == 0) {
+                StartBody();
+                return i + 1;
+            }
+        }
+        return length;
+    }
+
+    /**
+     * Write the status and headers and start the body string
+     */
+    void StartBody() {
+        // "HTTP/1.1 200 OK"
+        uint16_t status;
+        if(headLength < 12 || memcmp(head, "HTTP/1.", 7) != 0
+            || ParseInteger(head + 9, 3, status) != ValueParseError::None) {
+            state = State::Invalid;
+            return;
+        }
+        json.BeginObject();
+        WriteRequest();
+        json.Key("status").Number((unsigned)status);
+        json.Key("headers").BeginObject();
+        bool chunked = false;
+        size_t contentLength = 0;
+        const char* end = head + headLength - 2; // Before the empty line
+        const char* p = (const char*)memchr(head, '\n', headLength) + 1;
+        while(p < end) {
+            const char* lineEnd = (const char*)memchr(p, '\r', end - p);
+            if(lineEnd == nullptr) {
+                lineEnd = end;
+            }
+            const char* colon = (const char*)memchr(p, ':', lineEnd - p);
+            if(colon != nullptr) {
+                size_t nameLength = colon - p;
+                const char* value = colon + 1;
+                while(value < lineEnd && *value == ' ') {
+                    value++;
+                }
+                size_t valueLength = lineEnd - value;
+                // Framing headers describe the captured response, not the body in the batch
+                if(nameLength == 14 && strncasecmp(p, "Content-Length", 14) == 0) {
+                    ParseInteger(value, valueLength, contentLength);
+                } else if(nameLength == 17 && strncasecmp(p, "Transfer-Encoding", 17) == 0) {
+                    chunked = true;
+                } else {
+                    json.Key(p, nameLength).String(value, valueLength);
+                }
+            }
+            p = lineEnd + 2;
+        }
+        json.EndObject();
+        json.Key("body").BeginString();
+        started = true;
+        if(chunked) {
+            state = State::ChunkSize;
+        } else {
+            state = contentLength > 0 ? State::Identity : State::Done;
+            remaining = contentLength;
+        }
+    }
+
+    void ReceiveBody(const char* data, size_t length) {
+        const char* end = data + length;
+        while(data < end) {
+            switch(state) {
+                case State::ChunkSize: {
+                    unsigned digit = (unsigned char)*data - '0';
+                    if(digit > 9) {
+                        digit = ((unsigned char)*data | 0x20) - 'a' + 10;
+                    }
+                    if(digit < 16) {
+                        remaining = remaining * 16 + digit;
+                    } else if(*data == '\n') {
+                        state = remaining > 0 ? State::ChunkData : State::Done;
+                    } else {
+                        state = State::ChunkExtension; // "\r" or ";name=value"
+                    }
+                    data++;
+                    break;
+                }
+                case State::ChunkExtension:
+                    if(*data++ == '\n') {
+                        state = remaining > 0 ? State::ChunkData : State::Done;
+                    }
+                    break;
+                case State::ChunkData:
+                case State::Identity: {
+                    size_t part = (size_t)(end - data) < remaining ? (size_t)(end - data) : remaining;
+                    WriteBody(data, part);
+                    data += part;
+                    remaining -= part;
+                    if(remaining == 0) {
+                        state = state == State::Identity ? State::Done : State::ChunkDataEnd;
+                    }
+                    break;
+                }
+                case State::ChunkDataEnd:
+                    if(*data++ == '\n') {
+                        state = State::ChunkSize;
+                    }
+                    break;
+                default:
+                    return; // Anything after the end of the response is ignored
+            }
+        }
+    }
+
+    void WriteBody(const char* data, size_t length) {
+        if(length > budget) {
+            // Don't cut a UTF-8 sequence in half
+            length = budget;
+            while(length > 0 && ((unsigned char)data[length] & 0xC0) == 0x80) {
+                length--;
+            }
+            truncated = true;
+            budget = 0;
+        } else {
+            budget -= length;
+        }
+        json.StringPart(data, length);
+    }
+
+    JSONWriter& json;
+    SubRequestLine line = {};
+    State state = State::Head;
+    bool started = false; // The object has been opened
+    bool truncated = false;
+    size_t remaining = 0; // Of the current chunk or of the Content-Length
+    size_t budget = HUMANESPHTTP_BATCH_MAX_OUTPUT;
+    size_t headLength = 0;
+    char head[HUMANESPHTTP_BATCH_MAX_HEAD];
+};
+
+/**
+ * Kept on the heap, since the sub-request handlers run on top of the batch handler's stack
+ */
+struct BatchResponse {
+    BatchResponse(httpd_req_t *request) : response(request), json(CompressedResponse::Output, &response), sub(json) {}
+
+    CompressedResponse response;
+    JSONWriter json;
+    SubResponse sub;
+};
+
+esp_err_t HandleBatchRequest(httpd_req_t *request, BatchDispatcher dispatch, void* context) {
+#if HUMANESPHTTP_ASYNC_HANDLERS
+    if(currentSubRequest != nullptr) {
+        httpd_resp_set_status(request, "400 Bad Request");
+        return SendStatusError(request, "Batches can't be nested");
+    }
+    // Capturing replaces the session's send function, which would bypass TLS
+    if(httpd_sess_get_transport_ctx(request->handle, httpd_req_to_sockfd(request)) != nullptr) {
+        ESP_LOGE(TAG, "Batch requests are not supported with esp_https_server");
+        return SendStatusInternalServerError(request);
+    }
+    size_t length = request->content_len;
+    if(length > HUMANESPHTTP_BATCH_MAX_BODY) {
+        httpd_resp_set_status(request, "413 Payload Too Large");
+        return SendStatusError(request, "Batch too large");
+    }
+    std::unique_ptr<char, void(*)(void*)> body((char*)RequestAllocate(length + 1), RequestFree);
+    if(body == nullptr) {
+        return SendStatusInternalServerError(request);
+    }
+    size_t filled = 0;
+    while(filled < length) {
+        int received = httpd_req_recv(request, body.get() + filled, length - filled);
+        if(received == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue; // Retry
+        }
+        if(received <= 0) {
+            ESP_LOGE(TAG, "Failed to receive body");
+            return ESP_FAIL;
+        }
+        filled += received;
+    }
+    const char* end = body.get() + length;
+
+    // Validate the whole batch before running anything
+    SubRequestLine line;
+    size_t count = 0;
+    LineResult result;
+    for(const char* p = body.get(); (result = NextLine(p, end, line)) != LineResult::End; count++) {
+        if(result == LineResult::Invalid) {
+            httpd_resp_set_status(request, "400 Bad Request");
+            return SendStatusError(request, "Invalid sub-request");
+        }
+    }
+    if(count == 0 || count > HUMANESPHTTP_BATCH_MAX_REQUESTS) {
+        httpd_resp_set_status(request, "400 Bad Request");
+        return SendStatusError(request, count == 0 ? "Empty batch" : "Too many sub-requests");
+    }
+
+    // Sub-requests are copied from a copy taken before anything is sent,
+    // so each of them starts with a fresh response state
+    httpd_req_t *base;
+    if(httpd_req_async_handler_begin(request, &base) != ESP_OK) {
+        return SendStatusInternalServerError(request);
+    }
+    httpd_resp_set_type(request, "application/json");
+    std::unique_ptr<BatchResponse> batch(new BatchResponse(request));
+    JSONWriter& json = batch->json;
+    SubResponse& sub = batch->sub;
+    json.BeginArray();
+    for(const char* p = body.get(); NextLine(p, end, line) == LineResult::Ok && json.GetError() == ESP_OK; ) {
+        sub.Begin(line);
+        if(sub.GetBudget() == 0) {
+            sub.WriteError("Output limit exceeded");
+            continue;
+        }
+        httpd_req_t *subRequest;
+        if(httpd_req_async_handler_begin(base, &subRequest) != ESP_OK) {
+            sub.WriteError("Out of memory");
+            continue;
+        }
+        subRequest->method = line.method;
+        memcpy((char*)subRequest->uri, line.uri, line.uriLength);
+        ((char*)subRequest->uri)[line.uriLength] = '\0';
+        subRequest->content_len = 0;
+        subRequest->user_ctx = nullptr;
+        esp_err_t err;
+        {
+            ScopedSendSink sink(subRequest, &sub);
+            // Bodies are embedded as JSON strings, the batch response as a whole is compressed
+            ScopedIdentityEncoding identity;
+            currentSubRequest = subRequest;
+            err = dispatch(subRequest, context);
+            currentSubRequest = nullptr;
+        }
+        sub.Finish(err);
+        httpd_req_async_handler_complete(subRequest);
+    }
+    json.EndArray();
+    esp_err_t err = json.Finish();
+    if(err == ESP_OK) {
+        err = batch->response.Finish();
+    }
+    httpd_req_async_handler_complete(base);
+    return err;
+#else
+    ESP_LOGE(TAG, "Batch requests require ESP-IDF 5.1 or later");
+    return SendStatusInternalServerError(request);
+#endif
+}
@@ -0,0 +1,435 @@
+#include "CompressedResponse.hpp"
+#include <esp_log.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+static const char* TAG = "Compression";
+
+// Set by ScopedIdentityEncoding on the current task
+static thread_local bool identityOnly = false;
+
+static constexpr size_t MinMatch = 3;
+static constexpr size_t MaxMatch = 258;
+static constexpr size_t HashSize = 1 << HUMANESPHTTP_GZIP_HASH_BITS;
+
+// Deflate length and distance codes (RFC 1951, 3.2.5)
+static const uint16_t LengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// CRC-32 (as used by gzip), 4 bits at a time
+static const uint32_t CRCTable[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+
+static uint32_t UpdateCRC(uint32_t crc, const uint8_t* data, size_t length) {
+    crc = ~crc;
+    for(size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ CRCTable[crc & 15];
+        crc = (crc >> 4) ^ CRCTable[crc & 15];
+    }
+    return ~crc;
+}
+
+/**
+ * Fixed Huffman code of each literal/length symbol, bit-reversed
+ * since deflate writes Huffman codes starting with the most significant bit
+ */
+struct FixedCodes {
+    uint16_t code[288];
+    uint8_t length[288];
+
+    FixedCodes() {
+        for(unsigned symbol = 0; symbol < 288; symbol++) {
+            unsigned value, bits;
+            if(symbol < 144) {
+                value = 0x30 + symbol;
+                bits = 8;
+            } else if(symbol < 256) {
+                value = 0x190 + symbol - 144;
+                bits = 9;
+            } else if(symbol < 280) {
+                value = symbol - 256;
+                bits = 7;
+            } else {
+                value = 0xc0 + symbol - 280;
+                bits = 8;
+            }
+            unsigned reversed = 0;
+            for(unsigned bit = 0; bit < bits; bit++) {
+                reversed |= ((value >> bit) & 1) << (bits - 1 - bit);
+            }
+            code[symbol] = reversed;
+            length[symbol] = bits;
+        }
+    }
+};
+
+static const FixedCodes& GetFixedCodes() {
+    static const FixedCodes codes;
+    return codes;
+}
+
+static inline uint32_t Hash(const uint8_t* data) {
+    uint32_t value = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+    return (value * 2654435761u) >> (32 - HUMANESPHTTP_GZIP_HASH_BITS);
+}
+
+GzipEncoder::GzipEncoder(OutputFunction output, void* context, size_t window)
+    : output(output), context(context), window(512) {
+    while(this->window < window && this->window < 16384) {
+        this->window <<= 1;
+    }
+    window = this->window;
+    memory = (uint8_t*)calloc(1, HashSize * sizeof(uint16_t) + window * sizeof(uint16_t)
+                                  + 2 * window + HUMANESPHTTP_GZIP_OUTPUT_SIZE);
+    if(memory == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate encoder for a %u byte window", (unsigned)window);
+        error = ESP_ERR_NO_MEM;
+        return;
+    }
+    head = (uint16_t*)memory;
+    prev = head + HashSize;
+    buffer = (uint8_t*)(prev + window);
+    out = buffer + 2 * window;
+    GetFixedCodes();
+
+    // gzip header: deflate, no flags, no modification time, unknown OS
+    static const uint8_t header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+    for(uint8_t byte : header) {
+        PutByte(byte);
+    }
+    // A single fixed Huffman block for all data (not final, see Finish())
+    PutBits(2, 3);
+}
+
+GzipEncoder::~GzipEncoder() {
+    free(memory);
+}
+
+void GzipEncoder::FlushOutput() {
+    if(outLength > 0 && error == ESP_OK) {
+        error = output(context, (const char*)out, outLength);
+    }
+    outputSize += outLength;
+    outLength = 0;
+}
+
+void GzipEncoder::PutByte(uint8_t value) {
+    out[outLength++] = value;
+    if(outLength == HUMANESPHTTP_GZIP_OUTPUT_SIZE) {
+        FlushOutput();
+    }
+}
+
+void GzipEncoder::PutBits(uint32_t value, unsigned count) {
+    bits |= value << bitCount;
+    bitCount += count;
+    while(bitCount >= 8) {
+        PutByte(bits & 0xff);
+        bits >>= 8;
+        bitCount -= 8;
+    }
+}
+
+void GzipEncoder::PutSymbol(unsigned symbol) {
+    const FixedCodes& codes = GetFixedCodes();
+    PutBits(codes.code[symbol], codes.length[symbol]);
+}
+
+void GzipEncoder::PutMatch(size_t length, size_t distance) {
+    unsigned code = 28;
+    while(LengthBase[code] > length) {
+        code--;
+    }
+    PutSymbol(257 + code);
+    PutBits(length - LengthBase[code], LengthExtra[code]);
+    code = 29;
+    while(DistanceBase[code] > distance) {
+        code--;
+    }
+    // Fixed distance codes are 5 bits, also written most significant bit first
+    unsigned reversed = ((code & 1) << 4) | ((code & 2) << 2) | (code & 4) | ((code & 8) >> 2) | ((code & 16) >> 4);
+    PutBits(reversed, 5);
+    PutBits(distance - DistanceBase[code], DistanceExtra[code]);
+}
+
+void GzipEncoder::Insert(size_t position) {
+    uint32_t hash = Hash(buffer + position);
+    prev[position & (window - 1)] = head[hash];
+    head[hash] = position + 1;
+}
+
+void GzipEncoder::Process(bool finish) {
+    while(position < end && error == ESP_OK) {
+        size_t available = end - position;
+        if(!finish && available < MaxMatch) {
+            break; // Wait for more data, a longer match may be possible
+        }
+        size_t bestLength = 0;
+        size_t bestDistance = 0;
+        if(available >= MinMatch) {
+            size_t maxLength = available < MaxMatch ? available : MaxMatch;
+            const uint8_t* current = buffer + position;
+            size_t candidate = head[Hash(current)];
+            for(unsigned chain = 0; candidate != 0 && chain < HUMANESPHTTP_GZIP_MAX_CHAIN; chain++) {
+                size_t start = candidate - 1;
+                size_t distance = position - start;
+                if(distance > window) {
+                    break;
+                }
+                const uint8_t* match = buffer + start;
+                // Only compare if this candidate can be longer than the best match
+                if(match[bestLength] == current[bestLength]) {
+                    size_t length = 0;
+                    while(length < maxLength && match[length] == current[length]) {
+                        length++;
+                    }
+                    if(length > bestLength) {
+                        bestLength = length;
+                        bestDistance = distance;
+                        if(length == maxLength) {
+                            break;
+                        }
+                    }
+                }
+                size_t next = prev[start & (window - 1)];
+                if(next >= candidate) {
+                    break; // Overwritten by a newer position
+                }
+                candidate = next;
+            }
+            Insert(position);
+        }
+        if(bestLength >= MinMatch) {
+            PutMatch(bestLength, bestDistance);
+            for(size_t i = 1; i < bestLength; i++) {
+                if(position + i + MinMatch <= end) {
+                    Insert(position + i);
+                }
+            }
+            position += bestLength;
+        } else {
+            PutSymbol(buffer[position]);
+            position++;
+        }
+    }
+}
+
+void GzipEncoder::Slide() {
+    // Keep the last window of history, positions in the tables move down by window
+    memmove(buffer, buffer + window, end - window);
+    position -= window;
+    end -= window;
+    for(size_t i = 0; i < HashSize; i++) {
+        head[i] = head[i] > window ? head[i] - window : 0;
+    }
+    for(size_t i = 0; i < window; i++) {
+        prev[i] = prev[i] > window ? prev[i] - window : 0;
+    }
+}
+
+esp_err_t GzipEncoder::Write(const char* data, size_t length) {
+    if(memory == nullptr) {
+        return error;
+    }
+    while(length > 0 && error == ESP_OK) {
+        if(end == 2 * window) {
+            Slide();
+        }
+        size_t count = 2 * window - end;
+        if(count > length) {
+            count = length;
+        }
+        memcpy(buffer + end, data, count);
+        crc = UpdateCRC(crc, buffer + end, count);
+        end += count;
+        inputSize += count;
+        data += count;
+        length -= count;
+        Process(false);
+    }
+    return error;
+}
+
+esp_err_t GzipEncoder::Finish() {
+    if(memory == nullptr) {
+        return error;
+    }
+    Process(true);
+    PutSymbol(256); // End of block
+    PutBits(3, 3);  // Empty final block
+    PutSymbol(256);
+    if(bitCount > 0) {
+        PutBits(0, 8 - bitCount);
+    }
+    uint32_t trailer[2] = {crc, (uint32_t)inputSize};
+    for(uint32_t value : trailer) {
+        for(unsigned shift = 0; shift < 32; shift += 8) {
+            PutByte((value >> shift) & 0xff);
+        }
+    }
+    FlushOutput();
+    return error;
+}
+
+/**
+ * Check a single Accept-Encoding entry like "gzip;q=0.8"
+ */
+static bool AcceptsEntry(const char* entry, size_t length) {
+    while(length > 0 && isspace((unsigned char)*entry)) {
+        entry++;
+        length--;
+    }
+    size_t nameLength = 0;
+    while(nameLength < length && entry[nameLength] != ';' && !isspace((unsigned char)entry[nameLength])) {
+        nameLength++;
+    }
+    bool gzip = (nameLength == 4 && strncasecmp(entry, "gzip", 4) == 0)
+                || (nameLength == 1 && entry[0] == '*');
+    if(!gzip) {
+        return false;
+    }
+    // Explicitly refused with q=0
+    for(size_t i = nameLength; i + 2 < length; i++) {
+        if((entry[i] == 'q' || entry[i] == 'Q') && entry[i + 1] == '=') {
+            return strtof(entry + i + 2, nullptr) > 0.0f;
+        }
+    }
+    return true;
+}
+
+ScopedIdentityEncoding::ScopedIdentityEncoding() : previous(identityOnly) {
+    identityOnly = true;
+}
+
+ScopedIdentityEncoding::~ScopedIdentityEncoding() {
+    identityOnly = previous;
+}
+
+bool AcceptsGzip(httpd_req_t *request) {
+    if(identityOnly) {
+        return false;
+    }
+    char value[128];
+    esp_err_t err = httpd_req_get_hdr_value_str(request, "Accept-Encoding", value, sizeof(value));
+    if(err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    const char* entry = value;
+    while(true) {
+        const char* comma = strchr(entry, ',');
+        size_t length = comma != nullptr ? (size_t)(comma - entry) : strlen(entry);
+        if(AcceptsEntry(entry, length)) {
+            return true;
+        }
+        if(comma == nullptr) {
+            return false;
+        }
+        entry = comma + 1;
+    }
+}
+
+CompressedResponse::CompressedResponse(httpd_req_t *request) : request(request) {
+    acceptsGzip = AcceptsGzip(request);
+    // Caches must not serve the compressed response to other clients
+    // (ResponseCache doesn't store responses with a Content-Encoding)
+    httpd_resp_set_hdr(request, "Vary", "Accept-Encoding");
+}
+
+esp_err_t CompressedResponse::SendChunk(void* context, const char* data, size_t length) {
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), data, length);
+}
+
+void CompressedResponse::Start() {
+    if(acceptsGzip) {
+        encoder.reset(new GzipEncoder(SendChunk, request));
+        if(!encoder->IsValid()) {
+            encoder.reset(); // Out of memory, send uncompressed
+        }
+    }
+    if(encoder != nullptr) {
+        httpd_resp_set_hdr(request, "Content-Encoding", "gzip");
+        state = State::Compressing;
+        error = encoder->Write(pending, pendingLength);
+    } else {
+        state = State::Identity;
+        // An empty chunk would end the response
+        if(pendingLength > 0) {
+            error = httpd_resp_send_chunk(request, pending, pendingLength);
+        }
+    }
+    pendingLength = 0;
+}
+
+esp_err_t CompressedResponse::Write(const char* data, size_t length) {
+    if(error != ESP_OK || length == 0) {
+        return error;
+    }
+    if(state == State::Buffering) {
+        if(pendingLength + length < sizeof(pending)) {
+            memcpy(pending + pendingLength, data, length);
+            pendingLength += length;
+            return ESP_OK;
+        }
+        Start();
+    }
+    if(error != ESP_OK) {
+        return error;
+    }
+    if(state == State::Compressing) {
+        error = encoder->Write(data, length);
+    } else if(state == State::Identity) {
+        error = httpd_resp_send_chunk(request, data, length);
+    }
+    return error;
+}
+
+esp_err_t CompressedResponse::Finish() {
+    State previous = state;
+    state = State::Finished;
+    if(error != ESP_OK) {
+        return error;
+    }
+    switch(previous) {
+        case State::Buffering:
+            // Small response: identity with Content-Length
+            error = httpd_resp_send(request, pending, pendingLength);
+            break;
+        case State::Compressing:
+            error = encoder->Finish();
+            if(error == ESP_OK) {
+                error = httpd_resp_send_chunk(request, nullptr, 0);
+            }
+            ESP_LOGD(TAG, "Compressed %u to %u bytes", (unsigned)encoder->GetInputSize(), (unsigned)encoder->GetOutputSize());
+            break;
+        case State::Identity:
+            error = httpd_resp_send_chunk(request, nullptr, 0);
+            break;
+        case State::Finished:
+            break;
+    }
+    return error;
+}
+
+esp_err_t CompressedResponse::Output(void* context, const char* data, size_t length) {
+    return static_cast<CompressedResponse*>(context)->Write(data, length);
+}
+
+esp_err_t SendCompressed(httpd_req_t *request, const char* data, size_t length) {
+    CompressedResponse response(request);
+    response.Write(data, length);
+    return response.Finish();
+}
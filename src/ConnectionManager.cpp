@@ -0,0 +1,340 @@
+#include "ConnectionManager.hpp"
+#include "SendObserver.hpp"
+#include "JSONWriter.hpp"
+#include <esp_log.h>
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char* TAG = "Connections";
+
+// All attached managers, to check the global user context in the (global) send hook
+static std::mutex attachedMutex;
+static std::vector<ConnectionManager*> attached;
+
+ConnectionManager::ConnectionManager(uint32_t idleTimeoutMs, size_t reservedSlots, uint32_t purgeMinIdleMs)
+    : idleTimeoutMs(idleTimeoutMs), reservedSlots(reservedSlots), purgeMinIdleMs(purgeMinIdleMs) {
+}
+
+ConnectionManager::~ConnectionManager() {
+    if(timer != nullptr) {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+    }
+    std::lock_guard<std::mutex> lock(attachedMutex);
+    for(size_t i = 0; i < attached.size(); i++) {
+        if(attached[i] == this) {
+            attached.erase(attached.begin() + i);
+            break;
+        }
+    }
+}
+
+esp_err_t ConnectionManager::Attach(httpd_config_t& conf) {
+    if(conf.global_user_ctx != nullptr) {
+        ESP_LOGE(TAG, "conf.global_user_ctx is already in use");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(conf.open_fn != OnOpen) {
+        userOpen = conf.open_fn;
+        userClose = conf.close_fn;
+    }
+    conf.global_user_ctx = this;
+    conf.global_user_ctx_free_fn = FreeContext;
+    conf.open_fn = OnOpen;
+    conf.close_fn = OnClose;
+    conf.lru_purge_enable = false;
+    maxConnections = conf.max_open_sockets;
+    connections.assign(maxConnections, ConnectionInfo());
+    {
+        std::lock_guard<std::mutex> lock(attachedMutex);
+        attached.push_back(this);
+    }
+    SetSendHook(OnSend);
+    return ESP_OK;
+}
+
+esp_err_t ConnectionManager::Start(httpd_handle_t server) {
+    this->server = server;
+    if(idleTimeoutMs == 0 || timer != nullptr) {
+        return ESP_OK;
+    }
+    esp_timer_create_args_t args = {};
+    args.callback = ReapTimer;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "conn_reap";
+    esp_err_t err = esp_timer_create(&args, &timer);
+    if(err == ESP_OK) {
+        // Connections are closed at most a quarter of the timeout late
+        uint64_t periodUs = (uint64_t)idleTimeoutMs * 1000 / 4;
+        err = esp_timer_start_periodic(timer, periodUs > 250000 ? periodUs : 250000);
+    }
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start idle timer: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+ConnectionInfo* ConnectionManager::Find(int sockfd) {
+    for(ConnectionInfo& connection : connections) {
+        if(connection.sockfd == sockfd) {
+            return &connection;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t ConnectionManager::OnOpen(httpd_handle_t hd, int sockfd) {
+    ConnectionManager* manager = static_cast<ConnectionManager*>(httpd_get_global_user_ctx(hd));
+    if(manager->userOpen != nullptr) {
+        esp_err_t err = manager->userOpen(hd, sockfd);
+        if(err != ESP_OK) {
+            return err; // ESP-IDF closes the socket
+        }
+    }
+    manager->server = hd; // Start() may not have been called yet
+    size_t open = 0;
+    {
+        std::lock_guard<std::mutex> lock(manager->mutex);
+        ConnectionInfo* connection = manager->Find(-1);
+        if(connection == nullptr) {
+            // More sockets than max_open_sockets (should not happen)
+            manager->connections.emplace_back();
+            connection = &manager->connections.back();
+        }
+        *connection = ConnectionInfo();
+        connection->sockfd = sockfd;
+        connection->openedUs = esp_timer_get_time();
+        connection->lastActivityUs = connection->openedUs;
+        manager->stats.accepted++;
+        open = ++manager->stats.open;
+    }
+    httpd_sess_set_send_override(hd, sockfd, ObservedSend);
+    httpd_sess_set_recv_override(hd, sockfd, Receive);
+    if(open + manager->reservedSlots > manager->maxConnections) {
+        manager->Purge(sockfd);
+    }
+    return ESP_OK;
+}
+
+void ConnectionManager::OnClose(httpd_handle_t hd, int sockfd) {
+    ConnectionManager* manager = static_cast<ConnectionManager*>(httpd_get_global_user_ctx(hd));
+    {
+        std::lock_guard<std::mutex> lock(manager->mutex);
+        ConnectionInfo* connection = manager->Find(sockfd);
+        if(connection != nullptr) {
+            connection->sockfd = -1;
+            manager->stats.open--;
+            manager->stats.closed++;
+        }
+    }
+    // With a close function set, ESP-IDF leaves closing the socket to it
+    if(manager->userClose != nullptr) {
+        manager->userClose(hd, sockfd);
+    } else {
+        close(sockfd);
+    }
+}
+
+int ConnectionManager::Receive(httpd_handle_t hd, int sockfd, char *buf, size_t length, int flags) {
+    if(buf == nullptr) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    int ret = recv(sockfd, buf, length, flags);
+    if(ret < 0) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    if(ret > 0) {
+        ConnectionManager* manager = static_cast<ConnectionManager*>(httpd_get_global_user_ctx(hd));
+        std::lock_guard<std::mutex> lock(manager->mutex);
+        ConnectionInfo* connection = manager->Find(sockfd);
+        if(connection != nullptr) {
+            if(!connection->receiving) {
+                // First data after a response: a new request
+                connection->receiving = true;
+                connection->requests++;
+            }
+            connection->bytesReceived += ret;
+            connection->lastActivityUs = esp_timer_get_time();
+        }
+    }
+    return ret;
+}
+
+void ConnectionManager::OnSend(httpd_handle_t hd, int sockfd, size_t length) {
+    ConnectionManager* manager = static_cast<ConnectionManager*>(httpd_get_global_user_ctx(hd));
+    {
+        // Other servers may use ObservedSend() as well
+        std::lock_guard<std::mutex> lock(attachedMutex);
+        bool found = false;
+        for(ConnectionManager* candidate : attached) {
+            found = found || candidate == manager;
+        }
+        if(!found) {
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> lock(manager->mutex);
+    ConnectionInfo* connection = manager->Find(sockfd);
+    if(connection != nullptr) {
+        connection->receiving = false;
+        connection->bytesSent += length;
+        connection->lastActivityUs = esp_timer_get_time();
+    }
+}
+
+void ConnectionManager::UpdateStreaming(ConnectionInfo& connection) {
+    // SSEHub and WebSocketHub store their subscription in the session context
+    connection.streaming = httpd_sess_get_ctx(server, connection.sockfd) != nullptr;
+}
+
+void ConnectionManager::Close(int sockfd) {
+    // Closed later by the httpd task, which calls OnClose()
+    if(httpd_sess_trigger_close(server, sockfd) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to close socket %d", sockfd);
+    }
+}
+
+void ConnectionManager::Purge(int newSockfd) {
+    int64_t now = esp_timer_get_time();
+    int64_t minIdleUs = (int64_t)purgeMinIdleMs * 1000;
+    int victim = -1;
+    int64_t victimActivityUs = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(ConnectionInfo& connection : connections) {
+            if(connection.sockfd < 0 || connection.sockfd == newSockfd || connection.closing
+                || connection.activeRequests > 0 || now - connection.lastActivityUs < minIdleUs) {
+                continue;
+            }
+            UpdateStreaming(connection);
+            if(connection.streaming) {
+                continue; // Subscribers are limited by their hub
+            }
+            if(victim < 0 || connection.lastActivityUs < victimActivityUs) {
+                victim = connection.sockfd;
+                victimActivityUs = connection.lastActivityUs;
+            }
+        }
+        if(victim < 0) {
+            return; // All connections are busy, ESP-IDF will queue new clients
+        }
+        Find(victim)->closing = true;
+        stats.purged++;
+    }
+    ESP_LOGD(TAG, "Closing socket %d (idle for %lld ms) to free a slot",
+             victim, (long long)(now - victimActivityUs) / 1000);
+    Close(victim);
+}
+
+void ConnectionManager::Reap() {
+    int64_t now = esp_timer_get_time();
+    int64_t timeoutUs = (int64_t)idleTimeoutMs * 1000;
+    std::vector<int> idle;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(ConnectionInfo& connection : connections) {
+            if(connection.sockfd < 0 || connection.closing || connection.activeRequests > 0
+                || now - connection.lastActivityUs < timeoutUs) {
+                continue;
+            }
+            UpdateStreaming(connection);
+            if(connection.streaming) {
+                continue; // Kept alive by their hub
+            }
+            connection.closing = true;
+            stats.idleClosed++;
+            idle.push_back(connection.sockfd);
+        }
+    }
+    for(int sockfd : idle) {
+        Close(sockfd);
+    }
+}
+
+void ConnectionManager::ReapTimer(void* arg) {
+    ConnectionManager* manager = static_cast<ConnectionManager*>(arg);
+    // Sessions may only be accessed on the httpd task
+    if(manager->server != nullptr) {
+        httpd_queue_work(manager->server, ReapWork, manager);
+    }
+}
+
+void ConnectionManager::ReapWork(void* arg) {
+    static_cast<ConnectionManager*>(arg)->Reap();
+}
+
+ConnectionStats ConnectionManager::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+size_t ConnectionManager::GetConnections(ConnectionInfo* out, size_t maxCount) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    for(const ConnectionInfo& connection : connections) {
+        if(connection.sockfd >= 0 && count < maxCount) {
+            out[count++] = connection;
+        }
+    }
+    return count;
+}
+
+esp_err_t ConnectionManager::SendJSON(httpd_req_t *request) {
+    std::vector<ConnectionInfo> open(maxConnections);
+    open.resize(GetConnections(open.data(), open.size()));
+    ConnectionStats totals = GetStats();
+    int64_t now = esp_timer_get_time();
+
+    JSONWriter json(request);
+    json.BeginObject();
+    json.Key("open").Number((unsigned long)totals.open);
+    json.Key("max").Number((unsigned long)maxConnections);
+    json.Key("accepted").Number((unsigned long)totals.accepted);
+    json.Key("closed").Number((unsigned long)totals.closed);
+    json.Key("idleClosed").Number((unsigned long)totals.idleClosed);
+    json.Key("purged").Number((unsigned long)totals.purged);
+    json.Key("connections").BeginArray();
+    for(const ConnectionInfo& connection : open) {
+        json.BeginObject();
+        json.Key("socket").Number(connection.sockfd);
+        json.Key("ageMs").Number((long long)(now - connection.openedUs) / 1000);
+        json.Key("idleMs").Number((long long)(now - connection.lastActivityUs) / 1000);
+        json.Key("requests").Number((unsigned long)connection.requests);
+        json.Key("bytesReceived").Number((unsigned long)connection.bytesReceived);
+        json.Key("bytesSent").Number((unsigned long)connection.bytesSent);
+        json.Key("streaming").Bool(connection.streaming);
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    return json.Finish();
+}
+
+ConnectionManager::RequestScope::RequestScope(ConnectionManager* manager, httpd_req_t *request)
+    : manager(manager), sockfd(-1) {
+    if(manager == nullptr) {
+        return;
+    }
+    sockfd = httpd_req_to_sockfd(request);
+    std::lock_guard<std::mutex> lock(manager->mutex);
+    ConnectionInfo* connection = manager->Find(sockfd);
+    if(connection != nullptr) {
+        connection->activeRequests++;
+    }
+}
+
+ConnectionManager::RequestScope::~RequestScope() {
+    if(manager == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(manager->mutex);
+    ConnectionInfo* connection = manager->Find(sockfd);
+    if(connection != nullptr && connection->activeRequests > 0) {
+        connection->activeRequests--;
+    }
+}
@@ -0,0 +1,151 @@
+#include "FormBodyParser.hpp"
+#include "URLDecode.hpp"
+#include <esp_log.h>
+#include <cstring>
+
+static const char* TAG = "Form body parser";
+
+FormBodyParser::FormBodyParser(httpd_req_t *request) : request(request) {
+}
+
+void FormBodyParser::Compact() {
+    memmove(buffer, buffer + pairStart, filled - pairStart);
+    valueStart -= inValue ? pairStart : 0;
+    decodedEnd -= pairStart;
+    rawStart -= pairStart;
+    filled -= pairStart;
+    pairStart = 0;
+}
+
+esp_err_t FormBodyParser::Parse(PairCallback callback, void* context) {
+    size_t remaining = request->content_len;
+    while(remaining > 0) {
+        // Make room by discarding completed pairs once
+        // the buffer is more than half full
+        if(pairStart > 0 && filled > HUMANESPHTTP_FORM_BUFFER_SIZE / 2) {
+            Compact();
+        }
+        if(filled == HUMANESPHTTP_FORM_BUFFER_SIZE) {
+            ESP_LOGE(TAG, "Form field longer than %u bytes", (unsigned)HUMANESPHTTP_FORM_BUFFER_SIZE);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        size_t toReceive = HUMANESPHTTP_FORM_BUFFER_SIZE - filled;
+        if(toReceive > remaining) {
+            toReceive = remaining;
+        }
+        int received = httpd_req_recv(request, buffer + filled, toReceive);
+        if(received == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue; // Retry
+        }
+        if(received <= 0) {
+            ESP_LOGE(TAG, "Failed to receive body");
+            return ESP_FAIL;
+        }
+        filled += received;
+        remaining -= received;
+        esp_err_t err = Process(remaining == 0, callback, context);
+        if(err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t FormBodyParser::Process(bool final, PairCallback callback, void* context) {
+    while(true) {
+        char* raw = buffer + rawStart;
+        char* end = buffer + filled;
+        char* delimiter = (char*)URLFindDelimiter(raw, end, !inValue);
+        if(delimiter == end && !final) {
+            // The key or value continues in the next chunk. Decode what we have,
+            // except for an escape sequence which might be incomplete ("%" or "%4")
+            size_t length = end - raw;
+            size_t keep = 0;
+            if(length >= 1 && end[-1] == '%') {
+                keep = 1;
+            } else if(length >= 2 && end[-2] == '%') {
+                keep = 2;
+            }
+            decodedEnd += URLDecode(raw, length - keep, buffer + decodedEnd);
+            memmove(buffer + decodedEnd, end - keep, keep);
+            rawStart = decodedEnd;
+            filled = decodedEnd + keep;
+            return ESP_OK;
+        }
+        // Decoded data is never longer than the raw data, so the
+        // decoded pair always stays in front of the remaining raw data
+        decodedEnd += URLDecode(raw, delimiter - raw, buffer + decodedEnd);
+        if(delimiter != end && *delimiter == '=') {
+            buffer[decodedEnd++] = '\0';
+            valueStart = decodedEnd;
+            inValue = true;
+            rawStart = delimiter + 1 - buffer;
+            continue;
+        }
+        // End of the pair ('&' or end of body)
+        buffer[decodedEnd] = '\0';
+        const char* key = buffer + pairStart;
+        size_t keyLength;
+        const char* value;
+        size_t valueLength;
+        if(inValue) {
+            keyLength = valueStart - 1 - pairStart;
+            value = buffer + valueStart;
+            valueLength = decodedEnd - valueStart;
+        } else { // Key without value
+            keyLength = decodedEnd - pairStart;
+            value = buffer + decodedEnd;
+            valueLength = 0;
+        }
+        // Skip empty segments, e.g. "a=1&&b=2"
+        if(inValue || keyLength > 0) {
+            esp_err_t err = callback(context, key, keyLength, value, valueLength);
+            if(err != ESP_OK) {
+                return err;
+            }
+        }
+        if(delimiter == end) {
+            return ESP_OK; // End of body
+        }
+        rawStart = delimiter + 1 - buffer;
+        pairStart = rawStart;
+        decodedEnd = rawStart;
+        inValue = false;
+    }
+}
+
+struct FormBodyFieldSet {
+    FormBodyField* fields;
+    size_t numFields;
+};
+
+static esp_err_t CopyFormBodyField(void* context, const char* key, size_t keyLength,
+                                   const char* value, size_t valueLength) {
+    FormBodyFieldSet* set = static_cast<FormBodyFieldSet*>(context);
+    for(size_t i = 0; i < set->numFields; i++) {
+        FormBodyField& field = set->fields[i];
+        if(field.found || strlen(field.key) != keyLength || memcmp(field.key, key, keyLength) != 0) {
+            continue;
+        }
+        field.found = true;
+        if(field.bufferSize == 0) {
+            field.truncated = true;
+            break;
+        }
+        size_t length = valueLength;
+        if(length >= field.bufferSize) {
+            length = field.bufferSize - 1;
+            field.truncated = true;
+        }
+        memcpy(field.buffer, value, length);
+        field.buffer[length] = '\0';
+        field.length = length;
+        break;
+    }
+    return ESP_OK;
+}
+
+esp_err_t FormBodyParser::Parse(FormBodyField* fields, size_t numFields) {
+    FormBodyFieldSet set = {fields, numFields};
+    return Parse(CopyFormBodyField, &set);
+}
@@ -1,5 +1,9 @@
 #include "HTTPServer.hpp"
+#include "JSONResponse.hpp"
 #include <esp_log.h>
+#include <cstring>
+
+static const char* RouterURI = "/*";
 
 HTTPServer::HTTPServer(): conf(HTTPD_DEFAULT_CONFIG()) {
 }
@@ -7,9 +11,300 @@ HTTPServer::HTTPServer(): conf(HTTPD_DEFAULT_CONFIG()) {
 void HTTPServer::StartServer() {
     if (httpd_start(&server, &conf) != ESP_OK) {
         ESP_LOGE("HTTP server", "Error starting server!");
+        return;
+    }
+    if (connections != nullptr) {
+        connections->Start(server);
+    }
+    // Routes registered before starting the server
+    for (int method = 0; method < 64; method++) {
+        if (routerMethods & (1ULL << method)) {
+            RegisterRouterHandler((httpd_method_t)method);
+        }
     }
 }
 
 void HTTPServer::RegisterHandler(const httpd_uri_t *uri_handler) {
+    if (WrapAllHandlers()) {
+        RegisterHandler(uri_handler, HandlerOptions());
+        return;
+    }
+    RegisterNativeHandler(uri_handler);
+}
+
+void HTTPServer::RegisterNativeHandler(const httpd_uri_t *uri_handler) {
+    int method = (int)uri_handler->method;
+    bool routed = method >= 0 && method < 64 && (routerMethods & (1ULL << method));
+    if (routed) {
+        // ESP-IDF matches handlers in registration order,
+        // so the catch-all handler has to stay last
+        httpd_unregister_uri_handler(this->server, RouterURI, uri_handler->method);
+    }
     httpd_register_uri_handler(this->server, uri_handler);
-}
\ No newline at end of file
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    if (!uri_handler->is_websocket) {
+        nativeHandlers.push_back(*uri_handler);
+    }
+#else
+    nativeHandlers.push_back(*uri_handler);
+#endif
+    if (routed) {
+        RegisterRouterHandler(uri_handler->method);
+    }
+}
+
+HTTPServer::HandlerRecord* HTTPServer::AddHandlerRecord(httpd_method_t method, const char* route,
+                                                        void* userCtx, const HandlerOptions& options) {
+    HandlerRecord* record = new HandlerRecord();
+    record->userCtx = userCtx;
+    record->options = options;
+    if (metrics != nullptr) {
+        record->metrics = metrics->AddRoute(method, route);
+    }
+    record->arenaSize = arenaSize;
+    if (options.workers != nullptr) {
+        record->connections = connections;
+    }
+    record->rateLimiter = rateLimiter;
+    handlerRecords.emplace_back(record);
+    return record;
+}
+
+void HTTPServer::RegisterHandler(const httpd_uri_t *uri_handler, const HandlerOptions& options) {
+    HandlerRecord* record = AddHandlerRecord(uri_handler->method, uri_handler->uri, uri_handler->user_ctx, options);
+    record->handler = uri_handler->handler;
+    // ESP-IDF copies the handler struct, so a temporary copy is fine
+    httpd_uri_t wrapped = *uri_handler;
+    wrapped.handler = WrappedHandler;
+    wrapped.user_ctx = record;
+    RegisterNativeHandler(&wrapped);
+}
+
+void HTTPServer::RegisterRoute(httpd_method_t method, const char* pattern, RouteHandler handler,
+                               void* user_ctx, const HandlerOptions& options) {
+    HandlerRecord* record = AddHandlerRecord(method, pattern, user_ctx, options);
+    record->routeHandler = handler;
+    AddRouterRoute(method, pattern, WrappedRoute, record);
+}
+
+esp_err_t HTTPServer::CallHandler(httpd_req_t *request, void* context) {
+    const HandlerCall* call = static_cast<const HandlerCall*>(context);
+    if (call->params != nullptr) {
+        return call->record->routeHandler(request, *call->params);
+    }
+    return call->record->handler(request);
+}
+
+esp_err_t HTTPServer::InvokeHandler(httpd_req_t *request, void* context, const RouteParams* params) {
+    HandlerRecord* record = static_cast<HandlerRecord*>(context);
+    // The wrapped handler sees its own user_ctx
+    request->user_ctx = record->userCtx;
+    HandlerCall call = {record, params};
+    ConnectionManager::RequestScope busy(record->connections, request);
+    RequestArenaScope arena(record->arenaSize);
+    if (record->metrics != nullptr) {
+        esp_err_t err = Metrics::Measure(request, record->metrics, CallCachedHandler, &call);
+        record->metrics->RecordArenaUse(arena.GetUsed());
+        return err;
+    }
+    return CallCachedHandler(request, &call);
+}
+
+esp_err_t HTTPServer::CallCachedHandler(httpd_req_t *request, void* context) {
+    const HandlerCall* call = static_cast<const HandlerCall*>(context);
+    const HandlerOptions& options = call->record->options;
+    if (options.cache != nullptr) {
+        return options.cache->Handle(request, options.cacheTTL, CallHandler, context);
+    }
+    return CallHandler(request, context);
+}
+
+esp_err_t HTTPServer::ScheduleHandler(HandlerRecord* record, httpd_req_t *request, const RouteParams* params) {
+    // Admission control, before any work is done for the request
+    if (record->rateLimiter != nullptr && !record->rateLimiter->Admit(request)) {
+        return ESP_OK;
+    }
+    if (record->options.rateLimit != nullptr && !record->options.rateLimit->Admit(request)) {
+        return ESP_OK;
+    }
+    // Sub-requests of a batch have to complete while the batch captures their response
+    if (record->options.workers != nullptr && !IsBatchSubRequest(request)) {
+        return record->options.workers->Submit(request, InvokeHandler, record, params);
+    }
+    return InvokeHandler(request, record, params);
+}
+
+esp_err_t HTTPServer::WrappedHandler(httpd_req_t *request) {
+    return ScheduleHandler(static_cast<HandlerRecord*>(request->user_ctx), request, nullptr);
+}
+
+esp_err_t HTTPServer::WrappedRoute(httpd_req_t *request, const RouteParams& params) {
+    return ScheduleHandler(static_cast<HandlerRecord*>(request->user_ctx), request, &params);
+}
+
+void HTTPServer::RegisterRoute(httpd_method_t method, const char* pattern, RouteHandler handler, void* user_ctx) {
+    if (WrapAllHandlers()) {
+        RegisterRoute(method, pattern, handler, user_ctx, HandlerOptions());
+        return;
+    }
+    AddRouterRoute(method, pattern, handler, user_ctx);
+}
+
+void HTTPServer::AddRouterRoute(httpd_method_t method, const char* pattern, RouteHandler handler, void* user_ctx) {
+    if ((int)method < 0 || (int)method >= 64) {
+        ESP_LOGE("HTTP server", "Unsupported method for route %s", pattern);
+        return;
+    }
+    if (router.AddRoute(method, pattern, handler, user_ctx) != ESP_OK) {
+        return; // Already logged
+    }
+    EnableRouter(method);
+}
+
+void HTTPServer::EnableRouter(httpd_method_t method) {
+    if (routerMethods & (1ULL << method)) {
+        return;
+    }
+    if (routerMethods == 0 && conf.uri_match_fn == nullptr) {
+        // Only set once the router is used, so servers without routes keep exact URI matching
+        if (server == nullptr) {
+            conf.uri_match_fn = httpd_uri_match_wildcard;
+        } else {
+            ESP_LOGE("HTTP server", "Set conf.uri_match_fn = httpd_uri_match_wildcard to use routes registered after StartServer()");
+        }
+    }
+    routerMethods |= 1ULL << method;
+    if (server != nullptr) {
+        RegisterRouterHandler(method);
+    }
+}
+
+void HTTPServer::ServeStaticAssets(const StaticAssetServer* assets) {
+    router.SetNotFoundHandler(StaticAssetServer::Dispatch, const_cast<StaticAssetServer*>(assets));
+    EnableRouter(HTTP_GET);
+}
+
+void HTTPServer::RegisterEventStream(const char* pattern, SSEHub* hub) {
+    RegisterRoute(HTTP_GET, pattern, [](httpd_req_t *request, const RouteParams&) {
+        // Would take over the connection of the batch
+        if (IsBatchSubRequest(request)) {
+            httpd_resp_set_status(request, "400 Bad Request");
+            return SendStatusError(request, "Event streams can't be batched");
+        }
+        return static_cast<SSEHub*>(request->user_ctx)->Handle(request);
+    }, hub);
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+void HTTPServer::RegisterWebSocket(const char* uri, WebSocketHub* hub) {
+    httpd_uri_t handler = {};
+    handler.uri = uri;
+    handler.method = HTTP_GET;
+    handler.handler = WebSocketHub::Dispatch;
+    handler.user_ctx = hub;
+    handler.is_websocket = true;
+    if (rateLimiter != nullptr) {
+        // Not wrapped like other handlers, which would answer frames with HTTP responses
+        HandlerRecord* record = new HandlerRecord();
+        record->handler = WebSocketHub::Dispatch;
+        record->userCtx = hub;
+        record->rateLimiter = rateLimiter;
+        handlerRecords.emplace_back(record);
+        handler.handler = LimitedWebSocket;
+        handler.user_ctx = record;
+    }
+    RegisterNativeHandler(&handler);
+}
+
+esp_err_t HTTPServer::LimitedWebSocket(httpd_req_t *request) {
+    HandlerRecord* record = static_cast<HandlerRecord*>(request->user_ctx);
+    request->user_ctx = record->userCtx;
+    // Only the handshake (GET) is limited, not the frames
+    if (request->method == HTTP_GET && !record->rateLimiter->AdmitConnection(request)) {
+        return ESP_FAIL; // Closes the connection
+    }
+    return record->handler(request);
+}
+#endif
+
+void HTTPServer::EnableMetrics(Metrics* metrics) {
+    this->metrics = metrics;
+}
+
+void HTTPServer::EnableRequestArena(size_t size) {
+    arenaSize = size;
+}
+
+void HTTPServer::EnableConnectionManager(ConnectionManager* manager) {
+    if (server != nullptr) {
+        ESP_LOGE("HTTP server", "Call EnableConnectionManager() before StartServer()");
+        return;
+    }
+    if (manager->Attach(conf) == ESP_OK) {
+        connections = manager;
+    }
+}
+
+void HTTPServer::EnableRateLimit(RateLimiter* limiter) {
+    rateLimiter = limiter;
+}
+
+void HTTPServer::ServeMetrics(const char* prometheusPath, const char* jsonPath) {
+    if (metrics == nullptr) {
+        ESP_LOGE("HTTP server", "Call EnableMetrics() before ServeMetrics()");
+        return;
+    }
+    if (prometheusPath != nullptr) {
+        RegisterRoute(HTTP_GET, prometheusPath, [](httpd_req_t *request, const RouteParams&) {
+            return static_cast<const Metrics*>(request->user_ctx)->SendPrometheus(request);
+        }, metrics);
+    }
+    if (jsonPath != nullptr) {
+        RegisterRoute(HTTP_GET, jsonPath, [](httpd_req_t *request, const RouteParams&) {
+            return static_cast<const Metrics*>(request->user_ctx)->SendJSON(request);
+        }, metrics);
+    }
+}
+
+void HTTPServer::ServeBatch(const char* path) {
+    RegisterRoute(HTTP_POST, path, [](httpd_req_t *request, const RouteParams&) {
+        return HandleBatchRequest(request, DispatchSubRequest, request->user_ctx);
+    }, this);
+}
+
+esp_err_t HTTPServer::DispatchSubRequest(httpd_req_t *request, void* context) {
+    HTTPServer* http = static_cast<HTTPServer*>(context);
+    size_t pathLength = strcspn(request->uri, "?#");
+    for (const httpd_uri_t& handler : http->nativeHandlers) {
+        if ((int)handler.method != request->method
+#ifdef HTTP_ANY
+            && (int)handler.method != HTTP_ANY
+#endif
+            ) {
+            continue;
+        }
+        bool match = http->conf.uri_match_fn != nullptr
+            ? http->conf.uri_match_fn(handler.uri, request->uri, pathLength)
+            : strlen(handler.uri) == pathLength && strncmp(handler.uri, request->uri, pathLength) == 0;
+        if (match) {
+            request->user_ctx = handler.user_ctx;
+            return handler.handler(request);
+        }
+    }
+    int method = request->method;
+    if (method >= 0 && method < 64 && (http->routerMethods & (1ULL << method))) {
+        return http->router.Handle(request);
+    }
+    return SendStatusNotFound(request);
+}
+
+void HTTPServer::RegisterRouterHandler(httpd_method_t method) {
+    httpd_uri_t uri = {};
+    uri.uri = RouterURI;
+    uri.method = method;
+    uri.handler = Router::Dispatch;
+    uri.user_ctx = &router;
+    if (httpd_register_uri_handler(this->server, &uri) != ESP_OK) {
+        ESP_LOGE("HTTP server", "Error registering router handler (increase conf.max_uri_handlers?)");
+    }
+}
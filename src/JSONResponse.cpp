@@ -1,18 +1,81 @@
-#pragma once
-#include <esp_http_server.h>
+#include "JSONResponse.hpp"
+#include "JSONWriter.hpp"
+#include "StaticResponse.hpp"
+
+#if _CPP17_AVAILABLE && HUMANESPHTTP_STATIC_RESPONSES
+
+#define STATIC_JSON_RESPONSE(name, status, body) \
+    static constexpr auto name = MakeStaticResponse(status, "application/json", HUMANESPHTTP_STATIC_RESPONSE_HEADERS, body)
+
+STATIC_JSON_RESPONSE(StatusOKResponse, "200 OK", "{\"status\":\"ok\"}");
+STATIC_JSON_RESPONSE(BadRequestResponse, "400 Bad Request", "{\"status\":\"error\",\"error\":\"Bad request\"}");
+STATIC_JSON_RESPONSE(NotFoundResponse, "404 Not Found", "{\"status\":\"error\",\"error\":\"Not found\"}");
+STATIC_JSON_RESPONSE(InternalServerErrorResponse, "500 Internal Server Error", "{\"status\":\"error\",\"error\":\"Internal server error\"}");
+STATIC_JSON_RESPONSE(ServiceUnavailableResponse, "503 Service Unavailable", "{\"status\":\"error\",\"error\":\"Service unavailable\"}");
 
 esp_err_t SendStatusOK(httpd_req_t *request) {
+    return StatusOKResponse.Send(request);
+}
+
+esp_err_t SendStatusBadRequest(httpd_req_t *request) {
+    return BadRequestResponse.Send(request);
+}
+
+esp_err_t SendStatusNotFound(httpd_req_t *request) {
+    return NotFoundResponse.Send(request);
+}
+
+esp_err_t SendStatusInternalServerError(httpd_req_t *request) {
+    return InternalServerErrorResponse.Send(request);
+}
+
+esp_err_t SendStatusServiceUnavailable(httpd_req_t *request) {
+    return ServiceUnavailableResponse.Send(request);
+}
+
+#else
+
+/**
+ * Send a constant JSON body through the regular ESP-IDF response functions
+ * @param status The status, or nullptr to keep the one set by the handler (200 OK by default)
+ */
+static esp_err_t SendConstantJSON(httpd_req_t *request, const char* status, const char* body, size_t length) {
+    if(status != nullptr) {
+        httpd_resp_set_status(request, status);
+    }
     httpd_resp_set_type(request, "application/json");
-    httpd_resp_sendstr(request, "{\"status\":\"ok\"}");
-    return ESP_OK;
+    return httpd_resp_send(request, body, length);
 }
 
+#define CONSTANT_JSON(request, status, body) SendConstantJSON(request, status, body, sizeof(body) - 1)
+
+esp_err_t SendStatusOK(httpd_req_t *request) {
+    return CONSTANT_JSON(request, nullptr, "{\"status\":\"ok\"}");
+}
+
+esp_err_t SendStatusBadRequest(httpd_req_t *request) {
+    return CONSTANT_JSON(request, "400 Bad Request", "{\"status\":\"error\",\"error\":\"Bad request\"}");
+}
+
+esp_err_t SendStatusNotFound(httpd_req_t *request) {
+    return CONSTANT_JSON(request, "404 Not Found", "{\"status\":\"error\",\"error\":\"Not found\"}");
+}
+
+esp_err_t SendStatusInternalServerError(httpd_req_t *request) {
+    return CONSTANT_JSON(request, "500 Internal Server Error", "{\"status\":\"error\",\"error\":\"Internal server error\"}");
+}
+
+esp_err_t SendStatusServiceUnavailable(httpd_req_t *request) {
+    return CONSTANT_JSON(request, "503 Service Unavailable", "{\"status\":\"error\",\"error\":\"Service unavailable\"}");
+}
+
+#endif
+
 esp_err_t SendStatusError(httpd_req_t *request, const char* description) {
-    httpd_resp_set_type(request, "application/json");
-    httpd_resp_send_chunk(request, "{\"status\":\"error\", \"error\": \"", HTTPD_RESP_USE_STRLEN);
-    // NOTE: We silently assume that description does not have any special characters
-    httpd_resp_send_chunk(request, description, HTTPD_RESP_USE_STRLEN);
-    httpd_resp_send_chunk(request, "\"}", HTTPD_RESP_USE_STRLEN);
-    httpd_resp_send_chunk(request, nullptr, 0); // Finished
-    return ESP_OK;
-}
\ No newline at end of file
+    JSONWriter json(request);
+    json.BeginObject();
+    json.Key("status").String("error");
+    json.Key("error").String(description);
+    json.EndObject();
+    return json.Finish();
+}
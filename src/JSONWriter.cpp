@@ -0,0 +1,276 @@
+#include "JSONWriter.hpp"
+#include "NumberFormat.hpp"
+#include <esp_log.h>
+#include <cstring>
+#include <cmath>
+
+static const char* TAG = "JSONWriter";
+
+JSONWriter::JSONWriter(httpd_req_t *request) : request(request) {
+    httpd_resp_set_type(request, "application/json");
+}
+
+JSONWriter::JSONWriter(OutputFunction output, void* context) : output(output), outputContext(context) {
+}
+
+void JSONWriter::SendChunk(const char* data, size_t dataLength) {
+    if(error != ESP_OK) {
+        return;
+    }
+    if(output != nullptr) {
+        error = output(outputContext, data, dataLength);
+    } else {
+        error = httpd_resp_send_chunk(request, data, dataLength);
+    }
+    chunked = true;
+}
+
+void JSONWriter::Flush() {
+    if(length != 0) {
+        SendChunk(buffer, length);
+    }
+    length = 0;
+}
+
+void JSONWriter::Write(const char* data, size_t dataLength) {
+    if(length + dataLength > sizeof(buffer)) {
+        // Fill the buffer completely before flushing so every chunk is full
+        size_t room = sizeof(buffer) - length;
+        memcpy(buffer + length, data, room);
+        length += room;
+        data += room;
+        dataLength -= room;
+        Flush();
+        // Send very large values directly instead of copying them piece by piece
+        if(dataLength >= sizeof(buffer)) {
+            SendChunk(data, dataLength);
+            return;
+        }
+    }
+    memcpy(buffer + length, data, dataLength);
+    length += dataLength;
+}
+
+void JSONWriter::Put(char c) {
+    if(length == sizeof(buffer)) {
+        Flush();
+    }
+    buffer[length++] = c;
+}
+
+void JSONWriter::BeginValue() {
+    if(afterKey) {
+        afterKey = false;
+        return;
+    }
+    if(nonEmpty & (1u << depth)) {
+        Put(',');
+    }
+}
+
+void JSONWriter::EndValue() {
+    nonEmpty |= (1u << depth);
+}
+
+void JSONWriter::Open(char bracket) {
+    if(depth + 1 >= HUMANESPHTTP_JSON_MAX_DEPTH) {
+        ESP_LOGE(TAG, "Maximum nesting depth exceeded");
+        error = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    BeginValue();
+    Put(bracket);
+    depth++;
+    nonEmpty &= ~(1u << depth);
+}
+
+void JSONWriter::Close(char bracket) {
+    if(depth == 0) {
+        ESP_LOGE(TAG, "Unbalanced '%c'", bracket);
+        error = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    Put(bracket);
+    depth--;
+    EndValue();
+}
+
+JSONWriter& JSONWriter::BeginObject() {
+    Open('{');
+    return *this;
+}
+
+JSONWriter& JSONWriter::EndObject() {
+    Close('}');
+    return *this;
+}
+
+JSONWriter& JSONWriter::BeginArray() {
+    Open('[');
+    return *this;
+}
+
+JSONWriter& JSONWriter::EndArray() {
+    Close(']');
+    return *this;
+}
+
+JSONWriter& JSONWriter::Key(const char* key) {
+    return Key(key, strlen(key));
+}
+
+JSONWriter& JSONWriter::Key(const char* key, size_t keyLength) {
+    BeginValue();
+    Put('"');
+    WriteEscaped(key, keyLength);
+    Write("\":", 2);
+    afterKey = true;
+    return *this;
+}
+
+JSONWriter& JSONWriter::String(const char* value) {
+    if(value == nullptr) {
+        return Null();
+    }
+    return String(value, strlen(value));
+}
+
+JSONWriter& JSONWriter::String(const char* value, size_t valueLength) {
+    BeginValue();
+    Put('"');
+    WriteEscaped(value, valueLength);
+    Put('"');
+    EndValue();
+    return *this;
+}
+
+JSONWriter& JSONWriter::BeginString() {
+    BeginValue();
+    Put('"');
+    return *this;
+}
+
+JSONWriter& JSONWriter::StringPart(const char* value, size_t valueLength) {
+    WriteEscaped(value, valueLength);
+    return *this;
+}
+
+JSONWriter& JSONWriter::EndString() {
+    Put('"');
+    EndValue();
+    return *this;
+}
+
+void JSONWriter::WriteEscaped(const char* str, size_t strLength) {
+    static const char hex[] = "0123456789abcdef";
+    const char* end = str + strLength;
+    while(str < end) {
+        // Copy runs of characters which don't need escaping in one go
+        const char* run = str;
+        while(run < end && (uint8_t)*run >= 0x20 && *run != '"' && *run != '\\') {
+            run++;
+        }
+        Write(str, run - str);
+        if(run == end) {
+            break;
+        }
+        char c = *run;
+        char escape[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t escapeLength = 2;
+        switch(c) {
+            case '"': escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            default: // Other control characters
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = hex[((uint8_t)c >> 4) & 0xF];
+                escape[5] = hex[(uint8_t)c & 0xF];
+                escapeLength = 6;
+                break;
+        }
+        Write(escape, escapeLength);
+        str = run + 1;
+    }
+}
+
+JSONWriter& JSONWriter::Number(long long value) {
+    BeginValue();
+    char digits[NumberFormatMaxLength];
+    Write(digits, FormatInteger(digits, value));
+    EndValue();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Number(unsigned long long value) {
+    BeginValue();
+    char digits[NumberFormatMaxLength];
+    Write(digits, FormatUnsigned(digits, value));
+    EndValue();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Number(double value, uint8_t decimals) {
+    if(!std::isfinite(value)) {
+        return Null();
+    }
+    BeginValue();
+    char digits[NumberFormatMaxLength];
+    Write(digits, FormatDouble(digits, value, decimals));
+    EndValue();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Bool(bool value) {
+    BeginValue();
+    if(value) {
+        Write("true", 4);
+    } else {
+        Write("false", 5);
+    }
+    EndValue();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Null() {
+    BeginValue();
+    Write("null", 4);
+    EndValue();
+    return *this;
+}
+
+JSONWriter& JSONWriter::Raw(const char* json, size_t jsonLength) {
+    BeginValue();
+    Write(json, jsonLength);
+    EndValue();
+    return *this;
+}
+
+esp_err_t JSONWriter::Finish() {
+    if(depth != 0) {
+        ESP_LOGW(TAG, "Finishing response with %u unclosed containers", (unsigned)depth);
+    }
+    if(error != ESP_OK) {
+        return error;
+    }
+    if(output != nullptr) {
+        Flush();
+        return error;
+    }
+    if(!chunked) {
+        // Everything fits into the buffer: single write with Content-Length
+        error = httpd_resp_send(request, buffer, length);
+        length = 0;
+        return error;
+    }
+    Flush();
+    if(error == ESP_OK) {
+        error = httpd_resp_send_chunk(request, nullptr, 0);
+    }
+    return error;
+}
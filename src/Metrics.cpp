@@ -0,0 +1,222 @@
+#include "Metrics.hpp"
+#include "SendObserver.hpp"
+#include "JSONWriter.hpp"
+#include "ResponseWriter.hpp"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cstring>
+
+static const char* TAG = "Metrics";
+
+constexpr size_t RouteMetrics::NumBuckets;
+constexpr uint32_t RouteMetrics::FirstBucketUs;
+
+RouteMetrics::RouteMetrics() : method(HTTP_GET), route("") {
+    for(std::atomic<uint32_t>& counter : statusClasses) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for(std::atomic<uint32_t>& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t RouteMetrics::BucketIndex(uint32_t latencyUs) {
+    if(latencyUs <= FirstBucketUs) {
+        return 0;
+    }
+    // ceil(log2(latencyUs / FirstBucketUs))
+    size_t index = 32 - __builtin_clz((latencyUs - 1) / FirstBucketUs);
+    return index < NumBuckets ? index : NumBuckets - 1;
+}
+
+void RouteMetrics::Record(uint32_t latencyUs, int status, uint32_t bytes, bool error) {
+    requests.fetch_add(1, std::memory_order_relaxed);
+    if(status >= 100 && status < 600) {
+        statusClasses[status / 100 - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+    if(error) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    bytesSent.fetch_add(bytes, std::memory_order_relaxed);
+    latencySumUs.fetch_add(latencyUs, std::memory_order_relaxed);
+    buckets[BucketIndex(latencyUs)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void RouteMetrics::RecordArenaUse(uint32_t bytes) {
+    uint32_t peak = arenaPeak.load(std::memory_order_relaxed);
+    while(bytes > peak && !arenaPeak.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+        // peak has been reloaded, retry
+    }
+}
+
+RouteMetrics* Metrics::AddRoute(httpd_method_t method, const char* route) {
+    size_t index = count.load(std::memory_order_relaxed);
+    if(index >= HUMANESPHTTP_METRICS_MAX_ROUTES) {
+        ESP_LOGE(TAG, "Too many routes, not measuring %s (increase HUMANESPHTTP_METRICS_MAX_ROUTES)", route);
+        return nullptr;
+    }
+    routes[index].method = method;
+    routes[index].route = route;
+    // Publish the initialized entry to concurrent readers
+    count.store(index + 1, std::memory_order_release);
+    return &routes[index];
+}
+
+/**
+ * Counts the bytes sent and extracts the status code from the status line
+ */
+class ResponseMeter : public SendObserver {
+public:
+    void OnSend(const char* data, size_t length) override {
+        // "HTTP/1.1 200 OK": the status code is at offset 9
+        for(size_t i = 0; i < length && bytes + i < 12; i++) {
+            size_t position = bytes + i;
+            if(position >= 9) {
+                char c = data[i];
+                status = (c >= '0' && c <= '9') ? status * 10 + (c - '0') : -1000;
+            }
+        }
+        bytes += length;
+    }
+
+    uint32_t bytes = 0;
+    int status = 0;
+};
+
+esp_err_t Metrics::Measure(httpd_req_t *request, RouteMetrics* route, Handler handler, void* context) {
+    ResponseMeter meter;
+    int64_t start = esp_timer_get_time();
+    esp_err_t err;
+    {
+        ScopedSendObserver observer(request, &meter);
+        err = handler(request, context);
+    }
+    uint32_t latencyUs = (uint32_t)(esp_timer_get_time() - start);
+    route->Record(latencyUs, meter.status > 0 ? meter.status : 0, meter.bytes, err != ESP_OK);
+    return err;
+}
+
+/**
+ * Print a label value, escaped as required by the Prometheus text format
+ */
+static void PrintLabel(ResponseWriter& out, const char* value) {
+    for(const char* c = value; *c != '\0'; c++) {
+        if(*c == '"' || *c == '\\') {
+            out.Printf("\\%c", *c);
+        } else if(*c == '\n') {
+            out.Write("\\n", 2);
+        } else {
+            out.Write(c, 1);
+        }
+    }
+}
+
+static void PrintLabels(ResponseWriter& out, const RouteMetrics& route) {
+    out.Printf("method=\"%s\",route=\"", http_method_str((enum http_method)route.method));
+    PrintLabel(out, route.route);
+    out.Printf("\"");
+}
+
+esp_err_t Metrics::SendPrometheus(httpd_req_t *request) const {
+    ResponseWriter out(request);
+    out.SetType("text/plain; version=0.0.4");
+    size_t numRoutes = GetRouteCount();
+
+    out.Printf("# HELP http_requests_total Requests by status class\n"
+               "# TYPE http_requests_total counter\n");
+    for(size_t i = 0; i < numRoutes; i++) {
+        const RouteMetrics& route = routes[i];
+        for(size_t statusClass = 0; statusClass < 5; statusClass++) {
+            out.Printf("http_requests_total{");
+            PrintLabels(out, route);
+            out.Printf(",status=\"%uxx\"} %u\n", (unsigned)statusClass + 1,
+                       (unsigned)route.statusClasses[statusClass].load(std::memory_order_relaxed));
+        }
+    }
+
+    out.Printf("# HELP http_handler_errors_total Handler calls which returned an error\n"
+               "# TYPE http_handler_errors_total counter\n");
+    for(size_t i = 0; i < numRoutes; i++) {
+        out.Printf("http_handler_errors_total{");
+        PrintLabels(out, routes[i]);
+        out.Printf("} %u\n", (unsigned)routes[i].errors.load(std::memory_order_relaxed));
+    }
+
+    out.Printf("# HELP http_response_bytes_total Bytes sent including headers\n"
+               "# TYPE http_response_bytes_total counter\n");
+    for(size_t i = 0; i < numRoutes; i++) {
+        out.Printf("http_response_bytes_total{");
+        PrintLabels(out, routes[i]);
+        out.Printf("} %u\n", (unsigned)routes[i].bytesSent.load(std::memory_order_relaxed));
+    }
+
+    out.Printf("# HELP http_request_arena_peak_bytes Largest request arena use of a single request\n"
+               "# TYPE http_request_arena_peak_bytes gauge\n");
+    for(size_t i = 0; i < numRoutes; i++) {
+        out.Printf("http_request_arena_peak_bytes{");
+        PrintLabels(out, routes[i]);
+        out.Printf("} %u\n", (unsigned)routes[i].arenaPeak.load(std::memory_order_relaxed));
+    }
+
+    out.Printf("# HELP http_request_duration_seconds Handler latency\n"
+               "# TYPE http_request_duration_seconds histogram\n");
+    for(size_t i = 0; i < numRoutes; i++) {
+        const RouteMetrics& route = routes[i];
+        uint32_t cumulative = 0;
+        for(size_t bucket = 0; bucket < RouteMetrics::NumBuckets; bucket++) {
+            cumulative += route.buckets[bucket].load(std::memory_order_relaxed);
+            out.Printf("http_request_duration_seconds_bucket{");
+            PrintLabels(out, route);
+            if(bucket + 1 < RouteMetrics::NumBuckets) {
+                out.Printf(",le=\"%.6f\"} %u\n", RouteMetrics::BucketUpperBoundUs(bucket) / 1e6, (unsigned)cumulative);
+            } else {
+                out.Printf(",le=\"+Inf\"} %u\n", (unsigned)cumulative);
+            }
+        }
+        out.Printf("http_request_duration_seconds_sum{");
+        PrintLabels(out, route);
+        out.Printf("} %.6f\n", route.latencySumUs.load(std::memory_order_relaxed) / 1e6);
+        out.Printf("http_request_duration_seconds_count{");
+        PrintLabels(out, route);
+        // Consistent with the buckets, which may have been updated in the meantime
+        out.Printf("} %u\n", (unsigned)cumulative);
+    }
+    return out.Finish();
+}
+
+esp_err_t Metrics::SendJSON(httpd_req_t *request) const {
+    JSONWriter json(request);
+    json.BeginObject();
+    json.Key("bucketsUs").BeginArray();
+    for(size_t bucket = 0; bucket + 1 < RouteMetrics::NumBuckets; bucket++) {
+        json.Number((unsigned long)RouteMetrics::BucketUpperBoundUs(bucket));
+    }
+    json.EndArray();
+    json.Key("routes").BeginArray();
+    size_t numRoutes = GetRouteCount();
+    for(size_t i = 0; i < numRoutes; i++) {
+        const RouteMetrics& route = routes[i];
+        json.BeginObject();
+        json.Key("method").String(http_method_str((enum http_method)route.method));
+        json.Key("route").String(route.route);
+        json.Key("requests").Number((unsigned long)route.requests.load(std::memory_order_relaxed));
+        json.Key("status").BeginArray();
+        for(const std::atomic<uint32_t>& counter : route.statusClasses) {
+            json.Number((unsigned long)counter.load(std::memory_order_relaxed));
+        }
+        json.EndArray();
+        json.Key("errors").Number((unsigned long)route.errors.load(std::memory_order_relaxed));
+        json.Key("bytes").Number((unsigned long)route.bytesSent.load(std::memory_order_relaxed));
+        json.Key("latencySumUs").Number((unsigned long)route.latencySumUs.load(std::memory_order_relaxed));
+        json.Key("arenaPeak").Number((unsigned long)route.arenaPeak.load(std::memory_order_relaxed));
+        json.Key("histogram").BeginArray();
+        for(const std::atomic<uint32_t>& bucket : route.buckets) {
+            json.Number((unsigned long)bucket.load(std::memory_order_relaxed));
+        }
+        json.EndArray();
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    return json.Finish();
+}
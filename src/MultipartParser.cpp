@@ -0,0 +1,376 @@
+#include "MultipartParser.hpp"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+static const char* TAG = "Multipart parser";
+
+MultipartParser::MultipartParser(httpd_req_t *request) : request(request) {
+    part.name[0] = '\0';
+    part.filename[0] = '\0';
+    part.contentType[0] = '\0';
+}
+
+esp_err_t MultipartParser::AddSink(const char* name, UploadSink* sink) {
+    if(numSinks >= HUMANESPHTTP_MULTIPART_MAX_SINKS) {
+        ESP_LOGE(TAG, "Too many sinks (increase HUMANESPHTTP_MULTIPART_MAX_SINKS)");
+        return ESP_ERR_NO_MEM;
+    }
+    sinks[numSinks].name = name;
+    sinks[numSinks].sink = sink;
+    numSinks++;
+    return ESP_OK;
+}
+
+UploadSink* MultipartParser::FindSink(const char* name) const {
+    UploadSink* fallback = nullptr;
+    for(size_t i = 0; i < numSinks; i++) {
+        if(sinks[i].name == nullptr) {
+            if(fallback == nullptr) {
+                fallback = sinks[i].sink;
+            }
+        } else if(strcmp(sinks[i].name, name) == 0) {
+            return sinks[i].sink;
+        }
+    }
+    return fallback;
+}
+
+esp_err_t MultipartParser::ParseBoundary() {
+    char contentType[160];
+    size_t length = httpd_req_get_hdr_value_len(request, "Content-Type");
+    if(length == 0 || length >= sizeof(contentType)
+        || httpd_req_get_hdr_value_str(request, "Content-Type", contentType, sizeof(contentType)) != ESP_OK) {
+        ESP_LOGE(TAG, "Missing or invalid Content-Type header");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(strncasecmp(contentType, "multipart/form-data", 19) != 0) {
+        ESP_LOGE(TAG, "Not a multipart/form-data request: %s", contentType);
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char* boundary = strstr(contentType, "boundary=");
+    if(boundary == nullptr) {
+        ESP_LOGE(TAG, "No boundary in Content-Type header");
+        return ESP_ERR_INVALID_ARG;
+    }
+    boundary += 9;
+    size_t boundaryLength;
+    if(*boundary == '"') {
+        boundary++;
+        const char* quote = strchr(boundary, '"');
+        boundaryLength = quote == nullptr ? 0 : quote - boundary;
+    } else {
+        boundaryLength = strcspn(boundary, "; \t");
+    }
+    if(boundaryLength == 0 || boundaryLength > 70) {
+        ESP_LOGE(TAG, "Invalid boundary length %u", (unsigned)boundaryLength);
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(delimiter, "\r\n--", 4);
+    memcpy(delimiter + 4, boundary, boundaryLength);
+    delimiterLength = 4 + boundaryLength;
+    delimiter[delimiterLength] = '\0';
+
+    // Horspool shift table: distance from the last occurrence
+    // of each character to the end of the delimiter
+    memset(skip, (int)delimiterLength, sizeof(skip));
+    for(size_t i = 0; i < delimiterLength - 1; i++) {
+        skip[(uint8_t)delimiter[i]] = (uint8_t)(delimiterLength - 1 - i);
+    }
+    return ESP_OK;
+}
+
+const char* MultipartParser::FindDelimiter(const char* begin, const char* end) const {
+    const size_t n = delimiterLength;
+    if((size_t)(end - begin) < n) {
+        return nullptr;
+    }
+    const char last = delimiter[n - 1];
+    // p points to the last character of the current window
+    for(const char* p = begin + n - 1; p < end; p += skip[(uint8_t)*p]) {
+        if(*p == last && memcmp(p - (n - 1), delimiter, n - 1) == 0) {
+            return p - (n - 1);
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Copy the value of the given parameter (e.g. name="file") of a header line
+ * like 'form-data; name="file"; filename="a.bin"' to out.
+ */
+static void ExtractHeaderParameter(const char* line, const char* end, const char* key, char* out, size_t outSize) {
+    size_t keyLength = strlen(key);
+    const char* p = line;
+    while(p < end) {
+        // Skip to the start of the next parameter
+        while(p < end && *p != ';') {
+            p++;
+        }
+        while(p < end && (*p == ';' || *p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if((size_t)(end - p) > keyLength && strncasecmp(p, key, keyLength) == 0 && p[keyLength] == '=') {
+            p += keyLength + 1;
+            const char* valueEnd;
+            if(p < end && *p == '"') {
+                p++;
+                valueEnd = (const char*)memchr(p, '"', end - p);
+                if(valueEnd == nullptr) {
+                    valueEnd = end;
+                }
+            } else {
+                valueEnd = p;
+                while(valueEnd < end && *valueEnd != ';') {
+                    valueEnd++;
+                }
+            }
+            size_t length = valueEnd - p;
+            if(length >= outSize) {
+                length = outSize - 1;
+            }
+            memcpy(out, p, length);
+            out[length] = '\0';
+            return;
+        }
+        // Skip a quoted value which might contain ';'
+        if(p < end) {
+            const char* equals = p;
+            while(equals < end && *equals != '=' && *equals != ';') {
+                equals++;
+            }
+            if(equals + 1 < end && *equals == '=' && equals[1] == '"') {
+                const char* quote = (const char*)memchr(equals + 2, '"', end - equals - 2);
+                p = quote == nullptr ? end : quote + 1;
+            } else {
+                p = equals;
+            }
+        }
+    }
+}
+
+esp_err_t MultipartParser::ParseHeaders(const char* headers, const char* end) {
+    part.name[0] = '\0';
+    part.filename[0] = '\0';
+    part.contentType[0] = '\0';
+    const char* line = headers;
+    while(line < end) {
+        const char* lineEnd = (const char*)memchr(line, '\r', end - line);
+        if(lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        const char* colon = (const char*)memchr(line, ':', lineEnd - line);
+        if(colon != nullptr) {
+            const char* value = colon + 1;
+            while(value < lineEnd && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            size_t nameLength = colon - line;
+            if(nameLength == 19 && strncasecmp(line, "Content-Disposition", 19) == 0) {
+                ExtractHeaderParameter(value, lineEnd, "name", part.name, sizeof(part.name));
+                ExtractHeaderParameter(value, lineEnd, "filename", part.filename, sizeof(part.filename));
+            } else if(nameLength == 12 && strncasecmp(line, "Content-Type", 12) == 0) {
+                size_t length = lineEnd - value;
+                if(length >= sizeof(part.contentType)) {
+                    length = sizeof(part.contentType) - 1;
+                }
+                memcpy(part.contentType, value, length);
+                part.contentType[length] = '\0';
+            }
+        }
+        line = lineEnd + 2; // Skip "\r\n"
+    }
+    stats.numParts++;
+    currentSink = FindSink(part.name);
+    if(currentSink != nullptr) {
+        esp_err_t err = currentSink->Begin(part);
+        if(err != ESP_OK) {
+            currentSink = nullptr; // Nothing to abort
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t MultipartParser::Emit(const char* data, size_t length) {
+    if(currentSink == nullptr || length == 0) {
+        return ESP_OK;
+    }
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = currentSink->Write(data, length);
+    stats.sinkTime += esp_timer_get_time() - start;
+    return err;
+}
+
+esp_err_t MultipartParser::Process(bool& needMoreData) {
+    needMoreData = false;
+    while(true) {
+        const char* begin = buffer + pos;
+        const char* end = buffer + filled;
+        switch(state) {
+        case State::Preamble:
+        case State::Body: {
+            const char* found = FindDelimiter(begin, end);
+            if(found == nullptr) {
+                // Everything except a possible partial delimiter at the end
+                // can be passed on right away
+                size_t available = end - begin;
+                size_t keep = delimiterLength - 1;
+                if(available > keep) {
+                    if(state == State::Body) {
+                        esp_err_t err = Emit(begin, available - keep);
+                        if(err != ESP_OK) {
+                            return err;
+                        }
+                    }
+                    pos += available - keep;
+                }
+                needMoreData = true;
+                return ESP_OK;
+            }
+            if(state == State::Body) {
+                esp_err_t err = Emit(begin, found - begin);
+                if(err == ESP_OK && currentSink != nullptr) {
+                    int64_t start = esp_timer_get_time();
+                    err = currentSink->End();
+                    stats.sinkTime += esp_timer_get_time() - start;
+                }
+                if(err != ESP_OK) {
+                    return err;
+                }
+                currentSink = nullptr;
+            }
+            pos = (found - buffer) + delimiterLength;
+            state = State::AfterBoundary;
+            break;
+        }
+        case State::AfterBoundary: {
+            // Transport padding (whitespace) may follow the boundary
+            while(begin < end && (*begin == ' ' || *begin == '\t')) {
+                begin++;
+                pos++;
+            }
+            if(end - begin < 2) {
+                needMoreData = true;
+                return ESP_OK;
+            }
+            if(begin[0] == '-' && begin[1] == '-') {
+                state = State::Done;
+                return ESP_OK; // The epilogue is discarded by the server
+            }
+            if(begin[0] != '\r' || begin[1] != '\n') {
+                ESP_LOGE(TAG, "Malformed boundary");
+                return ESP_FAIL;
+            }
+            pos += 2;
+            state = State::Headers;
+            break;
+        }
+        case State::Headers: {
+            const char* headersEnd;
+            if(end - begin >= 2 && begin[0] == '\r' && begin[1] == '\n') {
+                headersEnd = begin; // No headers
+            } else {
+                headersEnd = nullptr;
+                for(const char* p = begin; (p = (const char*)memchr(p, '\r', end - p)) != nullptr; p++) {
+                    if(end - p < 4) {
+                        break;
+                    }
+                    if(p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+                        headersEnd = p + 2; // Keep the CRLF terminating the last header
+                        break;
+                    }
+                }
+                if(headersEnd == nullptr) {
+                    needMoreData = true;
+                    return ESP_OK;
+                }
+            }
+            esp_err_t err = ParseHeaders(begin, headersEnd);
+            if(err != ESP_OK) {
+                return err;
+            }
+            pos = (headersEnd - buffer) + 2;
+            state = State::Body;
+            break;
+        }
+        case State::Done:
+            return ESP_OK;
+        }
+    }
+}
+
+esp_err_t MultipartParser::Parse() {
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = ParseBoundary();
+    if(err != ESP_OK) {
+        return err;
+    }
+    buffer = (char*)malloc(HUMANESPHTTP_MULTIPART_BUFFER_SIZE);
+    if(buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes receive buffer", (unsigned)HUMANESPHTTP_MULTIPART_BUFFER_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+    // The first boundary is not preceded by a CRLF.
+    // Insert one so it matches the delimiter like all other boundaries.
+    buffer[0] = '\r';
+    buffer[1] = '\n';
+    filled = 2;
+    pos = 0;
+    state = State::Preamble;
+    size_t remaining = request->content_len;
+    while(true) {
+        bool needMoreData;
+        err = Process(needMoreData);
+        if(err != ESP_OK || !needMoreData) {
+            break;
+        }
+        if(remaining == 0) {
+            ESP_LOGE(TAG, "Body ended before the final boundary");
+            err = ESP_FAIL;
+            break;
+        }
+        // Move the unprocessed rest (e.g. a partial delimiter) to the front
+        memmove(buffer, buffer + pos, filled - pos);
+        filled -= pos;
+        pos = 0;
+        if(filled == HUMANESPHTTP_MULTIPART_BUFFER_SIZE) {
+            ESP_LOGE(TAG, "Part headers larger than %u bytes", (unsigned)HUMANESPHTTP_MULTIPART_BUFFER_SIZE);
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        size_t toReceive = HUMANESPHTTP_MULTIPART_BUFFER_SIZE - filled;
+        if(toReceive > remaining) {
+            toReceive = remaining;
+        }
+        int64_t receiveStart = esp_timer_get_time();
+        int received = httpd_req_recv(request, buffer + filled, toReceive);
+        stats.receiveTime += esp_timer_get_time() - receiveStart;
+        if(received == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue; // Retry
+        }
+        if(received <= 0) {
+            ESP_LOGE(TAG, "Failed to receive body");
+            err = ESP_FAIL;
+            break;
+        }
+        stats.receiveCalls++;
+        stats.bytesReceived += received;
+        filled += received;
+        remaining -= received;
+    }
+    if(err != ESP_OK && currentSink != nullptr) {
+        currentSink->Abort();
+        currentSink = nullptr;
+    }
+    free(buffer);
+    buffer = nullptr;
+    stats.totalTime = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Received %u bytes in %u parts, %u ms (%u kB/s, %u recv calls, %u ms in recv, %u ms in sinks)",
+        (unsigned)stats.bytesReceived, (unsigned)stats.numParts, (unsigned)(stats.totalTime / 1000),
+        (unsigned)stats.ThroughputKBps(), (unsigned)stats.receiveCalls,
+        (unsigned)(stats.receiveTime / 1000), (unsigned)(stats.sinkTime / 1000));
+    return err;
+}
@@ -0,0 +1,78 @@
+#include "NumberFormat.hpp"
+#include <cmath>
+#include <cstring>
+
+size_t FormatUnsigned(char* out, unsigned long long value) {
+    char digits[20];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = (char)('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+    memcpy(out, digits + pos, sizeof(digits) - pos);
+    return sizeof(digits) - pos;
+}
+
+size_t FormatInteger(char* out, long long value) {
+    if(value < 0) {
+        out[0] = '-';
+        // Negate as unsigned to handle LLONG_MIN correctly
+        return 1 + FormatUnsigned(out + 1, 0ULL - (unsigned long long)value);
+    }
+    return FormatUnsigned(out, (unsigned long long)value);
+}
+
+size_t FormatDouble(char* out, double value, uint8_t decimals) {
+    if(decimals > 15) {
+        decimals = 15;
+    }
+    bool negative = value < 0.0;
+    if(negative) {
+        value = -value;
+    }
+    int exponent = 0;
+    if(value >= 1e15) {
+        // Too large to split into integer and fractional part exactly,
+        // use scientific notation
+        exponent = (int)std::floor(std::log10(value));
+        value /= std::pow(10.0, exponent);
+        if(value >= 10.0) { // log10() rounding
+            value /= 10.0;
+            exponent++;
+        }
+    }
+    unsigned long long scale = 1;
+    for(uint8_t i = 0; i < decimals; i++) {
+        scale *= 10;
+    }
+    unsigned long long integerPart = (unsigned long long)value;
+    unsigned long long fraction = (unsigned long long)std::llround((value - (double)integerPart) * (double)scale);
+    if(fraction >= scale) { // Rounded up to the next integer
+        integerPart++;
+        fraction -= scale;
+    }
+    size_t length = 0;
+    if(negative && (integerPart != 0 || fraction != 0)) { // Avoid "-0"
+        out[length++] = '-';
+    }
+    length += FormatUnsigned(out + length, integerPart);
+    if(fraction != 0) {
+        size_t numDigits = decimals;
+        // Strip trailing zeros
+        while(fraction % 10 == 0) {
+            fraction /= 10;
+            numDigits--;
+        }
+        out[length] = '.';
+        for(size_t i = numDigits; i > 0; i--) {
+            out[length + i] = (char)('0' + fraction % 10);
+            fraction /= 10;
+        }
+        length += numDigits + 1;
+    }
+    if(exponent != 0) {
+        out[length++] = 'e';
+        length += FormatUnsigned(out + length, (unsigned long long)exponent);
+    }
+    return length;
+}
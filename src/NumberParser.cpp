@@ -0,0 +1,302 @@
+#include "NumberParser.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+const char* ValueParseErrorToString(ValueParseError error) {
+    switch(error) {
+        case ValueParseError::None: return "ok";
+        case ValueParseError::NotFound: return "not found";
+        case ValueParseError::Empty: return "empty";
+        case ValueParseError::Invalid: return "invalid";
+        case ValueParseError::OutOfRange: return "out of range";
+        case ValueParseError::UnknownName: return "unknown name";
+        case ValueParseError::TooMany: return "too many values";
+    }
+    return "unknown";
+}
+
+template<typename T>
+ValueParseError ParseInteger(const char* str, size_t length, T& out, unsigned base) {
+    typedef typename std::make_unsigned<T>::type Unsigned;
+    // 32 bit arithmetic for everything up to 32 bit types, which is much faster on the ESP32
+    typedef typename std::conditional<(sizeof(T) > 4), uint64_t, uint32_t>::type Accumulator;
+
+    if(length == 0) {
+        return ValueParseError::Empty;
+    }
+    const char* p = str;
+    const char* end = str + length;
+    bool negative = false;
+    if(*p == '+' || *p == '-') {
+        negative = *p == '-';
+        if(negative && !std::is_signed<T>::value) {
+            return ValueParseError::Invalid;
+        }
+        p++;
+    }
+    if(base == 16 || base == 0) {
+        if(end - p >= 2 && p[0] == '0' && (p[1] | 0x20) == 'x') {
+            p += 2;
+            base = 16;
+        } else if(base == 0) {
+            base = 10;
+        }
+    }
+    if(p == end) {
+        return ValueParseError::Invalid;
+    }
+    // Largest magnitude allowed, e.g. 128 for a negative int8_t
+    Accumulator limit = (Accumulator)(Unsigned)std::numeric_limits<T>::max() + (negative ? 1 : 0);
+    Accumulator cutoff = limit / base;
+    unsigned cutlim = (unsigned)(limit % base);
+    Accumulator value = 0;
+    bool overflow = false;
+    for(; p < end; p++) {
+        unsigned digit = (unsigned)(unsigned char)*p - '0';
+        if(digit > 9) {
+            digit = ((unsigned)(unsigned char)*p | 0x20) - 'a';
+            if(base != 16 || digit > 5) {
+                return ValueParseError::Invalid;
+            }
+            digit += 10;
+        }
+        // Keep validating the remaining digits, garbage takes precedence over overflow
+        if(value > cutoff || (value == cutoff && digit > cutlim)) {
+            overflow = true;
+        }
+        value = value * base + digit;
+    }
+    if(overflow) {
+        return ValueParseError::OutOfRange;
+    }
+    out = negative ? (T)(Unsigned)(Accumulator(0) - value) : (T)value;
+    return ValueParseError::None;
+}
+
+template ValueParseError ParseInteger<signed char>(const char*, size_t, signed char&, unsigned);
+template ValueParseError ParseInteger<unsigned char>(const char*, size_t, unsigned char&, unsigned);
+template ValueParseError ParseInteger<short>(const char*, size_t, short&, unsigned);
+template ValueParseError ParseInteger<unsigned short>(const char*, size_t, unsigned short&, unsigned);
+template ValueParseError ParseInteger<int>(const char*, size_t, int&, unsigned);
+template ValueParseError ParseInteger<unsigned int>(const char*, size_t, unsigned int&, unsigned);
+template ValueParseError ParseInteger<long>(const char*, size_t, long&, unsigned);
+template ValueParseError ParseInteger<unsigned long>(const char*, size_t, unsigned long&, unsigned);
+template ValueParseError ParseInteger<long long>(const char*, size_t, long long&, unsigned);
+template ValueParseError ParseInteger<unsigned long long>(const char*, size_t, unsigned long long&, unsigned);
+
+namespace {
+
+/**
+ * A decimal number split up into sign, (up to 19) significant digits and exponent,
+ * such that value = mantissa * 10^exponent
+ */
+struct Decimal {
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool negative = false;
+    bool truncated = false; // Non-zero digits beyond the first 19 were dropped
+};
+
+/**
+ * Validate [+-]digits[.digits][(e|E)[+-]digits], at least one mantissa digit
+ */
+ValueParseError ScanDecimal(const char* str, size_t length, Decimal& decimal) {
+    if(length == 0) {
+        return ValueParseError::Empty;
+    }
+    const char* p = str;
+    const char* end = str + length;
+    if(*p == '+' || *p == '-') {
+        decimal.negative = *p == '-';
+        p++;
+    }
+    int significant = 0;
+    bool anyDigits = false;
+    for(; p < end && (unsigned)(*p - '0') <= 9; p++) {
+        anyDigits = true;
+        if(significant < 19) {
+            decimal.mantissa = decimal.mantissa * 10 + (*p - '0');
+            significant += decimal.mantissa != 0;
+        } else {
+            decimal.exponent++;
+            decimal.truncated |= *p != '0';
+        }
+    }
+    if(p < end && *p == '.') {
+        for(p++; p < end && (unsigned)(*p - '0') <= 9; p++) {
+            anyDigits = true;
+            if(significant < 19) {
+                decimal.mantissa = decimal.mantissa * 10 + (*p - '0');
+                significant += decimal.mantissa != 0;
+                decimal.exponent--;
+            } else {
+                decimal.truncated |= *p != '0';
+            }
+        }
+    }
+    if(!anyDigits) {
+        return ValueParseError::Invalid;
+    }
+    if(p < end && (*p | 0x20) == 'e') {
+        p++;
+        bool negativeExponent = false;
+        if(p < end && (*p == '+' || *p == '-')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        if(p == end) {
+            return ValueParseError::Invalid;
+        }
+        int exponent = 0;
+        for(; p < end && (unsigned)(*p - '0') <= 9; p++) {
+            if(exponent < 100000) { // Saturate, anything this large is 0 or infinite anyway
+                exponent = exponent * 10 + (*p - '0');
+            }
+        }
+        decimal.exponent += negativeExponent ? -exponent : exponent;
+    }
+    return p == end ? ValueParseError::None : ValueParseError::Invalid;
+}
+
+// All powers of ten which are exactly representable
+const double ExactPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const float ExactPowersOfTenFloat[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+/**
+ * strtod()/strtof() on an already validated number, which is not NUL-terminated
+ */
+template<typename T, T (*Convert)(const char*, char**)>
+T ConvertSlow(const char* str, size_t length) {
+    char stackBuffer[64];
+    std::unique_ptr<char[]> heapBuffer;
+    char* buf = stackBuffer;
+    if(length >= sizeof(stackBuffer)) {
+        heapBuffer.reset(new char[length + 1]);
+        buf = heapBuffer.get();
+    }
+    memcpy(buf, str, length);
+    buf[length] = '\0';
+    return Convert(buf, nullptr);
+}
+
+template<typename T>
+ValueParseError CheckRange(T result, const Decimal& decimal, T& out) {
+    if(std::isinf(result) || (result == 0 && decimal.mantissa != 0)) {
+        return ValueParseError::OutOfRange;
+    }
+    out = result;
+    return ValueParseError::None;
+}
+
+}
+
+/*
+ * Clinger's fast path: if the mantissa and the power of ten are both exactly
+ * representable, a single IEEE multiplication or division is correctly rounded.
+ * This covers practically all values seen in query strings ("12.5", "0.001", "1500").
+ * Everything else goes to the (C locale) strtod()/strtof() of the C library.
+ */
+
+ValueParseError ParseDouble(const char* str, size_t length, double& out) {
+    Decimal decimal;
+    ValueParseError error = ScanDecimal(str, length, decimal);
+    if(error != ValueParseError::None) {
+        return error;
+    }
+    double result;
+    if(!decimal.truncated && decimal.mantissa <= (UINT64_C(1) << 53)
+        && decimal.exponent >= -22 && decimal.exponent <= 22) {
+        result = (double)decimal.mantissa;
+        if(decimal.exponent < 0) {
+            result /= ExactPowersOfTen[-decimal.exponent];
+        } else {
+            result *= ExactPowersOfTen[decimal.exponent];
+        }
+        if(decimal.negative) {
+            result = -result;
+        }
+    } else {
+        result = ConvertSlow<double, strtod>(str, length);
+    }
+    return CheckRange(result, decimal, out);
+}
+
+ValueParseError ParseFloat(const char* str, size_t length, float& out) {
+    Decimal decimal;
+    ValueParseError error = ScanDecimal(str, length, decimal);
+    if(error != ValueParseError::None) {
+        return error;
+    }
+    float result;
+    if(!decimal.truncated && decimal.mantissa <= (UINT64_C(1) << 24)
+        && decimal.exponent >= -10 && decimal.exponent <= 10) {
+        result = (float)decimal.mantissa;
+        if(decimal.exponent < 0) {
+            result /= ExactPowersOfTenFloat[-decimal.exponent];
+        } else {
+            result *= ExactPowersOfTenFloat[decimal.exponent];
+        }
+    } else {
+        // Integers which are exact in double are rounded only once when converting to float
+        double exact = (double)decimal.mantissa;
+        if(!decimal.truncated && decimal.mantissa <= (UINT64_C(1) << 53)
+            && decimal.exponent >= 0 && decimal.exponent <= 22
+            && (exact *= ExactPowersOfTen[decimal.exponent]) <= 9007199254740992.0) {
+            result = (float)exact;
+        } else {
+            return CheckRange(ConvertSlow<float, strtof>(str, length), decimal, out);
+        }
+    }
+    if(decimal.negative) {
+        result = -result;
+    }
+    return CheckRange(result, decimal, out);
+}
+
+ValueParseError ParseBool(const char* str, size_t length, bool& out) {
+    // Dispatch on length, then compare the whole word
+    switch(length) {
+        case 0:
+            return ValueParseError::Empty;
+        case 1:
+            if(str[0] == '1' || str[0] == '0') {
+                out = str[0] == '1';
+                return ValueParseError::None;
+            }
+            break;
+        case 2:
+            if(memcmp(str, "on", 2) == 0 || memcmp(str, "no", 2) == 0) {
+                out = str[0] == 'o';
+                return ValueParseError::None;
+            }
+            break;
+        case 3:
+            if(memcmp(str, "off", 3) == 0 || memcmp(str, "yes", 3) == 0) {
+                out = str[0] == 'y';
+                return ValueParseError::None;
+            }
+            break;
+        case 4:
+            if(memcmp(str, "true", 4) == 0) {
+                out = true;
+                return ValueParseError::None;
+            }
+            break;
+        case 5:
+            if(memcmp(str, "false", 5) == 0) {
+                out = false;
+                return ValueParseError::None;
+            }
+            break;
+    }
+    return ValueParseError::Invalid;
+}
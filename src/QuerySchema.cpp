@@ -0,0 +1,25 @@
+#include "QuerySchema.hpp"
+
+#if _CPP17_AVAILABLE
+#include "JSONWriter.hpp"
+
+bool ParseQueryBool(std::string_view value, bool& out) {
+    return ParseBool(value.data(), value.size(), out) == ValueParseError::None;
+}
+
+esp_err_t SendQueryFieldErrors(httpd_req_t *request, const QueryFieldErrorEntry* errors, size_t numErrors) {
+    httpd_resp_set_status(request, "400 Bad Request");
+    JSONWriter json(request);
+    json.BeginObject();
+    json.Key("status").String("error");
+    json.Key("error").String("Invalid query parameters");
+    json.Key("parameters").BeginObject();
+    for(size_t i = 0; i < numErrors; i++) {
+        json.Key(errors[i].name).String(QueryFieldErrorToString(errors[i].error));
+    }
+    json.EndObject();
+    json.EndObject();
+    return json.Finish();
+}
+
+#endif // _CPP17_AVAILABLE
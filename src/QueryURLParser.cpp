@@ -1,266 +1,409 @@
 #include "QueryURLParser.hpp"
+#include "URLDecode.hpp"
+#include "RequestArena.hpp"
 #include <esp_log.h>
 #include <string>
 #include <cstdlib>
 #include <climits>
 #include <cstdint>
+#include <cstring>
 
 QueryURLParser::QueryURLParser(httpd_req_t *req) {
-    size_t queryURLLen = httpd_req_get_url_query_len(req) + 1;
-
-    if(queryURLLen > 1) {
-        // Allocate temporary buffer.
-        // In C++17, we could write directly to the std::string using .data()
-        // but we don't want to enforce C++17 yet.
-        char* buf = (char*)malloc(queryURLLen);
-
-        this->queryURLString = std::string(queryURLLen, '\0');
-        if (httpd_req_get_url_query_str(req, buf, queryURLLen) != ESP_OK) {
-            ESP_LOGE("Query URL parser", "Failed to extract query URL");
-            // Set string to "not found"
-            this->queryURLString = "";
-        } else { // Parsed successfully
-            this->queryURLString = std::string(buf, queryURLLen);
-        }
-        free(buf);
+    // Taken from req->uri instead of httpd_req_get_url_query_str(), which locates the query
+    // using offsets parsed from the URI as received, so it is also correct for rewritten URIs
+    const char* question = strchr(req->uri, '?');
+    if(question != nullptr) {
+        Parse(question + 1, strcspn(question + 1, "#"));
     }
 }
 
-std::string QueryURLParser::GetParameter(const char* key) {
-    // Allocate enough space to store the parameter.
-    // NOTE: The parameter can only be as long as the query URL itself.
-    // Therefore, allocating "too much" space upfront will
-    // avoid unneccessary copying
-    size_t bufSize = queryURLString.size();
-    char* buf = (char*)malloc(bufSize);
+QueryURLParser::QueryURLParser(const char* query) : QueryURLParser(query, strlen(query)) {
+}
 
-    /* Get value of expected key from query string */
-    esp_err_t err = httpd_query_key_value(queryURLString.c_str(), key, buf, bufSize);
-    if(err != ESP_OK) { // Not found
-        free(buf);
-        return "";
+QueryURLParser::QueryURLParser(const char* query, size_t length) {
+    Parse(query, length);
+}
+
+QueryURLParser::~QueryURLParser() {
+    if(query != inlineQuery) {
+        RequestFree(query);
+    }
+    if(parameters != inlineParameters) {
+        // Index and hash slots share a single allocation
+        RequestFree(parameters);
     }
-    // Convert to std::string
-    std::string param(buf); // by strlen
-    free(buf);
-    // Shrink param so it fits.
-    return param;
 }
 
+void QueryURLParser::Parse(const char* str, size_t length) {
+    if(length == 0) {
+        return;
+    }
+    char* buf = AllocateQuery(length);
+    if(buf == nullptr) {
+        return;
+    }
+    memcpy(buf, str, length);
+    buf[length] = '\0';
+    queryLength = length;
+    BuildIndex();
+}
 
-bool QueryURLParser::HasParameter(const char* key) {
-    char buf[1]; // Dummy buffer - will lead to truncation or OK if exists, or not found if not exists
-    esp_err_t err = httpd_query_key_value(queryURLString.c_str(), key, buf, 1);
-    return err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC;
+char* QueryURLParser::AllocateQuery(size_t length) {
+    // Offsets are stored as 16-bit values in the index
+    if(length >= UINT16_MAX) {
+        ESP_LOGE("Query URL parser", "Query URL too long (%u bytes)", (unsigned)length);
+        return nullptr;
+    }
+    if(length + 1 > sizeof(inlineQuery)) {
+        char* buf = (char*)RequestAllocate(length + 1);
+        if(buf == nullptr) {
+            ESP_LOGE("Query URL parser", "Failed to allocate %u bytes for query URL", (unsigned)(length + 1));
+            return nullptr;
+        }
+        query = buf;
+    }
+    return query;
 }
 
-#if _CPP17_AVAILABLE
+uint32_t QueryURLParser::HashKey(const char* key, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-std::optional<std::string> QueryURLParser::GetParameterOptional(const char* key) {
-    if(HasParameter(key)) {
-        return GetParameter(key);
-    } else {
-        return std::nullopt;
+void QueryURLParser::BuildIndex() {
+    // Count the '&' separators first so we know the maximum number
+    // of parameters, and can size the index with a single allocation (if any)
+    size_t maxParameters = 1;
+    for(const char* p = query; (p = (const char*)memchr(p, '&', query + queryLength - p)) != nullptr; p++) {
+        maxParameters++;
+    }
+    size_t numSlots = QueryURLParserNextPowerOfTwo(2 * maxParameters);
+    if(maxParameters > HUMANESPHTTP_QUERY_INLINE_PARAMETERS || numSlots > InlineSlots) {
+        void* block = RequestAllocate(maxParameters * sizeof(Parameter) + numSlots * sizeof(uint16_t));
+        if(block == nullptr) {
+            ESP_LOGE("Query URL parser", "Failed to allocate index for %u parameters", (unsigned)maxParameters);
+            queryLength = 0;
+            return;
+        }
+        parameters = (Parameter*)block;
+        slots = (uint16_t*)(parameters + maxParameters);
+    }
+    slotMask = numSlots - 1;
+    memset(slots, 0, numSlots * sizeof(uint16_t));
+
+    // Tokenize in place: every '&' and the first '=' in every pair is
+    // replaced by a NUL terminator, so both keys and values can be used as C strings.
+    char* end = query + queryLength;
+    char* segment = query;
+    while(segment < end) {
+        // Single pass over the pair: find the end of the key, then the end of the value
+        char* keyEnd = (char*)URLFindDelimiter(segment, end, true);
+        char* segmentEnd = keyEnd;
+        if(*keyEnd == '=') {
+            segmentEnd = (char*)URLFindDelimiter(keyEnd + 1, end, false);
+        }
+        char* next = segmentEnd + 1;
+        if(segmentEnd == segment) { // e.g. "a=1&&b=2"
+            segment = next;
+            continue;
+        }
+        *segmentEnd = '\0';
+
+        Parameter& param = parameters[numParameters];
+        param.keyOffset = (uint16_t)(segment - query);
+        param.keyLength = (uint16_t)(keyEnd - segment);
+        if(keyEnd != segmentEnd) {
+            *keyEnd = '\0';
+            param.valueOffset = (uint16_t)(keyEnd + 1 - query);
+            param.valueLength = (uint16_t)(segmentEnd - keyEnd - 1);
+        } else { // Key without value
+            param.valueOffset = (uint16_t)(segmentEnd - query);
+            param.valueLength = 0;
+        }
+        uint32_t hash = HashKey(segment, param.keyLength);
+        param.hash = (uint8_t)(hash >> 24);
+        param.flags = 0;
+
+        // Insert into hash table. Only the first occurrence of a key
+        // is inserted, so lookups behave like httpd_query_key_value()
+        size_t slot = hash & slotMask;
+        while(true) {
+            if(slots[slot] == 0) {
+                slots[slot] = (uint16_t)(numParameters + 1);
+                break;
+            }
+            const Parameter& other = parameters[slots[slot] - 1];
+            if(other.hash == param.hash && other.keyLength == param.keyLength
+                && memcmp(query + other.keyOffset, segment, param.keyLength) == 0) {
+                break; // Duplicate key
+            }
+            slot = (slot + 1) & slotMask;
+        }
+        numParameters++;
+        segment = next;
     }
 }
 
+const QueryURLParser::Parameter* QueryURLParser::FindParameter(const char* key) const {
+    if(numParameters == 0) {
+        return nullptr;
+    }
+    size_t keyLength = strlen(key);
+    uint32_t hash = HashKey(key, keyLength);
+    uint8_t shortHash = (uint8_t)(hash >> 24);
+    for(size_t slot = hash & slotMask; slots[slot] != 0; slot = (slot + 1) & slotMask) {
+        const Parameter& param = parameters[slots[slot] - 1];
+        if(param.hash == shortHash && param.keyLength == keyLength
+            && memcmp(query + param.keyOffset, key, keyLength) == 0) {
+            return &param;
+        }
+    }
+    return nullptr;
+}
 
-std::optional<int> QueryURLParser::GetParameterIntOptional(const char* key) {
-    std::optional<std::string> param = GetParameterOptional(key);
-    if(param.has_value()) {
-        char* endptr;
-        const char* str = param.value().c_str();
-        long result = strtol(str, &endptr, 10);
-        
-        // Check if conversion was successful and result fits in int
-        if (endptr != str && *endptr == '\0' && result >= INT_MIN && result <= INT_MAX) {
-            return static_cast<int>(result);
-        } else {
-            return std::nullopt;
+const QueryURLParser::Parameter* QueryURLParser::FindNextParameter(const Parameter* param) const {
+    // Later occurrences are not in the hash table, but they are always
+    // after the first one in the index, so scan the rest of it
+    const char* key = query + param->keyOffset;
+    for(const Parameter* other = param + 1; other < parameters + numParameters; other++) {
+        if(other->hash == param->hash && other->keyLength == param->keyLength
+            && memcmp(query + other->keyOffset, key, param->keyLength) == 0) {
+            return other;
         }
-    } else {
-        return std::nullopt;
     }
+    return nullptr;
+}
+
+size_t QueryURLParser::CountValues(const char* key) const {
+    return ForEachValue(key, [](const char*, size_t) {});
+}
+
+const QueryURLParser::Parameter* QueryURLParser::FindDecodedParameter(const char* key) {
+    Parameter* param = const_cast<Parameter*>(FindParameter(key));
+    if(param == nullptr || (param->flags & ParameterDecoded)) {
+        return param;
+    }
+    char* value = query + param->valueOffset;
+    if(URLNeedsDecoding(value, param->valueLength)) {
+        param->valueLength = (uint16_t)URLDecode(value, param->valueLength, value);
+        value[param->valueLength] = '\0';
+    }
+    param->flags |= ParameterDecoded;
+    return param;
 }
 
-std::optional<unsigned int> QueryURLParser::GetParameterUnsignedIntOptional(const char* key) {
-    std::optional<std::string> param = GetParameterOptional(key);
-    if(param.has_value()) {
-        char* endptr;
-        const char* str = param.value().c_str();
-        unsigned long result = strtoul(str, &endptr, 10);
-        
-        // Check if conversion was successful, result is non-negative, and fits in int
-        if (endptr != str && *endptr == '\0' && result <= UINT_MAX) {
-            return static_cast<unsigned int>(result);
-        } else {
-            return std::nullopt;
+std::string QueryURLParser::GetParameterDecoded(const char* key) {
+    const Parameter* param = FindDecodedParameter(key);
+    if(param == nullptr) { // Not found
+        return "";
+    }
+    return std::string(query + param->valueOffset, param->valueLength);
+}
+
+esp_err_t QueryURLParser::GetParameterDecoded(const char* key, char* buf, size_t bufSize) const {
+    const Parameter* param = FindParameter(key);
+    if(param == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if(bufSize == 0) {
+        return ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    const char* value = query + param->valueOffset;
+    if(param->valueLength < bufSize) {
+        // Fits entirely, decode directly into the caller's buffer
+        size_t length = URLDecode(value, param->valueLength, buf);
+        buf[length] = '\0';
+        return ESP_OK;
+    }
+    // The decoded value might still fit, decode in pieces
+    // (escapes are never split between pieces)
+    const char* end = value + param->valueLength;
+    size_t outLength = 0;
+    while(value < end) {
+        size_t room = bufSize - 1 - outLength;
+        if(room == 0) {
+            buf[outLength] = '\0';
+            return ESP_ERR_HTTPD_RESULT_TRUNC;
         }
-    } else {
+        // Decoding never makes the string longer, so a piece of
+        // "room" input characters always fits into the buffer
+        size_t pieceLength = room;
+        if(pieceLength > (size_t)(end - value)) {
+            pieceLength = end - value;
+        }
+        // Don't cut an escape sequence in half
+        for(size_t i = 1; i <= 2 && i <= pieceLength; i++) {
+            if(value[pieceLength - i] == '%' && value + pieceLength < end) {
+                pieceLength -= i;
+                break;
+            }
+        }
+        if(pieceLength == 0) {
+            // Less than three characters of room and an escape comes next.
+            // A valid escape decodes to a single character, an invalid one
+            // is copied verbatim one character at a time.
+            char decoded[3];
+            size_t escapeLength = (end - value) >= 3 ? 3 : (end - value);
+            if(URLDecode(value, escapeLength, decoded) == 1) {
+                buf[outLength++] = decoded[0];
+                value += escapeLength;
+            } else {
+                buf[outLength++] = *value++;
+            }
+            continue;
+        }
+        outLength += URLDecode(value, pieceLength, buf + outLength);
+        value += pieceLength;
+    }
+    buf[outLength] = '\0';
+    return ESP_OK;
+}
+
+std::string QueryURLParser::GetParameter(const char* key) const {
+    const Parameter* param = FindParameter(key);
+    if(param == nullptr) { // Not found
+        return "";
+    }
+    return std::string(query + param->valueOffset, param->valueLength);
+}
+
+
+bool QueryURLParser::HasParameter(const char* key) const {
+    return FindParameter(key) != nullptr;
+}
+
+#if _CPP17_AVAILABLE
+
+std::string_view QueryURLParser::GetParameterView(const char* key) const {
+    const Parameter* param = FindParameter(key);
+    if(param == nullptr) {
+        return std::string_view();
+    }
+    return std::string_view(query + param->valueOffset, param->valueLength);
+}
+
+std::optional<std::string_view> QueryURLParser::GetParameterViewOptional(const char* key) const {
+    const Parameter* param = FindParameter(key);
+    if(param == nullptr) {
         return std::nullopt;
     }
+    return std::string_view(query + param->valueOffset, param->valueLength);
 }
 
-std::optional<long> QueryURLParser::GetParameterLongOptional(const char* key) {
-    std::optional<std::string> param = GetParameterOptional(key);
-    if(param.has_value()) {
-        char* endptr;
-        const char* str = param.value().c_str();
-        long result = strtol(str, &endptr, 10);
-        
-        // Check if conversion was successful
-        if (endptr != str && *endptr == '\0') {
-            return result;
-        } else {
-            return std::nullopt;
-        }
-    } else {
+std::string_view QueryURLParser::GetParameterDecodedView(const char* key) {
+    const Parameter* param = FindDecodedParameter(key);
+    if(param == nullptr) {
+        return std::string_view();
+    }
+    return std::string_view(query + param->valueOffset, param->valueLength);
+}
+
+std::optional<std::string_view> QueryURLParser::GetParameterDecodedViewOptional(const char* key) {
+    const Parameter* param = FindDecodedParameter(key);
+    if(param == nullptr) {
         return std::nullopt;
     }
+    return std::string_view(query + param->valueOffset, param->valueLength);
 }
 
-std::optional<unsigned long> QueryURLParser::GetParameterUnsignedLongOptional(const char* key) {
-    std::optional<std::string> param = GetParameterOptional(key);
-    if(param.has_value()) {
-        char* endptr;
-        const char* str = param.value().c_str();
-        unsigned long result = strtoul(str, &endptr, 10);
-        
-        // Check if conversion was successful
-        if (endptr != str && *endptr == '\0') {
-            return static_cast<unsigned long>(result);
-        } else {
-            return std::nullopt;
-        }
-    } else {
+template<typename T>
+std::optional<T> QueryURLParser::ParseNumber(std::string_view value) {
+    T result;
+    if(ParseValue(value.data(), value.size(), result) != ValueParseError::None) {
         return std::nullopt;
     }
+    return result;
 }
 
+template std::optional<signed char> QueryURLParser::ParseNumber<signed char>(std::string_view);
+template std::optional<unsigned char> QueryURLParser::ParseNumber<unsigned char>(std::string_view);
+template std::optional<short> QueryURLParser::ParseNumber<short>(std::string_view);
+template std::optional<unsigned short> QueryURLParser::ParseNumber<unsigned short>(std::string_view);
+template std::optional<int> QueryURLParser::ParseNumber<int>(std::string_view);
+template std::optional<unsigned int> QueryURLParser::ParseNumber<unsigned int>(std::string_view);
+template std::optional<long> QueryURLParser::ParseNumber<long>(std::string_view);
+template std::optional<unsigned long> QueryURLParser::ParseNumber<unsigned long>(std::string_view);
+template std::optional<long long> QueryURLParser::ParseNumber<long long>(std::string_view);
+template std::optional<unsigned long long> QueryURLParser::ParseNumber<unsigned long long>(std::string_view);
+template std::optional<float> QueryURLParser::ParseNumber<float>(std::string_view);
+template std::optional<double> QueryURLParser::ParseNumber<double>(std::string_view);
 
-std::optional<float> QueryURLParser::GetParameterFloatOptional(const char* key) {
-    std::optional<std::string> param = GetParameterOptional(key);
-    if(param.has_value()) {
-        char* endptr;
-        const char* str = param.value().c_str();
-        float result = strtof(str, &endptr);
-        
-        // Check if conversion was successful
-        if (endptr != str && *endptr == '\0') {
-            return result;
-        } else {
-            return std::nullopt;
-        }
+std::optional<std::string> QueryURLParser::GetParameterOptional(const char* key) const {
+    std::optional<std::string_view> value = GetParameterViewOptional(key);
+    if(value.has_value()) {
+        return std::string(*value);
     } else {
         return std::nullopt;
     }
 }
 
+std::optional<int> QueryURLParser::GetParameterIntOptional(const char* key) const {
+    return GetParameterNumberOptional<int>(key);
+}
+
+std::optional<unsigned int> QueryURLParser::GetParameterUnsignedIntOptional(const char* key) const {
+    return GetParameterNumberOptional<unsigned int>(key);
+}
+
+std::optional<long> QueryURLParser::GetParameterLongOptional(const char* key) const {
+    return GetParameterNumberOptional<long>(key);
+}
+
+std::optional<unsigned long> QueryURLParser::GetParameterUnsignedLongOptional(const char* key) const {
+    return GetParameterNumberOptional<unsigned long>(key);
+}
+
+std::optional<float> QueryURLParser::GetParameterFloatOptional(const char* key) const {
+    return GetParameterNumberOptional<float>(key);
+}
+
+std::optional<double> QueryURLParser::GetParameterDoubleOptional(const char* key) const {
+    return GetParameterNumberOptional<double>(key);
+}
+
 #endif
 
 #if HUMANESPHTTP_EXCEPTIONS
-std::string QueryURLParser::GetParameterException(const char* key) {
-    if(HasParameter(key)) {
-        return GetParameter(key);
-    } else {
-        throw QueryURLParameterNotFoundException("Parameter " + std::string(key) + "not found");
+void QueryURLParser::ThrowOnError(const char* key, ValueParseError error) const {
+    if(error == ValueParseError::None) {
+        return;
     }
-    // Unreachable
-    return "";
-}
-
-int QueryURLParser::GetParameterIntException(const char* key) {
-    if(HasParameter(key)) {
-        std::string value = GetParameter(key);
-        char* endptr;
-        long result = strtol(value.c_str(), &endptr, 10);
-        
-        // Check if conversion was successful and result fits in int
-        if (endptr != value.c_str() && *endptr == '\0' && result >= INT_MIN && result <= INT_MAX) {
-            return static_cast<int>(result);
-        } else {
-            // Return 0 as fallback instead of throwing exception
-            return 0;
-        }
-    } else {
-        // Return 0 as fallback instead of throwing exception
-        return 0;
+    if(error == ValueParseError::NotFound) {
+        throw QueryURLParameterNotFoundException("Parameter " + std::string(key) + " not found");
     }
+    throw QueryURLParameterConversionException("Parameter " + std::string(key) + " is " + ValueParseErrorToString(error));
 }
 
-unsigned int QueryURLParser::GetParameterUnsignedIntException(const char* key) {
-    if(HasParameter(key)) {
-        std::string value = GetParameter(key);
-        char* endptr;
-        unsigned long result = strtoul(value.c_str(), &endptr, 10);
-        
-        // Check if conversion was successful and result fits in unsigned int
-        if (endptr != value.c_str() && *endptr == '\0' && result <= UINT32_MAX) {
-            return static_cast<unsigned int>(result);
-        } else {
-            // Return 0 as fallback instead of throwing exception
-            return 0;
-        }
-    } else {
-        // Return 0 as fallback instead of throwing exception
-        return 0;
+std::string QueryURLParser::GetParameterException(const char* key) const {
+    const Parameter* param = FindParameter(key);
+    if(param == nullptr) {
+        ThrowOnError(key, ValueParseError::NotFound);
     }
+    return std::string(query + param->valueOffset, param->valueLength);
 }
 
-long QueryURLParser::GetParameterLongException(const char* key) {
-    if(HasParameter(key)) {
-        std::string value = GetParameter(key);
-        char* endptr;
-        long result = strtol(value.c_str(), &endptr, 10);
-        
-        // Check if conversion was successful
-        if (endptr != value.c_str() && *endptr == '\0') {
-            return result;
-        } else {
-            // Return 0 as fallback instead of throwing exception
-            return 0;
-        }
-    } else {
-        // Return 0 as fallback instead of throwing exception
-        return 0;
-    }
+int QueryURLParser::GetParameterIntException(const char* key) const {
+    return GetParameterValueException<int>(key);
 }
 
-unsigned long QueryURLParser::GetParameterUnsignedLongException(const char* key) {
-    if(HasParameter(key)) {
-        std::string value = GetParameter(key);
-        char* endptr;
-        unsigned long result = strtoul(value.c_str(), &endptr, 10);
-        
-        // Check if conversion was successful
-        if (endptr != value.c_str() && *endptr == '\0') {
-            return result;
-        } else {
-            // Return 0 as fallback instead of throwing exception
-            return 0;
-        }
-    } else {
-        // Return 0 as fallback instead of throwing exception
-        return 0;
-    }
+unsigned int QueryURLParser::GetParameterUnsignedIntException(const char* key) const {
+    return GetParameterValueException<unsigned int>(key);
 }
 
-float QueryURLParser::GetParameterFloatException(const char* key) {
-    if(HasParameter(key)) {
-        std::string value = GetParameter(key);
-        char* endptr;
-        float result = strtof(value.c_str(), &endptr);
-        
-        // Check if conversion was successful
-        if (endptr != value.c_str() && *endptr == '\0') {
-            return result;
-        } else {
-            // Return 0.0f as fallback instead of throwing exception
-            return 0.0f;
-        }
-    } else {
-        // Return 0.0f as fallback instead of throwing exception
-        return 0.0f;
-    }
+long QueryURLParser::GetParameterLongException(const char* key) const {
+    return GetParameterValueException<long>(key);
+}
+
+unsigned long QueryURLParser::GetParameterUnsignedLongException(const char* key) const {
+    return GetParameterValueException<unsigned long>(key);
+}
+
+float QueryURLParser::GetParameterFloatException(const char* key) const {
+    return GetParameterValueException<float>(key);
 }
-#endif // HUMANESPHTTP_EXCEPTIONS
\ No newline at end of file
+#endif // HUMANESPHTTP_EXCEPTIONS
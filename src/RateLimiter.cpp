@@ -0,0 +1,135 @@
+#include "RateLimiter.hpp"
+#include "JSONResponse.hpp"
+#include "RawSend.hpp"
+#include <esp_timer.h>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+constexpr size_t RateLimiter::MaxProbes;
+
+TokenBucket::TokenBucket(float ratePerSecond, uint32_t burst) {
+    intervalUs = ratePerSecond > 0 ? (int64_t)(1e6f / ratePerSecond) : INT64_C(1000000);
+    if(intervalUs < 1) {
+        intervalUs = 1;
+    }
+    toleranceUs = (int64_t)(burst > 0 ? burst - 1 : 0) * intervalUs;
+    SetResponse("503 Service Unavailable", "Service unavailable");
+}
+
+uint32_t TokenBucket::GetRetryAfter() const {
+    // Time until the next token, rounded up to whole seconds
+    return (uint32_t)((intervalUs + 999999) / 1000000);
+}
+
+void TokenBucket::SetResponse(const char* status, const char* error) {
+    // Formatted once, so rejecting a request costs a single send
+    const char* format =
+        "HTTP/1.1 %s\r\n"
+        "Content-Type: application/json\r\n"
+        "Retry-After: %u\r\n"
+        "Content-Length: %u\r\n"
+        HUMANESPHTTP_STATIC_RESPONSE_HEADERS
+        "\r\n"
+        "%s";
+    char body[96];
+    int bodyLength = snprintf(body, sizeof(body), "{\"status\":\"error\",\"error\":\"%s\"}", error);
+    int length = snprintf(nullptr, 0, format, status, (unsigned)GetRetryAfter(), (unsigned)bodyLength, body);
+    response.reset(new char[length + 1]);
+    snprintf(response.get(), length + 1, format, status, (unsigned)GetRetryAfter(), (unsigned)bodyLength, body);
+    responseLength = length;
+}
+
+esp_err_t TokenBucket::SendResponse(httpd_req_t *request) const {
+    // Shedding load must stay cheap, so a client which doesn't read never blocks the httpd task
+    esp_err_t err = SendRaw(request, response.get(), responseLength, MSG_DONTWAIT);
+    if(err != ESP_OK) {
+        httpd_sess_trigger_close(request->handle, httpd_req_to_sockfd(request));
+    }
+    return err;
+}
+
+bool TokenBucket::Admit(httpd_req_t *request) {
+    if(Take(esp_timer_get_time())) {
+        return true;
+    }
+    rejected++;
+    SendResponse(request);
+    return false;
+}
+
+RateLimiter::RateLimiter(float ratePerSecond, uint32_t burst, size_t maxClients)
+    : TokenBucket(ratePerSecond, burst), tableSize(1) {
+    while(tableSize < maxClients) {
+        tableSize <<= 1;
+    }
+    clients.reset(new Client[tableSize]());
+    SetResponse("429 Too Many Requests", "Too many requests");
+}
+
+bool RateLimiter::GetClientAddress(httpd_req_t *request, Address address) {
+    struct sockaddr_storage peer;
+    socklen_t length = sizeof(peer);
+    if(getpeername(httpd_req_to_sockfd(request), (struct sockaddr*)&peer, &length) != 0) {
+        return false;
+    }
+    if(peer.ss_family == AF_INET) {
+        // IPv4-mapped IPv6 address ::ffff:a.b.c.d
+        const struct sockaddr_in* ipv4 = (const struct sockaddr_in*)&peer;
+        memset(address, 0, 10);
+        address[10] = 0xff;
+        address[11] = 0xff;
+        memcpy(address + 12, &ipv4->sin_addr.s_addr, 4);
+        return true;
+    }
+    if(peer.ss_family == AF_INET6) {
+        memcpy(address, ((const struct sockaddr_in6*)&peer)->sin6_addr.s6_addr, 16);
+        return true;
+    }
+    return false;
+}
+
+bool RateLimiter::AdmitClient(const Address address, int64_t nowUs) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < sizeof(Address); i++) {
+        hash = (hash ^ address[i]) * 16777619u;
+    }
+    Client* reusable = nullptr;
+    size_t probes = tableSize < MaxProbes ? tableSize : MaxProbes;
+    for(size_t probe = 0; probe < probes; probe++) {
+        Client& client = clients[(hash + probe) & (tableSize - 1)];
+        if(client.full != 0 && memcmp(client.address, address, sizeof(Address)) == 0) {
+            return Take(client.full, nowUs);
+        }
+        // A client whose bucket is full again is the same as a new client,
+        // otherwise replace the least limited one
+        if(reusable == nullptr || (reusable->full > nowUs && client.full < reusable->full)) {
+            reusable = &client;
+        }
+    }
+    memcpy(reusable->address, address, sizeof(Address));
+    reusable->full = 0;
+    return Take(reusable->full, nowUs);
+}
+
+bool RateLimiter::AdmitConnection(httpd_req_t *request) {
+    Address address;
+    if(!GetClientAddress(request, address)) {
+        return true; // Not limited
+    }
+    if(AdmitClient(address, esp_timer_get_time())) {
+        return true;
+    }
+    rejected++;
+    return false;
+}
+
+bool RateLimiter::Admit(httpd_req_t *request) {
+    if(AdmitConnection(request)) {
+        return true;
+    }
+    SendResponse(request);
+    return false;
+}
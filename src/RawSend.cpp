@@ -0,0 +1,22 @@
+#include "RawSend.hpp"
+#include <sys/socket.h>
+
+esp_err_t SendRaw(httpd_req_t *request, const char* data, size_t length, int flags) {
+    int retries = (flags & MSG_DONTWAIT) ? 0 : HUMANESPHTTP_SEND_RETRIES;
+    int sockfd = flags != 0 ? httpd_req_to_sockfd(request) : -1;
+    size_t sent = 0;
+    while(sent < length) {
+        int ret = flags != 0
+            ? httpd_socket_send(request->handle, sockfd, data + sent, length - sent, flags)
+            : httpd_send(request, data + sent, length - sent);
+        if(ret == HTTPD_SOCK_ERR_TIMEOUT && retries > 0) {
+            retries--;
+            continue;
+        }
+        if(ret <= 0) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        sent += ret;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,90 @@
+#include "RequestArena.hpp"
+#include <esp_log.h>
+#include <cstdlib>
+
+static const char* TAG = "Request arena";
+
+// Arena of the current task, allocated on first use
+static thread_local RequestArena* taskArena = nullptr;
+// Arena of the request running on the current task
+static thread_local RequestArena* currentArena = nullptr;
+
+RequestArena::RequestArena(size_t capacity) : capacity(capacity) {
+    buffer = (uint8_t*)malloc(capacity);
+    if(buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes", (unsigned)capacity);
+        this->capacity = 0;
+    }
+}
+
+RequestArena::~RequestArena() {
+    free(buffer);
+}
+
+void* RequestArena::Allocate(size_t size, size_t alignment) {
+    // Alignment is relative to the buffer, which is aligned for any type
+    size_t offset = (used + alignment - 1) & ~(alignment - 1);
+    if(size > capacity || offset > capacity - size) {
+        return nullptr;
+    }
+    used = offset + size;
+    return buffer + offset;
+}
+
+void RequestArena::Reset() {
+    if(used > peak) {
+        peak = used;
+    }
+    used = 0;
+}
+
+RequestArena* RequestArena::Current() {
+    return currentArena;
+}
+
+RequestArena* RequestArena::ForCurrentTask() {
+    return taskArena;
+}
+
+RequestArenaScope::RequestArenaScope(size_t capacity) {
+    if(capacity == 0 || currentArena != nullptr) {
+        return;
+    }
+    if(taskArena == nullptr) {
+        // Once per task, kept for the lifetime of the task
+        taskArena = new RequestArena(capacity);
+    }
+    arena = taskArena;
+    currentArena = arena;
+}
+
+RequestArenaScope::~RequestArenaScope() {
+    if(arena != nullptr) {
+        arena->Reset();
+        currentArena = nullptr;
+    }
+}
+
+size_t RequestArenaScope::GetUsed() const {
+    return arena != nullptr ? arena->GetUsed() : 0;
+}
+
+void* RequestAllocate(size_t size) {
+    RequestArena* arena = currentArena;
+    if(arena != nullptr) {
+        void* pointer = arena->Allocate(size);
+        if(pointer != nullptr) {
+            return pointer;
+        }
+        arena->overflows++;
+    }
+    return malloc(size);
+}
+
+void RequestFree(void* pointer) {
+    RequestArena* arena = taskArena;
+    if(arena != nullptr && arena->Contains(pointer)) {
+        return; // Released when the request is finished
+    }
+    free(pointer);
+}
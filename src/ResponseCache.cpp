@@ -0,0 +1,277 @@
+#include "ResponseCache.hpp"
+#include "SendObserver.hpp"
+#include "RawSend.hpp"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <strings.h>
+
+static const char* TAG = "Response cache";
+
+/**
+ * Records a response while it is being sent
+ */
+class ResponseCapture : public SendObserver {
+public:
+    void OnSend(const char* data, size_t length) override {
+        if(overflow) {
+            return;
+        }
+        if(this->data.size() + length > limit) {
+            overflow = true;
+            this->data.clear();
+        } else {
+            this->data.append(data, length);
+        }
+    }
+
+    std::string data;
+    size_t limit = 0;
+    bool overflow = false;
+};
+
+/**
+ * @return true if the head of the captured response contains the given header (name in lower case)
+ */
+static bool HasHeader(const std::string& response, const char* name) {
+    size_t headEnd = response.find("\r\n\r\n");
+    size_t nameLength = strlen(name);
+    for(size_t line = response.find("\r\n"); line < headEnd; line = response.find("\r\n", line + 2)) {
+        if(response.size() >= line + 2 + nameLength
+            && strncasecmp(response.data() + line + 2, name, nameLength) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t HashKey(const std::string& key) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for(char c : key) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+ResponseCache::ResponseCache(size_t budget) : budget(budget) {
+    entries.reserve(HUMANESPHTTP_CACHE_MAX_ENTRIES);
+}
+
+bool ResponseCache::BuildKey(httpd_req_t *request, std::string& key, size_t& pathLength) {
+    const char* uri = request->uri;
+    size_t uriLength = strcspn(uri, "#");
+    const char* question = (const char*)memchr(uri, '?', uriLength);
+    size_t uriPathLength = question == nullptr ? uriLength : (size_t)(question - uri);
+
+    key = request->method == HTTP_HEAD ? "HEAD " : "GET ";
+    key.append(uri, uriPathLength);
+    pathLength = key.size();
+    if(question == nullptr) {
+        return true;
+    }
+    // Normalize the query by sorting its parameters
+    const char* query = question + 1;
+    const char* queryEnd = uri + uriLength;
+    const char* parameters[32];
+    size_t lengths[32];
+    size_t numParameters = 0;
+    while(query < queryEnd) {
+        const char* ampersand = (const char*)memchr(query, '&', queryEnd - query);
+        const char* end = ampersand == nullptr ? queryEnd : ampersand;
+        if(end != query) {
+            if(numParameters == 32) {
+                return false; // Unusual request, don't cache
+            }
+            parameters[numParameters] = query;
+            lengths[numParameters] = end - query;
+            numParameters++;
+        }
+        query = end + 1;
+    }
+    size_t order[32];
+    for(size_t i = 0; i < numParameters; i++) {
+        order[i] = i;
+    }
+    std::sort(order, order + numParameters, [&](size_t a, size_t b) {
+        int cmp = memcmp(parameters[a], parameters[b], std::min(lengths[a], lengths[b]));
+        return cmp < 0 || (cmp == 0 && lengths[a] < lengths[b]);
+    });
+    for(size_t i = 0; i < numParameters; i++) {
+        key += i == 0 ? '?' : '&';
+        key.append(parameters[order[i]], lengths[order[i]]);
+    }
+    return true;
+}
+
+ResponseCache::Entry* ResponseCache::Find(uint32_t hash, const std::string& key) {
+    for(Entry& entry : entries) {
+        if(entry.hash == hash && entry.key == key) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+size_t ResponseCache::EntrySize(const Entry& entry) {
+    return entry.key.size() + (entry.response ? entry.response->size() : 0);
+}
+
+void ResponseCache::Remove(Entry* entry) {
+    used -= EntrySize(*entry);
+    entries.erase(entries.begin() + (entry - entries.data()));
+}
+
+bool ResponseCache::MakeRoom(size_t bytes) {
+    if(bytes > budget) {
+        return false;
+    }
+    while(used + bytes > budget || entries.size() >= HUMANESPHTTP_CACHE_MAX_ENTRIES) {
+        // Evict the least recently used entry which is not being generated
+        Entry* oldest = nullptr;
+        for(Entry& entry : entries) {
+            if(entry.state == EntryState::Ready && (oldest == nullptr || entry.lastUsed < oldest->lastUsed)) {
+                oldest = &entry;
+            }
+        }
+        if(oldest == nullptr) {
+            return false;
+        }
+        Remove(oldest);
+        stats.evictions++;
+    }
+    return true;
+}
+
+esp_err_t ResponseCache::Handle(httpd_req_t *request, uint32_t ttlMs, Generator generator, void* context) {
+    std::string key;
+    size_t pathLength;
+    if((request->method != HTTP_GET && request->method != HTTP_HEAD)
+        || !BuildKey(request, key, pathLength)) {
+        return generator(request, context);
+    }
+    uint32_t hash = HashKey(key);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    bool waited = false;
+    while(true) {
+        Entry* entry = Find(hash, key);
+        if(entry != nullptr && entry->state == EntryState::Ready) {
+            if(esp_timer_get_time() < entry->expires) {
+                stats.hits++;
+                entry->lastUsed = ++clock;
+                std::shared_ptr<const std::string> response = entry->response;
+                lock.unlock();
+                // Send the stored response as-is, the handler is not called
+                return SendRaw(request, response->data(), response->size());
+            }
+            Remove(entry); // Expired
+            entry = nullptr;
+        }
+        if(entry == nullptr || waited) {
+            break;
+        }
+        // Another request is generating this response, wait for it
+        stats.coalesced++;
+        waited = true;
+        generated.wait_for(lock, std::chrono::milliseconds(HUMANESPHTTP_CACHE_WAIT_MS), [&]() {
+            Entry* current = Find(hash, key);
+            return current == nullptr || current->state != EntryState::Pending;
+        });
+    }
+
+    // Miss: generate the response, capturing everything which is sent
+    stats.misses++;
+    uint32_t generation = 0;
+    if(Find(hash, key) == nullptr && MakeRoom(key.size())) {
+        Entry entry;
+        entry.hash = hash;
+        entry.key = key;
+        entry.pathLength = pathLength;
+        entry.generation = generation = ++nextGeneration;
+        entries.push_back(std::move(entry));
+        used += key.size();
+    }
+    lock.unlock();
+
+    ResponseCapture capture;
+    capture.limit = budget;
+    esp_err_t err;
+    {
+        ScopedSendObserver observer(request, &capture);
+        err = generator(request, context);
+    }
+
+    if(generation == 0) {
+        return err; // Not cacheable (no room or timed out waiting)
+    }
+    lock.lock();
+    Entry* entry = Find(hash, key);
+    // The entry might have been invalidated (and maybe recreated) in the meantime
+    if(entry != nullptr && entry->generation == generation) {
+        static const char OKStatus[] = "HTTP/1.1 200 ";
+        // The key doesn't include Accept-Encoding, so encoded responses
+        // (see CompressedResponse) would be served to clients which can't decode them
+        bool cacheable = err == ESP_OK && !capture.overflow
+            && capture.data.compare(0, sizeof(OKStatus) - 1, OKStatus) == 0
+            && !HasHeader(capture.data, "content-encoding:");
+        if(cacheable) {
+            Remove(entry); // Re-added below, after making room
+            cacheable = MakeRoom(key.size() + capture.data.size());
+            if(cacheable) {
+                Entry ready;
+                ready.hash = hash;
+                ready.key = key;
+                ready.pathLength = pathLength;
+                ready.response = std::make_shared<const std::string>(std::move(capture.data));
+                ready.expires = esp_timer_get_time() + (int64_t)ttlMs * 1000;
+                ready.lastUsed = ++clock;
+                ready.state = EntryState::Ready;
+                used += EntrySize(ready);
+                entries.push_back(std::move(ready));
+            }
+        } else {
+            Remove(entry);
+        }
+        if(!cacheable) {
+            stats.uncacheable++;
+            ESP_LOGD(TAG, "Not caching response for %s", key.c_str());
+        }
+    }
+    lock.unlock();
+    generated.notify_all();
+    return err;
+}
+
+void ResponseCache::Invalidate(const char* path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t pathLength = strlen(path);
+    for(size_t i = entries.size(); i > 0; i--) {
+        Entry& entry = entries[i - 1];
+        // Key is "<method> <path>[?query]"
+        size_t methodLength = entry.key.find(' ') + 1;
+        if(entry.pathLength - methodLength == pathLength
+            && entry.key.compare(methodLength, pathLength, path) == 0) {
+            Remove(&entry);
+        }
+    }
+}
+
+void ResponseCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    used = 0;
+}
+
+ResponseCacheStats ResponseCache::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+size_t ResponseCache::GetUsedBytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
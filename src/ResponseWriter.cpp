@@ -0,0 +1,254 @@
+#include "ResponseWriter.hpp"
+#include "JSONResponse.hpp"
+#include "NumberFormat.hpp"
+#include "RawSend.hpp"
+#include "RequestArena.hpp"
+#include <esp_log.h>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+static const char* TAG = "ResponseWriter";
+
+static constexpr size_t ChunkSizeLineSize = 12;
+
+/**
+ * Format the size line preceding a chunk, e.g. "5a0\r\n"
+ */
+static size_t FormatChunkSize(char* out, size_t size) {
+    return (size_t)snprintf(out, ChunkSizeLineSize, "%x\r\n", (unsigned)size);
+}
+
+ResponseWriter::ResponseWriter(httpd_req_t *request) : request(request) {
+}
+
+ResponseWriter::ResponseWriter(OutputFunction output, void* context) : output(output), outputContext(context) {
+}
+
+ResponseWriter& ResponseWriter::SetStatus(const char* status) {
+    if(headSent) {
+        ESP_LOGW(TAG, "Status set after the headers have been sent");
+    }
+    this->status = status;
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::SetType(const char* type) {
+    if(headSent) {
+        ESP_LOGW(TAG, "Content type set after the headers have been sent");
+    }
+    this->type = type;
+    return *this;
+}
+
+esp_err_t ResponseWriter::SetHeader(const char* name, const char* value) {
+    if(headSent) {
+        ESP_LOGW(TAG, "Header %s set after the headers have been sent", name);
+    }
+    if(numHeaders == HUMANESPHTTP_RESPONSE_MAX_HEADERS) {
+        ESP_LOGE(TAG, "Too many headers, increase HUMANESPHTTP_RESPONSE_MAX_HEADERS");
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    headers[numHeaders][0] = name;
+    headers[numHeaders][1] = value;
+    numHeaders++;
+    return ESP_OK;
+}
+
+void ResponseWriter::Send(const char* data, size_t dataLength) {
+    if(error != ESP_OK || dataLength == 0) {
+        return;
+    }
+    stats.flushes++;
+    if(output != nullptr) {
+        error = output(outputContext, data, dataLength);
+        return;
+    }
+    error = SendRaw(request, data, dataLength);
+}
+
+size_t ResponseWriter::FormatHead(char* out, bool chunked, size_t contentLength) const {
+    size_t headLength = 0;
+    auto put = [&](const char* str, size_t strLength) {
+        if(out != nullptr) {
+            memcpy(out + headLength, str, strLength);
+        }
+        headLength += strLength;
+    };
+    auto putString = [&](const char* str) {
+        put(str, strlen(str));
+    };
+    putString("HTTP/1.1 ");
+    putString(status);
+    putString("\r\nContent-Type: ");
+    putString(type);
+    if(chunked) {
+        putString("\r\nTransfer-Encoding: chunked\r\n");
+    } else {
+        putString("\r\nContent-Length: ");
+        char digits[NumberFormatMaxLength];
+        put(digits, FormatUnsigned(digits, contentLength));
+        putString("\r\n");
+    }
+    for(uint8_t i = 0; i < numHeaders; i++) {
+        putString(headers[i][0]);
+        putString(": ");
+        putString(headers[i][1]);
+        putString("\r\n");
+    }
+    putString(HUMANESPHTTP_STATIC_RESPONSE_HEADERS "\r\n");
+    return headLength;
+}
+
+char* ResponseWriter::PrependHead(char* end, bool chunked, size_t contentLength) {
+    headSent = true;
+    size_t headLength = FormatHead(nullptr, chunked, contentLength);
+    if(headLength <= (size_t)(end - buffer)) {
+        FormatHead(end - headLength, chunked, contentLength);
+        return end - headLength;
+    }
+    // Too many headers for the reserved space, send them on their own
+    char* head = (char*)RequestAllocate(headLength);
+    if(head == nullptr) {
+        error = ESP_ERR_NO_MEM;
+        return end;
+    }
+    FormatHead(head, chunked, contentLength);
+    Send(head, headLength);
+    RequestFree(head);
+    return end;
+}
+
+void ResponseWriter::Flush(bool last) {
+    if(error != ESP_OK) {
+        return;
+    }
+    stats.chunked = true;
+    char* data = buffer + HUMANESPHTTP_RESPONSE_HEAD_SIZE;
+    char* start = data;
+    char* end = data + length;
+    if(length > 0) {
+        // Frame the chunk in place: size line in the head space, "\r\n" in the trailer space
+        char sizeLine[ChunkSizeLineSize];
+        size_t sizeLineLength = FormatChunkSize(sizeLine, length);
+        start -= sizeLineLength;
+        memcpy(start, sizeLine, sizeLineLength);
+        memcpy(end, "\r\n", 2);
+        end += 2;
+    }
+    if(last) {
+        memcpy(end, "0\r\n\r\n", 5);
+        end += 5;
+    }
+    if(!headSent) {
+        start = PrependHead(start, true, 0);
+    }
+    Send(start, end - start);
+    length = 0;
+}
+
+void ResponseWriter::Append(const char* data, size_t dataLength) {
+    if(error != ESP_OK) {
+        return;
+    }
+    if(length + dataLength > Capacity) {
+        // Fill the buffer completely before flushing so every chunk is full
+        size_t room = Capacity - length;
+        memcpy(buffer + HUMANESPHTTP_RESPONSE_HEAD_SIZE + length, data, room);
+        length += room;
+        data += room;
+        dataLength -= room;
+        Flush(false);
+        // Send very large data directly instead of copying it piece by piece
+        if(dataLength >= Capacity) {
+            char sizeLine[ChunkSizeLineSize];
+            Send(sizeLine, FormatChunkSize(sizeLine, dataLength));
+            Send(data, dataLength);
+            Send("\r\n", 2);
+            return;
+        }
+    }
+    memcpy(buffer + HUMANESPHTTP_RESPONSE_HEAD_SIZE + length, data, dataLength);
+    length += dataLength;
+}
+
+ResponseWriter& ResponseWriter::Write(const char* data, size_t dataLength) {
+    stats.writes++;
+    stats.bytes += dataLength;
+    Append(data, dataLength);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::Write(const char* str) {
+    return Write(str, strlen(str));
+}
+
+ResponseWriter& ResponseWriter::Printf(const char* format, ...) {
+    stats.writes++;
+    if(error != ESP_OK) {
+        return *this;
+    }
+    va_list args;
+    va_start(args, format);
+    va_list retryArgs;
+    va_copy(retryArgs, args);
+    // The terminating NUL may go into the chunk trailer space, which is only used when flushing
+    size_t room = Capacity - length;
+    int written = vsnprintf(buffer + HUMANESPHTTP_RESPONSE_HEAD_SIZE + length, room + 1, format, args);
+    va_end(args);
+    if(written >= 0 && (size_t)written <= room) {
+        length += written;
+        stats.bytes += written;
+    } else if(written > 0) {
+        // Doesn't fit, format into a temporary buffer so the current chunk can be filled up
+        char* text = (char*)RequestAllocate(written + 1);
+        if(text != nullptr) {
+            vsnprintf(text, written + 1, format, retryArgs);
+            stats.bytes += written;
+            Append(text, written);
+            RequestFree(text);
+        } else {
+            error = ESP_ERR_NO_MEM;
+        }
+    }
+    va_end(retryArgs);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::WriteNumber(long long value) {
+    char digits[NumberFormatMaxLength];
+    return Write(digits, FormatInteger(digits, value));
+}
+
+ResponseWriter& ResponseWriter::WriteNumber(unsigned long long value) {
+    char digits[NumberFormatMaxLength];
+    return Write(digits, FormatUnsigned(digits, value));
+}
+
+ResponseWriter& ResponseWriter::WriteNumber(double value, uint8_t decimals) {
+    if(std::isnan(value)) {
+        return Write("nan", 3);
+    }
+    if(std::isinf(value)) {
+        return value > 0 ? Write("inf", 3) : Write("-inf", 4);
+    }
+    char digits[NumberFormatMaxLength];
+    return Write(digits, FormatDouble(digits, value, decimals));
+}
+
+esp_err_t ResponseWriter::Finish() {
+    if(error != ESP_OK) {
+        return error;
+    }
+    if(!headSent) {
+        // Everything fits into the buffer: single send with Content-Length
+        char* data = buffer + HUMANESPHTTP_RESPONSE_HEAD_SIZE;
+        char* start = PrependHead(data, false, length);
+        Send(start, data + length - start);
+        length = 0;
+        return error;
+    }
+    Flush(true);
+    return error;
+}
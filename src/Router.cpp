@@ -0,0 +1,262 @@
+#include "Router.hpp"
+#include "JSONResponse.hpp"
+#include <cstring>
+#include <esp_log.h>
+
+static const char* TAG = "Router";
+
+const RouteParams::Capture* RouteParams::Find(const char* name) const {
+    size_t nameLength = strlen(name);
+    for(size_t i = 0; i < count; i++) {
+        if(captures[i].nameLength == nameLength && memcmp(captures[i].name, name, nameLength) == 0) {
+            return &captures[i];
+        }
+    }
+    return nullptr;
+}
+
+bool RouteParams::HasParam(const char* name) const {
+    return Find(name) != nullptr;
+}
+
+std::string RouteParams::GetParam(const char* name) const {
+    const Capture* capture = Find(name);
+    if(capture == nullptr) {
+        return std::string();
+    }
+    return std::string(capture->value, capture->length);
+}
+
+bool RouteParams::GetParam(const char* name, const char*& value, size_t& length) const {
+    const Capture* capture = Find(name);
+    if(capture == nullptr) {
+        return false;
+    }
+    value = capture->value;
+    length = capture->length;
+    return true;
+}
+
+#if _CPP17_AVAILABLE
+std::string_view RouteParams::GetParamView(const char* name) const {
+    const Capture* capture = Find(name);
+    if(capture == nullptr) {
+        return std::string_view();
+    }
+    return std::string_view(capture->value, capture->length);
+}
+#endif
+
+void RouteParams::Rebase(const char* oldURI, const char* newURI) {
+    for(size_t i = 0; i < count; i++) {
+        captures[i].value = newURI + (captures[i].value - oldURI);
+    }
+}
+
+Router::Router() {
+    NewNode(); // Root
+}
+
+uint16_t Router::NewNode() {
+    nodes.emplace_back();
+    return (uint16_t)(nodes.size() - 1);
+}
+
+uint16_t Router::InsertStatic(uint16_t node, const char* str, size_t length) {
+    while(length > 0) {
+        // Find the child sharing the first character (there is at most one)
+        int child = -1;
+        for(uint16_t candidate : nodes[node].children) {
+            if(nodes[candidate].prefix[0] == str[0]) {
+                child = candidate;
+                break;
+            }
+        }
+        if(child < 0) {
+            uint16_t newChild = NewNode();
+            nodes[newChild].prefix.assign(str, length);
+            nodes[node].children.push_back(newChild);
+            return newChild;
+        }
+        // Length of the common prefix
+        const std::string& prefix = nodes[child].prefix;
+        size_t common = 1;
+        while(common < prefix.size() && common < length && prefix[common] == str[common]) {
+            common++;
+        }
+        if(common < prefix.size()) {
+            // Split the edge: node -> intermediate (common part) -> child (rest)
+            uint16_t intermediate = NewNode();
+            nodes[intermediate].prefix = nodes[child].prefix.substr(0, common);
+            nodes[child].prefix.erase(0, common);
+            nodes[intermediate].children.push_back((uint16_t)child);
+            for(uint16_t& existing : nodes[node].children) {
+                if(existing == child) {
+                    existing = intermediate;
+                }
+            }
+            child = intermediate;
+        }
+        node = (uint16_t)child;
+        str += common;
+        length -= common;
+    }
+    return node;
+}
+
+int Router::InsertParam(uint16_t node, const char* name, size_t nameLength) {
+    int16_t child = nodes[node].paramChild;
+    if(child >= 0) {
+        if(nodes[child].paramNameLength != nameLength
+            || memcmp(nodes[child].paramName, name, nameLength) != 0) {
+            return -1;
+        }
+        return child;
+    }
+    uint16_t newChild = NewNode();
+    nodes[newChild].paramName = name;
+    nodes[newChild].paramNameLength = nameLength;
+    nodes[node].paramChild = (int16_t)newChild;
+    return newChild;
+}
+
+esp_err_t Router::AddRoute(httpd_method_t method, const char* pattern, RouteHandler handler, void* userCtx) {
+    if(pattern == nullptr || pattern[0] != '/' || handler == nullptr) {
+        ESP_LOGE(TAG, "Invalid route %s", pattern == nullptr ? "(null)" : pattern);
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint16_t node = 0;
+    size_t numParams = 0;
+    const char* pos = pattern;
+    while(*pos != '\0') {
+        if(*pos == '{') {
+            // Captures must span a whole path segment: /{name}/ or /{name}
+            const char* nameEnd = strchr(pos, '}');
+            if(pos[-1] != '/' || nameEnd == nullptr || nameEnd == pos + 1
+                || (nameEnd[1] != '/' && nameEnd[1] != '\0')
+                || ++numParams > HUMANESPHTTP_ROUTER_MAX_PARAMS) {
+                ESP_LOGE(TAG, "Invalid parameter in route %s", pattern);
+                return ESP_ERR_INVALID_ARG;
+            }
+            int child = InsertParam(node, pos + 1, nameEnd - pos - 1);
+            if(child < 0) {
+                ESP_LOGE(TAG, "Route %s conflicts with a parameter of a different name", pattern);
+                return ESP_ERR_INVALID_STATE;
+            }
+            node = (uint16_t)child;
+            pos = nameEnd + 1;
+        } else {
+            const char* staticEnd = strchr(pos, '{');
+            size_t length = staticEnd == nullptr ? strlen(pos) : (size_t)(staticEnd - pos);
+            node = InsertStatic(node, pos, length);
+            pos += length;
+        }
+    }
+    for(uint16_t existing : nodes[node].routes) {
+        if(routes[existing].method == method) {
+            ESP_LOGE(TAG, "Route %s is already registered", pattern);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    Route route;
+    route.method = method;
+    route.handler = handler;
+    route.userCtx = userCtx;
+    route.pattern = pattern;
+    routes.push_back(route);
+    nodes[node].routes.push_back((uint16_t)(routes.size() - 1));
+    return ESP_OK;
+}
+
+bool Router::MatchNode(uint16_t node, const char* path, const char* end, httpd_method_t method,
+                       RouteParams& params, const Route*& result, bool& methodMismatch) const {
+    const Node& current = nodes[node];
+    if(path == end) {
+        for(uint16_t index : current.routes) {
+            if(routes[index].method == method) {
+                result = &routes[index];
+                return true;
+            }
+        }
+        if(!current.routes.empty()) {
+            methodMismatch = true;
+        }
+        return false;
+    }
+    // Static children take precedence over captures
+    for(uint16_t index : current.children) {
+        const Node& child = nodes[index];
+        if(child.prefix[0] != *path) {
+            continue;
+        }
+        size_t length = child.prefix.size();
+        if((size_t)(end - path) >= length && memcmp(child.prefix.data(), path, length) == 0
+            && MatchNode(index, path + length, end, method, params, result, methodMismatch)) {
+            return true;
+        }
+        break; // First characters are distinct, so no other child can match
+    }
+    if(current.paramChild >= 0) {
+        const char* segmentEnd = (const char*)memchr(path, '/', end - path);
+        if(segmentEnd == nullptr) {
+            segmentEnd = end;
+        }
+        if(segmentEnd != path) {
+            const Node& child = nodes[current.paramChild];
+            size_t count = params.count;
+            RouteParams::Capture& capture = params.captures[count];
+            capture.name = child.paramName;
+            capture.nameLength = child.paramNameLength;
+            capture.value = path;
+            capture.length = segmentEnd - path;
+            params.count = count + 1;
+            if(MatchNode(current.paramChild, segmentEnd, end, method, params, result, methodMismatch)) {
+                return true;
+            }
+            params.count = count;
+        }
+    }
+    return false;
+}
+
+const Router::Route* Router::Match(httpd_method_t method, const char* path, size_t pathLength,
+                                   RouteParams& params, bool* methodMismatch) const {
+    const Route* result = nullptr;
+    bool mismatch = false;
+    params.count = 0;
+    MatchNode(0, path, path + pathLength, method, params, result, mismatch);
+    if(methodMismatch != nullptr) {
+        *methodMismatch = mismatch;
+    }
+    return result;
+}
+
+void Router::SetNotFoundHandler(esp_err_t (*handler)(httpd_req_t *request), void* userCtx) {
+    notFoundHandler = handler;
+    notFoundUserCtx = userCtx;
+}
+
+esp_err_t Router::Handle(httpd_req_t *request) const {
+    const char* path = request->uri;
+    size_t pathLength = strcspn(path, "?#");
+    RouteParams params;
+    bool methodMismatch = false;
+    const Route* route = Match((httpd_method_t)request->method, path, pathLength, params, &methodMismatch);
+    if(route == nullptr) {
+        if(methodMismatch) {
+            httpd_resp_set_status(request, "405 Method Not Allowed");
+            return SendStatusError(request, "Method not allowed");
+        }
+        if(notFoundHandler != nullptr) {
+            request->user_ctx = notFoundUserCtx;
+            return notFoundHandler(request);
+        }
+        return SendStatusNotFound(request);
+    }
+    request->user_ctx = route->userCtx;
+    return route->handler(request, params);
+}
+
+esp_err_t Router::Dispatch(httpd_req_t *request) {
+    return static_cast<const Router*>(request->user_ctx)->Handle(request);
+}
@@ -0,0 +1,245 @@
+#include "SSEHub.hpp"
+#include "JSONResponse.hpp"
+#include "RawSend.hpp"
+#include <esp_log.h>
+#include <cstring>
+#include <sys/socket.h>
+
+static const char* TAG = "SSE";
+
+static const char EventStreamHeaders[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    HUMANESPHTTP_STATIC_RESPONSE_HEADERS
+    "\r\n";
+
+SSEHub::SSEHub(size_t maxClients, size_t maxBacklog) : maxClients(maxClients), maxBacklog(maxBacklog) {
+    clients.reserve(maxClients);
+}
+
+SSEHub::~SSEHub() {
+    if(timer != nullptr) {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+    }
+}
+
+esp_err_t SSEHub::Handle(httpd_req_t *request) {
+    if(request->sess_ctx != nullptr) {
+        // Used by the application (or already subscribed)
+        ESP_LOGE(TAG, "Session context of socket already in use");
+        return SendStatusInternalServerError(request);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(clients.size() >= maxClients) {
+            return SendStatusServiceUnavailable(request);
+        }
+    }
+    esp_err_t err = SendRaw(request, EventStreamHeaders, sizeof(EventStreamHeaders) - 1);
+    if(err != ESP_OK) {
+        return err;
+    }
+
+    Subscription* subscription = new Subscription{this, httpd_req_to_sockfd(request)};
+    // ESP-IDF calls SessionClosed() when the connection is closed
+    request->sess_ctx = subscription;
+    request->free_ctx = SessionClosed;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(timer == nullptr) {
+        // Created here since esp_timer may not be initialized during static construction
+        esp_timer_create_args_t args = {};
+        args.callback = RetryTimer;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "sse_retry";
+        if(esp_timer_create(&args, &timer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create timer");
+        }
+    }
+    server = request->handle;
+    Client client;
+    client.subscription = subscription;
+    client.sockfd = subscription->sockfd;
+    clients.push_back(std::move(client));
+    return ESP_OK;
+}
+
+esp_err_t SSEHub::Publish(const char* event, const char* data, size_t length) {
+    std::string message;
+    message.reserve(length + 16 + (event == nullptr ? 0 : strlen(event) + 8));
+    if(event != nullptr) {
+        message += "event: ";
+        message += event;
+        message += '\n';
+    }
+    // Every line of the data needs its own "data:" field
+    const char* end = data + length;
+    const char* line = data;
+    while(true) {
+        const char* newline = (const char*)memchr(line, '\n', end - line);
+        const char* lineEnd = newline == nullptr ? end : newline;
+        message += "data: ";
+        message.append(line, lineEnd - line);
+        message += '\n';
+        if(newline == nullptr) {
+            break;
+        }
+        line = newline + 1;
+    }
+    message += '\n';
+    return Broadcast(std::make_shared<const std::string>(std::move(message)));
+}
+
+esp_err_t SSEHub::Publish(const char* event, const char* data) {
+    return Publish(event, data, strlen(data));
+}
+
+esp_err_t SSEHub::Ping() {
+    static const std::shared_ptr<const std::string> PingMessage = std::make_shared<const std::string>(":\n\n");
+    return Broadcast(PingMessage);
+}
+
+esp_err_t SSEHub::Broadcast(std::shared_ptr<const std::string> message) {
+    httpd_handle_t handle;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(clients.empty()) {
+            return ESP_OK; // Nobody listening
+        }
+        handle = server;
+    }
+    Delivery* delivery = new Delivery{this, std::move(message)};
+    esp_err_t err = httpd_queue_work(handle, DeliverWork, delivery);
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to queue event: %s", esp_err_to_name(err));
+        delete delivery;
+    }
+    return err;
+}
+
+void SSEHub::DeliverWork(void* arg) {
+    Delivery* delivery = static_cast<Delivery*>(arg);
+    delivery->hub->Deliver(delivery->message);
+    delete delivery;
+}
+
+void SSEHub::Deliver(const std::shared_ptr<const std::string>& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(size_t i = clients.size(); i > 0; i--) {
+        Client& client = clients[i - 1];
+        // The socket may have drained since the last attempt
+        if(!Flush(client)) {
+            Disconnect(i - 1);
+            continue;
+        }
+        if(client.backlog.size() >= maxBacklog) {
+            ESP_LOGW(TAG, "Disconnecting slow client %d", client.sockfd);
+            dropped++;
+            Disconnect(i - 1);
+            continue;
+        }
+        client.backlog.push_back(message);
+        if(!Flush(client)) {
+            Disconnect(i - 1);
+        }
+    }
+    ScheduleRetry();
+}
+
+void SSEHub::FlushAll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    retryScheduled = false;
+    for(size_t i = clients.size(); i > 0; i--) {
+        if(!Flush(clients[i - 1])) {
+            Disconnect(i - 1);
+        }
+    }
+    ScheduleRetry();
+}
+
+void SSEHub::ScheduleRetry() {
+    if(retryScheduled || timer == nullptr) {
+        return;
+    }
+    bool pending = false;
+    for(const Client& client : clients) {
+        pending = pending || !client.backlog.empty();
+    }
+    if(!pending) {
+        return;
+    }
+    esp_err_t err = esp_timer_start_once(timer, (uint64_t)HUMANESPHTTP_SSE_RETRY_MS * 1000);
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to schedule sending: %s", esp_err_to_name(err));
+        return;
+    }
+    retryScheduled = true;
+}
+
+void SSEHub::RetryTimer(void* arg) {
+    SSEHub* hub = static_cast<SSEHub*>(arg);
+    // Sockets may only be used on the httpd task
+    if(httpd_queue_work(hub->server, RetryWork, hub) != ESP_OK) {
+        std::lock_guard<std::mutex> lock(hub->mutex);
+        hub->retryScheduled = false;
+    }
+}
+
+void SSEHub::RetryWork(void* arg) {
+    static_cast<SSEHub*>(arg)->FlushAll();
+}
+
+bool SSEHub::Flush(Client& client) {
+    while(!client.backlog.empty()) {
+        const std::string& message = *client.backlog.front();
+        // Never block the httpd task on a slow client
+        int ret = httpd_socket_send(server, client.sockfd, message.data() + client.offset,
+                                    message.size() - client.offset, MSG_DONTWAIT);
+        if(ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            return true; // Socket buffer full, retried by ScheduleRetry()
+        }
+        if(ret < 0) {
+            return false;
+        }
+        client.offset += ret;
+        if(client.offset == message.size()) {
+            client.backlog.erase(client.backlog.begin());
+            client.offset = 0;
+        }
+    }
+    return true;
+}
+
+void SSEHub::Disconnect(size_t index) {
+    // The subscription is freed by SessionClosed() once ESP-IDF has closed the session
+    httpd_sess_trigger_close(server, clients[index].sockfd);
+    clients.erase(clients.begin() + index);
+}
+
+void SSEHub::SessionClosed(void* context) {
+    Subscription* subscription = static_cast<Subscription*>(context);
+    SSEHub* hub = subscription->hub;
+    {
+        std::lock_guard<std::mutex> lock(hub->mutex);
+        for(size_t i = 0; i < hub->clients.size(); i++) {
+            if(hub->clients[i].subscription == subscription) {
+                hub->clients.erase(hub->clients.begin() + i);
+                break;
+            }
+        }
+    }
+    delete subscription;
+}
+
+size_t SSEHub::GetClientCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return clients.size();
+}
+
+uint32_t SSEHub::GetDroppedCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped;
+}
@@ -0,0 +1,80 @@
+#include "SendObserver.hpp"
+#include <cerrno>
+#include <sys/socket.h>
+
+// Observers attached on the current (server or worker) task
+static thread_local SendObserver* observers = nullptr;
+// Sink attached on the current task
+static thread_local SendSink* currentSink = nullptr;
+static SendHook sendHook = nullptr;
+
+void SetSendHook(SendHook hook) {
+    sendHook = hook;
+}
+
+// The ESP-IDF default send function is not public, so it can't be restored directly
+int ObservedSend(httpd_handle_t hd, int sockfd, const char *buf, size_t length, int flags) {
+    if(buf == nullptr) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    if(currentSink != nullptr && currentSink->sockfd == sockfd) {
+        // Whatever the sink sends goes to the socket, seen by the observers outside of it
+        SendSink* sink = currentSink;
+        SendObserver* innerObservers = observers;
+        currentSink = nullptr;
+        observers = sink->outerObservers;
+        esp_err_t err = sink->OnSend(buf, length);
+        currentSink = sink;
+        observers = innerObservers;
+        if(err != ESP_OK) {
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+        for(SendObserver* observer = observers; observer != sink->outerObservers; observer = observer->next) {
+            if(observer->sockfd == sockfd && length > 0) {
+                observer->OnSend(buf, length);
+            }
+        }
+        return (int)length;
+    }
+    int ret = send(sockfd, buf, length, flags);
+    if(ret < 0) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    if(sendHook != nullptr && ret > 0) {
+        sendHook(hd, sockfd, ret);
+    }
+    for(SendObserver* observer = observers; observer != nullptr; observer = observer->next) {
+        if(observer->sockfd == sockfd && ret > 0) {
+            observer->OnSend(buf, ret);
+        }
+    }
+    return ret;
+}
+
+ScopedSendObserver::ScopedSendObserver(httpd_req_t *request, SendObserver* observer) : observer(observer) {
+    observer->sockfd = httpd_req_to_sockfd(request);
+    httpd_sess_set_send_override(request->handle, observer->sockfd, ObservedSend);
+    observer->next = observers;
+    observers = observer;
+}
+
+ScopedSendObserver::~ScopedSendObserver() {
+    observers = observer->next;
+    observer->next = nullptr;
+}
+
+ScopedSendSink::ScopedSendSink(httpd_req_t *request, SendSink* sink) : sink(sink) {
+    sink->sockfd = httpd_req_to_sockfd(request);
+    httpd_sess_set_send_override(request->handle, sink->sockfd, ObservedSend);
+    sink->outerObservers = observers;
+    sink->previous = currentSink;
+    currentSink = sink;
+}
+
+ScopedSendSink::~ScopedSendSink() {
+    currentSink = sink->previous;
+    sink->previous = nullptr;
+}
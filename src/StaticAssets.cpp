@@ -0,0 +1,96 @@
+#include "StaticAssets.hpp"
+#include "JSONResponse.hpp"
+#include "CompressedResponse.hpp"
+#include <esp_log.h>
+#include <cstring>
+
+StaticAssetServer::StaticAssetServer(const StaticAsset* assets, size_t numAssets,
+                                     const char* cacheControl, const char* fallbackPath)
+    : assets(assets), numAssets(numAssets), cacheControl(cacheControl), fallbackPath(fallbackPath) {
+}
+
+const StaticAsset* StaticAssetServer::Find(const char* path, size_t length) const {
+    size_t low = 0;
+    size_t high = numAssets;
+    while(low < high) {
+        size_t mid = low + (high - low) / 2;
+        const char* assetPath = assets[mid].path;
+        int cmp = strncmp(assetPath, path, length);
+        if(cmp == 0 && assetPath[length] != '\0') {
+            cmp = 1; // assetPath is longer
+        }
+        if(cmp == 0) {
+            return &assets[mid];
+        }
+        if(cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return nullptr;
+}
+
+bool StaticAssetServer::IsNotModified(httpd_req_t *request, const char* etag) {
+    char ifNoneMatch[128];
+    size_t length = httpd_req_get_hdr_value_len(request, "If-None-Match");
+    if(length == 0 || length >= sizeof(ifNoneMatch)
+        || httpd_req_get_hdr_value_str(request, "If-None-Match", ifNoneMatch, sizeof(ifNoneMatch)) != ESP_OK) {
+        return false;
+    }
+    // The header may contain a list of (weak or strong) ETags or "*".
+    // If-None-Match uses weak comparison, so W/"x" matches "x" as well.
+    return strcmp(ifNoneMatch, "*") == 0 || strstr(ifNoneMatch, etag) != nullptr;
+}
+
+esp_err_t StaticAssetServer::Handle(httpd_req_t *request) const {
+    if(request->method != HTTP_GET && request->method != HTTP_HEAD) {
+        return SendStatusNotFound(request);
+    }
+    const char* path = request->uri;
+    size_t pathLength = strcspn(path, "?#");
+    const StaticAsset* asset = nullptr;
+    if(pathLength > 0 && path[pathLength - 1] == '/') {
+        // Directory index
+        char indexPath[128];
+        if(pathLength + sizeof("index.html") > sizeof(indexPath)) {
+            return SendStatusNotFound(request);
+        }
+        memcpy(indexPath, path, pathLength);
+        memcpy(indexPath + pathLength, "index.html", sizeof("index.html"));
+        asset = Find(indexPath, pathLength + sizeof("index.html") - 1);
+    } else {
+        asset = Find(path, pathLength);
+    }
+    if(asset == nullptr && fallbackPath != nullptr) {
+        asset = Find(fallbackPath, strlen(fallbackPath));
+    }
+    if(asset == nullptr) {
+        return SendStatusNotFound(request);
+    }
+
+    if(asset->gzip) {
+        // Only stored compressed, so there is no identity representation to fall back to
+        httpd_resp_set_hdr(request, "Vary", "Accept-Encoding");
+        if(!AcceptsGzip(request)) {
+            httpd_resp_set_status(request, "406 Not Acceptable");
+            return SendStatusError(request, "gzip encoding required");
+        }
+    }
+    httpd_resp_set_hdr(request, "ETag", asset->etag);
+    httpd_resp_set_hdr(request, "Cache-Control", cacheControl);
+    if(IsNotModified(request, asset->etag)) {
+        httpd_resp_set_status(request, "304 Not Modified");
+        return httpd_resp_send(request, nullptr, 0);
+    }
+    httpd_resp_set_type(request, asset->contentType);
+    if(asset->gzip) {
+        httpd_resp_set_hdr(request, "Content-Encoding", "gzip");
+    }
+    // Sent straight from flash in a single send
+    return httpd_resp_send(request, (const char*)asset->data, asset->length);
+}
+
+esp_err_t StaticAssetServer::Dispatch(httpd_req_t *request) {
+    return static_cast<const StaticAssetServer*>(request->user_ctx)->Handle(request);
+}
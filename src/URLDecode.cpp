@@ -0,0 +1,126 @@
+#include "URLDecode.hpp"
+#include "RequestArena.hpp"
+#include <cstdint>
+#include <cstring>
+
+// Word-at-a-time byte search, see "Determine if a word has a zero byte"
+// from Sean Eron Anderson's Bit Twiddling Hacks.
+typedef uintptr_t URLWord;
+
+static constexpr URLWord URLWordOnes = ~(URLWord)0 / 0xFF; // 0x0101...
+static constexpr URLWord URLWordHighs = URLWordOnes * 0x80; // 0x8080...
+
+static inline URLWord HasZeroByte(URLWord v) {
+    return (v - URLWordOnes) & ~v & URLWordHighs;
+}
+
+/**
+ * Find the first occurrence of either a or b in the given range
+ */
+static const char* FindEither(const char* begin, const char* end, char a, char b) {
+    const char* p = begin;
+    // Process unaligned head byte by byte (unaligned word loads trap or are slow on Xtensa)
+    while(p < end && ((uintptr_t)p % sizeof(URLWord)) != 0) {
+        if(*p == a || *p == b) {
+            return p;
+        }
+        p++;
+    }
+    // Process aligned words
+    const URLWord wordA = URLWordOnes * (uint8_t)a;
+    const URLWord wordB = URLWordOnes * (uint8_t)b;
+    while((size_t)(end - p) >= sizeof(URLWord)) {
+        URLWord word;
+        memcpy(&word, __builtin_assume_aligned(p, sizeof(URLWord)), sizeof(URLWord));
+        if(HasZeroByte(word ^ wordA) | HasZeroByte(word ^ wordB)) {
+            break; // Exact position is found by the tail loop
+        }
+        p += sizeof(URLWord);
+    }
+    // Tail (or the word containing the match)
+    while(p < end) {
+        if(*p == a || *p == b) {
+            return p;
+        }
+        p++;
+    }
+    return end;
+}
+
+const char* URLFindEncoded(const char* begin, const char* end) {
+    return FindEither(begin, end, '%', '+');
+}
+
+const char* URLFindDelimiter(const char* begin, const char* end, bool inKey) {
+    if(inKey) {
+        return FindEither(begin, end, '&', '=');
+    }
+    const char* ampersand = (const char*)memchr(begin, '&', end - begin);
+    return ampersand == nullptr ? end : ampersand;
+}
+
+/**
+ * Parse a single hex digit.
+ * @return The value (0-15) or -1 if c is not a hex digit
+ */
+static inline int HexDigitValue(char c) {
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20; // To lowercase
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+size_t URLDecode(const char* src, size_t length, char* dst) {
+    const char* end = src + length;
+    char* out = dst;
+    size_t cleanBytes = 0; // Length of the current run without special characters
+    while(src < end) {
+        if(*src == '+') {
+            *out++ = ' ';
+            src++;
+            cleanBytes = 0;
+        } else if(*src == '%') {
+            int high = (end - src) >= 3 ? HexDigitValue(src[1]) : -1;
+            int low = high >= 0 ? HexDigitValue(src[2]) : -1;
+            if(low >= 0) {
+                *out++ = (char)((high << 4) | low);
+                src += 3;
+            } else { // Invalid escape, copy verbatim
+                *out++ = *src++;
+            }
+            cleanBytes = 0;
+        } else if(++cleanBytes < sizeof(URLWord)) {
+            // Short runs (e.g. between the escapes of encoded JSON) are copied byte by byte,
+            // as searching and moving them costs more than the copy itself
+            *out++ = *src++;
+        } else {
+            // Copy the rest of a long clean run up to the next special character in one go
+            const char* special = URLFindEncoded(src, end);
+            size_t runLength = special - src;
+            if(out != src) {
+                memmove(out, src, runLength);
+            }
+            out += runLength;
+            src = special;
+            cleanBytes = 0;
+        }
+    }
+    return out - dst;
+}
+
+char* URLDecodeAllocate(const char* src, size_t length, size_t* decodedLength) {
+    char* dst = (char*)RequestAllocate(length + 1);
+    if(dst == nullptr) {
+        return nullptr;
+    }
+    size_t decoded = URLDecode(src, length, dst);
+    dst[decoded] = '\0';
+    if(decodedLength != nullptr) {
+        *decodedLength = decoded;
+    }
+    return dst;
+}
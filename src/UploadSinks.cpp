@@ -0,0 +1,107 @@
+#include "UploadSinks.hpp"
+#include <esp_log.h>
+#include <cstring>
+
+static const char* TAG = "Upload";
+
+OTAUploadSink::OTAUploadSink(bool setBootPartition) : setBootPartition(setBootPartition) {
+}
+
+esp_err_t OTAUploadSink::Begin(const MultipartPart& /*part*/) {
+    partition = esp_ota_get_next_update_partition(nullptr);
+    if(partition == nullptr) {
+        ESP_LOGE(TAG, "No OTA partition available");
+        return ESP_ERR_NOT_FOUND;
+    }
+#ifdef OTA_WITH_SEQUENTIAL_WRITES
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &handle);
+#else
+    esp_err_t err = esp_ota_begin(partition, OTA_SIZE_UNKNOWN, &handle);
+#endif
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        partition = nullptr;
+    }
+    return err;
+}
+
+esp_err_t OTAUploadSink::Write(const char* data, size_t length) {
+    esp_err_t err = esp_ota_write(handle, data, length);
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t OTAUploadSink::End() {
+    esp_err_t err = esp_ota_end(handle);
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    if(setBootPartition) {
+        err = esp_ota_set_boot_partition(partition);
+        if(err != ESP_OK) {
+            ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        }
+    }
+    return err;
+}
+
+void OTAUploadSink::Abort() {
+    esp_ota_abort(handle);
+}
+
+FileUploadSink::FileUploadSink(const char* path) : path(path) {
+}
+
+FileUploadSink::~FileUploadSink() {
+    if(file != nullptr) {
+        fclose(file);
+    }
+}
+
+esp_err_t FileUploadSink::Begin(const MultipartPart& /*part*/) {
+    file = fopen(path, "wb");
+    if(file == nullptr) {
+        ESP_LOGE(TAG, "Failed to open %s for writing", path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t FileUploadSink::Write(const char* data, size_t length) {
+    if(fwrite(data, 1, length, file) != length) {
+        ESP_LOGE(TAG, "Failed to write to %s", path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t FileUploadSink::End() {
+    int ret = fclose(file);
+    file = nullptr;
+    if(ret != 0) {
+        ESP_LOGE(TAG, "Failed to close %s", path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void FileUploadSink::Abort() {
+    if(file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+    remove(path);
+}
+
+esp_err_t MemoryUploadSink::Write(const char* data, size_t dataLength) {
+    if(dataLength > size - length) {
+        ESP_LOGE(TAG, "Upload larger than %u bytes", (unsigned)size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buffer + length, data, dataLength);
+    length += dataLength;
+    return ESP_OK;
+}
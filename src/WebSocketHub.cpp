@@ -0,0 +1,297 @@
+#include "WebSocketHub.hpp"
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+#include <esp_log.h>
+#include <cstring>
+#include <sys/socket.h>
+
+static const char* TAG = "WebSocket";
+
+WebSocketHub::WebSocketHub(size_t maxClients, size_t maxQueue, uint32_t coalesceUs)
+    : maxClients(maxClients), maxQueue(maxQueue), coalesceUs(coalesceUs) {
+    clients.reserve(maxClients);
+}
+
+WebSocketHub::~WebSocketHub() {
+    if(timer != nullptr) {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+    }
+}
+
+void WebSocketHub::SetMessageHandler(WebSocketMessageHandler handler, void* context) {
+    std::lock_guard<std::mutex> lock(mutex);
+    messageHandler = handler;
+    messageContext = context;
+}
+
+WebSocketHub::Client* WebSocketHub::FindClient(int sockfd) {
+    for(Client& client : clients) {
+        if(client.sockfd == sockfd) {
+            return &client;
+        }
+    }
+    return nullptr;
+}
+
+int WebSocketHub::FindTopic(const char* topic) {
+    for(size_t i = 0; i < topics.size(); i++) {
+        if(topics[i] == topic) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t WebSocketHub::Subscribe(int client, const char* topic) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Client* subscriber = FindClient(client);
+    if(subscriber == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    int index = FindTopic(topic);
+    if(index < 0) {
+        if(topics.size() >= MaxTopics) {
+            ESP_LOGE(TAG, "Too many topics, can't add %s", topic);
+            return ESP_ERR_NO_MEM;
+        }
+        index = (int)topics.size();
+        topics.emplace_back(topic);
+    }
+    subscriber->topics |= 1UL << index;
+    return ESP_OK;
+}
+
+esp_err_t WebSocketHub::Unsubscribe(int client, const char* topic) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Client* subscriber = FindClient(client);
+    if(subscriber == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    int index = FindTopic(topic);
+    if(index >= 0) {
+        subscriber->topics &= ~(1UL << index);
+    }
+    return ESP_OK;
+}
+
+void WebSocketHub::BuildFrame(std::string& frame, httpd_ws_type_t type, const char* data, size_t length) {
+    // Server frames are not masked
+    frame.reserve(length + 10);
+    frame += (char)(0x80 | type); // FIN
+    if(length < 126) {
+        frame += (char)length;
+    } else if(length <= 0xFFFF) {
+        frame += (char)126;
+        frame += (char)(length >> 8);
+        frame += (char)length;
+    } else {
+        frame += (char)127;
+        for(int shift = 56; shift >= 0; shift -= 8) {
+            frame += (char)((uint64_t)length >> shift);
+        }
+    }
+    frame.append(data, length);
+}
+
+void WebSocketHub::Enqueue(Client& client, const std::string& frame) {
+    if(client.outbound.size() + frame.size() > maxQueue) {
+        stats.dropped++;
+        return;
+    }
+    client.outbound += frame;
+    stats.queued++;
+    ScheduleFlush(coalesceUs);
+}
+
+esp_err_t WebSocketHub::Publish(const char* topic, const char* data, size_t length, httpd_ws_type_t type) {
+    // Framed once for all clients
+    std::string frame;
+    BuildFrame(frame, type, data, length);
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.published++;
+    int index = FindTopic(topic);
+    if(index < 0) {
+        return ESP_OK; // Nobody ever subscribed
+    }
+    for(Client& client : clients) {
+        if(client.topics & (1UL << index)) {
+            Enqueue(client, frame);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t WebSocketHub::Send(int client, const char* data, size_t length, httpd_ws_type_t type) {
+    std::string frame;
+    BuildFrame(frame, type, data, length);
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.published++;
+    Client* receiver = FindClient(client);
+    if(receiver == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    Enqueue(*receiver, frame);
+    return ESP_OK;
+}
+
+void WebSocketHub::ScheduleFlush(uint64_t delayUs) {
+    if(flushScheduled) {
+        return;
+    }
+    esp_err_t err;
+    if(delayUs == 0) {
+        err = httpd_queue_work(server, FlushWork, this);
+    } else {
+        err = esp_timer_start_once(timer, delayUs);
+    }
+    if(err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to schedule sending: %s", esp_err_to_name(err));
+        return;
+    }
+    flushScheduled = true;
+}
+
+void WebSocketHub::FlushTimer(void* arg) {
+    WebSocketHub* hub = static_cast<WebSocketHub*>(arg);
+    // Sockets may only be used on the httpd task
+    if(httpd_queue_work(hub->server, FlushWork, hub) != ESP_OK) {
+        std::lock_guard<std::mutex> lock(hub->mutex);
+        hub->flushScheduled = false;
+    }
+}
+
+void WebSocketHub::FlushWork(void* arg) {
+    static_cast<WebSocketHub*>(arg)->Flush();
+}
+
+void WebSocketHub::Flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    flushScheduled = false;
+    bool pending = false;
+    for(size_t i = clients.size(); i > 0; i--) {
+        Client& client = clients[i - 1];
+        if(client.outbound.empty()) {
+            continue;
+        }
+        // All frames queued since the last flush in a single send
+        int ret = httpd_socket_send(server, client.sockfd, client.outbound.data(),
+                                    client.outbound.size(), MSG_DONTWAIT);
+        stats.sends++;
+        if(ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            pending = true; // Socket buffer full
+            continue;
+        }
+        if(ret < 0) {
+            // The session is freed by SessionClosed()
+            httpd_sess_trigger_close(server, client.sockfd);
+            clients.erase(clients.begin() + (i - 1));
+            continue;
+        }
+        client.outbound.erase(0, ret);
+        pending = pending || !client.outbound.empty();
+    }
+    if(pending) {
+        // Retry later, without busy-looping on the httpd task
+        ScheduleFlush(coalesceUs > 1000 ? coalesceUs : 1000);
+    }
+}
+
+esp_err_t WebSocketHub::Handle(httpd_req_t *request) {
+    int sockfd = httpd_req_to_sockfd(request);
+    if(request->method == HTTP_GET) {
+        // Handshake completed by ESP-IDF: new client
+        if(request->sess_ctx != nullptr) {
+            ESP_LOGE(TAG, "Session context of socket already in use");
+            return ESP_FAIL;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if(clients.size() >= maxClients) {
+            ESP_LOGW(TAG, "Too many clients, rejecting %d", sockfd);
+            return ESP_FAIL; // Closes the connection
+        }
+        if(timer == nullptr) {
+            // Created here since esp_timer may not be initialized during static construction
+            esp_timer_create_args_t args = {};
+            args.callback = FlushTimer;
+            args.arg = this;
+            args.dispatch_method = ESP_TIMER_TASK;
+            args.name = "ws_flush";
+            if(esp_timer_create(&args, &timer) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to create timer");
+                return ESP_FAIL;
+            }
+        }
+        server = request->handle;
+        Session* session = new Session{this, sockfd};
+        // ESP-IDF calls SessionClosed() when the connection is closed
+        request->sess_ctx = session;
+        request->free_ctx = SessionClosed;
+        Client client;
+        client.session = session;
+        client.sockfd = sockfd;
+        clients.push_back(std::move(client));
+        return ESP_OK;
+    }
+
+    httpd_ws_frame_t frame = {};
+    esp_err_t err = httpd_ws_recv_frame(request, &frame, 0); // Only get the length
+    if(err != ESP_OK) {
+        return err;
+    }
+    if(frame.len > sizeof(receiveBuffer)) {
+        ESP_LOGW(TAG, "Message of %u bytes from %d is too large", (unsigned)frame.len, sockfd);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if(frame.len > 0) {
+        frame.payload = receiveBuffer;
+        err = httpd_ws_recv_frame(request, &frame, sizeof(receiveBuffer));
+        if(err != ESP_OK) {
+            return err;
+        }
+    }
+    WebSocketMessageHandler handler;
+    void* context;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.received++;
+        handler = messageHandler;
+        context = messageContext;
+    }
+    if(handler == nullptr) {
+        return ESP_OK;
+    }
+    return handler(*this, sockfd, frame.type, (const char*)receiveBuffer, frame.len, context);
+}
+
+esp_err_t WebSocketHub::Dispatch(httpd_req_t *request) {
+    return static_cast<WebSocketHub*>(request->user_ctx)->Handle(request);
+}
+
+void WebSocketHub::SessionClosed(void* context) {
+    Session* session = static_cast<Session*>(context);
+    WebSocketHub* hub = session->hub;
+    {
+        std::lock_guard<std::mutex> lock(hub->mutex);
+        for(size_t i = 0; i < hub->clients.size(); i++) {
+            if(hub->clients[i].session == session) {
+                hub->clients.erase(hub->clients.begin() + i);
+                break;
+            }
+        }
+    }
+    delete session;
+}
+
+size_t WebSocketHub::GetClientCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return clients.size();
+}
+
+WebSocketStats WebSocketHub::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""
+Embed a directory of static files (e.g. a web UI) into the firmware
+for serving with HumanESPHTTP's StaticAssetServer.
+
+Every file is gzip-compressed at build time (unless compression doesn't help)
+and stored together with its content type, length and a strong ETag
+derived from the hash of the stored (possibly compressed) data. The table is sorted by path so it can be
+searched using binary search.
+
+Usage:
+    embed_assets.py <directory> <output basename> [--name WebUIAssets] [--prefix /]
+
+generates <output basename>.cpp and <output basename>.hpp declaring
+    extern const StaticAsset WebUIAssets[];
+    extern const size_t WebUIAssetsCount;
+
+ESP-IDF CMake example (in your main component's CMakeLists.txt):
+
+    add_custom_command(
+        OUTPUT ${CMAKE_CURRENT_BINARY_DIR}/WebUIAssets.cpp ${CMAKE_CURRENT_BINARY_DIR}/WebUIAssets.hpp
+        COMMAND python3 ${HUMANESPHTTP_DIR}/tools/embed_assets.py ${CMAKE_CURRENT_SOURCE_DIR}/webui
+                ${CMAKE_CURRENT_BINARY_DIR}/WebUIAssets --name WebUIAssets
+        DEPENDS ${CMAKE_CURRENT_SOURCE_DIR}/webui
+    )
+
+This script is released under CC0 1.0 Universal
+"""
+import argparse
+import gzip
+import hashlib
+import mimetypes
+import os
+import sys
+import urllib.parse
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".htm": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".mjs": "application/javascript",
+    ".json": "application/json",
+    ".map": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".jpeg": "image/jpeg",
+    ".gif": "image/gif",
+    ".ico": "image/x-icon",
+    ".webp": "image/webp",
+    ".woff": "font/woff",
+    ".woff2": "font/woff2",
+    ".txt": "text/plain",
+    ".xml": "application/xml",
+    ".wasm": "application/wasm",
+    ".webmanifest": "application/manifest+json",
+}
+
+# Already compressed formats, which are not worth gzipping
+NO_COMPRESSION = {".png", ".jpg", ".jpeg", ".gif", ".webp", ".woff", ".woff2", ".gz"}
+
+
+def content_type(filename):
+    extension = os.path.splitext(filename)[1].lower()
+    if extension in CONTENT_TYPES:
+        return CONTENT_TYPES[extension]
+    guessed, _ = mimetypes.guess_type(filename)
+    return guessed or "application/octet-stream"
+
+
+def c_string(value):
+    return '"' + value.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def collect_assets(directory, prefix):
+    assets = []
+    for root, dirs, files in os.walk(directory):
+        dirs.sort()
+        for filename in sorted(files):
+            if filename.startswith("."):
+                continue
+            filepath = os.path.join(root, filename)
+            relative = os.path.relpath(filepath, directory).replace(os.sep, "/")
+            # Stored percent-encoded, as in the request URI
+            path = urllib.parse.quote(prefix.rstrip("/") + "/" + relative, safe="/-_.~!$&'()*+,;=:@")
+            with open(filepath, "rb") as infile:
+                content = infile.read()
+            extension = os.path.splitext(filename)[1].lower()
+            data, compressed = content, False
+            if extension not in NO_COMPRESSION:
+                # mtime=0 makes the output reproducible
+                gzipped = gzip.compress(content, compresslevel=9, mtime=0)
+                if len(gzipped) < len(content):
+                    data, compressed = gzipped, True
+            # Strong ETags identify the representation, i.e. the bytes actually sent
+            etag = '"' + hashlib.sha256(data).hexdigest()[:16] + '"'
+            assets.append({
+                "path": path,
+                "content_type": content_type(filename),
+                "data": data,
+                "gzip": compressed,
+                "etag": etag,
+                "original_size": len(content),
+            })
+    # Sorted by the UTF-8 bytes, like strncmp() on the device
+    assets.sort(key=lambda asset: asset["path"].encode("utf-8"))
+    return assets
+
+
+def write_output(assets, basename, name):
+    header_name = os.path.basename(basename) + ".hpp"
+    output_directory = os.path.dirname(basename)
+    if output_directory:
+        os.makedirs(output_directory, exist_ok=True)
+    with open(basename + ".hpp", "w") as header:
+        header.write("// Generated by embed_assets.py, do not edit\n")
+        header.write("#pragma once\n")
+        header.write("#include <StaticAssets.hpp>\n\n")
+        header.write(f"extern const StaticAsset {name}[];\n")
+        header.write(f"extern const size_t {name}Count;\n")
+
+    with open(basename + ".cpp", "w") as source:
+        source.write("// Generated by embed_assets.py, do not edit\n")
+        source.write(f'#include "{header_name}"\n\n')
+        for index, asset in enumerate(assets):
+            source.write(f"// {asset['path']} ({asset['original_size']} bytes"
+                         f"{', gzip ' + str(len(asset['data'])) + ' bytes' if asset['gzip'] else ''})\n")
+            source.write(f"static const uint8_t {name}Data{index}[] = {{\n")
+            data = asset["data"]
+            for offset in range(0, len(data), 16):
+                source.write("    " + ", ".join(f"0x{byte:02x}" for byte in data[offset:offset + 16]) + ",\n")
+            source.write("};\n\n")
+        source.write(f"const StaticAsset {name}[] = {{\n")
+        for index, asset in enumerate(assets):
+            source.write(f"    {{{c_string(asset['path'])}, {c_string(asset['content_type'])}, "
+                         f"{name}Data{index}, {len(asset['data'])}, {c_string(asset['etag'])}, "
+                         f"{'true' if asset['gzip'] else 'false'}}},\n")
+        source.write("};\n\n")
+        source.write(f"const size_t {name}Count = {len(assets)};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Embed static files for HumanESPHTTP's StaticAssetServer")
+    parser.add_argument("directory", help="Directory containing the files to embed")
+    parser.add_argument("output", help="Output basename (.cpp and .hpp are appended)")
+    parser.add_argument("--name", default="StaticAssets", help="Name of the generated asset table")
+    parser.add_argument("--prefix", default="/", help="URL path prefix of the files")
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.directory):
+        print(f"Not a directory: {args.directory}", file=sys.stderr)
+        return 1
+    assets = collect_assets(args.directory, args.prefix)
+    if not assets:
+        print(f"No files in {args.directory}", file=sys.stderr)
+        return 1
+    write_output(assets, args.output, args.name)
+    total = sum(len(asset["data"]) for asset in assets)
+    original = sum(asset["original_size"] for asset in assets)
+    print(f"Embedded {len(assets)} files, {original} bytes ({total} bytes compressed)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())